@@ -0,0 +1,136 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_BENCH_H
+#define SX_BENCH_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "sx/emad.h"
+#include "sx/emu/asic.h"
+
+namespace sx {
+namespace bench {
+
+static inline uint64_t cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/* Cycle counter frequency, measured once against the monotonic clock. */
+static inline double cycles_per_ns()
+{
+    static double hz = 0;
+
+    if (hz == 0) {
+        uint64_t t0 = emu::asic::now_ns(), c0 = cycles();
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        hz = static_cast<double>(cycles() - c0) / (emu::asic::now_ns() - t0);
+    }
+    return hz;
+}
+
+/* Busy-wait @ns, as work done per packet */
+static inline void spin_ns(uint64_t ns)
+{
+    uint64_t end = emu::asic::now_ns() + ns;
+
+    while (emu::asic::now_ns() < end)
+        cpu_relax();
+}
+
+/* Value of "--@name=N" on the command line, or @def. */
+static inline uint64_t arg(int argc, char **argv, const char *name, uint64_t def)
+{
+    size_t len = strlen(name);
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+
+        if (!strncmp(a, "--", 2) && !strncmp(a + 2, name, len) && a[2 + len] == '=')
+            return strtoull(a + 3 + len, nullptr, 0);
+    }
+    return def;
+}
+
+/* Minimal Ethernet frame of @len bytes with @ethertype, for trap injection. */
+static inline void fill_frame(uint8_t *buf, uint32_t len, uint16_t ethertype, uint32_t seed)
+{
+    memset(buf, 0, len);
+    buf[0] = 0x01; buf[1] = 0x80; buf[2] = 0xc2;
+    buf[6] = 0x02; buf[7] = 0x00;
+    memcpy(buf + 8, &seed, sizeof(seed));
+    buf[12] = ethertype >> 8;
+    buf[13] = ethertype & 0xff;
+    for (uint32_t i = 14; i < len; i++)
+        buf[i] = static_cast<uint8_t>(seed + i);
+}
+
+/* Locally administered MAC number @i */
+static inline void make_mac(uint8_t *mac, uint32_t i)
+{
+    mac[0] = 0x02; mac[1] = 0x00;
+    mac[2] = i >> 24; mac[3] = i >> 16; mac[4] = i >> 8; mac[5] = i;
+}
+
+/* The low @bytes bytes of @v to @p, big endian: addresses and MACs */
+static inline void put_be(uint8_t *p, uint64_t v, unsigned bytes)
+{
+    for (unsigned i = 0; i < bytes; i++)
+        p[i] = static_cast<uint8_t>(v >> (8 * (bytes - 1 - i)));
+}
+
+/*
+ * Bring @d up with the EMAD channel of @e (built on SDQ 0 and CQ 0): CQ 0
+ * of 2^@log_size entries, SDQ 0 and RDQ 0 of half that, the EMAD trap on
+ * trap group 0. Busy polling is turned on once the channel is up, if
+ * @busy_poll is set.
+ */
+static inline int setup_emad(dev &d, emad &e, unsigned log_size, bool busy_poll = true)
+{
+    int err;
+
+    err = d.init();
+    if (!err)
+        err = d.create_cq(0, log_size);
+    if (!err)
+        err = d.create_sdq(0, log_size - 1, 0);
+    if (!err)
+        err = d.create_rdq(0, log_size - 1, 0, 2048);
+    if (!err)
+        err = d.set_trap_group_rdq(0, 0);
+    if (!err)
+        err = d.set_trap_group(SX_TRAP_ID_EMAD, 0);
+    if (!err)
+        err = e.init();
+    if (!err && busy_poll)
+        e.set_busy_poll(true);
+    return err;
+}
+
+static inline void report(const char *name, uint64_t packets, uint64_t ns, uint64_t cyc)
+{
+    printf("%-32s %10.3f Mpps %10.1f cycles/pkt %8.1f ns/pkt\n", name,
+           packets ? packets * 1e3 / ns : 0.0,
+           packets ? static_cast<double>(cyc) / packets : 0.0,
+           packets ? static_cast<double>(ns) / packets : 0.0);
+}
+
+} /* namespace bench */
+} /* namespace sx */
+
+#endif /* SX_BENCH_H */
@@ -0,0 +1,191 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * ACL insert latency against the model's TCAM, over EMAD answered after
+ * --latency-ns. For 1k, 10k and 40k rules (or just --rules), an ACL is
+ * loaded with replace() and then takes --inserts single-rule inserts at
+ * random priorities, each timed on its own:
+ *
+ *  - dense: regions laid out without gaps, so an insert shifts every rule
+ *    after it or rebuilds the region, as rewriting the region would;
+ *    only a tenth of the inserts are run;
+ *  - gaps: the acl_table default, 25% free entries spread between rules.
+ *
+ * Rules are a mix of 16, 32 and 64 byte keys, some with wildcarded bytes
+ * so they overlap. After the inserts, --checks keys of random rules are
+ * looked up in the model and must hit the rule a linear search of the
+ * rule set picks; every insert is then removed again.
+ *
+ *   bench_acl [--rules=N] [--inserts=N] [--checks=N] [--latency-ns=NS]
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "bench.h"
+#include "sx/acl.h"
+
+using namespace sx;
+
+#define EMAD_SDQ    0
+#define LOG_SIZE    11
+#define ACL_ID      7
+
+/* A 5-tuple-like narrow key mostly, some IPv6 pairs and wide keys */
+static acl_rule make_rule(std::mt19937_64 &rng, uint32_t priority)
+{
+    static const uint8_t lens[] = { 13, 13, 13, 13, 13, 13, 13, 32, 32, 64 };
+    acl_rule r = {};
+
+    r.priority = priority;
+    r.action = static_cast<uint32_t>(rng());
+    r.key_len = lens[rng() % 10];
+    for (unsigned i = 0; i < r.key_len; i++) {
+        r.key[i] = static_cast<uint8_t>(rng());
+        r.mask[i] = 0xff;
+    }
+    /* One in eight leaves its second half wildcarded */
+    if (rng() % 8 == 0) {
+        for (unsigned i = r.key_len / 2; i < r.key_len; i++)
+            r.key[i] = r.mask[i] = 0;
+    }
+    return r;
+}
+
+static bool matches(const acl_rule &r, const uint8_t *key)
+{
+    for (unsigned i = 0; i < r.key_len; i++) {
+        if ((key[i] & r.mask[i]) != r.key[i])
+            return false;
+    }
+    return true;
+}
+
+static double pct(std::vector<uint64_t> v, double p)
+{
+    std::sort(v.begin(), v.end());
+    return v.empty() ? 0 : v[std::min(v.size() - 1, static_cast<size_t>(p * v.size()))] / 1e3;
+}
+
+/* --checks lookups must pick the lowest-priority matching rule */
+static bool check(emu::asic &asic, const std::vector<acl_rule> &rules, uint32_t checks,
+                  std::mt19937_64 &rng)
+{
+    for (uint32_t c = 0; c < checks; c++) {
+        const acl_rule &pick = rules[rng() % rules.size()];
+        uint8_t key[SX_TCAM_KEY_MAX] = {};
+        const acl_rule *want = nullptr;
+        uint32_t action;
+
+        for (unsigned i = 0; i < pick.key_len; i++)
+            key[i] = pick.key[i] | (~pick.mask[i] & static_cast<uint8_t>(rng()));
+        for (const acl_rule &r : rules) {
+            if (matches(r, key) && (!want || r.priority < want->priority))
+                want = &r;
+        }
+        if (asic.acl_lookup(ACL_ID, key, &action) || action != want->action) {
+            fprintf(stderr, "lookup %u: model and rule set disagree\n", c);
+            return false;
+        }
+    }
+    return true;
+}
+
+static int run(uint32_t nrules, uint32_t inserts, uint32_t checks, bool dense,
+               const emu::asic_config &cfg)
+{
+    emu::asic asic(cfg);
+    dev d(asic);
+    emad e(d, EMAD_SDQ, 0);
+    acl_table acl(e, ACL_ID);
+    std::mt19937_64 rng(nrules);
+    std::vector<acl_rule> rules;
+    std::vector<uint64_t> handles(nrules), added, lat;
+    acl_stats s0, s1;
+    int err = bench::setup_emad(d, e, LOG_SIZE);
+
+    if (err) {
+        fprintf(stderr, "setup failed: %d\n", err);
+        return 1;
+    }
+    acl.set_gap_pct(dense ? 0 : 25);
+
+    /* Distinct priorities: which of two overlapping rules wins is defined */
+    std::vector<uint32_t> prio(nrules + inserts);
+    for (uint32_t i = 0; i < prio.size(); i++)
+        prio[i] = i * 16;
+    std::shuffle(prio.begin(), prio.end(), rng);
+    for (uint32_t i = 0; i < nrules; i++)
+        rules.push_back(make_rule(rng, prio[i]));
+
+    uint64_t t0 = emu::asic::now_ns();
+    err = acl.replace(rules.data(), rules.size(), handles.data());
+    uint64_t load_ns = emu::asic::now_ns() - t0;
+    if (err) {
+        fprintf(stderr, "replace: %d\n", err);
+        return 1;
+    }
+
+    acl.get_stats(&s0);
+    for (uint32_t i = 0; i < inserts; i++) {
+        acl_rule r = make_rule(rng, prio[nrules + i]);
+        uint64_t h;
+
+        t0 = emu::asic::now_ns();
+        err = acl.insert(r, &h);
+        lat.push_back(emu::asic::now_ns() - t0);
+        if (err) {
+            fprintf(stderr, "insert %u: %d\n", i, err);
+            return 1;
+        }
+        rules.push_back(r);
+        added.push_back(h);
+    }
+    acl.get_stats(&s1);
+
+    double n = inserts ? inserts : 1;
+    printf("%7u %-6s %9.3f %8u %9.1f %9.1f %9.1f %9.1f %9.1f %7lu\n", nrules,
+           dense ? "dense" : "gaps", load_ns / 1e9, inserts, (s1.writes - s0.writes) / n,
+           (s1.moves - s0.moves) / n, pct(lat, 0.5), pct(lat, 0.99),
+           lat.empty() ? 0 : *std::max_element(lat.begin(), lat.end()) / 1e3,
+           s1.relayouts - s0.relayouts);
+
+    if (!check(asic, rules, checks, rng))
+        return 1;
+    for (uint64_t h : added) {
+        err = acl.remove(h);
+        if (err) {
+            fprintf(stderr, "remove: %d\n", err);
+            return 1;
+        }
+    }
+    rules.resize(nrules);
+    return check(asic, rules, checks / 10, rng) ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    static const uint32_t sizes[] = { 1000, 10000, 40000 };
+    uint32_t only = bench::arg(argc, argv, "rules", 0);
+    uint32_t inserts = bench::arg(argc, argv, "inserts", 200);
+    uint32_t checks = bench::arg(argc, argv, "checks", 500);
+    emu::asic_config cfg;
+    cfg.emad_latency_ns = bench::arg(argc, argv, "latency-ns", 20000);
+
+    printf("inserts=%u latency=%uns\n", inserts, cfg.emad_latency_ns);
+    printf("%7s %-6s %9s %8s %9s %9s %9s %9s %9s %7s\n", "rules", "layout", "load s", "inserts",
+           "writes", "moves", "p50 us", "p99 us", "max us", "rebuilt");
+    for (uint32_t n : sizes) {
+        if (only)
+            n = only;
+        for (bool dense : { true, false }) {
+            if (run(n, dense ? std::max(inserts / 10, 1u) : inserts, checks, dense, cfg))
+                return 1;
+        }
+        if (only)
+            break;
+    }
+    return 0;
+}
@@ -0,0 +1,294 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * BFD sessions run by the driver against a loopback emulation. Ports are
+ * cabled in pairs: what the model sends out of port 2n arrives trapped on
+ * 2n + 1 and the other way round, and the two ends of every session run in
+ * the same engine. --sessions sessions (half as many pairs) at --interval-us
+ * and multiplier --mult come Up, then for --seconds:
+ *
+ *  - the CPU time of the process and of the engine's timer thread, which
+ *    also carries the model's transmit and the loopback;
+ *  - the gaps between the packets of each session on the wire: 1st and
+ *    99th percentile in intervals (0.75-1.0 with jitter), and the longest,
+ *    which must stay under the detection time;
+ *  - any state change, which must not happen.
+ *
+ * Then every eighth cable is cut: each session on it must go Down, within
+ * the detection time plus the timer's lateness, and no other. The run is
+ * repeated for an eighth, a quarter and half of --sessions, then all. A
+ * state change after the host held the timer thread off a whole interval
+ * is the host's doing, not the engine's: that run is tried again, up to
+ * three times in all.
+ *
+ *   bench_bfd [--sessions=N] [--interval-us=US] [--mult=N] [--seconds=N]
+ *             [--ports=N]
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "sx/bfd.h"
+
+using namespace sx;
+
+#define SDQ         0
+#define RDQ         0
+#define GROUP       1
+#define LOG_SIZE    12
+#define SLOW_TX_US  20000       /* bring-up, instead of RFC 5880's second */
+#define RX_HOLD_US  100         /* interrupt moderation of the trap CQ */
+#define IP_BASE     0x0a000000u
+
+/* The wire: per session, the time of its last packet and its gaps */
+struct wire {
+    std::vector<std::atomic<bool>> cut;
+    std::vector<uint64_t>          last_ns;
+    std::vector<uint64_t>          hist;        /* gaps, in tenths of the interval */
+    uint64_t                       interval_ns;
+    uint64_t                       max_gap_ns = 0;
+    std::atomic<bool>              record{false};
+
+    wire(unsigned ports, unsigned sessions, uint64_t ival)
+        : cut(ports / 2), last_ns(sessions), hist(64), interval_ns(ival)
+    {
+    }
+
+    void sent(uint32_t session, uint64_t now)
+    {
+        uint64_t gap = now - last_ns[session];
+
+        if (record.load(std::memory_order_relaxed) && last_ns[session]) {
+            hist[std::min<uint64_t>(gap * 10 / interval_ns, hist.size() - 1)]++;
+            max_gap_ns = std::max(max_gap_ns, gap);
+        }
+        last_ns[session] = now;
+    }
+
+    double percentile(double p) const
+    {
+        uint64_t total = 0, n = 0;
+
+        for (uint64_t h : hist)
+            total += h;
+        for (size_t i = 0; i < hist.size(); i++) {
+            n += hist[i];
+            if (n >= total * p)
+                return (i + 1) / 10.0;
+        }
+        return hist.size() / 10.0;
+    }
+};
+
+static int setup(emu::asic &asic, dev &d)
+{
+    unsigned cqn = asic.config().num_sdq + RDQ;
+    int err;
+
+    err = d.init();
+    if (!err)
+        err = d.create_cq(SDQ, LOG_SIZE);
+    if (!err)
+        err = d.create_sdq(SDQ, LOG_SIZE - 2, SDQ);
+    if (!err)
+        err = d.create_cq(cqn, LOG_SIZE);
+    if (!err)
+        err = d.create_rdq(RDQ, LOG_SIZE, cqn, 2048);
+    if (!err)
+        err = d.set_napi_thread(cqn, -1);
+    if (!err)
+        err = d.set_coalesce(cqn, { RX_HOLD_US, SX_NAPI_WEIGHT, false });
+    if (!err)
+        err = d.set_trap_group_rdq(GROUP, RDQ);
+    if (!err)
+        err = d.set_trap_group(SX_TRAP_ID_IPV4_BFD, GROUP);
+    return err;
+}
+
+/* Session 2k on port 2j and 2k + 1 on port 2j + 1, each the other's neighbor */
+static bfd_session_cfg session_cfg(uint32_t i, unsigned ports, uint32_t ival_us, uint8_t mult)
+{
+    bfd_session_cfg c = {};
+    uint32_t pair = i / 2;
+
+    c.port = (pair % (ports / 2)) * 2 + (i & 1);
+    c.src_mac[0] = 0x02;
+    c.src_mac[5] = c.port;
+    c.dst_mac[0] = 0x02;
+    c.dst_mac[5] = c.port ^ 1;
+    c.src_ip = IP_BASE + i + 1;
+    c.dst_ip = IP_BASE + (i ^ 1) + 1;
+    c.tx_us = ival_us;
+    c.rx_us = ival_us;
+    c.detect_mult = mult;
+    return c;
+}
+
+/* Reads state changes until @want arrived or @timeout_ms passed */
+static void wait_events(bfd &b, std::vector<bfd_event> &out, size_t want, unsigned timeout_ms)
+{
+    uint64_t deadline = emu::asic::now_ns() + timeout_ms * 1000000ull;
+    bfd_event ev[256];
+
+    while (out.size() < want) {
+        ssize_t n = b.read(ev, 256, true);
+
+        if (n > 0)
+            out.insert(out.end(), ev, ev + n);
+        else if (emu::asic::now_ns() < deadline)
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        else
+            break;
+    }
+}
+
+/* 0, 1 on failure, or -EAGAIN if the host held the timer thread off an interval */
+static int run(unsigned sessions, unsigned ports, uint32_t ival_us, uint8_t mult, unsigned seconds)
+{
+    emu::asic_config cfg;
+    cfg.num_ports = ports;
+    emu::asic asic(cfg);
+    dev d(asic);
+    bfd b(d, SDQ, sessions);
+    wire w(ports, sessions, ival_us * 1000ull);
+    std::vector<bfd_event> ev;
+    uint64_t detect_ns = mult * ival_us * 1000ull;
+    int err;
+
+    err = setup(asic, d);
+    if (err) {
+        fprintf(stderr, "setup failed: %d\n", err);
+        return 1;
+    }
+    asic.set_egress_handler([&](uint16_t port, const uint8_t *data, uint32_t len) {
+        uint32_t ip;
+
+        if (len < SX_BFD_FRAME_LEN || w.cut[port / 2].load(std::memory_order_relaxed))
+            return;
+        memcpy(&ip, data + 26, sizeof(ip));
+        w.sent(be32toh(ip) - IP_BASE - 1, emu::asic::now_ns());
+        asic.inject(SX_TRAP_ID_IPV4_BFD, port ^ 1, data, len);
+    });
+    asic.set_irq_handler([&d](unsigned vector) { d.irq(vector); });
+
+    b.set_slow_tx_us(SLOW_TX_US);
+    err = b.start();
+    for (uint32_t i = 0; i < sessions && !err; i++) {
+        uint32_t id;
+
+        err = b.add_session(session_cfg(i, ports, ival_us, mult), &id);
+        if (!err && id != i)
+            err = -EINVAL;
+    }
+    if (err) {
+        fprintf(stderr, "sessions: %d\n", err);
+        return 1;
+    }
+
+    /* Down, Init, Up; an end may skip Init */
+    unsigned up = 0;
+    for (uint64_t deadline = emu::asic::now_ns() + 5000000000ull;
+         up < sessions && emu::asic::now_ns() < deadline;) {
+        uint8_t state;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        wait_events(b, ev, SIZE_MAX, 0);
+        up = 0;
+        for (uint32_t i = 0; i < sessions; i++)
+            up += !b.get_state(i, &state) && state == SX_BFD_STATE_UP;
+    }
+    if (up != sessions) {
+        fprintf(stderr, "%u: %u of %u sessions up\n", sessions, up, sessions);
+        return 1;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    /* Steady state */
+    bfd_stats s0, s1;
+    ev.clear();
+    b.get_stats(&s0);
+    w.record = true;
+    uint64_t t0 = emu::asic::now_ns(), p0 = cpu_ns(CLOCK_PROCESS_CPUTIME_ID);
+    wait_events(b, ev, 1, seconds * 1000);
+    uint64_t ns = emu::asic::now_ns() - t0, pcpu = cpu_ns(CLOCK_PROCESS_CPUTIME_ID) - p0;
+    w.record = false;
+    b.get_stats(&s1);
+    if (!ev.empty()) {
+        fprintf(stderr, "%u: session %u went %u (diag %u) in steady state; max gap %.2f ms, "
+                "timer late %.2f ms, %lu CQEs lost\n", sessions, ev[0].session, ev[0].state,
+                ev[0].diag, w.max_gap_ns / 1e6, s1.timer_late_max_ns / 1e6,
+                asic.stats().cq_overflow.load());
+        return s1.timer_late_max_ns >= ival_us * 1000ull ? -EAGAIN : 1;
+    }
+
+    /* Cut every eighth cable; exactly its sessions must go down */
+    std::vector<bool> on_cut(sessions);
+    size_t want = 0;
+    for (uint32_t i = 0; i < sessions; i++) {
+        on_cut[i] = (session_cfg(i, ports, ival_us, mult).port / 2) % 8 == 0;
+        want += on_cut[i];
+    }
+    uint64_t t_cut = emu::asic::now_ns();
+    for (unsigned p = 0; p < ports / 2; p += 8)
+        w.cut[p].store(true, std::memory_order_relaxed);
+    wait_events(b, ev, want, 1000);
+    std::this_thread::sleep_for(std::chrono::milliseconds(4 * detect_ns / 1000000 + 10));
+    wait_events(b, ev, want + 1, 0);
+
+    uint64_t worst = 0;
+    bool bad = ev.size() != want;
+    for (const bfd_event &e : ev) {
+        bad |= e.session >= sessions || !on_cut[e.session] || e.state != SX_BFD_STATE_DOWN ||
+               e.diag != SX_BFD_DIAG_EXPIRED;
+        worst = std::max(worst, e.timestamp - t_cut);
+    }
+    b.stop();
+    asic.set_irq_handler(nullptr);
+
+    uint64_t rx = s1.rx_packets - s0.rx_packets, tx = s1.tx_packets - s0.tx_packets;
+    printf("%8u %10.0f %10.0f %8.1f%% %8.1f%% %7.2f %7.2f %8.2f %8.2f %8.2f\n", sessions,
+           tx * 1e9 / ns, rx * 1e9 / ns, 100.0 * pcpu / ns,
+           100.0 * (s1.cpu_ns - s0.cpu_ns) / ns, w.percentile(0.01), w.percentile(0.99),
+           w.max_gap_ns / 1e6, s1.timer_late_max_ns / 1e6, worst / 1e6);
+    if (bad || s1.rx_invalid || s1.events_dropped != s0.events_dropped ||
+        w.max_gap_ns >= detect_ns) {
+        fprintf(stderr, "%u: %zu changes on cut (want %zu), %lu invalid, %lu dropped, "
+                "max gap %.2f ms\n", sessions, ev.size(), want, s1.rx_invalid,
+                s1.events_dropped - s0.events_dropped, w.max_gap_ns / 1e6);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned sessions = bench::arg(argc, argv, "sessions", 1000);
+    uint32_t ival_us = bench::arg(argc, argv, "interval-us", 3300);
+    unsigned mult = bench::arg(argc, argv, "mult", 3);
+    unsigned seconds = bench::arg(argc, argv, "seconds", 2);
+    unsigned ports = bench::arg(argc, argv, "ports", 64);
+
+    if (sessions < 16 || sessions % 2 || sessions > 0xffff || !ival_us || !mult || mult > 255 ||
+        !seconds || ports < 16 || ports % 16 || ports > SX_MAX_PORTS) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    printf("interval=%u us mult=%u detect=%.1f ms ports=%u, %u s per run\n", ival_us, mult,
+           mult * ival_us / 1000.0, ports, seconds);
+    printf("%8s %10s %10s %9s %9s %7s %7s %8s %8s %8s\n", "sessions", "tx pps", "rx pps",
+           "proc CPU", "timer CPU", "gap p1", "p99", "max ms", "late ms", "detect");
+    for (unsigned n : { sessions / 8, sessions / 4, sessions / 2, sessions }) {
+        int err = -EAGAIN;
+
+        for (unsigned tries = 0; err == -EAGAIN && tries < 3; tries++)
+            err = run(n & ~1u, ports, ival_us, mult, seconds);
+        if (err)
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,162 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * CQ interrupt moderation against the software ASIC model, with live
+ * interrupts: no moderation, a static 64 us / 64 frames setting and
+ * adaptive moderation, each under a paced trap load and a trap storm.
+ *
+ * Latency is from the ASIC timestamping the packet to the listener
+ * receiving it. Reported are the achieved rate, interrupts per packet and
+ * latency percentiles; adaptive runs also show the setting they settled
+ * on. Every packet must arrive, in order.
+ *
+ *   bench_coalesce [--paced=N] [--rate=PPS] [--storm=N] [--size=BYTES]
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <ctime>
+#include <sys/prctl.h>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "sx/dev.h"
+
+using namespace sx;
+
+#define RDQ         0
+#define GROUP       1
+#define TRAP        SX_TRAP_ID_ETH_L2_LACP
+#define LOG_SIZE    10
+
+struct mode {
+    const char *name;
+    cq_coalesce coal;
+};
+
+static double pct(std::vector<uint32_t> &v, double p)
+{
+    size_t i = std::min(v.size() - 1, static_cast<size_t>(p / 100 * v.size()));
+
+    std::nth_element(v.begin(), v.begin() + i, v.end());
+    return v[i] / 1e3;
+}
+
+/* @rate 0: inject as fast as the driver drains. Returns false on loss. */
+static bool run(const mode &m, const char *load, uint64_t packets, uint64_t rate, uint32_t size)
+{
+    emu::asic asic;
+    dev d(asic);
+    std::vector<uint32_t> lat(packets);
+    std::atomic<uint64_t> got{0};
+    uint64_t bad = 0;
+    unsigned cqn = asic.config().num_sdq + RDQ;
+    uint8_t frame[2048];
+    int err;
+
+    err = d.init();
+    if (!err)
+        err = d.create_cq(cqn, LOG_SIZE);
+    if (!err)
+        err = d.create_rdq(RDQ, LOG_SIZE, cqn, 2048);
+    if (!err)
+        err = d.set_trap_group_rdq(GROUP, RDQ);
+    if (!err)
+        err = d.set_trap_group(TRAP, GROUP);
+    if (!err)
+        err = d.set_coalesce(cqn, m.coal);
+    if (!err) {
+        err = d.add_listener(TRAP, [&](const rx_info &info, pkt_buf *buf) {
+            uint64_t n = got.load(std::memory_order_relaxed), seq;
+
+            memcpy(&seq, buf->data + 14, sizeof(seq));
+            if (seq != n)
+                bad++;
+            if (n < packets)
+                lat[n] = emu::asic::now_ns() - info.timestamp;
+            pkt_buf_free(buf);
+            got.store(n + 1, std::memory_order_release);
+        });
+    }
+    if (err) {
+        fprintf(stderr, "setup failed: %d\n", err);
+        return false;
+    }
+    asic.set_irq_handler([&d](unsigned vector) { d.irq(vector); });
+    bench::fill_frame(frame, size, 0x8809, 0);
+
+    uint64_t irqs0 = asic.stats().irqs.load();
+    uint64_t t0 = emu::asic::now_ns();
+    for (uint64_t i = 0; i < packets; i++) {
+        memcpy(frame + 14, &i, sizeof(i));
+        while (asic.inject(TRAP, 1, frame, size) == -ENOSPC)
+            std::this_thread::yield();
+        if (rate) {
+            uint64_t due = t0 + (i + 1) * 1000000000ull / rate;
+            struct timespec ts = { static_cast<time_t>(due / 1000000000ull),
+                                   static_cast<long>(due % 1000000000ull) };
+
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+        }
+    }
+    while (got.load(std::memory_order_acquire) < packets)
+        std::this_thread::yield();
+    uint64_t ns = emu::asic::now_ns() - t0;
+    uint64_t irqs = asic.stats().irqs.load() - irqs0;
+
+    cq_coalesce c;
+    char name[64];
+
+    asic.set_irq_handler(nullptr);
+    d.get_coalesce(cqn, &c);
+    snprintf(name, sizeof(name), "%s, %s", m.name, load);
+    printf("%-28s %9.1f kpps %7.3f irq/pkt  p50 %7.1f  p99 %7.1f  p99.9 %7.1f us",
+           name, packets * 1e6 / ns, static_cast<double>(irqs) / packets,
+           pct(lat, 50), pct(lat, 99), pct(lat, 99.9));
+    if (m.coal.adaptive)
+        printf("  -> %u us/%u frames", c.usecs, c.max_frames);
+    printf("\n");
+
+    d.destroy_queues();
+    if (bad) {
+        fprintf(stderr, "%s: %lu packets out of order\n", name, bad);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t paced = bench::arg(argc, argv, "paced", 20000);
+    uint64_t rate = bench::arg(argc, argv, "rate", 20000);
+    uint64_t storm = bench::arg(argc, argv, "storm", 500000);
+    uint32_t size = bench::arg(argc, argv, "size", 128);
+    static const mode modes[] = {
+        { "off",        { 0, 0, false } },
+        { "64us/64",    { 64, 64, false } },
+        { "adaptive",   { 0, 0, true } },
+    };
+    char load[32];
+
+    if (!paced || !storm || !rate || size < 64 || size > 2048) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    /* Pace at the requested rate rather than the default timer slack */
+    prctl(PR_SET_TIMERSLACK, 1UL);
+
+    printf("paced=%lu at %lu pps, storm=%lu, size=%u\n", paced, rate, storm, size);
+    snprintf(load, sizeof(load), "%lu kpps", rate / 1000);
+    for (const mode &m : modes) {
+        if (!run(m, load, paced, rate, size))
+            return 1;
+    }
+    for (const mode &m : modes) {
+        if (!run(m, "storm", storm, 0, size))
+            return 1;
+    }
+    return 0;
+}
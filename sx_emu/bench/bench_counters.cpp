@@ -0,0 +1,200 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * Refreshing --counters flow counters from the model over EMAD answered
+ * after --latency-ns:
+ *
+ *  - per counter, one MGPC query at a time, as a poller walking the
+ *    counters would;
+ *  - per counter, pipelined MGPC queries;
+ *  - counter_pool as meant: one MOCS DMA per bank, banks in flight
+ *    together, --rounds times.
+ *
+ * Before every refresh the model counts traffic on a random fifth of the
+ * counters; every counter must then read its total and the traffic of the
+ * round as delta. Between rounds some counters are freed and allocated
+ * again and must start from zero. During the bulk rounds a reader thread
+ * reads counters all the while and must never see a value or delta torn
+ * between refreshes.
+ *
+ *   bench_counters [--counters=N] [--rounds=N] [--latency-ns=NS]
+ */
+
+#include <atomic>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "sx/counter_pool.h"
+
+using namespace sx;
+
+#define EMAD_SDQ    0
+#define LOG_SIZE    11
+#define PKT_BYTES   64
+
+struct mode {
+    const char *name;
+    bool        bulk;
+    unsigned    window;
+    unsigned    rounds;         /* 0: --rounds */
+};
+
+struct block {
+    uint32_t index;
+    uint32_t n;
+};
+
+int main(int argc, char **argv)
+{
+    static const mode modes[] = {
+        { "per counter, serial",    false, 1,                    1 },
+        { "per counter, pipelined", false, SX_EMAD_MAX_INFLIGHT, 1 },
+        { "counter_pool: bulk DMA", true,  SX_EMAD_MAX_INFLIGHT, 0 },
+    };
+    static const uint32_t sizes[] = { 1, 1, 1, 1, 1, 2, 4, 8 };
+    uint32_t want = bench::arg(argc, argv, "counters", 100000);
+    uint32_t rounds = bench::arg(argc, argv, "rounds", 20);
+    emu::asic_config cfg;
+    cfg.emad_latency_ns = bench::arg(argc, argv, "latency-ns", 20000);
+    std::mt19937_64 rng(1);
+    std::vector<block> blocks;
+    std::vector<uint32_t> live;             /* allocated counter indexes */
+    std::vector<sx_flow_cnt> total, round;
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> reads{0}, torn{0};
+    uint32_t allocated = 0;
+    int err;
+
+    if (!want || want > cfg.flow_counters / 2 || !rounds) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    emu::asic asic(cfg);
+    dev d(asic);
+    emad e(d, EMAD_SDQ, 0);
+    counter_pool pool(e, cfg.flow_counters);
+
+    err = bench::setup_emad(d, e, LOG_SIZE);
+    if (err) {
+        fprintf(stderr, "setup failed: %d\n", err);
+        return 1;
+    }
+    while (allocated < want) {
+        block b = { 0, sizes[rng() % 8] };
+
+        err = pool.alloc(b.n, &b.index);
+        if (err) {
+            fprintf(stderr, "alloc: %d\n", err);
+            return 1;
+        }
+        blocks.push_back(b);
+        for (uint32_t i = 0; i < b.n; i++)
+            live.push_back(b.index + i);
+        allocated += b.n;
+    }
+    total.assign(cfg.flow_counters, sx_flow_cnt());
+    round.assign(cfg.flow_counters, sx_flow_cnt());
+
+    counter_pool_stats s;
+    pool.get_stats(&s);
+    printf("counters=%u allocated=%u banks=%lu latency=%uns\n", want, allocated, s.banks,
+           cfg.emad_latency_ns);
+    printf("%-24s %7s %10s %12s %12s\n", "mode", "rounds", "accesses", "ms/refresh",
+           "counters/s");
+    std::vector<uint32_t> probe = live;
+    std::thread reader;
+    auto finish = [&](int ret) {
+        stop.store(true);
+        if (reader.joinable())
+            reader.join();
+        return ret;
+    };
+    for (const mode &m : modes) {
+        unsigned n = m.rounds ? m.rounds : rounds;
+        uint64_t ns = 0, acc;
+
+        /* Packets and bytes of one counter always go together */
+        if (m.bulk && !reader.joinable()) {
+            reader = std::thread([&] {
+                std::mt19937_64 r(2);
+                sx_flow_cnt v, dl;
+
+                while (!stop.load(std::memory_order_relaxed)) {
+                    if (pool.read(probe[r() % probe.size()], &v, &dl))
+                        continue;
+                    if (v.bytes != v.packets * PKT_BYTES || dl.bytes != dl.packets * PKT_BYTES)
+                        torn.fetch_add(1, std::memory_order_relaxed);
+                    if (reads.fetch_add(1, std::memory_order_relaxed) % 256 == 255)
+                        std::this_thread::yield();
+                }
+            });
+        }
+
+        pool.set_bulk(m.bulk);
+        pool.set_window(m.window);
+        pool.get_stats(&s);
+        acc = s.accesses;
+        for (unsigned r = 0; r < n; r++) {
+            /* Recycle a few blocks: they must read zero until counted */
+            for (unsigned k = 0; k < 100; k++) {
+                block &b = blocks[rng() % blocks.size()];
+
+                pool.free(b.index);
+                if (pool.alloc(b.n, &b.index)) {
+                    fprintf(stderr, "realloc failed\n");
+                    return finish(1);
+                }
+                for (uint32_t i = 0; i < b.n; i++)
+                    total[b.index + i] = sx_flow_cnt();
+            }
+            /* Recycling kept sizes, but indexes may have moved */
+            live.clear();
+            for (const block &b : blocks) {
+                for (uint32_t i = 0; i < b.n; i++)
+                    live.push_back(b.index + i);
+            }
+
+            for (uint32_t idx : live) {
+                uint64_t pkts = rng() % 5 ? 0 : 1 + rng() % 100;
+
+                asic.flow_count(idx, pkts, pkts * PKT_BYTES);
+                round[idx] = { pkts, pkts * PKT_BYTES };
+                total[idx].packets += pkts;
+                total[idx].bytes += pkts * PKT_BYTES;
+            }
+
+            uint64_t t0 = emu::asic::now_ns();
+            err = pool.refresh();
+            ns += emu::asic::now_ns() - t0;
+            if (err) {
+                fprintf(stderr, "%s: refresh: %d\n", m.name, err);
+                return finish(1);
+            }
+
+            for (uint32_t idx : live) {
+                sx_flow_cnt v, dl;
+
+                if (pool.read(idx, &v, &dl) || v.packets != total[idx].packets ||
+                    v.bytes != total[idx].bytes || dl.packets != round[idx].packets ||
+                    dl.bytes != round[idx].bytes) {
+                    fprintf(stderr, "%s: counter %u: %lu packets (+%lu), want %lu (+%lu)\n",
+                            m.name, idx, v.packets, dl.packets, total[idx].packets,
+                            round[idx].packets);
+                    return finish(1);
+                }
+            }
+        }
+        pool.get_stats(&s);
+        printf("%-24s %7u %10lu %12.3f %12.0f\n", m.name, n, (s.accesses - acc) / n,
+               ns / 1e6 / n, static_cast<double>(s.banks) * SX_CNT_BANK_SIZE * n * 1e9 / ns);
+    }
+
+    finish(0);
+    pool.get_stats(&s);
+    printf("reader: %lu reads, %lu retried, %lu torn\n", reads.load(), s.read_retries, torn.load());
+    return torn.load() ? 1 : 0;
+}
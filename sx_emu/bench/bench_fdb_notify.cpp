@@ -0,0 +1,234 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * FDB learning notifications during a MAC move storm, one notification per
+ * event through a cdev_file against batched, coalesced fdb_notify reads.
+ *
+ * --macs MACs are learned and the user-space view synced first. The storm
+ * then moves every MAC to another port, flapping it back and forth until
+ * it settles (--flaps moves each), while --transient new MACs are learned
+ * and aged out again shortly after, all through live interrupts. The SDK
+ * side pays --wakeup-ns per notification read and --event-ns per event
+ * applied to its view.
+ *
+ * Reported are the time until the view has caught up, the events the ASIC
+ * raised against those the SDK had to apply and its wakeups. The view must
+ * match the ASIC's table afterwards.
+ *
+ *   bench_fdb_notify [--macs=N] [--flaps=N] [--transient=N] [--batch=N]
+ *                    [--window-us=US] [--wakeup-ns=NS] [--event-ns=NS]
+ */
+
+#include <cstdio>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "bench.h"
+#include "sx/cdev.h"
+#include "sx/dev.h"
+#include "sx/fdb_notify.h"
+
+using namespace sx;
+
+#define RDQ         0
+#define GROUP       3
+#define LOG_SIZE    10
+#define FID         10
+#define MARK_FID    4095
+
+struct params {
+    uint32_t macs, flaps, transient, batch, window_us;
+    uint64_t wakeup_ns, event_ns;
+};
+
+/* SDK side: applies events to its copy of the FDB until it sees @mark */
+class view {
+public:
+    view(const params &p) : p_(p) {}
+
+    /* Returns true once the mark went by */
+    bool apply(const sx_fdb_rec *ev, size_t n, uint64_t mark)
+    {
+        bool seen = false;
+
+        bench::spin_ns(p_.wakeup_ns);
+        wakeups++;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t key = sx_fdb_key(ev[i].fid, ev[i].mac);
+
+            bench::spin_ns(p_.event_ns);
+            if (ev[i].type == SX_FDB_EV_AGE)
+                fdb.erase(key);
+            else
+                fdb[key] = ev[i].port;
+            seen |= key == mark;
+        }
+        events += n;
+        return seen;
+    }
+
+    std::unordered_map<uint64_t, uint16_t> fdb;
+    uint64_t events = 0, wakeups = 0;
+
+private:
+    const params &p_;
+};
+
+static bool learn(emu::asic &asic, uint16_t fid, uint32_t i, uint16_t port)
+{
+    uint8_t mac[6];
+    int err;
+
+    bench::make_mac(mac, i);
+    while ((err = asic.fdb_learn(fid, mac, port)) == -ENOSPC)
+        std::this_thread::yield();
+    return !err;
+}
+
+static bool age(emu::asic &asic, uint16_t fid, uint32_t i)
+{
+    uint8_t mac[6];
+    int err;
+
+    bench::make_mac(mac, i);
+    while ((err = asic.fdb_age(fid, mac)) == -ENOSPC)
+        std::this_thread::yield();
+    return !err;
+}
+
+/* Learn every MAC, then run the storm; the mark ends each phase */
+static bool produce(emu::asic &asic, const params &p, unsigned phase)
+{
+    uint32_t ports = asic.config().num_ports;
+    bool ok = true;
+
+    if (phase == 0) {
+        for (uint32_t i = 0; i < p.macs && ok; i++)
+            ok = learn(asic, FID, i, i % ports);
+        return ok && learn(asic, MARK_FID, 0, 0);
+    }
+
+    /* Each MAC flaps between its new and its old port until it settles */
+    for (uint32_t i = 0; i < p.macs && ok; i++) {
+        for (uint32_t f = 0; f < p.flaps && ok; f++)
+            ok = learn(asic, FID, i, (i + 1 - (f & 1)) % ports);
+        if (ok && i < p.transient)
+            ok = learn(asic, FID, p.macs + i, i % ports);
+        if (ok && i >= 8 && i - 8 < p.transient)
+            ok = age(asic, FID, p.macs + i - 8);
+    }
+    return ok && learn(asic, MARK_FID, 0, 1);
+}
+
+/* Returns false on a producer error or a view that differs from the ASIC */
+static bool run(bool batched, const params &p)
+{
+    emu::asic asic;
+    dev d(asic);
+    cdev_file file(d, 1u << 24);
+    fdb_notify notify(d, p.batch, p.window_us);
+    view v(p);
+    unsigned cqn = asic.config().num_sdq + RDQ;
+    uint8_t mark_mac[6];
+    int err;
+
+    bench::make_mac(mark_mac, 0);
+    uint64_t mark = sx_fdb_key(MARK_FID, mark_mac);
+
+    err = d.init();
+    if (!err)
+        err = d.create_cq(cqn, LOG_SIZE);
+    if (!err)
+        err = d.create_rdq(RDQ, LOG_SIZE, cqn, 256);
+    if (!err)
+        err = d.set_trap_group_rdq(GROUP, RDQ);
+    if (!err)
+        err = d.set_trap_group(SX_TRAP_ID_FDB_EVENT, GROUP);
+    if (!err)
+        err = batched ? notify.start() : file.add_trap(SX_TRAP_ID_FDB_EVENT);
+    if (err) {
+        fprintf(stderr, "setup failed: %d\n", err);
+        return false;
+    }
+    asic.set_irq_handler([&d](unsigned vector) { d.irq(vector); });
+
+    uint64_t t0 = 0, raised0 = 0, events0 = 0, wakeups0 = 0, ns = 0;
+    bool ok = true;
+
+    for (unsigned phase = 0; phase < 2 && ok; phase++) {
+        std::thread consumer([&] {
+            std::vector<sx_fdb_rec> ev(batched ? p.batch : 1);
+            uint8_t rbuf[sizeof(ku_read) + 64];
+
+            for (bool done = false; !done;) {
+                if (batched) {
+                    ssize_t n = notify.read(ev.data(), ev.size());
+
+                    done = v.apply(ev.data(), n, mark);
+                } else {
+                    file.read(rbuf, sizeof(rbuf));
+                    memcpy(ev.data(), rbuf + sizeof(ku_read), sizeof(sx_fdb_rec));
+                    done = v.apply(ev.data(), 1, mark);
+                }
+            }
+        });
+
+        t0 = emu::asic::now_ns();
+        raised0 = asic.stats().trapped.load();
+        events0 = v.events;
+        wakeups0 = v.wakeups;
+        ok = produce(asic, p, phase);
+        consumer.join();
+        ns = emu::asic::now_ns() - t0;
+    }
+    asic.set_irq_handler(nullptr);
+
+    uint64_t raised = asic.stats().trapped.load() - raised0;
+    uint64_t events = v.events - events0, wakeups = v.wakeups - wakeups0;
+    printf("%-22s %9.1f ms %9lu raised %9lu applied %9lu wakeups %8.2f Mevents/s\n",
+           batched ? "fdb_notify, batched" : "cdev, per event", ns / 1e6, raised, events,
+           wakeups, raised * 1e3 / ns);
+    if (batched) {
+        fdb_notify_stats s;
+
+        notify.get_stats(&s);
+        printf("%-22s coalesced %lu, cancelled %lu pairs, overflow %lu\n", "", s.coalesced,
+               s.cancelled, s.overflow);
+    }
+
+    if (!ok) {
+        fprintf(stderr, "storm failed\n");
+        return false;
+    }
+    if (v.fdb != asic.fdb_dump()) {
+        fprintf(stderr, "view has %zu entries, ASIC %zu, or ports differ\n", v.fdb.size(),
+                asic.fdb_dump().size());
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    params p;
+
+    p.macs = bench::arg(argc, argv, "macs", 100000);
+    p.flaps = bench::arg(argc, argv, "flaps", 3);
+    p.transient = bench::arg(argc, argv, "transient", 10000);
+    p.batch = bench::arg(argc, argv, "batch", SX_FDB_NOTIFY_BATCH);
+    p.window_us = bench::arg(argc, argv, "window-us", SX_FDB_NOTIFY_WINDOW_US);
+    p.wakeup_ns = bench::arg(argc, argv, "wakeup-ns", 2000);
+    p.event_ns = bench::arg(argc, argv, "event-ns", 200);
+
+    if (!p.macs || p.macs > (1u << 24) || !p.flaps || p.transient > p.macs || !p.batch) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    printf("macs=%u flaps=%u transient=%u batch=%u window=%uus wakeup=%luns event=%luns\n",
+           p.macs, p.flaps, p.transient, p.batch, p.window_us, p.wakeup_ns, p.event_ns);
+    if (!run(false, p) || !run(true, p))
+        return 1;
+    return 0;
+}
@@ -0,0 +1,378 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * "Get MAC entry" and full FDB dumps served by the driver's shadow FDB
+ * against SFD queries over EMAD, at 64k, 256k and 1M entries (or just
+ * --entries). The model answers EMAD after --latency-ns.
+ *
+ * The table is filled by learning, with moves and short-lived MACs, fed to
+ * the shadow through fdb_notify, plus --static entries written through the
+ * shadow (SFD writes; as many again are written and deleted). A reader
+ * thread looks the static entries up without pause meanwhile and must
+ * always find them.
+ *
+ * Timed are --lookups random lookups, one in eight a miss, from the shadow
+ * and, for reference, from a std::unordered_map; --emad-lookups SFD lookups
+ * one at a time; a shadow dump against a dump by SFD queries (the
+ * consistency check) and against one SFD lookup per entry, estimated from
+ * the sampled rate. The shadow must match the ASIC's table and check()
+ * must find it consistent, then find exactly the differences planted.
+ *
+ *   bench_fdb_shadow [--entries=N] [--static=N] [--lookups=N]
+ *                    [--emad-lookups=N] [--latency-ns=NS]
+ */
+
+#include <atomic>
+#include <cstdio>
+#include <endian.h>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "bench.h"
+#include "sx/fdb_notify.h"
+#include "sx/fdb_shadow.h"
+
+using namespace sx;
+
+#define EMAD_SDQ    0
+#define EMAD_RDQ    0
+#define EMAD_GROUP  0
+#define FDB_RDQ     1
+#define FDB_GROUP   3
+#define LOG_SIZE    11
+#define FID         10
+#define STATIC_FID  20
+#define MISS_FID    4094
+
+struct params {
+    uint32_t entries, nstatic, lookups, emad_lookups, latency_ns;
+};
+
+class fdb_bench {
+public:
+    fdb_bench(const params &p) : p_(p), asic_(config(p)), d_(asic_), e_(d_, EMAD_SDQ, 0),
+                                 notify_(d_), shadow_(p.entries) {}
+
+    int setup();
+    bool fill();
+    bool run();
+
+private:
+    static emu::asic_config config(const params &p)
+    {
+        emu::asic_config cfg;
+
+        cfg.emad_latency_ns = p.latency_ns;
+        return cfg;
+    }
+
+    void pump();
+    bool learn(uint16_t fid, uint32_t i, uint16_t port);
+    bool age(uint16_t fid, uint32_t i);
+    int emad_lookup(const sx_fdb_rec &rec);
+    bool plant();
+
+    const params     &p_;
+    emu::asic         asic_;
+    dev               d_;
+    emad              e_;
+    fdb_notify        notify_;
+    fdb_shadow        shadow_;
+    unsigned          fdb_cqn_ = 0;
+    sx_fdb_rec        ev_[SX_FDB_NOTIFY_BATCH];
+};
+
+int fdb_bench::setup()
+{
+    int err;
+
+    fdb_cqn_ = asic_.config().num_sdq + FDB_RDQ;
+    err = d_.init();
+    if (!err)
+        err = d_.create_cq(0, LOG_SIZE);
+    if (!err)
+        err = d_.create_sdq(EMAD_SDQ, LOG_SIZE - 1, 0);
+    if (!err)
+        err = d_.create_rdq(EMAD_RDQ, LOG_SIZE - 1, 0, 2048);
+    if (!err)
+        err = d_.set_trap_group_rdq(EMAD_GROUP, EMAD_RDQ);
+    if (!err)
+        err = d_.set_trap_group(SX_TRAP_ID_EMAD, EMAD_GROUP);
+    if (!err)
+        err = d_.create_cq(fdb_cqn_, LOG_SIZE);
+    if (!err)
+        err = d_.create_rdq(FDB_RDQ, LOG_SIZE, fdb_cqn_, 256);
+    if (!err)
+        err = d_.set_trap_group_rdq(FDB_GROUP, FDB_RDQ);
+    if (!err)
+        err = d_.set_trap_group(SX_TRAP_ID_FDB_EVENT, FDB_GROUP);
+    if (!err)
+        err = e_.init();
+    if (!err) {
+        notify_.set_shadow(&shadow_);
+        err = notify_.start();
+    }
+    e_.set_busy_poll(true);
+    return err;
+}
+
+/* Deliver pending learning records; the SDK drains its notifications */
+void fdb_bench::pump()
+{
+    while (d_.poll_cq(fdb_cqn_, SX_NAPI_WEIGHT) > 0)
+        ;
+    while (notify_.read(ev_, SX_FDB_NOTIFY_BATCH, true) > 0)
+        ;
+}
+
+bool fdb_bench::learn(uint16_t fid, uint32_t i, uint16_t port)
+{
+    uint8_t mac[6];
+    int err;
+
+    bench::make_mac(mac, i);
+    while ((err = asic_.fdb_learn(fid, mac, port)) == -ENOSPC)
+        pump();
+    return !err;
+}
+
+bool fdb_bench::age(uint16_t fid, uint32_t i)
+{
+    uint8_t mac[6];
+    int err;
+
+    bench::make_mac(mac, i);
+    while ((err = asic_.fdb_age(fid, mac)) == -ENOSPC)
+        pump();
+    return !err;
+}
+
+bool fdb_bench::fill()
+{
+    uint32_t ports = asic_.config().num_ports;
+    uint32_t learned = p_.entries - p_.nstatic, transient = learned / 8;
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> reads{0}, bad{0};
+    uint8_t mac[6];
+    bool ok = true;
+
+    /* Static entries; the odd ones are deleted again */
+    for (uint32_t i = 0; i < 2 * p_.nstatic && ok; i++) {
+        bench::make_mac(mac, i);
+        ok = !shadow_.add(e_, STATIC_FID, mac, i % ports);
+    }
+    for (uint32_t i = 1; i < 2 * p_.nstatic && ok; i += 2) {
+        bench::make_mac(mac, i);
+        ok = !shadow_.del(e_, STATIC_FID, mac);
+    }
+    if (!ok) {
+        fprintf(stderr, "static entries failed\n");
+        return false;
+    }
+
+    std::thread reader([&] {
+        uint8_t m[6];
+
+        for (uint32_t i = 0; !stop.load(std::memory_order_relaxed); i += 2) {
+            if (i >= 2 * p_.nstatic)
+                i = 0;
+            bench::make_mac(m, i);
+            if (shadow_.lookup(STATIC_FID, m) != static_cast<int>(i % ports))
+                bad.fetch_add(1, std::memory_order_relaxed);
+            if (!(reads.fetch_add(1, std::memory_order_relaxed) & 1023))
+                std::this_thread::yield();
+        }
+    });
+
+    uint64_t t0 = emu::asic::now_ns();
+    for (uint32_t i = 0; i < learned && ok; i++) {
+        ok = learn(FID, i, i % ports);
+        if (ok && !(i & 15))
+            ok = learn(FID, i, (i + 1) % ports);
+        if (ok && i < transient)
+            ok = learn(FID, learned + i, i % ports);
+        if (ok && i >= 64 && i - 64 < transient)
+            ok = age(FID, learned + i - 64);
+    }
+    for (uint32_t i = learned >= 64 ? learned - 64 : 0; i < transient && ok; i++)
+        ok = age(FID, learned + i);
+    pump();
+    uint64_t ns = emu::asic::now_ns() - t0;
+
+    stop = true;
+    reader.join();
+    printf("%u entries (%u static): filled in %.0f ms, %lu events, reader %lu lookups\n",
+           p_.entries, p_.nstatic, ns / 1e6, asic_.stats().trapped.load(), reads.load());
+    if (!ok || bad) {
+        fprintf(stderr, "learning failed or reader saw %lu wrong static entries\n", bad.load());
+        return false;
+    }
+    return true;
+}
+
+int fdb_bench::emad_lookup(const sx_fdb_rec &rec)
+{
+    emad_op op;
+
+    op.reg_id = SX_REG_ID_SFD;
+    op.payload.assign(sizeof(sx_sfd_reg) + sizeof(sx_sfd_rec), 0);
+
+    sx_sfd_reg *reg = reinterpret_cast<sx_sfd_reg *>(op.payload.data());
+    reg->op = SX_SFD_OP_LOOKUP;
+    reg->rec[0].fid = htobe16(rec.fid);
+    memcpy(reg->rec[0].mac, rec.mac, sizeof(rec.mac));
+    if (e_.access(op))
+        return -EIO;
+    return reg->num_rec ? be16toh(reg->rec[0].port) : -ENOENT;
+}
+
+/*
+ * One missing, one moved and one stale entry (added last: the shadow is
+ * full); check() must see just those.
+ */
+bool fdb_bench::plant()
+{
+    std::vector<sx_fdb_rec> all;
+    fdb_check_report r;
+    sx_fdb_rec rec = {};
+
+    shadow_.dump(&all);
+    rec = all[0];
+    rec.type = SX_FDB_EV_AGE;
+    shadow_.apply(rec);
+    rec = {};
+    rec.type = SX_FDB_EV_LEARN;
+    rec.fid = MISS_FID;
+    shadow_.apply(rec);
+    rec = all[1];
+    rec.type = SX_FDB_EV_MOVE;
+    rec.port = (rec.port + 1) % asic_.config().num_ports;
+    shadow_.apply(rec);
+
+    int err = shadow_.check(e_, &r);
+    printf("  %-24s stale %lu, missing %lu, mismatched %lu\n", "check, planted 1/1/1", r.stale,
+           r.missing, r.mismatched);
+    return err == -EUCLEAN && r.stale == 1 && r.missing == 1 && r.mismatched == 1;
+}
+
+bool fdb_bench::run()
+{
+    std::unordered_map<uint64_t, uint16_t> ref = asic_.fdb_dump();
+    std::vector<sx_fdb_rec> all, keys(p_.lookups);
+    std::mt19937_64 rng(p_.entries);
+    fdb_check_report r;
+    uint64_t sum = 0, sum_ref = 0;
+    int err;
+
+    /* The shadow must hold the ASIC's table exactly */
+    shadow_.dump(&all);
+    if (all.size() != p_.entries || ref.size() != p_.entries) {
+        fprintf(stderr, "shadow %zu, ASIC %zu entries, want %u\n", all.size(), ref.size(),
+                p_.entries);
+        return false;
+    }
+    for (const sx_fdb_rec &rec : all) {
+        auto it = ref.find(sx_fdb_key(rec.fid, rec.mac));
+
+        if (it == ref.end() || it->second != rec.port) {
+            fprintf(stderr, "shadow entry not in the ASIC\n");
+            return false;
+        }
+    }
+
+    for (sx_fdb_rec &k : keys) {
+        k = all[rng() % all.size()];
+        if (!(rng() & 7))
+            k.fid = MISS_FID;
+    }
+
+    uint64_t t0 = emu::asic::now_ns();
+    for (const sx_fdb_rec &k : keys)
+        sum += shadow_.lookup(k.fid, k.mac) + ENOENT;
+    uint64_t shadow_ns = emu::asic::now_ns() - t0;
+
+    t0 = emu::asic::now_ns();
+    for (const sx_fdb_rec &k : keys) {
+        auto it = ref.find(sx_fdb_key(k.fid, k.mac));
+
+        sum_ref += it == ref.end() ? 0 : it->second + ENOENT;
+    }
+    uint64_t ref_ns = emu::asic::now_ns() - t0;
+
+    uint32_t n = std::min(p_.emad_lookups, p_.lookups);
+    bool emad_ok = true;
+    t0 = emu::asic::now_ns();
+    for (uint32_t i = 0; i < n; i++)
+        emad_ok &= emad_lookup(keys[i]) == shadow_.lookup(keys[i].fid, keys[i].mac);
+    uint64_t emad_ns = emu::asic::now_ns() - t0;
+
+    t0 = emu::asic::now_ns();
+    shadow_.dump(&all);
+    uint64_t dump_ns = emu::asic::now_ns() - t0;
+
+    t0 = emu::asic::now_ns();
+    err = shadow_.check(e_, &r);
+    uint64_t check_ns = emu::asic::now_ns() - t0;
+
+    double emad_op_ns = n ? static_cast<double>(emad_ns) / n : 0;
+    printf("  %-24s %12.1f ns\n", "lookup, shadow", static_cast<double>(shadow_ns) / p_.lookups);
+    printf("  %-24s %12.1f ns\n", "lookup, unordered_map", static_cast<double>(ref_ns) / p_.lookups);
+    printf("  %-24s %12.1f ns (%u queries)\n", "lookup, EMAD SFD", emad_op_ns, n);
+    printf("  %-24s %12.2f ms\n", "dump, shadow", dump_ns / 1e6);
+    printf("  %-24s %12.2f ms (%lu queries, check)\n", "dump, EMAD SFD dump", check_ns / 1e6,
+           r.accesses);
+    printf("  %-24s %12.2f ms (estimated)\n", "dump, EMAD per entry", emad_op_ns * p_.entries / 1e6);
+
+    if (sum != sum_ref || !emad_ok) {
+        fprintf(stderr, "shadow lookups differ from the ASIC\n");
+        return false;
+    }
+    if (err || r.asic_entries != p_.entries) {
+        fprintf(stderr, "check: %d, %lu ASIC entries, %lu missing, %lu stale, %lu mismatched\n",
+                err, r.asic_entries, r.missing, r.stale, r.mismatched);
+        return false;
+    }
+    if (!plant()) {
+        fprintf(stderr, "check missed planted differences\n");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    static const uint32_t sizes[] = { 1u << 16, 1u << 18, 1u << 20 };
+    params p;
+    uint32_t only = bench::arg(argc, argv, "entries", 0);
+
+    p.nstatic = bench::arg(argc, argv, "static", 1000);
+    p.lookups = bench::arg(argc, argv, "lookups", 4000000);
+    p.emad_lookups = bench::arg(argc, argv, "emad-lookups", 2000);
+    p.latency_ns = bench::arg(argc, argv, "latency-ns", 20000);
+
+    if (!p.lookups || (only && only < 2 * p.nstatic + 2) || only > (1u << 24)) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    printf("static=%u lookups=%u emad-lookups=%u latency=%uns\n", p.nstatic, p.lookups,
+           p.emad_lookups, p.latency_ns);
+    for (uint32_t entries : sizes) {
+        if (only && entries != sizes[0])
+            break;
+        p.entries = only ? only : entries;
+
+        fdb_bench b(p);
+        int err = b.setup();
+
+        if (err) {
+            fprintf(stderr, "setup failed: %d\n", err);
+            return 1;
+        }
+        if (!b.fill() || !b.run())
+            return 1;
+    }
+    return 0;
+}
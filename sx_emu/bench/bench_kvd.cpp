@@ -0,0 +1,215 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * Long-running KVD churn, without and with defragmentation. Objects of 1
+ * to 512 entries (next hops, ECMP groups, large tables) are allocated and
+ * freed at random for --ops operations, holding a --size entry partition
+ * about --occupancy percent full. With defragmentation, every --every
+ * operations the owner's periodic work runs defrag() for up to --moves
+ * relocations.
+ *
+ * Each object writes its tag into a copy of the KVD; the move callback
+ * checks the old copy, writes the new one, and only then repoints the
+ * object, as a driver would rewrite hardware entries. After every defrag
+ * step every object must still find its tag at its index.
+ *
+ * Reported are allocation failures per size class, those that failed
+ * despite enough free entries, moves and fragmentation at the end.
+ *
+ *   bench_kvd [--size=ENTRIES] [--ops=N] [--occupancy=PCT] [--every=N] [--moves=N]
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "bench.h"
+#include "sx/kvd.h"
+
+using namespace sx;
+
+struct params {
+    uint32_t size, occupancy, every, moves;
+    uint64_t ops;
+};
+
+struct object {
+    uint32_t index;
+    uint32_t size;
+};
+
+/* Size class weights, per mille, for orders 0..SX_KVD_MAX_ORDER */
+static const unsigned class_weight[SX_KVD_ORDERS] = { 500, 120, 120, 100, 70, 40, 30, 12, 5, 3 };
+
+static uint32_t pick_size(std::mt19937_64 &rng, unsigned *order)
+{
+    unsigned w = rng() % 1000, o = 0;
+
+    while (o < SX_KVD_MAX_ORDER && w >= class_weight[o])
+        w -= class_weight[o++];
+    *order = o;
+    /* Anywhere in the class: an 11-way ECMP group takes a 16 block */
+    return o ? (1u << (o - 1)) + 1 + rng() % (1u << (o - 1)) : 1;
+}
+
+class churn {
+public:
+    churn(const params &p, bool defrag)
+        : p_(p), defrag_(defrag), mem_(p.size, 0),
+          kvd_(0, p.size, [this](uint64_t h, uint32_t from, uint32_t to, uint32_t size) {
+              return move(h, from, to, size);
+          })
+    {
+    }
+
+    bool run();
+
+private:
+    int move(uint64_t h, uint32_t from, uint32_t to, uint32_t size);
+    bool check();
+
+    const params          &p_;
+    bool                   defrag_;
+    std::vector<uint32_t>  mem_;        /* tag (object + 1) per entry */
+    std::vector<object>    objs_;
+    std::vector<uint32_t>  live_;
+    std::vector<uint32_t>  free_ids_;
+    kvd_alloc              kvd_;
+    uint64_t               bad_moves_ = 0;
+};
+
+int churn::move(uint64_t h, uint32_t from, uint32_t to, uint32_t size)
+{
+    object &o = objs_[h];
+
+    if (o.index != from) {
+        bad_moves_++;
+        return -EINVAL;
+    }
+    /* Make before break: new copy first, then repoint, then the old one goes */
+    for (uint32_t i = 0; i < size; i++) {
+        if (mem_[from + i] != h + 1)
+            bad_moves_++;
+        mem_[to + i] = h + 1;
+    }
+    o.index = to;
+    for (uint32_t i = 0; i < size; i++)
+        mem_[from + i] = 0;
+    return 0;
+}
+
+bool churn::check()
+{
+    for (uint32_t id : live_) {
+        const object &o = objs_[id];
+
+        for (uint32_t i = 0; i < o.size; i++) {
+            if (mem_[o.index + i] != id + 1)
+                return false;
+        }
+    }
+    return !bad_moves_;
+}
+
+bool churn::run()
+{
+    std::mt19937_64 rng(7);
+    uint64_t tries[SX_KVD_ORDERS] = {}, fails[SX_KVD_ORDERS] = {};
+    uint64_t target = static_cast<uint64_t>(p_.size) * p_.occupancy / 100;
+    kvd_stats s;
+
+    uint64_t t0 = emu::asic::now_ns();
+    for (uint64_t op = 0; op < p_.ops; op++) {
+        kvd_.get_stats(&s);
+        if (s.allocated < target || live_.empty()) {
+            unsigned order;
+            uint32_t size = pick_size(rng, &order), id, index;
+
+            if (free_ids_.empty()) {
+                free_ids_.push_back(objs_.size());
+                objs_.push_back({});
+            }
+            id = free_ids_.back();
+            tries[order]++;
+            if (kvd_.alloc(size, id, &index)) {
+                fails[order]++;
+            } else {
+                free_ids_.pop_back();
+                objs_[id] = { index, size };
+                live_.push_back(id);
+                for (uint32_t i = 0; i < size; i++)
+                    mem_[index + i] = id + 1;
+            }
+        } else {
+            uint32_t pos = rng() % live_.size(), id = live_[pos];
+            object &o = objs_[id];
+
+            for (uint32_t i = 0; i < o.size; i++)
+                mem_[o.index + i] = 0;
+            kvd_.free(o.index);
+            live_[pos] = live_.back();
+            live_.pop_back();
+            free_ids_.push_back(id);
+        }
+
+        if (defrag_ && op % p_.every == p_.every - 1) {
+            kvd_.defrag(p_.moves);
+            if (!check()) {
+                fprintf(stderr, "object lost its entries in a move\n");
+                return false;
+            }
+        }
+    }
+    uint64_t ns = emu::asic::now_ns() - t0;
+
+    kvd_.get_stats(&s);
+    uint64_t all = 0, failed = 0;
+    for (unsigned o = 0; o < SX_KVD_ORDERS; o++) {
+        all += tries[o];
+        failed += fails[o];
+    }
+    printf("%-10s %9lu %8lu %7.3f%% %10lu %9lu %6.1f%% %6.1f%% %8lu %8.0f ms\n",
+           defrag_ ? "defrag" : "none", all, failed, 100.0 * failed / all, s.failed_fragmented,
+           s.moves, 100.0 * s.allocated / s.capacity, kvd_unusable_pct(s, SX_KVD_MAX_ORDER),
+           s.largest_free, ns / 1e6);
+    printf("%-10s", "  fail%");
+    for (unsigned o = 0; o < SX_KVD_ORDERS; o++)
+        printf(" %3u:%6.2f", 1u << o, tries[o] ? 100.0 * fails[o] / tries[o] : 0);
+    printf("\n");
+
+    if (!check() || s.allocs - s.frees != live_.size()) {
+        fprintf(stderr, "objects and allocator disagree\n");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    params p;
+
+    p.size = bench::arg(argc, argv, "size", 1u << 18);
+    p.ops = bench::arg(argc, argv, "ops", 1000000);
+    p.occupancy = bench::arg(argc, argv, "occupancy", 95);
+    p.every = bench::arg(argc, argv, "every", 1000);
+    p.moves = bench::arg(argc, argv, "moves", 64);
+
+    if (p.size < SX_KVD_CHUNK || p.size % SX_KVD_CHUNK || !p.occupancy || p.occupancy >= 100 ||
+        !p.every || !p.ops) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    printf("size=%u ops=%lu occupancy=%u%% every=%u moves=%u\n", p.size, p.ops, p.occupancy,
+           p.every, p.moves);
+    printf("%-10s %9s %8s %8s %10s %9s %7s %7s %8s %11s\n", "mode", "allocs", "failed", "rate",
+           "fragmented", "moves", "held", "unusbl", "largest", "time");
+    for (bool defrag : { false, true }) {
+        churn c(p, defrag);
+
+        if (!c.run())
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,189 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * Cost and output of per-packet latency tracing.
+ *
+ * Cost: a trap backlog is drained by NAPI polls into a listener, in rounds
+ * alternating tracing off and on. The best round of each gives the trap
+ * path's cycles/packet; their difference is the tracing cost, which must
+ * stay under --max-ns. Every traced packet must be in the histograms.
+ *
+ * Output: traps are paced through live interrupts to a cdev_file read by a
+ * user thread, and the debugfs dump of the resulting histograms is shown.
+ *
+ *   bench_lat_trace [--packets=N] [--rounds=N] [--backlog=N] [--max-ns=NS]
+ *                   [--paced=N] [--rate=PPS]
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <sys/prctl.h>
+#include <thread>
+
+#include "bench.h"
+#include "sx/cdev.h"
+#include "sx/dev.h"
+
+using namespace sx;
+
+#define RDQ         0
+#define GROUP       1
+#define TRAP        SX_TRAP_ID_IPV4_BGP
+#define LOG_SIZE    10
+
+static int setup(emu::asic &asic, dev &d)
+{
+    unsigned cqn = asic.config().num_sdq + RDQ;
+    int err;
+
+    err = d.init();
+    if (!err)
+        err = d.create_cq(cqn, LOG_SIZE);
+    if (!err)
+        err = d.create_rdq(RDQ, LOG_SIZE, cqn, 2048);
+    if (!err)
+        err = d.set_trap_group_rdq(GROUP, RDQ);
+    if (!err)
+        err = d.set_trap_group(TRAP, GROUP);
+    return err;
+}
+
+/* Returns false if tracing costs too much or loses packets */
+static bool cost(uint64_t packets, unsigned rounds, uint32_t backlog, uint64_t max_ns)
+{
+    emu::asic asic;
+    dev d(asic);
+    unsigned cqn = asic.config().num_sdq + RDQ;
+    uint64_t best[2] = { UINT64_MAX, UINT64_MAX }, traced = 0, total = 0, received = 0;
+    uint8_t frame[128];
+    int err = setup(asic, d);
+
+    if (!err)
+        err = d.add_listener(TRAP, [&](const rx_info &, pkt_buf *buf) {
+            received++;
+            pkt_buf_free(buf);
+        });
+    if (err) {
+        fprintf(stderr, "setup failed: %d\n", err);
+        return false;
+    }
+    bench::fill_frame(frame, sizeof(frame), 0x0800, 1);
+
+    for (unsigned r = 0; r < 2 * rounds; r++) {
+        bool on = r & 1;
+        uint64_t cyc = 0, done = 0;
+
+        d.set_latency_trace(TRAP, on);
+        while (done < packets) {
+            for (uint32_t i = 0; i < backlog; i++)
+                asic.inject(TRAP, i % 32, frame, sizeof(frame));
+
+            uint64_t c = bench::cycles();
+            int n;
+            do {
+                n = d.poll_cq(cqn, SX_NAPI_WEIGHT);
+                done += n;
+            } while (n == SX_NAPI_WEIGHT);
+            cyc += bench::cycles() - c;
+        }
+        best[on] = std::min(best[on], cyc * 1000 / done);
+        total += done;
+        if (on)
+            traced += done;
+    }
+
+    double off = best[0] / 1e3, on = best[1] / 1e3;
+    double ns = (on - off) / bench::cycles_per_ns();
+    lat_hist h;
+
+    printf("%-24s %10.1f cycles/pkt\n", "tracing off", off);
+    printf("%-24s %10.1f cycles/pkt\n", "tracing on", on);
+    printf("%-24s %10.1f ns/pkt (limit %lu)\n", "tracing cost", ns, max_ns);
+
+    d.get_latency_hist(TRAP, SX_LAT_DRIVER, &h);
+    if (h.count != traced || received != total) {
+        fprintf(stderr, "traced %lu of %lu, received %lu of %lu packets\n", h.count, traced,
+                received, total);
+        return false;
+    }
+    if (ns > max_ns) {
+        fprintf(stderr, "tracing costs %.1f ns/pkt\n", ns);
+        return false;
+    }
+    return true;
+}
+
+/* Returns false if a stage misses packets */
+static bool live(uint64_t packets, uint64_t rate)
+{
+    emu::asic asic;
+    dev d(asic);
+    cdev_file file(d);
+    uint8_t frame[128], rbuf[256];
+    int err = setup(asic, d);
+
+    if (!err)
+        err = file.add_trap(TRAP);
+    if (!err)
+        err = d.set_latency_trace(TRAP, true);
+    if (err) {
+        fprintf(stderr, "setup failed: %d\n", err);
+        return false;
+    }
+    asic.set_irq_handler([&d](unsigned vector) { d.irq(vector); });
+    bench::fill_frame(frame, sizeof(frame), 0x0800, 2);
+
+    std::thread reader([&] {
+        for (uint64_t i = 0; i < packets; i++)
+            file.read(rbuf, sizeof(rbuf));
+    });
+
+    uint64_t t0 = emu::asic::now_ns();
+    for (uint64_t i = 0; i < packets; i++) {
+        uint64_t due = t0 + (i + 1) * 1000000000ull / rate;
+        struct timespec ts = { static_cast<time_t>(due / 1000000000ull),
+                               static_cast<long>(due % 1000000000ull) };
+
+        asic.inject(TRAP, i % 32, frame, sizeof(frame));
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+    }
+    reader.join();
+    asic.set_irq_handler(nullptr);
+
+    printf("\n%lu packets at %lu pps, interrupts, cdev read():\n%s", packets, rate,
+           d.latency_debugfs().c_str());
+    for (unsigned stage = 0; stage < SX_LAT_STAGES; stage++) {
+        lat_hist h;
+
+        d.get_latency_hist(TRAP, stage, &h);
+        if (h.count != packets) {
+            fprintf(stderr, "stage %u: %lu of %lu packets\n", stage, h.count, packets);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t packets = bench::arg(argc, argv, "packets", 1000000);
+    unsigned rounds = bench::arg(argc, argv, "rounds", 5);
+    uint32_t backlog = bench::arg(argc, argv, "backlog", 512);
+    uint64_t max_ns = bench::arg(argc, argv, "max-ns", 50);
+    uint64_t paced = bench::arg(argc, argv, "paced", 20000);
+    uint64_t rate = bench::arg(argc, argv, "rate", 20000);
+
+    if (!packets || !rounds || !backlog || backlog > (1u << LOG_SIZE) || !paced || !rate) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    /* Pace at the requested rate rather than the default timer slack */
+    prctl(PR_SET_TIMERSLACK, 1UL);
+
+    printf("packets=%lu rounds=%u backlog=%u\n", packets, rounds, backlog);
+    if (!cost(packets, rounds, backlog, max_ns) || !live(paced, rate))
+        return 1;
+    return 0;
+}
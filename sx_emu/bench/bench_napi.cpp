@@ -0,0 +1,108 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * Budgeted batch polling of the trap path: packets/sec, CPU cycles/packet
+ * and doorbells/packet when a poll reaps 1, 8, 32 and 64 completions.
+ *
+ * A backlog of mixed LACP/LLDP/ARP/BGP traps is queued by the model, then
+ * drained by NAPI polls with the trap group budget as the batch size.
+ *
+ * Doorbells are charged --mmio-ns of CPU time each, the cost of an uncached
+ * write to the device BAR.
+ *
+ *   bench_napi [--packets=N] [--backlog=N] [--size=BYTES] [--mmio-ns=NS]
+ */
+
+#include <cstdio>
+
+#include "bench.h"
+#include "sx/dev.h"
+
+using namespace sx;
+
+#define RDQ         0
+#define GROUP       2
+#define LOG_SIZE    10
+
+static const uint16_t traps[] = {
+    SX_TRAP_ID_ETH_L2_LACP, SX_TRAP_ID_ETH_L2_LLDP,
+    SX_TRAP_ID_ARP_REQUEST, SX_TRAP_ID_IPV4_BGP,
+};
+
+int main(int argc, char **argv)
+{
+    static const unsigned batches[] = { 1, 8, 32, 64 };
+    uint64_t packets = bench::arg(argc, argv, "packets", 2000000);
+    uint32_t backlog = bench::arg(argc, argv, "backlog", 512);
+    uint32_t size = bench::arg(argc, argv, "size", 128);
+    emu::asic_config cfg;
+    cfg.mmio_delay_ns = bench::arg(argc, argv, "mmio-ns", 100);
+    emu::asic asic(cfg);
+    dev d(asic);
+    uint8_t frame[2048];
+    uint64_t received = 0;
+    int err;
+
+    if (!backlog || backlog > (1u << LOG_SIZE) || size < 64 || size > sizeof(frame)) {
+        fprintf(stderr, "invalid backlog or size\n");
+        return 1;
+    }
+
+    unsigned cqn = asic.config().num_sdq + RDQ;
+    err = d.init();
+    if (!err)
+        err = d.create_cq(cqn, LOG_SIZE);
+    if (!err)
+        err = d.create_rdq(RDQ, LOG_SIZE, cqn, 2048);
+    if (!err)
+        err = d.set_trap_group_rdq(GROUP, RDQ);
+    for (uint16_t trap : traps) {
+        if (!err)
+            err = d.set_trap_group(trap, GROUP);
+        if (!err)
+            err = d.add_listener(trap, [&](const rx_info &, pkt_buf *buf) {
+                received++;
+                pkt_buf_free(buf);
+            });
+    }
+    if (err) {
+        fprintf(stderr, "setup failed: %d\n", err);
+        return 1;
+    }
+
+    bench::fill_frame(frame, size, 0x0800, 7);
+    printf("packets=%lu backlog=%u size=%u mmio=%uns\n", packets, backlog, size, cfg.mmio_delay_ns);
+    printf("%-8s %10s %12s %12s %12s\n", "batch", "Mpps", "cycles/pkt", "doorbell/pkt", "polls/pkt");
+
+    for (unsigned batch : batches) {
+        uint64_t cyc = 0, polls = 0, done = 0;
+        uint64_t db0 = asic.stats().doorbells.load();
+
+        d.set_trap_group_budget(GROUP, batch);
+        received = 0;
+        while (done < packets) {
+            for (uint32_t i = 0; i < backlog; i++)
+                asic.inject(traps[i & 3], i % 32, frame, size);
+
+            uint64_t c = bench::cycles();
+            int n;
+            do {
+                n = d.poll_cq(cqn, batch);
+                done += n;
+                polls++;
+            } while (n == static_cast<int>(batch));
+            cyc += bench::cycles() - c;
+        }
+
+        double ns = cyc / bench::cycles_per_ns();
+        printf("%-8u %10.3f %12.1f %12.3f %12.3f\n", batch, done * 1e3 / ns,
+               static_cast<double>(cyc) / done,
+               static_cast<double>(asic.stats().doorbells.load() - db0) / done,
+               static_cast<double>(polls) / done);
+        if (received != done) {
+            fprintf(stderr, "lost packets: reaped %lu delivered %lu\n", done, received);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,293 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * Host-terminated TCP through the port netdevs: --flows bulk flows, spread
+ * over --ports front-panel ports, trapped as IP2ME and received by the
+ * port_netdevs on 1 or --queues RDQs, each with its own CQ and threaded
+ * NAPI context. Interrupts are live.
+ *
+ * The sender writes --burst segments of --mss bytes per flow at a time, a
+ * TSO send's worth with PSH on the last, with TCP timestamps as Linux
+ * sends them. The netdev handler stands in for the stack: it spends
+ * --stack-ns per skb, then reads the payload as a copy to user space
+ * would and checks it against the byte stream, the sequence numbers, and
+ * for merged skbs the IP length and checksum GRO rewrote.
+ *
+ * Runs: GRO off on one queue (one skb per segment), GRO on one queue, GRO
+ * on --queues queues. Reported are goodput, segments per skb and the rate
+ * the busiest NAPI thread's CPU time allows, which shows the scaling even
+ * on a host with fewer CPUs than queues.
+ *
+ *   bench_netdev [--segments=N] [--flows=N] [--ports=N] [--queues=N]
+ *                [--burst=N] [--mss=BYTES] [--stack-ns=NS]
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <endian.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "sx/netdev.h"
+
+using namespace sx;
+
+#define GROUP       1
+#define TRAP        SX_TRAP_ID_IP2ME
+#define LOG_SIZE    10
+#define BUF_SIZE    2048
+#define POOL_BUFS   4096
+#define HDR_LEN     (14 + 20 + 32)      /* TCP with the timestamp option */
+#define PATTERN     4096
+
+struct SX_CACHELINE_ALIGNED queue_state {
+    uint64_t cpu_ns = 0;                /* of the NAPI thread, so far */
+};
+
+/* Written by the NAPI thread of the flow's queue only */
+struct flow_state {
+    uint32_t next_seq = 0;
+    int      queue = -1;
+};
+
+struct run_state {
+    std::vector<flow_state>  flows;
+    std::vector<queue_state> queues;
+    uint8_t                  pattern[PATTERN];
+    uint64_t                 stack_ns = 0;
+    std::atomic<uint64_t>    segs{0}, skbs{0}, bytes{0}, bad{0};
+};
+
+static uint16_t get16(const uint8_t *p)
+{
+    uint16_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return be16toh(v);
+}
+
+static void put16(uint8_t *p, uint16_t v)
+{
+    v = htobe16(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    v = htobe32(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+/* Ones' complement sum of the IP header; 0 if its checksum is right */
+static uint16_t ip_fold(const uint8_t *ip)
+{
+    uint32_t sum = 0;
+
+    for (unsigned i = 0; i < 20; i += 2)
+        sum += get16(ip + i);
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return static_cast<uint16_t>(~sum);
+}
+
+/* Segment of @flow at @seq with @len bytes of the stream; returns the frame length */
+static uint32_t make_segment(uint8_t *buf, const uint8_t *pattern, uint32_t flow, uint32_t seq,
+                             uint32_t len, uint32_t tsval, bool psh)
+{
+    uint8_t *ip = buf + 14, *tcp = ip + 20;
+
+    memset(buf, 0, HDR_LEN);
+    buf[0] = 0x02; buf[5] = 0x01;
+    buf[6] = 0x02; buf[11] = 0x02;
+    put16(buf + 12, 0x0800);
+
+    ip[0] = 0x45;
+    put16(ip + 2, 20 + 32 + len);
+    put16(ip + 6, 0x4000);                  /* DF */
+    ip[8] = 64;
+    ip[9] = 6;
+    ip[12] = 10; ip[13] = 0; ip[14] = flow >> 8; ip[15] = flow & 0xff;
+    ip[16] = 10; ip[17] = 1; ip[18] = 0; ip[19] = 1;
+    put16(ip + 10, ip_fold(ip));
+
+    put16(tcp + 0, 1024 + flow);
+    put16(tcp + 2, 179);
+    put32(tcp + 4, seq);
+    put32(tcp + 8, 1);
+    tcp[12] = 8 << 4;
+    tcp[13] = psh ? 0x18 : 0x10;
+    put16(tcp + 14, 0xffff);
+    tcp[20] = 1; tcp[21] = 1;               /* NOP, NOP, timestamps */
+    tcp[22] = 8; tcp[23] = 10;
+    put32(tcp + 24, tsval);
+    put32(tcp + 28, 1);
+
+    memcpy(buf + HDR_LEN, pattern + (seq & 255), len);
+    return HDR_LEN + len;
+}
+
+/* The stack's share: per-skb cost, then the payload read out in order */
+static void stack_rx(run_state &rs, netdev_skb *skb)
+{
+    const uint8_t *ip = skb->head->data + 14, *tcp = ip + 20;
+    uint32_t flow = get16(tcp) - 1024, seq, off, payload = 0;
+    bool ok = flow < rs.flows.size();
+
+    bench::spin_ns(rs.stack_ns);
+    if (ok) {
+        flow_state &fs = rs.flows[flow];
+
+        memcpy(&seq, tcp + 4, sizeof(seq));
+        seq = be32toh(seq);
+        if (fs.queue < 0)
+            fs.queue = skb->queue;
+        ok = fs.queue == skb->queue && seq == fs.next_seq && skb->head_len > HDR_LEN &&
+             get16(ip + 2) == skb->len - 14 && !ip_fold(ip) &&
+             (skb->gso_segs == 1) == (skb->nr_frags == 0);
+
+        off = skb->head_len - HDR_LEN;
+        ok = ok && !memcmp(skb->head->data + HDR_LEN, rs.pattern + (seq & 255), off);
+        payload = off;
+        for (unsigned i = 0; ok && i < skb->nr_frags; i++) {
+            const netdev_frag &f = skb->frags[i];
+
+            ok = !memcmp(f.buf->data + f.off, rs.pattern + ((seq + payload) & 255), f.len);
+            payload += f.len;
+        }
+        fs.next_seq = seq + payload;
+    }
+    if (!ok)
+        rs.bad.fetch_add(1, std::memory_order_relaxed);
+
+    rs.queues[skb->queue].cpu_ns = thread_cpu_ns();
+    rs.bytes.fetch_add(payload, std::memory_order_relaxed);
+    rs.skbs.fetch_add(1, std::memory_order_relaxed);
+    rs.segs.fetch_add(skb->gso_segs, std::memory_order_release);
+    netdev_skb_free(skb);
+}
+
+static bool run(const char *name, unsigned queues, bool gro, uint64_t segments, uint32_t flows,
+                unsigned ports, unsigned burst, uint32_t mss, uint64_t stack_ns)
+{
+    emu::asic asic;
+    dev d(asic);
+    run_state rs;
+    unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+    unsigned sdqs = asic.config().num_sdq;
+    std::vector<uint32_t> seq(flows);
+    uint8_t frame[BUF_SIZE];
+    int err = d.init();
+
+    rs.flows.resize(flows);
+    rs.queues.resize(queues);
+    rs.stack_ns = stack_ns;
+    for (unsigned i = 0; i < PATTERN; i++)
+        rs.pattern[i] = static_cast<uint8_t>(i);
+
+    std::unique_ptr<port_netdevs> nd = std::make_unique<port_netdevs>(d);
+    nd->set_gro(gro);
+    for (unsigned p = 0; p < ports && !err; p++) {
+        err = nd->register_netdev(p, "swp" + std::to_string(p + 1),
+                                  [&rs](netdev_skb *skb) { stack_rx(rs, skb); });
+    }
+    for (unsigned q = 0; q < queues && !err; q++) {
+        err = nd->add_rx_queue(q, BUF_SIZE, POOL_BUFS);
+        if (!err)
+            err = d.create_cq(sdqs + q, LOG_SIZE);
+        if (!err)
+            err = d.create_rdq(q, LOG_SIZE, sdqs + q, BUF_SIZE);
+        if (!err)
+            err = d.set_napi_thread(sdqs + q, q % cpus);
+    }
+    if (!err)
+        err = d.set_trap_group_rdqs(GROUP, 0, queues);
+    if (!err)
+        err = d.set_trap_group(TRAP, GROUP);
+    if (err) {
+        fprintf(stderr, "setup failed: %d\n", err);
+        return false;
+    }
+    asic.set_irq_handler([&d](unsigned vector) { d.irq(vector); });
+
+    uint64_t t0 = emu::asic::now_ns();
+    for (uint64_t i = 0; i < segments; ) {
+        uint32_t f = (i / burst) % flows;
+
+        for (unsigned b = 0; b < burst && i < segments; b++, i++) {
+            uint32_t len = make_segment(frame, rs.pattern, f, seq[f], mss, i / burst,
+                                        b == burst - 1);
+
+            seq[f] += mss;
+            while (asic.inject(TRAP, f % ports, frame, len) == -ENOSPC)
+                std::this_thread::yield();
+        }
+    }
+    while (rs.segs.load(std::memory_order_acquire) < segments)
+        std::this_thread::yield();
+    uint64_t ns = emu::asic::now_ns() - t0;
+
+    uint64_t busiest = 0;
+    for (const queue_state &q : rs.queues)
+        busiest = std::max(busiest, q.cpu_ns);
+
+    netdev_stats sum = {};
+    for (unsigned p = 0; p < ports; p++) {
+        netdev_stats st;
+
+        nd->get_stats(p, &st);
+        stats_add(&sum, st);
+    }
+
+    uint64_t bytes = rs.bytes.load(), skbs = rs.skbs.load();
+    printf("%-22s %8.2f Gbit/s %6.1f segs/skb %8.2f Gbit/s busiest-queue bound\n", name,
+           bytes * 8.0 / ns, static_cast<double>(segments) / skbs,
+           busiest ? bytes * 8.0 / busiest : 0.0);
+
+    /* Interrupts off and the RDQs gone before their consumers */
+    asic.set_irq_handler(nullptr);
+    d.destroy_queues();
+    nd.reset();
+
+    if (rs.bad) {
+        fprintf(stderr, "%s: %lu skbs corrupt, out of order or on the wrong queue\n", name,
+                rs.bad.load());
+        return false;
+    }
+    if (sum.rx_packets != segments || sum.rx_skbs != skbs ||
+        sum.gro_merged != segments - skbs || bytes != segments * mss) {
+        fprintf(stderr, "%s: netdev counters disagree: %lu packets %lu skbs %lu merged\n",
+                name, sum.rx_packets, sum.rx_skbs, sum.gro_merged);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t segments = bench::arg(argc, argv, "segments", 200000);
+    uint32_t flows = bench::arg(argc, argv, "flows", 32);
+    unsigned ports = bench::arg(argc, argv, "ports", 8);
+    unsigned queues = bench::arg(argc, argv, "queues", 4);
+    unsigned burst = bench::arg(argc, argv, "burst", 16);
+    uint32_t mss = bench::arg(argc, argv, "mss", 1448);
+    uint64_t stack_ns = bench::arg(argc, argv, "stack-ns", 2000);
+    char name[32];
+
+    if (!flows || flows > 60000 || !ports || ports > SX_MAX_PORTS || !queues ||
+        queues > SX_MAX_RDQ || !burst || !mss || HDR_LEN + mss > BUF_SIZE) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    printf("segments=%lu flows=%u ports=%u burst=%u mss=%u stack=%lu ns, %u CPUs\n", segments,
+           flows, ports, burst, mss, stack_ns, std::thread::hardware_concurrency());
+    snprintf(name, sizeof(name), "gro, %u queues", queues);
+    if (!run("no gro, 1 queue", 1, false, segments, flows, ports, burst, mss, stack_ns) ||
+        !run("gro, 1 queue", 1, true, segments, flows, ports, burst, mss, stack_ns) ||
+        !run(name, queues, true, segments, flows, ports, burst, mss, stack_ns))
+        return 1;
+    return 0;
+}
@@ -0,0 +1,204 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * RDQ receive buffers allocated per packet against a page pool, with the
+ * listener freeing each buffer inside the poll ("inline", recycled through
+ * the pool cache) and handing it to another thread that frees it later
+ * ("deferred", as a socket queue would; recycled through the pool ring).
+ *
+ * A backlog of traps is queued by the model and drained by NAPI polls.
+ * Reported are the rate, CPU cycles per packet and allocator calls per
+ * second: one per packet without a pool, the pool's fallbacks with one.
+ * Every packet must arrive intact and in order.
+ *
+ *   bench_page_pool [--packets=N] [--backlog=N] [--size=BYTES] [--buf-size=BYTES]
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "sx/dev.h"
+
+using namespace sx;
+
+#define RDQ         0
+#define GROUP       2
+#define TRAP        SX_TRAP_ID_ETH_L2_LLDP
+#define LOG_SIZE    10
+
+/* Frees buffers on its own thread, in the order they were queued */
+class deferred_free {
+public:
+    deferred_free() : thread_([this] { run(); }) {}
+
+    ~deferred_free()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            stop_ = true;
+        }
+        wq_.notify_one();
+        thread_.join();
+    }
+
+    void queue(pkt_buf *buf)
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+
+        bufs_.push_back(buf);
+        if (bufs_.size() == 64)
+            wq_.notify_one();
+    }
+
+    void drain()
+    {
+        std::unique_lock<std::mutex> guard(lock_);
+
+        wq_.notify_one();
+        idle_.wait(guard, [this] { return bufs_.empty() && !busy_; });
+    }
+
+private:
+    void run()
+    {
+        std::vector<pkt_buf *> batch;
+        std::unique_lock<std::mutex> guard(lock_);
+
+        for (;;) {
+            wq_.wait(guard, [this] { return stop_ || !bufs_.empty(); });
+            if (bufs_.empty())
+                return;
+            batch.swap(bufs_);
+            busy_ = true;
+            guard.unlock();
+            for (pkt_buf *buf : batch)
+                pkt_buf_free(buf);
+            batch.clear();
+            guard.lock();
+            busy_ = false;
+            idle_.notify_all();
+        }
+    }
+
+    std::mutex              lock_;
+    std::condition_variable wq_, idle_;
+    std::vector<pkt_buf *>  bufs_;
+    bool                    busy_ = false;
+    bool                    stop_ = false;
+    std::thread             thread_;
+};
+
+/* Returns false on a lost, corrupted or reordered packet */
+static bool run(bool pool, bool deferred, uint64_t packets, uint32_t backlog, uint32_t size,
+                uint32_t buf_size)
+{
+    emu::asic asic;
+    dev d(asic);
+    deferred_free df;
+    uint8_t frame[2048], ref[2048];
+    uint64_t received = 0, bad = 0, done = 0, cyc = 0;
+    unsigned cqn = asic.config().num_sdq + RDQ;
+    int err;
+
+    err = d.init();
+    if (!err)
+        err = d.create_cq(cqn, LOG_SIZE);
+    if (!err)
+        err = d.create_rdq(RDQ, LOG_SIZE, cqn, buf_size, pool ? SX_RDQ_POOL_AUTO : 0);
+    if (!err)
+        err = d.set_trap_group_rdq(GROUP, RDQ);
+    if (!err)
+        err = d.set_trap_group(TRAP, GROUP);
+    if (!err) {
+        bench::fill_frame(ref, size, 0x88cc, 3);
+        err = d.add_listener(TRAP, [&](const rx_info &, pkt_buf *buf) {
+            uint64_t seq;
+
+            memcpy(&seq, buf->data + 14, sizeof(seq));
+            if (buf->len != size || seq != received ||
+                memcmp(buf->data + 22, ref + 22, size - 22))
+                bad++;
+            received++;
+            if (deferred)
+                df.queue(buf);
+            else
+                pkt_buf_free(buf);
+        });
+    }
+    if (err) {
+        fprintf(stderr, "setup failed: %d\n", err);
+        return false;
+    }
+
+    memcpy(frame, ref, size);
+    uint64_t t0 = emu::asic::now_ns();
+    while (done < packets) {
+        for (uint32_t i = 0; i < backlog; i++) {
+            uint64_t seq = done + i;
+
+            memcpy(frame + 14, &seq, sizeof(seq));
+            asic.inject(TRAP, i % 32, frame, size);
+        }
+
+        uint64_t c = bench::cycles();
+        int n;
+        do {
+            n = d.poll_cq(cqn, SX_NAPI_WEIGHT);
+            done += n;
+        } while (n == SX_NAPI_WEIGHT);
+        cyc += bench::cycles() - c;
+    }
+    df.drain();
+    uint64_t ns = emu::asic::now_ns() - t0;
+
+    page_pool_stats ps = {};
+    uint64_t allocs = done;
+    char name[64];
+
+    if (pool) {
+        d.get_rdq_pool_stats(RDQ, &ps);
+        allocs = ps.alloc_fallback;
+    }
+    snprintf(name, sizeof(name), "%s, %s free", pool ? "page pool" : "per-packet alloc",
+             deferred ? "deferred" : "inline");
+    printf("%-32s %8.3f Mpps %8.1f cycles/pkt %12.0f allocs/s", name, done * 1e3 / ns,
+           static_cast<double>(cyc) / done, allocs * 1e9 / ns);
+    if (pool)
+        printf("  (fast %lu slow %lu cached %lu ring %lu)", ps.alloc_fast, ps.alloc_slow,
+               ps.recycle_cached, ps.recycle_ring);
+    printf("\n");
+
+    d.destroy_queues();
+    if (bad || received != done) {
+        fprintf(stderr, "%s: %lu bad packets, %lu/%lu delivered\n", name, bad, received, done);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t packets = bench::arg(argc, argv, "packets", 2000000);
+    uint32_t backlog = bench::arg(argc, argv, "backlog", 512);
+    uint32_t size = bench::arg(argc, argv, "size", 128);
+    uint32_t buf_size = bench::arg(argc, argv, "buf-size", 2048);
+
+    if (!backlog || backlog > (1u << LOG_SIZE) || size < 64 || size > 2048 ||
+        buf_size < size || buf_size > 0xffff) {
+        fprintf(stderr, "invalid backlog or size\n");
+        return 1;
+    }
+
+    printf("packets=%lu backlog=%u size=%u buf_size=%u\n", packets, backlog, size, buf_size);
+    for (bool deferred : { false, true }) {
+        if (!run(false, deferred, packets, backlog, size, buf_size) ||
+            !run(true, deferred, packets, backlog, size, buf_size))
+            return 1;
+    }
+    return 0;
+}
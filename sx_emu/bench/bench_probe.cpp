@@ -0,0 +1,210 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * Probe to ready of 1 and 4 devices (or --asics), each with --sdq SDQs,
+ * --rdq RDQs, a CQ per queue and --ports ports, on a model whose firmware
+ * takes --fw-boot-ms to boot, --queue-init-us to set each queue up and
+ * whose links come up --port-up-ms after their port. EMAD is answered
+ * after --latency-ns, through interrupts.
+ *
+ * The same init_graph of probe stages runs on one thread, stage after
+ * stage in probe order as a sequential probe would, then on --threads.
+ * Per stage kind: the time the sequential probe spent on it, the time
+ * the stages of that kind took summed, and the window from the first
+ * starting to the last finishing when run concurrently. Every stage must
+ * succeed, every link must be up and EMAD must answer on every device.
+ *
+ *   bench_probe [--asics=N] [--threads=N] [--sdq=N] [--rdq=N] [--ports=N]
+ *               [--fw-boot-ms=MS] [--queue-init-us=US] [--port-up-ms=MS]
+ *               [--latency-ns=NS] [--report=1]
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <endian.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "sx/probe.h"
+
+using namespace sx;
+
+#define LOG_CQ_SIZE 8
+#define LOG_DQ_SIZE 7
+#define BUF_SIZE    2048
+
+struct device {
+    std::unique_ptr<emu::asic> asic;
+    std::unique_ptr<dev>       d;
+    std::unique_ptr<emad>      e;
+};
+
+/* Time of the stages of one kind: "cq", "port", ... */
+struct kind_time {
+    unsigned n = 0;
+    uint64_t busy_ns = 0;
+    uint64_t first_ns = UINT64_MAX;
+    uint64_t last_ns = 0;
+};
+
+static std::string stage_kind(const std::string &name)
+{
+    std::string k = name.substr(name.find('/') + 1);
+
+    return k.substr(0, k.find('.'));
+}
+
+static std::map<std::string, kind_time> kind_times(const init_graph &g)
+{
+    std::map<std::string, kind_time> out;
+
+    for (unsigned id = 0; id < g.size(); id++) {
+        const init_graph::stage_time &t = g.time(id);
+        kind_time &k = out[stage_kind(g.name(id))];
+
+        k.n++;
+        k.busy_ns += t.end_ns - t.start_ns;
+        k.first_ns = std::min(k.first_ns, t.start_ns);
+        k.last_ns = std::max(k.last_ns, t.end_ns);
+    }
+    return out;
+}
+
+/* EMAD answers with the firmware's revision; every link is up */
+static bool check(device &dv, const emu::asic_config &cfg, unsigned ports)
+{
+    emad_op op;
+
+    op.reg_id = SX_REG_ID_MGIR;
+    op.payload.assign(8, 0);
+    if (dv.e->access(op) || be32toh(*reinterpret_cast<uint32_t *>(&op.payload[4])) != cfg.fw_rev) {
+        fprintf(stderr, "EMAD not answering after probe\n");
+        return false;
+    }
+    for (unsigned port = 0; port < ports; port++) {
+        emad_op q;
+
+        q.reg_id = SX_REG_ID_PAOS;
+        q.payload.assign(sizeof(sx_paos_reg), 0);
+
+        sx_paos_reg *reg = reinterpret_cast<sx_paos_reg *>(q.payload.data());
+        reg->local_port = htobe16(port);
+        if (dv.e->access(q)) {
+            fprintf(stderr, "PAOS query of port %u failed\n", port);
+            return false;
+        }
+        reg = reinterpret_cast<sx_paos_reg *>(q.payload.data());
+        if (reg->oper_status != SX_PORT_STATUS_UP) {
+            fprintf(stderr, "port %u down after probe\n", port);
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Probe @n fresh devices on @threads threads; the graph is left in @g */
+static bool probe(unsigned n, unsigned threads, const emu::asic_config &cfg,
+                  const probe_config &pc, init_graph &g, bool report)
+{
+    std::vector<device> devs(n);
+    bool ok = true;
+    int err;
+
+    for (unsigned i = 0; i < n; i++) {
+        device &dv = devs[i];
+
+        dv.asic = std::make_unique<emu::asic>(cfg);
+        dv.d = std::make_unique<dev>(*dv.asic);
+        dv.e = std::make_unique<emad>(*dv.d, 0, pc.num_sdq);
+        dev *d = dv.d.get();
+        dv.asic->set_irq_handler([d](unsigned vector) { d->irq(vector); });
+        probe_stages(g, "sx" + std::to_string(i), *dv.d, *dv.e, pc);
+    }
+
+    err = g.run(threads);
+    if (err) {
+        fprintf(stderr, "probe of %u devices on %u threads: %d\n%s", n, threads, err,
+                g.report().c_str());
+        ok = false;
+    }
+    for (unsigned i = 0; i < n && ok; i++)
+        ok = check(devs[i], cfg, pc.num_ports);
+    if (ok && report)
+        printf("%s", g.report().c_str());
+
+    /* Interrupts off before the driver goes */
+    for (device &dv : devs)
+        dv.asic->set_irq_handler(nullptr);
+    for (device &dv : devs) {
+        dv.e.reset();
+        dv.d.reset();
+    }
+    return ok;
+}
+
+static bool run(unsigned n, unsigned threads, const emu::asic_config &cfg,
+                const probe_config &pc, bool report)
+{
+    init_graph seq, par;
+
+    if (!probe(n, 1, cfg, pc, seq, false) || !probe(n, threads, cfg, pc, par, report))
+        return false;
+
+    std::map<std::string, kind_time> ks = kind_times(seq), kp = kind_times(par);
+    printf("\n%u device%s: sequential %.1f ms, %u threads %.1f ms, %.1fx\n", n, n > 1 ? "s" : "",
+           seq.elapsed_ns() / 1e6, threads, par.elapsed_ns() / 1e6,
+           static_cast<double>(seq.elapsed_ns()) / par.elapsed_ns());
+    printf("  %-6s %7s %14s %14s %14s\n", "stage", "count", "sequential ms", "graph busy ms",
+           "graph span ms");
+    for (const auto &it : ks) {
+        const kind_time &p = kp[it.first];
+
+        printf("  %-6s %7u %14.1f %14.1f %14.1f\n", it.first.c_str(), it.second.n,
+               it.second.busy_ns / 1e6, p.busy_ns / 1e6, (p.last_ns - p.first_ns) / 1e6);
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned asics = bench::arg(argc, argv, "asics", 0);
+    unsigned threads = bench::arg(argc, argv, "threads", 32);
+    bool report = bench::arg(argc, argv, "report", 0);
+    emu::asic_config cfg;
+    probe_config pc = {};
+
+    pc.num_sdq = bench::arg(argc, argv, "sdq", SX_MAX_SDQ);
+    pc.num_rdq = bench::arg(argc, argv, "rdq", SX_MAX_RDQ);
+    pc.num_ports = bench::arg(argc, argv, "ports", 64);
+    pc.log_cq_size = LOG_CQ_SIZE;
+    pc.log_dq_size = LOG_DQ_SIZE;
+    pc.rdq_buf_size = BUF_SIZE;
+    pc.fw_timeout_ms = SX_FW_BOOT_TIMEOUT_MS;
+    cfg.fw_boot_ns = bench::arg(argc, argv, "fw-boot-ms", 200) * 1000000;
+    cfg.queue_init_ns = bench::arg(argc, argv, "queue-init-us", 500) * 1000;
+    cfg.port_up_ns = bench::arg(argc, argv, "port-up-ms", 10) * 1000000;
+    cfg.emad_latency_ns = bench::arg(argc, argv, "latency-ns", 20000);
+    cfg.num_ports = pc.num_ports;
+
+    if (!pc.num_sdq || pc.num_sdq > SX_MAX_SDQ || !pc.num_rdq || pc.num_rdq > SX_MAX_RDQ ||
+        !pc.num_ports || pc.num_ports > SX_MAX_PORTS || !threads || asics > 16) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    printf("sdq=%u rdq=%u ports=%u fw-boot=%ums queue-init=%uus port-up=%ums latency=%uns\n",
+           pc.num_sdq, pc.num_rdq, pc.num_ports, cfg.fw_boot_ns / 1000000,
+           cfg.queue_init_ns / 1000, cfg.port_up_ns / 1000000, cfg.emad_latency_ns);
+
+    std::vector<unsigned> counts = { 1, 4 };
+    if (asics)
+        counts = { asics };
+    for (unsigned n : counts) {
+        if (!run(n, threads, cfg, pc, report))
+            return 1;
+    }
+    return 0;
+}
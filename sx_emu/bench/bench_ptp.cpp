@@ -0,0 +1,505 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * PTP timestamp correlation. Event messages enter the model on random
+ * ports with ptp_rx() or leave through ptp::xmit(); their timestamps are
+ * trapped separately, shuffled and in random chunks, interleaved with the
+ * packets' trap in random order:
+ *
+ *  - reorder: bursts of --burst received and --burst/4 sent messages,
+ *    polled from one thread;
+ *  - fifo drop: the model's timestamp FIFO holds half a burst, so the
+ *    rest is lost and age() must hand those packets on unstamped;
+ *  - threaded: both traps polled by their own NAPI threads at once.
+ *
+ * Every packet and send must come out exactly once, with the timestamp
+ * the model took for it, or none if the model lost that; each of them is
+ * stamped unless the FIFO dropped stamps.
+ *
+ * Then the cost of matching, in driver cycles per pair, with a window of
+ * packets waiting for their stamps: the slot table against a list scanned
+ * under a mutex.
+ *
+ *   bench_ptp [--rounds=N] [--burst=N] [--ports=N] [--table=N] [--iters=N]
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "sx/ptp.h"
+
+using namespace sx;
+
+#define SDQ         0
+#define EVENT_RDQ   0
+#define EVENT_GRP   1
+#define TS_RDQ      1
+#define TS_GRP      2
+#define LOG_SIZE    10
+#define FRAME_LEN   64
+#define ID_OFF      (14 + SX_PTP_HDR_LEN)
+#define MAX_AGE_US  2000
+
+/* What each packet and send must come out with, checked once all are out */
+struct checker {
+    std::mutex            lock;
+    std::vector<uint64_t> lo, hi;       /* rx: the stamp; tx: bounds of it */
+    std::vector<uint64_t> got;
+    std::vector<uint8_t>  seen;
+    uint64_t              delivered = 0, stamped = 0, bad = 0;
+
+    uint32_t add()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        lo.push_back(0);
+        hi.push_back(0);
+        got.push_back(0);
+        seen.push_back(0);
+        return seen.size() - 1;
+    }
+
+    void set(uint32_t id, uint64_t l, uint64_t h)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        lo[id] = l;
+        hi[id] = h;
+    }
+
+    void done(uint32_t id, uint64_t hwts)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        if (id >= seen.size() || seen[id]++) {
+            bad++;
+            return;
+        }
+        got[id] = hwts;
+        delivered++;
+    }
+
+    uint64_t pending()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        return seen.size() - delivered;
+    }
+
+    /* Counts stamps; false unless each came out once, stamped right or not at all */
+    bool check()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        stamped = 0;
+        for (size_t i = 0; i < seen.size(); i++) {
+            if (seen[i] != 1 || (got[i] && (got[i] < lo[i] || got[i] > hi[i])))
+                bad++;
+            stamped += got[i] != 0;
+        }
+        return !bad;
+    }
+};
+
+struct rig {
+    emu::asic asic;
+    dev       d;
+    unsigned  event_cq, ts_cq;
+
+    explicit rig(const emu::asic_config &cfg)
+        : asic(cfg), d(asic), event_cq(cfg.num_sdq + EVENT_RDQ), ts_cq(cfg.num_sdq + TS_RDQ)
+    {
+    }
+
+    int setup()
+    {
+        int err;
+
+        err = d.init();
+        if (!err)
+            err = d.create_cq(SDQ, LOG_SIZE);
+        if (!err)
+            err = d.create_sdq(SDQ, LOG_SIZE, SDQ);
+        if (!err)
+            err = d.create_cq(event_cq, LOG_SIZE);
+        if (!err)
+            err = d.create_rdq(EVENT_RDQ, LOG_SIZE, event_cq, 2048);
+        if (!err)
+            err = d.create_cq(ts_cq, LOG_SIZE);
+        if (!err)
+            err = d.create_rdq(TS_RDQ, LOG_SIZE, ts_cq, 2048);
+        if (!err)
+            err = d.set_trap_group_rdq(EVENT_GRP, EVENT_RDQ);
+        if (!err)
+            err = d.set_trap_group_rdq(TS_GRP, TS_RDQ);
+        if (!err)
+            err = d.set_trap_group(SX_TRAP_ID_PTP_EVENT, EVENT_GRP);
+        if (!err)
+            err = d.set_trap_group(SX_TRAP_ID_PTP_TS, TS_GRP);
+        return err;
+    }
+};
+
+/* Keys of the messages sent and received, unique while any is pending */
+struct msg_gen {
+    std::mt19937_64       rng;
+    unsigned              ports;
+    std::vector<uint16_t> seq;
+
+    msg_gen(uint64_t seed, unsigned nports) : rng(seed), ports(nports), seq(nports) {}
+
+    uint16_t next(uint8_t *f, uint32_t id)
+    {
+        uint16_t port = rng() % ports, s = seq[port]++;
+        uint8_t *h = f + 14;
+
+        bench::fill_frame(f, FRAME_LEN, SX_PTP_ETHERTYPE, id);
+        f[0] = 0x01; f[1] = 0x1b; f[2] = 0x19; f[3] = 0x00; f[4] = 0x00; f[5] = 0x00;
+        memset(h, 0, SX_PTP_HDR_LEN);
+        h[0] = rng() % (SX_PTP_MSG_PDELAY_RESP + 1);
+        h[1] = 2;                                   /* versionPTP */
+        h[3] = SX_PTP_HDR_LEN + 10;                 /* messageLength */
+        h[4] = rng() % 4;                           /* domainNumber */
+        h[30] = s >> 8;
+        h[31] = s & 0xff;
+        memcpy(f + ID_OFF, &id, sizeof(id));
+        return port;
+    }
+};
+
+static uint32_t frame_id(const pkt_buf *buf)
+{
+    uint32_t id = UINT32_MAX;
+
+    if (buf->len >= ID_OFF + sizeof(id))
+        memcpy(&id, buf->data + ID_OFF, sizeof(id));
+    return id;
+}
+
+static int start(ptp &p, checker &rx, checker &tx)
+{
+    return p.start(
+        [&rx](const rx_info &, pkt_buf *buf, uint64_t hwts) {
+            rx.done(frame_id(buf), hwts);
+            pkt_buf_free(buf);
+        },
+        [&tx](uint64_t cookie, uint64_t hwts) { tx.done(cookie, hwts); });
+}
+
+static int recv(rig &r, msg_gen &g, checker &rx, uint8_t *f)
+{
+    uint64_t ts = 0;
+    uint32_t id = rx.add();
+    uint16_t port = g.next(f, id);
+    int err;
+
+    err = r.asic.ptp_rx(port, f, FRAME_LEN, &ts);
+    rx.set(id, ts, ts);
+    return err;
+}
+
+static int xmit(ptp &p, msg_gen &g, checker &tx, uint8_t *f)
+{
+    uint32_t id = tx.add();
+    uint16_t port = g.next(f, id);
+    uint64_t t0 = emu::asic::now_ns();
+    int err;
+
+    /* The model stamps the send before the doorbell returns */
+    err = p.xmit(SDQ, port, f, FRAME_LEN, id);
+    tx.set(id, t0, emu::asic::now_ns());
+    if (err)
+        tx.done(id, 0);
+    return err == -EBUSY ? 0 : err;
+}
+
+/* Traps stamps and packets in random order until neither is left */
+static void interleave(rig &r, std::mt19937_64 &rng)
+{
+    bool ts_left = true, event_left = true;
+
+    while (ts_left || event_left) {
+        if (ts_left && (!event_left || rng() % 2)) {
+            ts_left = r.asic.ptp_ts_drain(1 + rng() % 96, rng() | 1) > 0;
+            while (r.d.poll_cq(r.ts_cq, SX_NAPI_WEIGHT) > 0)
+                ;
+        } else {
+            event_left = r.d.poll_cq(r.event_cq, 1 + rng() % 32) > 0;
+        }
+    }
+}
+
+static bool verify(const char *name, checker &rx, checker &tx, ptp &p, uint64_t lost)
+{
+    ptp_stats s;
+    bool ok = rx.check() & tx.check();
+
+    p.get_stats(&s);
+    printf("%-10s %8lu %8lu %8lu %8lu %8lu %8lu\n", name, rx.delivered, rx.stamped, tx.delivered,
+           tx.stamped, s.collisions, s.ts_dropped);
+    if (!ok || s.rx_matched != rx.stamped || s.tx_matched != tx.stamped ||
+        s.rx_unmatched + s.tx_unmatched > s.collisions + lost ||
+        s.rx_unmatched + s.tx_unmatched < lost ||
+        (!lost && (rx.stamped != rx.delivered || tx.stamped != tx.delivered))) {
+        fprintf(stderr, "%s: %lu/%lu wrong, rx %lu/%lu tx %lu/%lu, unmatched %lu+%lu, lost %lu\n",
+                name, rx.bad, tx.bad, rx.delivered, rx.seen.size(), tx.delivered, tx.seen.size(),
+                s.rx_unmatched, s.tx_unmatched, lost);
+        return false;
+    }
+    return true;
+}
+
+/* Single poll context; @fifo bounds the model's stamps, losing the rest */
+static bool run_sync(const char *name, unsigned rounds, unsigned burst, unsigned ports,
+                     unsigned table, unsigned fifo)
+{
+    emu::asic_config cfg;
+    cfg.num_ports = ports;
+    cfg.ptp_fifo_size = fifo;
+    rig r(cfg);
+    ptp p(r.d, table, MAX_AGE_US);
+    checker rx, tx;
+    msg_gen g(7, ports);
+    std::mt19937_64 rng(11);
+    uint8_t f[FRAME_LEN];
+    int err;
+
+    err = r.setup();
+    if (!err)
+        err = start(p, rx, tx);
+    for (unsigned i = 0; i < rounds && !err; i++) {
+        for (unsigned j = 0; j < burst && !err; j++) {
+            err = recv(r, g, rx, f);
+            if (!err && j % 4 == 3)
+                err = xmit(p, g, tx, f);
+        }
+        r.d.process_cq(SDQ);
+        interleave(r, rng);
+    }
+    if (err) {
+        fprintf(stderr, "%s: %d\n", name, err);
+        return false;
+    }
+
+    /* What lost its other half goes on once aged */
+    std::this_thread::sleep_for(std::chrono::microseconds(MAX_AGE_US * 2));
+    p.age();
+    return verify(name, rx, tx, p, r.asic.stats().ptp_ts_dropped.load());
+}
+
+/* Packets and stamps polled by two NAPI threads, matching concurrently */
+static bool run_threaded(unsigned rounds, unsigned burst, unsigned ports, unsigned table)
+{
+    emu::asic_config cfg;
+    cfg.num_ports = ports;
+    rig r(cfg);
+    ptp p(r.d, table, MAX_AGE_US);
+    checker rx, tx;
+    msg_gen g(13, ports);
+    std::mt19937_64 rng(17);
+    uint8_t f[FRAME_LEN];
+    int err;
+
+    err = r.setup();
+    if (!err)
+        err = r.d.set_napi_thread(r.event_cq, -1);
+    if (!err)
+        err = r.d.set_napi_thread(r.ts_cq, -1);
+    if (!err)
+        err = start(p, rx, tx);
+    r.asic.set_irq_handler([&r](unsigned vector) { r.d.irq(vector); });
+    for (uint64_t i = 0; i < static_cast<uint64_t>(rounds) * burst && !err; i++) {
+        /* Never more pending than the RDQ holds */
+        while (rx.pending() >= (1u << LOG_SIZE) / 2)
+            std::this_thread::yield();
+        err = recv(r, g, rx, f);
+        if (!err && rng() % 4 == 0)
+            r.asic.ptp_ts_drain(1 + rng() % 96, rng() | 1);
+    }
+    while (!err && r.asic.ptp_ts_drain(UINT32_MAX, rng() | 1) > 0)
+        std::this_thread::yield();
+
+    uint64_t deadline = emu::asic::now_ns() + 1000000000ull;
+    while (!err && rx.pending() && emu::asic::now_ns() < deadline) {
+        std::this_thread::sleep_for(std::chrono::microseconds(MAX_AGE_US));
+        p.age();
+    }
+    r.asic.set_irq_handler(nullptr);
+    if (err) {
+        fprintf(stderr, "threaded: %d\n", err);
+        return false;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(MAX_AGE_US * 2));
+    p.age();
+    return verify("threaded", rx, tx, p, 0);
+}
+
+/* The same correlation as one list of pending halves, scanned under a mutex */
+class linear_match {
+public:
+    explicit linear_match(dev &d) : dev_(d) {}
+    ~linear_match()
+    {
+        dev_.del_listener(SX_TRAP_ID_PTP_EVENT);
+        dev_.del_listener(SX_TRAP_ID_PTP_TS);
+    }
+
+    int start(ptp_rx_fn rx)
+    {
+        int err;
+
+        rx_ = std::move(rx);
+        err = dev_.add_listener(SX_TRAP_ID_PTP_EVENT, [this](const rx_info &info, pkt_buf *buf) {
+            sx_ptp_ts_rec rec;
+
+            if (!sx_ptp_parse(buf->data, buf->len, &rec)) {
+                rx_(info, buf, 0);
+                return;
+            }
+            match(sx_ptp_key(info.sys_port, SX_PTP_DIR_RX, rec.msg_type, rec.domain,
+                             rec.seq_id), false, reinterpret_cast<uint64_t>(buf), info);
+        });
+        if (!err)
+            err = dev_.add_listener(SX_TRAP_ID_PTP_TS, [this](const rx_info &info, pkt_buf *buf) {
+                for (uint32_t off = 0; off + sizeof(sx_ptp_ts_rec) <= buf->len;
+                     off += sizeof(sx_ptp_ts_rec)) {
+                    sx_ptp_ts_rec rec;
+
+                    memcpy(&rec, buf->data + off, sizeof(rec));
+                    match(sx_ptp_rec_key(rec), true, rec.timestamp, info);
+                }
+                pkt_buf_free(buf);
+            });
+        return err;
+    }
+
+private:
+    struct entry {
+        uint64_t key;
+        bool     ts;
+        uint64_t val;
+        rx_info  info;
+    };
+
+    void match(uint64_t key, bool ts, uint64_t val, const rx_info &info)
+    {
+        std::unique_lock<std::mutex> guard(lock_);
+
+        for (size_t i = 0; i < pending_.size(); i++) {
+            entry e = pending_[i];
+
+            if (e.key != key || e.ts == ts)
+                continue;
+            pending_[i] = pending_.back();
+            pending_.pop_back();
+            guard.unlock();
+            if (ts)
+                rx_(e.info, reinterpret_cast<pkt_buf *>(e.val), val);
+            else
+                rx_(info, reinterpret_cast<pkt_buf *>(val), e.val);
+            return;
+        }
+        pending_.push_back({ key, ts, val, info });
+    }
+
+    dev                &dev_;
+    std::mutex          lock_;
+    std::vector<entry>  pending_;
+    ptp_rx_fn           rx_;
+};
+
+/* Driver cycles per pair, @window packets waiting when their stamps come */
+static bool run_perf(bool table, unsigned window, unsigned iters, unsigned ports, unsigned size)
+{
+    emu::asic_config cfg;
+    cfg.num_ports = ports;
+    cfg.ptp_fifo_size = window;
+    rig r(cfg);
+    checker rx, tx;
+    msg_gen g(19, ports);
+    std::mt19937_64 rng(23);
+    std::unique_ptr<ptp> p;
+    std::unique_ptr<linear_match> l;
+    uint64_t cyc = 0;
+    uint8_t f[FRAME_LEN];
+    int err;
+
+    err = r.setup();
+    auto rx_fn = [&rx](const rx_info &, pkt_buf *buf, uint64_t hwts) {
+        rx.done(frame_id(buf), hwts);
+        pkt_buf_free(buf);
+    };
+    if (!err && table) {
+        p.reset(new ptp(r.d, size, MAX_AGE_US));
+        err = p->start(rx_fn, nullptr);
+    } else if (!err) {
+        l.reset(new linear_match(r.d));
+        err = l->start(rx_fn);
+    }
+
+    for (unsigned i = 0; i < iters && !err; i++) {
+        for (unsigned j = 0; j < window && !err; j++)
+            err = recv(r, g, rx, f);
+        uint64_t c = bench::cycles();
+        while (r.d.poll_cq(r.event_cq, SX_NAPI_WEIGHT) > 0)
+            ;
+        cyc += bench::cycles() - c;
+        while (r.asic.ptp_ts_drain(SX_PTP_TS_PER_TRAP * 8, rng() | 1) > 0) {
+            c = bench::cycles();
+            while (r.d.poll_cq(r.ts_cq, SX_NAPI_WEIGHT) > 0)
+                ;
+            cyc += bench::cycles() - c;
+        }
+    }
+    if (p) {
+        std::this_thread::sleep_for(std::chrono::microseconds(MAX_AGE_US * 2));
+        p->age();
+    }
+    /* The FIFO holds a window, so every packet must have its stamp */
+    if (err || !rx.check() || rx.stamped != rx.seen.size()) {
+        fprintf(stderr, "perf %s/%u: err %d, %lu wrong, %lu/%lu delivered, %lu stamped\n",
+                table ? "table" : "linear", window, err, rx.bad, rx.delivered, rx.seen.size(),
+                rx.stamped);
+        return false;
+    }
+    printf("%-10s %8u %12.1f %11.2f%%\n", table ? "table" : "linear", window,
+           static_cast<double>(cyc) / rx.delivered, 100.0 * rx.stamped / rx.delivered);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    static const unsigned windows[] = { 16, 256, 1024 };
+    unsigned rounds = bench::arg(argc, argv, "rounds", 200);
+    unsigned burst = bench::arg(argc, argv, "burst", 256);
+    unsigned ports = bench::arg(argc, argv, "ports", 64);
+    unsigned table = bench::arg(argc, argv, "table", SX_PTP_TABLE_SIZE);
+    unsigned iters = bench::arg(argc, argv, "iters", 1000);
+
+    if (!rounds || burst < 4 || burst > (1u << LOG_SIZE) / 2 || !ports || ports > SX_MAX_PORTS ||
+        table < 2) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    printf("rounds=%u burst=%u ports=%u table=%u\n", rounds, burst, ports, table);
+    printf("%-10s %8s %8s %8s %8s %8s %8s\n", "phase", "rx", "rx ts", "tx", "tx ts", "collide",
+           "ts drop");
+    if (!run_sync("reorder", rounds, burst, ports, table, 1024) ||
+        !run_sync("fifo drop", rounds, burst, ports, table, burst / 2) ||
+        !run_threaded(rounds, burst, ports, table))
+        return 1;
+
+    printf("\n%-10s %8s %12s %12s\n", "match", "window", "cycles/pair", "stamped");
+    for (unsigned w : windows) {
+        if (!run_perf(false, w, std::max(1u, iters * 16 / w), ports, table) ||
+            !run_perf(true, w, std::max(1u, iters * 16 / w), ports, table))
+            return 1;
+    }
+    return 0;
+}
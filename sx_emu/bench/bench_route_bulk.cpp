@@ -0,0 +1,231 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * Loading a synthetic full routing table, --v4 IPv4 and --v6 IPv6 prefixes
+ * with an Internet-like mix of prefix lengths in random (feed) order, into
+ * the model over EMAD answered after --latency-ns:
+ *
+ *  - one route per RALUE write, one write at a time, for the first
+ *    --serial routes; the full table's time is extrapolated;
+ *  - one route per write, pipelined;
+ *  - feed order, neighbours of one KVD region sharing a write;
+ *  - route_bulk as meant: sorted, grouped by KVD region, pipelined.
+ *
+ * --bad routes are mixed in, half with host bits set and half with an
+ * adjacency index beyond the KVD; each must fail with -EINVAL and no other
+ * route may fail. After the bulk load the model must hold every good route
+ * with its adjacency index; a tenth is then withdrawn in bulk.
+ *
+ *   bench_route_bulk [--v4=N] [--v6=N] [--bad=N] [--serial=N] [--latency-ns=NS]
+ */
+
+#include <cstdio>
+#include <random>
+#include <set>
+#include <unordered_set>
+#include <vector>
+
+#include "bench.h"
+#include "sx/route.h"
+
+using namespace sx;
+
+#define EMAD_SDQ    0
+#define LOG_SIZE    11
+
+struct len_weight {
+    uint8_t  len;
+    unsigned weight;
+};
+
+/* Roughly the prefix length mix of the Internet table */
+static const len_weight v4_lens[] = {
+    { 24, 600 }, { 23, 90 }, { 22, 110 }, { 21, 50 }, { 20, 50 }, { 19, 30 }, { 18, 20 },
+    { 17, 10 }, { 16, 30 }, { 15, 3 }, { 14, 2 }, { 13, 2 }, { 12, 1 }, { 11, 1 }, { 10, 1 },
+};
+
+static const len_weight v6_lens[] = {
+    { 48, 500 }, { 47, 20 }, { 46, 20 }, { 44, 70 }, { 40, 60 }, { 36, 30 }, { 32, 120 },
+    { 29, 30 }, { 28, 20 }, { 56, 50 }, { 64, 40 },
+};
+
+struct mode {
+    const char *name;
+    unsigned    window;
+    unsigned    batch;
+    bool        sort;
+    bool        serial;
+};
+
+template <size_t N>
+static uint8_t pick_len(const len_weight (&lens)[N], std::mt19937_64 &rng)
+{
+    unsigned total = 0, w;
+
+    for (const len_weight &l : lens)
+        total += l.weight;
+    w = rng() % total;
+    for (const len_weight &l : lens) {
+        if (w < l.weight)
+            return l.len;
+        w -= l.weight;
+    }
+    return lens[0].len;
+}
+
+/* A new random prefix; @seen keeps the table free of duplicates */
+static route_entry make_route(bool v6, std::mt19937_64 &rng,
+                              std::set<std::pair<uint64_t, uint8_t>> &seen)
+{
+    route_entry r = {};
+
+    r.protocol = v6 ? SX_RALUE_PROTO_IPV6 : SX_RALUE_PROTO_IPV4;
+    r.adj_index = rng() % emu::asic_config().kvd_adj_entries;
+    for (;;) {
+        uint64_t addr;
+
+        if (v6) {
+            r.prefix_len = pick_len(v6_lens, rng);
+            addr = 0x2000000000000000ull | rng() >> 3;     /* 2000::/3 */
+            addr &= ~0ull << (64 - r.prefix_len);
+        } else {
+            r.prefix_len = pick_len(v4_lens, rng);
+            addr = 0x01000000 + rng() % (0xe0000000 - 0x01000000);
+            addr &= ~0u << (32 - r.prefix_len);
+        }
+        if (seen.emplace(addr, r.protocol << 7 | r.prefix_len).second) {
+            bench::put_be(r.dip, addr, v6 ? 8 : 4);
+            return r;
+        }
+    }
+}
+
+/* Every good route must be in the model with its adjacency index */
+static bool verify(emu::asic &asic, const std::vector<route_entry> &routes,
+                   const std::vector<int> &expect, size_t good)
+{
+    uint32_t adj;
+
+    if (asic.lpm_routes() != good) {
+        fprintf(stderr, "model holds %zu routes, want %zu\n", asic.lpm_routes(), good);
+        return false;
+    }
+    for (size_t i = 0; i < routes.size(); i++) {
+        const route_entry &r = routes[i];
+
+        if (!expect[i] && (asic.lpm_route(r.protocol, r.vr, r.dip, r.prefix_len, &adj) ||
+                           adj != r.adj_index)) {
+            fprintf(stderr, "route %zu missing or wrong in the model\n", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    static const mode modes[] = {
+        { "per route, serial",       1,                    1,                false, true },
+        { "per route, pipelined",    SX_EMAD_MAX_INFLIGHT, 1,                false, false },
+        { "feed order, grouped",     SX_EMAD_MAX_INFLIGHT, SX_RALUE_MAX_REC, false, false },
+        { "route_bulk: sorted",      SX_EMAD_MAX_INFLIGHT, SX_RALUE_MAX_REC, true,  false },
+    };
+    uint32_t v4 = bench::arg(argc, argv, "v4", 1000000);
+    uint32_t v6 = bench::arg(argc, argv, "v6", 200000);
+    uint32_t bad = bench::arg(argc, argv, "bad", 1000);
+    uint32_t serial = bench::arg(argc, argv, "serial", 20000);
+    emu::asic_config cfg;
+    cfg.emad_latency_ns = bench::arg(argc, argv, "latency-ns", 20000);
+    std::set<std::pair<uint64_t, uint8_t>> seen;
+    std::mt19937_64 rng(1);
+    std::vector<route_entry> routes;
+    std::vector<int> expect;
+    size_t good = v4 + v6;
+
+    if (!v4 && !v6) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    /* The feed: v4 and v6 interleaved at random, bad routes anywhere */
+    routes.reserve(v4 + v6 + bad);
+    for (uint32_t n4 = 0, n6 = 0; n4 < v4 || n6 < v6;) {
+        bool six = n4 == v4 || (n6 < v6 && rng() % (v4 + v6) < v6);
+
+        routes.push_back(make_route(six, rng, seen));
+        (six ? n6 : n4)++;
+    }
+    expect.assign(routes.size(), 0);
+    for (uint32_t i = 0; i < bad; i++) {
+        route_entry r = make_route(false, rng, seen);
+        size_t pos = rng() % (routes.size() + 1);
+
+        if (i & 1)
+            r.adj_index = cfg.kvd_adj_entries + i;
+        else
+            r.dip[3] |= 1;      /* IPv4 prefixes here are /24 at most */
+        routes.push_back(r);
+        expect.push_back(-EINVAL);
+        std::swap(routes[pos], routes.back());
+        std::swap(expect[pos], expect.back());
+    }
+
+    printf("v4=%u v6=%u bad=%u latency=%uns\n", v4, v6, bad, cfg.emad_latency_ns);
+    printf("%-24s %9s %9s %8s %9s %11s %10s\n", "mode", "routes", "writes", "per-write", "seconds",
+           "routes/s", "table s");
+    for (const mode &m : modes) {
+        emu::asic asic(cfg);
+        dev d(asic);
+        emad e(d, EMAD_SDQ, 0);
+        route_bulk rb(e);
+        route_bulk_stats st;
+        size_t n = m.serial ? std::min<size_t>(serial, routes.size()) : routes.size();
+        ssize_t failed;
+        int err = bench::setup_emad(d, e, LOG_SIZE);
+
+        if (err) {
+            fprintf(stderr, "setup failed: %d\n", err);
+            return 1;
+        }
+        rb.set_window(m.window);
+        rb.set_batch(m.batch);
+        rb.set_sort(m.sort);
+
+        uint64_t t0 = emu::asic::now_ns();
+        failed = rb.add(routes.data(), n);
+        uint64_t ns = emu::asic::now_ns() - t0;
+
+        rb.get_stats(&st);
+        double rate = n * 1e9 / ns;
+        printf("%-24s %9zu %9lu %8.1f %9.3f %11.0f %10.1f\n", m.name, n, st.writes,
+               static_cast<double>(n - failed) / st.writes, ns / 1e9, rate, routes.size() / rate);
+
+        for (size_t i = 0; i < n; i++) {
+            if (routes[i].err != expect[i]) {
+                fprintf(stderr, "%s: route %zu: %d, want %d\n", m.name, i, routes[i].err, expect[i]);
+                return 1;
+            }
+        }
+        if (!m.sort)
+            continue;
+        if (!verify(asic, routes, expect, good))
+            return 1;
+
+        /* Withdraw a tenth of the table */
+        std::vector<route_entry> gone;
+        for (size_t i = 0; i < routes.size(); i += 10) {
+            if (!expect[i])
+                gone.push_back(routes[i]);
+        }
+        t0 = emu::asic::now_ns();
+        failed = rb.del(gone.data(), gone.size());
+        ns = emu::asic::now_ns() - t0;
+        printf("%-24s %9zu %9s %8s %9.3f %11.0f\n", "route_bulk: withdraw", gone.size(), "", "",
+               ns / 1e9, gone.size() * 1e9 / ns);
+        if (failed || asic.lpm_routes() != good - gone.size()) {
+            fprintf(stderr, "withdraw: %zd failed, %zu routes left\n", failed, asic.lpm_routes());
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,166 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * One trap group spread by flow hash over 1, 4 and 16 RDQs, each with its
+ * own CQ and threaded NAPI context pinned round-robin to the host's CPUs.
+ * Interrupts are live: the model raises them, the driver wakes the poll
+ * threads.
+ *
+ * Every packet carries its flow and a per-flow sequence number. The
+ * listener spends --work-ns per packet, as protocol processing would, and
+ * checks that each flow stays on one RDQ and arrives in order. Reported
+ * are the rate, the spread of packets over the queues (max/min share) and
+ * the busiest poll thread's CPU time. The last bounds the rate once every
+ * queue has a CPU of its own, so it shows the scaling even on a host with
+ * fewer CPUs than queues.
+ *
+ *   bench_rss [--packets=N] [--flows=N] [--work-ns=NS] [--size=BYTES]
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "sx/dev.h"
+
+using namespace sx;
+
+#define GROUP       1
+#define TRAP        SX_TRAP_ID_IPV4_BGP
+#define LOG_SIZE    10
+#define SEQ_OFF     42
+#define FLOW_OFF    46
+
+struct SX_CACHELINE_ALIGNED queue_state {
+    uint64_t cpu_ns = 0;                    /* of the poll thread, so far */
+};
+
+struct flow_state {
+    uint32_t next_seq = 0;
+    int      rdq = -1;
+};
+
+static void make_frame(uint8_t *buf, uint32_t len, uint32_t flow, uint32_t seq)
+{
+    bench::fill_frame(buf, len, 0x0800, 0);
+    buf[14] = 0x45;                         /* IPv4, 20-byte header */
+    buf[23] = 17;                           /* UDP */
+    buf[26] = 10; buf[27] = 0; buf[28] = flow >> 8; buf[29] = flow & 0xff;
+    buf[30] = 10; buf[31] = 1; buf[32] = 0; buf[33] = 1;
+    buf[34] = (1024 + flow) >> 8; buf[35] = (1024 + flow) & 0xff;
+    buf[36] = 0; buf[37] = 179;
+    memcpy(buf + SEQ_OFF, &seq, sizeof(seq));
+    memcpy(buf + FLOW_OFF, &flow, sizeof(flow));
+}
+
+/* Returns false on a lost, reordered or misrouted packet */
+static bool run(unsigned queues, uint64_t packets, uint32_t flows, uint64_t work_ns, uint32_t size)
+{
+    emu::asic asic;
+    dev d(asic);
+    std::vector<flow_state> state(flows);
+    std::vector<queue_state> qstate(queues);
+    std::vector<uint32_t> seq(flows);
+    std::atomic<uint64_t> got{0}, bad{0};
+    unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+    unsigned sdqs = asic.config().num_sdq;
+    uint8_t frame[2048];
+    int err = d.init();
+
+    for (unsigned q = 0; q < queues && !err; q++) {
+        err = d.create_cq(sdqs + q, LOG_SIZE);
+        if (!err)
+            err = d.create_rdq(q, LOG_SIZE, sdqs + q, 2048);
+        if (!err)
+            err = d.set_napi_thread(sdqs + q, q % cpus);
+    }
+    if (!err)
+        err = d.set_trap_group_rdqs(GROUP, 0, queues);
+    if (!err)
+        err = d.set_trap_group(TRAP, GROUP);
+    if (!err) {
+        err = d.add_listener(TRAP, [&](const rx_info &info, pkt_buf *buf) {
+            uint32_t f, s;
+
+            memcpy(&s, buf->data + SEQ_OFF, sizeof(s));
+            memcpy(&f, buf->data + FLOW_OFF, sizeof(f));
+            flow_state &fs = state[f];
+            if (fs.rdq < 0)
+                fs.rdq = info.rdq;
+            if (fs.rdq != info.rdq || fs.next_seq != s)
+                bad.fetch_add(1, std::memory_order_relaxed);
+            fs.next_seq = s + 1;
+            bench::spin_ns(work_ns);
+            pkt_buf_free(buf);
+            qstate[info.rdq].cpu_ns = thread_cpu_ns();
+            got.fetch_add(1, std::memory_order_release);
+        });
+    }
+    if (err) {
+        fprintf(stderr, "setup failed: %d\n", err);
+        return false;
+    }
+    asic.set_irq_handler([&d](unsigned vector) { d.irq(vector); });
+
+    uint64_t t0 = emu::asic::now_ns();
+    for (uint64_t i = 0; i < packets; i++) {
+        uint32_t f = i % flows;
+
+        make_frame(frame, size, f, seq[f]++);
+        while (asic.inject(TRAP, f % 32, frame, size) == -ENOSPC)
+            std::this_thread::yield();
+    }
+    while (got.load(std::memory_order_acquire) < packets)
+        std::this_thread::yield();
+    uint64_t ns = emu::asic::now_ns() - t0;
+
+    uint64_t lo = UINT64_MAX, hi = 0, busiest = 0;
+    for (unsigned q = 0; q < queues; q++) {
+        queue_counters qc;
+
+        d.get_rdq_counters(q, &qc);
+        lo = std::min(lo, qc.packets);
+        hi = std::max(hi, qc.packets);
+        busiest = std::max(busiest, qstate[q].cpu_ns);
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "%u queue%s", queues, queues > 1 ? "s" : "");
+    printf("%-32s %10.3f Mpps %8.2f max/min queue %8.3f Mpps busiest-queue bound\n", name,
+           packets * 1e3 / ns, lo ? static_cast<double>(hi) / lo : 0.0,
+           busiest ? packets * 1e3 / busiest : 0.0);
+
+    /* Quiesce interrupts before the device goes away */
+    asic.set_irq_handler(nullptr);
+    d.destroy_queues();
+    if (bad) {
+        fprintf(stderr, "%s: %lu packets misrouted or out of order\n", name, bad.load());
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t packets = bench::arg(argc, argv, "packets", 400000);
+    uint32_t flows = bench::arg(argc, argv, "flows", 4096);
+    uint64_t work_ns = bench::arg(argc, argv, "work-ns", 1000);
+    uint32_t size = bench::arg(argc, argv, "size", 128);
+    static const unsigned queues[] = { 1, 4, 16 };
+
+    if (!flows || flows > 65536 || size < 64 || size > 2048) {
+        fprintf(stderr, "invalid flows or size\n");
+        return 1;
+    }
+
+    printf("packets=%lu flows=%u work=%lu ns size=%u, %u CPUs\n", packets, flows, work_ns,
+           size, std::thread::hardware_concurrency());
+    for (unsigned q : queues) {
+        if (!run(q, packets, flows, work_ns, size))
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,223 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * Trap delivery to user space: copy per read() on the character device
+ * versus the zero-copy mmap'd receive ring, against the software ASIC model.
+ *
+ * Every packet carries its sequence number; the consumer checks order and
+ * payload on both paths and the run fails on any mismatch. Cycles are those
+ * of the driver poll plus the consumer, not of the model. The threaded run
+ * puts the consumer on its own thread, sleeping on the ring eventfd, and
+ * reports how many wakeups were needed.
+ *
+ *   bench_rx_ring [--packets=N] [--burst=N] [--size=BYTES]
+ */
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+
+#include "bench.h"
+#include "sx/cdev.h"
+#include "sx/rx_ring.h"
+
+using namespace sx;
+
+#define RDQ_CDEV    0
+#define RDQ_RING    1
+#define GROUP_CDEV  1
+#define GROUP_RING  2
+#define TRAP_CDEV   SX_TRAP_ID_ETH_L2_LLDP
+#define TRAP_RING   SX_TRAP_ID_ETH_L2_LACP
+#define LOG_SIZE    10
+
+static void make_frame(uint8_t *buf, uint32_t len, uint32_t seq)
+{
+    bench::fill_frame(buf, len, 0x88cc, 0);
+    memcpy(buf + 8, &seq, sizeof(seq));
+}
+
+/* @buf is the frame make_frame() built for @seq */
+static bool check_frame(const uint8_t *buf, const uint8_t *ref, uint32_t len, uint32_t seq)
+{
+    uint32_t got;
+
+    memcpy(&got, buf + 8, sizeof(got));
+    return got == seq && !memcmp(buf + 14, ref + 14, len - 14);
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t packets = bench::arg(argc, argv, "packets", 1000000);
+    uint32_t burst = bench::arg(argc, argv, "burst", 64);
+    uint32_t size = bench::arg(argc, argv, "size", 256);
+    emu::asic asic;
+    rx_ring ring;
+    dev d(asic);
+    std::vector<uint8_t> frames(static_cast<size_t>(burst) * 2048);
+    uint8_t ref[2048];
+    unsigned cq_cdev = asic.config().num_sdq + RDQ_CDEV;
+    unsigned cq_ring = asic.config().num_sdq + RDQ_RING;
+    int err;
+
+    if (!burst || burst > (1u << LOG_SIZE) || size < 64 || size > 2048) {
+        fprintf(stderr, "invalid burst or size\n");
+        return 1;
+    }
+
+    err = d.init();
+    if (!err)
+        err = ring.create(4096, 2048);
+    if (!err)
+        err = d.bind_rdq(RDQ_RING, &ring);
+    if (!err)
+        err = d.create_cq(cq_cdev, LOG_SIZE);
+    if (!err)
+        err = d.create_cq(cq_ring, LOG_SIZE);
+    if (!err)
+        err = d.create_rdq(RDQ_CDEV, LOG_SIZE, cq_cdev, 2048);
+    if (!err)
+        err = d.create_rdq(RDQ_RING, LOG_SIZE, cq_ring, 0);
+    if (!err)
+        err = d.set_trap_group_rdq(GROUP_CDEV, RDQ_CDEV);
+    if (!err)
+        err = d.set_trap_group_rdq(GROUP_RING, RDQ_RING);
+    if (!err)
+        err = d.set_trap_group(TRAP_CDEV, GROUP_CDEV);
+    if (!err)
+        err = d.set_trap_group(TRAP_RING, GROUP_RING);
+    if (err) {
+        fprintf(stderr, "setup failed: %d\n", err);
+        return 1;
+    }
+
+    make_frame(ref, size, 0);
+    printf("packets=%lu burst=%u size=%u\n", packets, burst, size);
+
+    /* read() path: listener queue, one copy and one call per packet */
+    {
+        cdev_file file(d, 2 * burst);
+        std::vector<uint8_t> rbuf(sizeof(ku_read) + 2048);
+        uint64_t got = 0, bad = 0;
+
+        file.add_trap(TRAP_CDEV);
+        uint64_t cyc = 0;
+        for (uint64_t seq = 0; seq < packets; seq += burst) {
+            for (uint32_t i = 0; i < burst; i++) {
+                make_frame(&frames[i * 2048], size, seq + i);
+                asic.inject(TRAP_CDEV, i % 32, &frames[i * 2048], size);
+            }
+            uint64_t c0 = bench::cycles();
+            d.process_cq(cq_cdev);
+            while (file.read(rbuf.data(), rbuf.size(), true) > 0) {
+                const ku_read *hdr = reinterpret_cast<const ku_read *>(rbuf.data());
+
+                if (!check_frame(rbuf.data() + sizeof(*hdr), ref, hdr->length, got))
+                    bad++;
+                got++;
+            }
+            cyc += bench::cycles() - c0;
+        }
+        bench::report("read() copy", got, cyc / bench::cycles_per_ns(), cyc);
+        if (bad || got != (packets + burst - 1) / burst * burst) {
+            fprintf(stderr, "read(): %lu packets, %lu bad\n", got, bad);
+            return 1;
+        }
+    }
+
+    /* mmap'd ring, same thread: in-place access, no syscall per packet */
+    {
+        rx_ring_reader reader;
+        uint64_t got = 0, bad = 0;
+
+        err = reader.open(ring.fd(), ring.event_fd());
+        if (err) {
+            fprintf(stderr, "ring open failed: %d\n", err);
+            return 1;
+        }
+
+        uint64_t cyc = 0;
+        for (uint64_t seq = 0; seq < packets; seq += burst) {
+            const sx_rx_ring_desc *desc;
+            uint32_t n = 0;
+
+            for (uint32_t i = 0; i < burst; i++) {
+                make_frame(&frames[i * 2048], size, seq + i);
+                asic.inject(TRAP_RING, i % 32, &frames[i * 2048], size);
+            }
+            uint64_t c0 = bench::cycles();
+            d.process_cq(cq_ring);
+            while ((desc = reader.peek(n))) {
+                if (!check_frame(reader.data(desc), ref, desc->len, got))
+                    bad++;
+                got++;
+                n++;
+            }
+            reader.release(n);
+            cyc += bench::cycles() - c0;
+        }
+        bench::report("mmap ring", got, cyc / bench::cycles_per_ns(), cyc);
+        if (bad || reader.drops()) {
+            fprintf(stderr, "ring: %lu packets, %lu bad, %lu drops\n", got, bad, reader.drops());
+            return 1;
+        }
+    }
+
+    /* mmap'd ring with the consumer on its own thread */
+    {
+        rx_ring_reader reader;
+        std::atomic<uint64_t> got{0};
+        std::atomic<bool> stop{false};
+        uint64_t bad = 0, sent = 0, wakeups0 = ring.wakeups();
+
+        reader.open(ring.fd(), ring.event_fd());
+        uint64_t t0 = emu::asic::now_ns();
+        std::thread consumer([&] {
+            uint64_t seq = got.load();
+
+            while (!stop.load(std::memory_order_relaxed) || reader.available()) {
+                const sx_rx_ring_desc *desc;
+                uint32_t n = 0;
+
+                if (reader.wait(10) <= 0)
+                    continue;
+                while ((desc = reader.peek(n))) {
+                    if (!check_frame(reader.data(desc), ref, desc->len, seq))
+                        bad++;
+                    seq++;
+                    n++;
+                }
+                reader.release(n);
+                got.store(seq, std::memory_order_release);
+            }
+        });
+
+        uint64_t base = got.load();
+        for (uint64_t seq = base; seq < base + packets; seq += burst) {
+            for (uint32_t i = 0; i < burst; i++) {
+                make_frame(&frames[i * 2048], size, seq + i);
+                while (asic.inject(TRAP_RING, i % 32, &frames[i * 2048], size) == -ENOSPC) {
+                    d.process_cq(cq_ring);
+                    std::this_thread::yield();
+                }
+                sent++;
+            }
+            d.process_cq(cq_ring);
+        }
+        while (got.load(std::memory_order_acquire) - base < sent) {
+            d.process_cq(cq_ring);
+            std::this_thread::yield();
+        }
+        stop = true;
+        consumer.join();
+
+        uint64_t ns = emu::asic::now_ns() - t0, wakeups = ring.wakeups() - wakeups0;
+        printf("%-32s %10.3f Mpps %10.4f wakeups/pkt\n", "mmap ring, consumer thread",
+               sent * 1e3 / ns, static_cast<double>(wakeups) / sent);
+        if (bad || reader.drops()) {
+            fprintf(stderr, "ring thread: %lu bad, %lu drops\n", bad, reader.drops());
+            return 1;
+        }
+    }
+    return 0;
+}
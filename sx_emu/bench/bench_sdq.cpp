@@ -0,0 +1,132 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * Control-plane transmit in bursts of 1, 16 and 64 packets. Every packet
+ * starts out fragmented, as the stack builds it: a header buffer and a
+ * payload buffer. It is either linearized and copied by send(), or handed
+ * over as is with send_sg(); either with a doorbell per packet or with
+ * SX_SEND_MORE on all but the last packet of a burst (xmit_more).
+ *
+ * Doorbells are charged --mmio-ns of CPU time each, the cost of an uncached
+ * write to the device BAR. The egress handler checks that every packet
+ * leaves its port intact and in order.
+ *
+ *   bench_sdq [--packets=N] [--size=BYTES] [--hdr=BYTES] [--mmio-ns=NS]
+ */
+
+#include <cstdio>
+
+#include "bench.h"
+#include "sx/dev.h"
+
+using namespace sx;
+
+#define SDQ         0
+#define LOG_SIZE    10
+#define SEQ_OFF     14
+
+struct mode {
+    const char *name;
+    bool        sg;
+    bool        more;
+};
+
+int main(int argc, char **argv)
+{
+    static const unsigned bursts[] = { 1, 16, 64 };
+    static const mode modes[] = {
+        { "linearize, doorbell each", false, false },
+        { "linearize, xmit_more",     false, true },
+        { "sg, doorbell each",        true,  false },
+        { "sg, xmit_more",            true,  true },
+    };
+    uint64_t packets = bench::arg(argc, argv, "packets", 1000000);
+    uint32_t size = bench::arg(argc, argv, "size", 512);
+    uint32_t hdr = bench::arg(argc, argv, "hdr", 64);
+    emu::asic_config cfg;
+    cfg.mmio_delay_ns = bench::arg(argc, argv, "mmio-ns", 100);
+    emu::asic asic(cfg);
+    dev d(asic);
+    uint8_t ref[2048], frame[2048];
+    uint64_t expect = 0, bad = 0;
+    int err;
+
+    if (size < 64 || size > sizeof(ref) || hdr < SEQ_OFF + 8 || hdr >= size) {
+        fprintf(stderr, "invalid size or hdr\n");
+        return 1;
+    }
+
+    err = d.init();
+    if (!err)
+        err = d.create_cq(SDQ, LOG_SIZE);
+    if (!err)
+        err = d.create_sdq(SDQ, LOG_SIZE, SDQ);
+    if (err) {
+        fprintf(stderr, "setup failed: %d\n", err);
+        return 1;
+    }
+
+    bench::fill_frame(ref, size, 0x0800, 5);
+    asic.set_egress_handler([&](uint16_t port, const uint8_t *data, uint32_t len) {
+        uint64_t seq;
+
+        memcpy(&seq, data + SEQ_OFF, sizeof(seq));
+        if (len != size || seq != expect || port != seq % 32 ||
+            memcmp(data + SEQ_OFF + 8, ref + SEQ_OFF + 8, size - SEQ_OFF - 8))
+            bad++;
+        expect++;
+    });
+
+    printf("packets=%lu size=%u hdr=%u mmio=%uns\n", packets, size, hdr, cfg.mmio_delay_ns);
+    printf("%-28s %6s %10s %12s %12s\n", "mode", "burst", "Mpps", "cycles/pkt", "doorbell/pkt");
+    for (const mode &m : modes) {
+        for (unsigned burst : bursts) {
+            uint64_t db0 = asic.stats().doorbells.load(), sent = 0, cyc = 0;
+            uint64_t t0 = emu::asic::now_ns();
+
+            expect = 0;
+            while (sent < packets) {
+                uint64_t c = bench::cycles();
+
+                for (unsigned i = 0; i < burst; i++, sent++) {
+                    pkt_buf *frags[2] = { pkt_buf_alloc(hdr), pkt_buf_alloc(size - hdr) };
+                    unsigned flags = m.more && i + 1 < burst ? SX_SEND_MORE : 0;
+                    uint16_t port = sent % 32;
+
+                    /* The stack's packet: headers, then payload */
+                    memcpy(frags[0]->data, ref, hdr);
+                    memcpy(frags[0]->data + SEQ_OFF, &sent, sizeof(sent));
+                    frags[0]->len = hdr;
+                    memcpy(frags[1]->data, ref + hdr, size - hdr);
+                    frags[1]->len = size - hdr;
+
+                    if (m.sg) {
+                        err = d.send_sg(SDQ, port, frags, 2, flags);
+                    } else {
+                        memcpy(frame, frags[0]->data, hdr);
+                        memcpy(frame + hdr, frags[1]->data, size - hdr);
+                        pkt_buf_free(frags[0]);
+                        pkt_buf_free(frags[1]);
+                        err = d.send(SDQ, port, frame, size, SX_TX_CTL_TO_PORT, flags);
+                    }
+                    if (err) {
+                        fprintf(stderr, "%s: send failed: %d\n", m.name, err);
+                        return 1;
+                    }
+                }
+                d.process_cq(SDQ);
+                cyc += bench::cycles() - c;
+            }
+            uint64_t ns = emu::asic::now_ns() - t0;
+
+            printf("%-28s %6u %10.3f %12.1f %12.3f\n", m.name, burst, sent * 1e3 / ns,
+                   static_cast<double>(cyc) / sent,
+                   static_cast<double>(asic.stats().doorbells.load() - db0) / sent);
+            if (bad || expect != sent) {
+                fprintf(stderr, "%s: %lu bad packets, %lu/%lu sent\n", m.name, bad, expect, sent);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
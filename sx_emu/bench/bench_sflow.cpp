@@ -0,0 +1,218 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * Sample records per second through the sampling trap path. --ports ports
+ * each run a session sampling one in --rate packets forwarded through the
+ * model; bursts of --backlog packets of --size bytes are forwarded, the
+ * samples polled and every pending datagram read back, as an agent would:
+ *
+ *  - full DMA: the trap group copies whole packets to 2 KiB buffers and
+ *    the driver keeps the headers;
+ *  - truncated: the ASIC DMAs only the --header bytes kept, to 256 byte
+ *    buffers;
+ *  - limited: truncated, and each session limited to --limit samples/s.
+ *
+ * Cycles per sample include the model's DMA of each sample. Every record
+ * is decoded and checked: ports, rate, lengths and header bytes must be
+ * those of its packet, and per session the sequence must run without gaps
+ * while pool and drops account for every sample; limited sessions must
+ * stay within their rate and burst.
+ *
+ *   bench_sflow [--packets=N] [--ports=N] [--rate=N] [--size=BYTES]
+ *               [--header=BYTES] [--limit=N] [--backlog=N]
+ */
+
+#include <cstdio>
+#include <vector>
+
+#include "bench.h"
+#include "sx/sflow.h"
+
+using namespace sx;
+
+#define EMAD_SDQ    0
+#define SAMPLE_RDQ  1
+#define SAMPLE_GRP  1
+#define LOG_SIZE    10
+#define SEQ_OFF     14
+#define MAX_SIZE    2048        /* RDQ buffers of full DMA */
+
+struct mode {
+    const char *name;
+    bool        trunc;
+    bool        limit;
+};
+
+struct port_state {
+    uint32_t seq = 0;           /* records seen */
+    uint32_t sampled = 0;       /* packets the ASIC trapped */
+    uint64_t next_pkt = 0;      /* sequence of the packet the next record may carry */
+};
+
+static int setup(dev &d, emad &e, unsigned cqn, bool trunc)
+{
+    int err;
+
+    err = bench::setup_emad(d, e, LOG_SIZE + 1);
+    if (!err)
+        err = d.create_cq(cqn, LOG_SIZE);
+    if (!err)
+        err = d.create_rdq(SAMPLE_RDQ, LOG_SIZE, cqn, trunc ? 256 : 2048);
+    if (!err)
+        err = d.set_trap_group_rdq(SAMPLE_GRP, SAMPLE_RDQ);
+    return err;
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return be32toh(v);
+}
+
+/* Checks the samples of one datagram; returns false on a bad one */
+static bool check(const uint8_t *p, size_t len, unsigned n, unsigned ports, uint32_t rate,
+                  uint32_t size, uint32_t header, std::vector<port_state> &ps,
+                  const uint8_t *ref)
+{
+    const uint8_t *end = p + len;
+
+    for (unsigned i = 0; i < n; i++) {
+        if (end - p < SX_SFLOW_SAMPLE_FIXED)
+            return false;
+
+        uint32_t slen = get32(p + 4) + 8, port = get32(p + 12), hlen = get32(p + 60);
+        uint32_t seq = get32(p + 8), pool = get32(p + 20), drops = get32(p + 24);
+        uint64_t pkt;
+
+        if (slen > static_cast<size_t>(end - p) || port >= ports || get32(p) != SX_SFLOW_FLOW_SAMPLE ||
+            get32(p + 16) != rate || get32(p + 28) != port || get32(p + 32) != (port + 1) % ports ||
+            get32(p + 52) != size || hlen != std::min(size, header) ||
+            slen != SX_SFLOW_SAMPLE_FIXED + ((hlen + 3) & ~3u))
+            return false;
+
+        port_state &s = ps[port];
+        memcpy(&pkt, p + SX_SFLOW_SAMPLE_FIXED + SEQ_OFF, sizeof(pkt));
+        if (seq != ++s.seq || pkt < s.next_pkt || pool != static_cast<uint32_t>(seq + drops) * rate ||
+            memcmp(p + SX_SFLOW_SAMPLE_FIXED + SEQ_OFF + 8, ref + SEQ_OFF + 8, hlen - SEQ_OFF - 8))
+            return false;
+        s.next_pkt = pkt + 1;
+        p += slen;
+    }
+    return p == end;
+}
+
+static bool run(const mode &m, uint64_t packets, unsigned ports, uint32_t rate, uint32_t size,
+                uint32_t header, uint32_t limit, uint32_t backlog)
+{
+    emu::asic_config cfg;
+    cfg.num_ports = ports;
+    emu::asic asic(cfg);
+    dev d(asic);
+    emad e(d, EMAD_SDQ, 0);
+    unsigned cqn = cfg.num_sdq + SAMPLE_RDQ;
+    sflow sf(d, e, SAMPLE_GRP, header);
+    std::vector<port_state> ps(ports);
+    std::vector<uint8_t> dgram(SX_SFLOW_DGRAM_BYTES);
+    uint8_t frame[MAX_SIZE], ref[MAX_SIZE];
+    uint64_t sent = 0, records = 0, datagrams = 0, dma = 0, cyc = 0;
+    int err;
+
+    err = setup(d, e, cqn, m.trunc);
+    if (!err)
+        err = sf.start();
+    if (!err && !m.trunc)
+        err = d.set_trap_group_trunc(SAMPLE_GRP, 0);
+    for (unsigned p = 0; p < ports && !err; p++)
+        err = sf.add_session(p, rate, m.limit ? limit : 0);
+    if (err) {
+        fprintf(stderr, "setup failed: %d\n", err);
+        return false;
+    }
+
+    bench::fill_frame(ref, size, 0x0800, 5);
+    memcpy(frame, ref, size);
+    uint64_t t0 = emu::asic::now_ns();
+    while (sent < packets) {
+        uint64_t c = bench::cycles();
+        unsigned n;
+        ssize_t len;
+
+        for (uint32_t i = 0; i < backlog && sent < packets; i++, sent++) {
+            unsigned port = sent % ports;
+            int ret;
+
+            memcpy(frame + SEQ_OFF, &sent, sizeof(sent));
+            ret = asic.port_forward(port, (port + 1) % ports, frame, size);
+            if (ret < 0) {
+                fprintf(stderr, "%s: forward: %d\n", m.name, ret);
+                return false;
+            }
+            ps[port].sampled += ret;
+        }
+        while (d.poll_cq(cqn, SX_NAPI_WEIGHT) > 0)
+            ;
+        while ((len = sf.read(dgram.data(), dgram.size(), &n, true)) > 0) {
+            if (!check(dgram.data(), len, n, ports, rate, size, header, ps, ref)) {
+                fprintf(stderr, "%s: bad sample in datagram %lu\n", m.name, datagrams);
+                return false;
+            }
+            records += n;
+            datagrams++;
+        }
+        cyc += bench::cycles() - c;
+    }
+    uint64_t ns = emu::asic::now_ns() - t0;
+
+    sflow_stats s;
+    sf.get_stats(&s);
+    uint64_t sampled = 0;
+    for (const port_state &p : ps)
+        sampled += p.sampled;
+    if (s.sampled != sampled || s.records != records || s.records + s.limited + s.overflow != sampled ||
+        (!m.limit && s.limited) ||
+        (m.limit && records > ports * (limit * (ns / 1e9) + std::max(limit / 10, 1u) + 1))) {
+        fprintf(stderr, "%s: %lu sampled, %lu records, %lu limited, %lu overflow\n", m.name,
+                sampled, records, s.limited, s.overflow);
+        return false;
+    }
+    dma = (m.trunc ? std::min(size, header) : size) * sampled;
+
+    printf("%-10s %10lu %10lu %10lu %12.0f %12.1f %10.0f\n", m.name, sampled, records, s.limited,
+           records * 1e9 / ns, static_cast<double>(cyc) / (sampled ? sampled : 1),
+           static_cast<double>(dma) / (sampled ? sampled : 1));
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    static const mode modes[] = {
+        { "full DMA",  false, false },
+        { "truncated", true,  false },
+        { "limited",   true,  true  },
+    };
+    uint64_t packets = bench::arg(argc, argv, "packets", 1000000);
+    unsigned ports = bench::arg(argc, argv, "ports", 32);
+    uint32_t rate = bench::arg(argc, argv, "rate", 1);
+    uint32_t size = bench::arg(argc, argv, "size", 1500);
+    uint32_t header = bench::arg(argc, argv, "header", SX_SFLOW_HEADER_BYTES);
+    uint32_t limit = bench::arg(argc, argv, "limit", 20000);
+    uint32_t backlog = bench::arg(argc, argv, "backlog", 256);
+
+    if (ports < 2 || ports > SX_MAX_PORTS || !rate || size < 64 || size > MAX_SIZE ||
+        header < 32 || header > 256 || !backlog || backlog > (1u << LOG_SIZE)) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    printf("packets=%lu ports=%u rate=1:%u size=%u header=%u limit=%u/s per session\n", packets,
+           ports, rate, size, header, limit);
+    printf("%-10s %10s %10s %10s %12s %12s %10s\n", "mode", "sampled", "records", "limited",
+           "records/s", "cycles/smp", "DMA B/smp");
+    for (const mode &m : modes) {
+        if (!run(m, packets, ports, rate, size, header, limit, backlog))
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,195 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * Cost of the per-packet counter update of the trap path (RDQ, port and
+ * trap packets/bytes) from 1 to 64 threads, all trapping into the same RDQ
+ * and trap: one lock around shared counters (the previous scheme), shared
+ * atomic counters, and per-CPU counters.
+ *
+ * A reader thread snapshots the counters throughout, as a sysfs/ioctl read
+ * would. Every packet is counted with the same length, so each snapshot
+ * must have bytes == packets * len (shared atomics cannot promise that and
+ * only report torn snapshots); final totals must match the updates.
+ * Cost is CPU time per update, summed over the updating threads, so it is
+ * comparable across thread counts whether or not threads share a CPU.
+ *
+ *   bench_stats [--updates=N] [--threads=MAX] [--len=BYTES]
+ */
+
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "sx/dev.h"
+#include "sx/pcpu.h"
+
+using namespace sx;
+
+#define NR_PORTS 32
+
+struct counters {
+    queue_counters rdq;
+    trap_counters  trap;
+    port_counters  port[NR_PORTS];
+};
+
+struct shared_counters {
+    std::atomic<uint64_t> rdq_packets{0}, rdq_bytes{0};
+    std::atomic<uint64_t> trap_packets{0}, trap_bytes{0};
+    std::atomic<uint64_t> port_packets[NR_PORTS] = {}, port_bytes[NR_PORTS] = {};
+};
+
+struct locked {
+    static const char *name() { return "mutex"; }
+
+    void count(unsigned port, uint32_t len)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        c.rdq.packets++;
+        c.rdq.bytes += len;
+        c.port[port].rx_packets++;
+        c.port[port].rx_bytes += len;
+        c.trap.packets++;
+        c.trap.bytes += len;
+    }
+
+    void snapshot(trap_counters *out)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        *out = c.trap;
+    }
+
+    static const bool consistent = true;
+    std::mutex        lock;
+    counters          c = {};
+};
+
+struct atomics {
+    static const char *name() { return "shared atomics"; }
+
+    void count(unsigned port, uint32_t len)
+    {
+        c.rdq_packets.fetch_add(1, std::memory_order_relaxed);
+        c.rdq_bytes.fetch_add(len, std::memory_order_relaxed);
+        c.port_packets[port].fetch_add(1, std::memory_order_relaxed);
+        c.port_bytes[port].fetch_add(len, std::memory_order_relaxed);
+        c.trap_packets.fetch_add(1, std::memory_order_relaxed);
+        c.trap_bytes.fetch_add(len, std::memory_order_relaxed);
+    }
+
+    /* Fields are read one by one, so packets and bytes may disagree */
+    void snapshot(trap_counters *out)
+    {
+        out->packets = c.trap_packets.load();
+        out->bytes = c.trap_bytes.load();
+        out->no_listener = 0;
+    }
+
+    static const bool consistent = false;
+    shared_counters   c;
+};
+
+struct percpu {
+    static const char *name() { return "per-CPU"; }
+
+    void count(unsigned port, uint32_t len)
+    {
+        pcpu_stats<counters>::update st(s);
+
+        stats_inc(&st->rdq.packets);
+        stats_inc(&st->rdq.bytes, len);
+        stats_inc(&st->port[port].rx_packets);
+        stats_inc(&st->port[port].rx_bytes, len);
+        stats_inc(&st->trap.packets);
+        stats_inc(&st->trap.bytes, len);
+    }
+
+    void snapshot(trap_counters *out)
+    {
+        s.read(out, [](const counters &c) -> const trap_counters & { return c.trap; });
+    }
+
+    static const bool    consistent = true;
+    pcpu_stats<counters> s;
+};
+
+/* Returns false on an inconsistent snapshot or wrong totals */
+template <typename S>
+static bool run(unsigned threads, uint64_t updates, uint32_t len)
+{
+    S s;
+    std::vector<std::thread> workers;
+    std::atomic<unsigned> ready{0};
+    std::atomic<bool> go{false}, stop{false};
+    std::atomic<uint64_t> cpu_ns{0};
+    uint64_t snapshots = 0, bad = 0;
+    char name[64];
+
+    for (unsigned t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            ready++;
+            while (!go.load(std::memory_order_acquire))
+                std::this_thread::yield();
+            uint64_t c0 = thread_cpu_ns();
+            for (uint64_t i = 0; i < updates; i++)
+                s.count((t + i) % NR_PORTS, len);
+            cpu_ns += thread_cpu_ns() - c0;
+        });
+    }
+
+    std::thread reader([&] {
+        while (!stop.load(std::memory_order_relaxed)) {
+            trap_counters tc;
+
+            s.snapshot(&tc);
+            if (tc.bytes != tc.packets * len)
+                bad++;
+            snapshots++;
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    });
+
+    while (ready.load() < threads)
+        std::this_thread::yield();
+    uint64_t t0 = emu::asic::now_ns();
+    go.store(true, std::memory_order_release);
+    for (auto &w : workers)
+        w.join();
+    uint64_t ns = emu::asic::now_ns() - t0;
+    stop = true;
+    reader.join();
+
+    trap_counters tc;
+    s.snapshot(&tc);
+    uint64_t total = updates * threads;
+
+    snprintf(name, sizeof(name), "%s, %u threads", S::name(), threads);
+    printf("%-32s %10.2f Mupd/s %10.1f CPU ns/upd %6lu/%lu torn snapshots\n", name,
+           total * 1e3 / ns, static_cast<double>(cpu_ns) / total, bad, snapshots);
+    if ((bad && S::consistent) || tc.packets != total || tc.bytes != total * len) {
+        fprintf(stderr, "%s: %lu bad snapshots, %lu/%lu packets\n", name, bad, tc.packets, total);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t updates = bench::arg(argc, argv, "updates", 1000000);
+    unsigned max_threads = bench::arg(argc, argv, "threads", 64);
+    uint32_t len = bench::arg(argc, argv, "len", 128);
+
+    printf("updates=%lu per thread, len=%u, %u CPUs\n", updates, len,
+           std::thread::hardware_concurrency());
+    for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+        if (!run<locked>(threads, updates, len) || !run<atomics>(threads, updates, len) ||
+            !run<percpu>(threads, updates, len))
+            return 1;
+    }
+    return 0;
+}
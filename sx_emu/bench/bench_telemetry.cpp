@@ -0,0 +1,235 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * CPU cost of exporting the counters of --ports ports every --interval-ms
+ * to --exporters exporters, over EMAD answered after --latency-ns:
+ *
+ *  - poll: every exporter reads every port itself, one PPCNT access at a
+ *    time, as exporters calling into the driver per port would;
+ *  - ring: the driver snapshots every port once per interval, pipelined,
+ *    into the telemetry ring; every exporter copies the records out of
+ *    its own mapping with telemetry_reader.
+ *
+ * Each mode runs --snapshots intervals while the main thread counts
+ * traffic and buffer occupancy on random ports. CPU is the process's,
+ * less the traffic thread's, so it includes the model's firmware thread,
+ * which costs about the same per access in both modes. Exporters check
+ * every sample: packet counts never go back, bytes are 64 per packet, and
+ * ring records arrive in sequence; at the end each exporter's last sample
+ * of a port must match what was counted.
+ *
+ *   bench_telemetry [--ports=N] [--exporters=N] [--snapshots=N]
+ *                   [--interval-ms=MS] [--latency-ns=NS]
+ */
+
+#include <atomic>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "sx/telemetry.h"
+
+using namespace sx;
+
+#define EMAD_SDQ    0
+#define LOG_SIZE    11
+#define PKT_BYTES   64
+
+struct exporter {
+    std::vector<sx_port_cnt> last;
+    uint64_t                 samples = 0;
+    uint64_t                 lost = 0;
+    bool                     bad = false;
+};
+
+/* One sample of a port: consistent in itself and not behind the last */
+static void sample(exporter &x, uint16_t port, const sx_port_cnt &c)
+{
+    sx_port_cnt &l = x.last[port];
+
+    if (c.rx_bytes != c.rx_packets * PKT_BYTES || c.tx_bytes != c.tx_packets * PKT_BYTES ||
+        c.rx_packets != c.tx_packets + c.tx_discards || c.rx_packets < l.rx_packets)
+        x.bad = true;
+    l = c;
+    x.samples++;
+}
+
+static void poll_ports(emad &e, unsigned ports, exporter &x)
+{
+    for (unsigned p = 0; p < ports; p++) {
+        emad_op o;
+
+        o.reg_id = SX_REG_ID_PPCNT;
+        o.method = SX_EMAD_METHOD_QUERY;
+        o.payload.assign(sizeof(sx_ppcnt_reg), 0);
+        reinterpret_cast<sx_ppcnt_reg *>(o.payload.data())->local_port = htobe16(p);
+        if (e.access(o)) {
+            x.bad = true;
+            return;
+        }
+
+        const sx_port_cnt &w = reinterpret_cast<const sx_ppcnt_reg *>(o.payload.data())->cnt;
+        sx_port_cnt c = {};
+        c.rx_packets = be64toh(w.rx_packets);
+        c.rx_bytes = be64toh(w.rx_bytes);
+        c.tx_packets = be64toh(w.tx_packets);
+        c.tx_bytes = be64toh(w.tx_bytes);
+        c.tx_discards = be64toh(w.tx_discards);
+        for (unsigned i = 0; i < SX_PORT_PRIOS; i++)
+            c.pg_occupancy[i] = be32toh(w.pg_occupancy[i]);
+        sample(x, p, c);
+    }
+}
+
+static void read_ring(telemetry_reader &r, exporter &x, uint64_t *expect)
+{
+    sx_tele_rec rec;
+
+    while (r.next(&rec) > 0) {
+        uint64_t n = (rec.seq - 2) / 2;
+
+        if (n != *expect + r.lost() - x.lost)
+            x.bad = true;
+        x.lost = r.lost();
+        *expect = n + 1;
+        sample(x, rec.local_port, rec.cnt);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    unsigned ports = bench::arg(argc, argv, "ports", 128);
+    unsigned nexp = bench::arg(argc, argv, "exporters", 2);
+    unsigned snapshots = bench::arg(argc, argv, "snapshots", 50);
+    unsigned interval = bench::arg(argc, argv, "interval-ms", 10);
+    emu::asic_config cfg;
+    cfg.emad_latency_ns = bench::arg(argc, argv, "latency-ns", 20000);
+    cfg.num_ports = ports;
+    std::mt19937_64 rng(1);
+    std::vector<sx_port_cnt> truth(ports);
+    int err;
+
+    if (!ports || ports > SX_MAX_PORTS || !nexp || !snapshots || !interval) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    emu::asic asic(cfg);
+    dev d(asic);
+    emad e(d, EMAD_SDQ, 0);
+    telemetry tele(e);
+
+    err = bench::setup_emad(d, e, LOG_SIZE, false);
+    if (!err)
+        err = tele.create(16 * ports, ports);
+    if (err) {
+        fprintf(stderr, "setup failed: %d\n", err);
+        return 1;
+    }
+    asic.set_irq_handler([&d](unsigned vector) { d.irq(vector); });
+    tele.set_interval_ms(interval);
+
+    printf("ports=%u exporters=%u snapshots=%u interval=%ums latency=%uns\n", ports, nexp,
+           snapshots, interval, cfg.emad_latency_ns);
+    printf("%-6s %9s %10s %9s %14s %16s\n", "mode", "accesses", "samples", "cpu ms",
+           "cpu us/1k smp", "cpu%/1k ports/s");
+
+    for (bool ring : { false, true }) {
+        std::vector<exporter> xs(nexp);
+        std::vector<std::thread> threads;
+        std::atomic<bool> stop{false};
+        uint64_t acc = asic.stats().emad_requests.load();
+        uint64_t c0 = cpu_ns(CLOCK_PROCESS_CPUTIME_ID), t0 = thread_cpu_ns();
+        auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(snapshots * interval);
+
+        for (exporter &x : xs)
+            x.last.assign(ports, sx_port_cnt());
+        if (ring && (err = tele.start())) {
+            fprintf(stderr, "start: %d\n", err);
+            return 1;
+        }
+        for (unsigned i = 0; i < nexp; i++) {
+            threads.emplace_back([&, i] {
+                exporter &x = xs[i];
+                telemetry_reader r;
+                uint64_t expect = 0;
+                auto next = std::chrono::steady_clock::now();
+
+                if (ring && r.open(tele.fd())) {
+                    x.bad = true;
+                    return;
+                }
+                while (!stop.load()) {
+                    if (ring)
+                        read_ring(r, x, &expect);
+                    else
+                        poll_ports(e, ports, x);
+                    next += std::chrono::milliseconds(interval);
+                    std::this_thread::sleep_until(next);
+                }
+                /* The driver's last snapshot postdates all traffic */
+                if (ring)
+                    read_ring(r, x, &expect);
+                else
+                    poll_ports(e, ports, x);
+            });
+        }
+
+        while (std::chrono::steady_clock::now() < end) {
+            for (unsigned k = 0; k < 16; k++) {
+                unsigned p = rng() % ports, prio = rng() % SX_PORT_PRIOS;
+                uint64_t pkts = 1 + rng() % 100, drops = rng() % 4 ? 0 : rng() % pkts;
+                uint32_t occ = rng() % 1000;
+
+                asic.port_traffic(p, prio, pkts, pkts * PKT_BYTES, drops);
+                asic.port_occupancy(p, prio, occ, occ / 2);
+                truth[p].rx_packets += pkts;
+                truth[p].pg_occupancy[prio] = occ;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+        }
+        uint64_t traffic_ns = thread_cpu_ns() - t0;
+
+        if (ring) {
+            tele.stop();
+            err = tele.snapshot();
+        }
+        stop.store(true);
+        for (std::thread &t : threads)
+            t.join();
+        if (err) {
+            fprintf(stderr, "snapshot: %d\n", err);
+            return 1;
+        }
+
+        uint64_t samples = 0;
+        for (unsigned i = 0; i < nexp; i++) {
+            exporter &x = xs[i];
+
+            for (unsigned p = 0; p < ports && !x.bad; p++) {
+                x.bad = x.last[p].rx_packets != truth[p].rx_packets ||
+                        memcmp(x.last[p].pg_occupancy, truth[p].pg_occupancy,
+                               sizeof(truth[p].pg_occupancy));
+            }
+            if (x.bad || x.lost) {
+                fprintf(stderr, "%s: exporter %u: bad sample, %lu lost\n", ring ? "ring" : "poll",
+                        i, x.lost);
+                return 1;
+            }
+            samples += x.samples;
+        }
+
+        double ns = cpu_ns(CLOCK_PROCESS_CPUTIME_ID) - c0 - traffic_ns;
+        double per_k = ns / 1e3 / (samples / 1e3);
+        printf("%-6s %9lu %10lu %9.1f %14.1f %16.3f\n", ring ? "ring" : "poll",
+               asic.stats().emad_requests.load() - acc, samples, ns / 1e6, per_k, per_k / 1e4);
+    }
+
+    telemetry_stats s;
+    tele.get_stats(&s);
+    printf("driver: %lu snapshots, last %.3f ms, %.1f us cpu each\n", s.snapshots,
+           s.snapshot_ns / 1e6, s.snapshots ? s.cpu_ns / 1e3 / s.snapshots : 0.0);
+    return 0;
+}
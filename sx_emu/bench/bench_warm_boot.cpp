@@ -0,0 +1,424 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * Restart to forwarding-ready with a full table loaded: --v4 IPv4 and --v6
+ * IPv6 prefixes, --hosts neighbours as /32 host routes, --fdb static MAC
+ * entries, an ACL of --acl rules and --counters flow counter blocks, over
+ * EMAD answered after --latency-ns. Each boot starts a new driver instance
+ * (dev, EMAD, modules, warm_boot) on the model and syncs the whole
+ * configuration through the shadow image in /dev/shm:
+ *
+ *  - cold: empty image, everything is programmed, as any restart costs
+ *    without one;
+ *  - warm, unchanged: the model kept its state across the restart and the
+ *    image says so, nothing is written;
+ *  - warm, --churn percent of every kind changed, removed and added while
+ *    the driver was down: only that goes out.
+ *
+ * After each boot the model must hold exactly the configuration: every
+ * route with its adjacency, the MAC table, every rule's action on a
+ * lookup of its key. Counter blocks must not overlap; traffic counted
+ * before a restart must still read on blocks kept, and blocks allocated
+ * anew must read zero. Finally an image left dirty by a crash must be
+ * discarded on open.
+ *
+ *   bench_warm_boot [--v4=N] [--v6=N] [--hosts=N] [--fdb=N] [--acl=N]
+ *                   [--counters=N] [--churn=PCT] [--latency-ns=NS]
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "bench.h"
+#include "sx/warm_boot.h"
+
+using namespace sx;
+
+#define EMAD_SDQ    0
+#define EMAD_RDQ    0
+#define EMAD_GROUP  0
+#define LOG_SIZE    11
+#define ACL_ID      3
+#define HOST_VR     1
+#define CNT_PACKETS 5
+
+/* What the control plane wants */
+struct config {
+    std::vector<route_entry>   routes;
+    std::vector<sx_wb_fdb>     fdb;
+    std::vector<acl_rule>      acl;
+    std::vector<sx_wb_counter> ctrs;
+};
+
+/* Keys drawn so far, so that no two objects share one */
+struct generator {
+    std::mt19937_64             rng{1};
+    std::unordered_set<uint64_t> v4, v6, macs, acl_keys;
+    uint64_t                    next_owner = 1;
+    uint32_t                    next_priority = 1;
+
+    route_entry route(unsigned kind);
+    sx_wb_fdb fdb();
+    acl_rule rule();
+    sx_wb_counter counter();
+};
+
+/* @kind 0: IPv4 prefix, 1: IPv6 prefix, 2: neighbour */
+route_entry generator::route(unsigned kind)
+{
+    static const uint8_t v4_lens[] = { 24, 24, 24, 24, 24, 24, 23, 22, 22, 21, 20, 19, 16 };
+    static const uint8_t v6_lens[] = { 48, 48, 48, 48, 32, 40, 44, 56 };
+    route_entry r = {};
+
+    r.adj_index = rng() % emu::asic_config().kvd_adj_entries;
+    for (;;) {
+        if (kind == 1) {
+            r.protocol = SX_RALUE_PROTO_IPV6;
+            r.prefix_len = v6_lens[rng() % sizeof(v6_lens)];
+
+            uint64_t addr = (0x2000000000000000ull | rng() >> 3) & ~0ull << (64 - r.prefix_len);
+            /* Lengths stay below 58: the low bits are free for the length */
+            if (v6.insert(addr | r.prefix_len).second) {
+                bench::put_be(r.dip, addr, 8);
+                return r;
+            }
+            continue;
+        }
+
+        r.protocol = SX_RALUE_PROTO_IPV4;
+        r.vr = kind == 2 ? HOST_VR : 0;
+        r.prefix_len = kind == 2 ? 32 : v4_lens[rng() % sizeof(v4_lens)];
+
+        uint64_t addr = (0x01000000 + rng() % 0xdf000000) & ~0u << (32 - r.prefix_len);
+        if (r.prefix_len == 32)
+            addr = 0x0a000000 | (rng() & 0xffffff);
+        uint64_t key = static_cast<uint64_t>(r.vr) << 40 |
+                       static_cast<uint64_t>(r.prefix_len) << 32 | addr;
+        if (v4.insert(key).second) {
+            bench::put_be(r.dip, addr, 4);
+            return r;
+        }
+    }
+}
+
+sx_wb_fdb generator::fdb()
+{
+    sx_wb_fdb e = {};
+
+    do {
+        e.fid = 1 + rng() % 4000;
+        e.mac[0] = 0x02;
+        bench::put_be(e.mac + 1, rng(), 5);
+    } while (!macs.insert(sx_fdb_key(e.fid, e.mac)).second);
+    e.port = rng() % 64;
+    return e;
+}
+
+/* Narrow 5-tuple-like keys, some wider ones, all exact */
+acl_rule generator::rule()
+{
+    acl_rule r = {};
+
+    r.priority = next_priority++;
+    r.action = static_cast<uint32_t>(rng());
+    r.key_len = rng() % 8 ? 13 : 32;
+    do {
+        for (unsigned i = 0; i < r.key_len; i++) {
+            r.key[i] = static_cast<uint8_t>(rng());
+            r.mask[i] = 0xff;
+        }
+    } while (!acl_keys.insert(*reinterpret_cast<const uint64_t *>(r.key)).second);
+    return r;
+}
+
+sx_wb_counter generator::counter()
+{
+    return { next_owner++, 0, 1u << (rng() % 4) };
+}
+
+static void make_config(generator &g, config *c, uint32_t v4, uint32_t v6, uint32_t hosts,
+                        uint32_t fdb, uint32_t acl, uint32_t ctrs)
+{
+    for (uint32_t i = 0; i < v4 + v6 + hosts; i++)
+        c->routes.push_back(g.route(i < v4 ? 0 : i < v4 + v6 ? 1 : 2));
+    for (uint32_t i = 0; i < fdb; i++)
+        c->fdb.push_back(g.fdb());
+    for (uint32_t i = 0; i < acl; i++)
+        c->acl.push_back(g.rule());
+    for (uint32_t i = 0; i < ctrs; i++)
+        c->ctrs.push_back(g.counter());
+}
+
+/* @pct percent of @v changed by @mod, as many removed and as many new from @make */
+template <typename T, typename Mod, typename Make>
+static void churn(std::vector<T> &v, unsigned pct, std::mt19937_64 &rng, Mod mod, Make make)
+{
+    size_t k = v.size() * pct / 100;
+
+    for (size_t i = 0; i < k; i++)
+        mod(v[rng() % v.size()]);
+    for (size_t i = 0; i < k && !v.empty(); i++) {
+        size_t j = rng() % v.size();
+
+        v[j] = v.back();
+        v.pop_back();
+    }
+    for (size_t i = 0; i < k; i++)
+        v.push_back(make());
+}
+
+static void churn_config(generator &g, config *c, unsigned pct)
+{
+    std::mt19937_64 &rng = g.rng;
+
+    churn(c->routes, pct, rng, [&](route_entry &r) { r.adj_index = (r.adj_index + 1) % 65536; },
+          [&] { return g.route(rng() % 3); });
+    churn(c->fdb, pct, rng, [&](sx_wb_fdb &e) { e.port = (e.port + 1) % 64; },
+          [&] { return g.fdb(); });
+    churn(c->acl, pct, rng, [&](acl_rule &r) { r.action++; }, [&] { return g.rule(); });
+    churn(c->ctrs, pct, rng, [&](sx_wb_counter &b) { b.count = b.count % 8 + 1; },
+          [&] { return g.counter(); });
+}
+
+/* One driver instance; the model outlives it */
+struct driver {
+    dev          d;
+    emad         e;
+    route_bulk   rb;
+    fdb_shadow   fdb;
+    acl_table    acl;
+    counter_pool pool;
+    warm_boot    wb;
+
+    driver(emu::asic &asic, warm_image &img, size_t fdb_max)
+        : d(asic), e(d, EMAD_SDQ, 0), rb(e), fdb(fdb_max), acl(e, ACL_ID),
+          pool(e, asic.config().flow_counters), wb(img)
+    {
+    }
+
+    int setup()
+    {
+        int err;
+
+        err = d.init();
+        if (!err)
+            err = d.create_cq(0, LOG_SIZE);
+        if (!err)
+            err = d.create_sdq(EMAD_SDQ, LOG_SIZE - 1, 0);
+        if (!err)
+            err = d.create_rdq(EMAD_RDQ, LOG_SIZE - 1, 0, 2048);
+        if (!err)
+            err = d.set_trap_group_rdq(EMAD_GROUP, EMAD_RDQ);
+        if (!err)
+            err = d.set_trap_group(SX_TRAP_ID_EMAD, EMAD_GROUP);
+        if (!err)
+            err = e.init();
+        e.set_busy_poll(true);
+        return err;
+    }
+};
+
+/* Counted traffic per counter owner: its block's index and packets */
+using counted_map = std::unordered_map<uint64_t, std::pair<uint32_t, uint64_t>>;
+
+static bool verify(emu::asic &asic, driver &drv, const config &c, counted_map &counted)
+{
+    uint32_t adj, action;
+
+    if (asic.lpm_routes() != c.routes.size()) {
+        fprintf(stderr, "model holds %zu routes, want %zu\n", asic.lpm_routes(), c.routes.size());
+        return false;
+    }
+    for (const route_entry &r : c.routes) {
+        if (asic.lpm_route(r.protocol, r.vr, r.dip, r.prefix_len, &adj) || adj != r.adj_index) {
+            fprintf(stderr, "route missing or wrong in the model\n");
+            return false;
+        }
+    }
+
+    std::unordered_map<uint64_t, uint16_t> fdb = asic.fdb_dump();
+    if (fdb.size() != c.fdb.size() || drv.fdb.size() != c.fdb.size()) {
+        fprintf(stderr, "MAC table: %zu in the model, %zu in the shadow, want %zu\n", fdb.size(),
+                drv.fdb.size(), c.fdb.size());
+        return false;
+    }
+    for (const sx_wb_fdb &e : c.fdb) {
+        auto it = fdb.find(sx_fdb_key(e.fid, e.mac));
+
+        if (it == fdb.end() || it->second != e.port || drv.fdb.lookup(e.fid, e.mac) != e.port) {
+            fprintf(stderr, "MAC entry missing or wrong\n");
+            return false;
+        }
+    }
+
+    for (const acl_rule &r : c.acl) {
+        if (asic.acl_lookup(ACL_ID, r.key, &action) || action != r.action) {
+            fprintf(stderr, "ACL rule missing or wrong in the model\n");
+            return false;
+        }
+    }
+
+    /* Blocks apart; kept ones still counting, new ones from zero */
+    std::vector<std::pair<uint32_t, uint32_t>> blocks;
+    counted_map next;
+    sx_flow_cnt v, d;
+    int err = drv.pool.refresh();
+
+    if (err) {
+        fprintf(stderr, "counter refresh: %d\n", err);
+        return false;
+    }
+    for (const sx_wb_counter &b : c.ctrs) {
+        auto it = counted.find(b.owner);
+        uint64_t want = it != counted.end() && it->second.first == b.index ? it->second.second : 0;
+
+        blocks.emplace_back(b.index, b.count);
+        if (b.index == UINT32_MAX || drv.pool.read(b.index, &v, &d) || v.packets != want) {
+            fprintf(stderr, "counter block of owner %lu: index %u, %lu packets, want %lu\n",
+                    b.owner, b.index, b.index == UINT32_MAX ? 0 : v.packets, want);
+            return false;
+        }
+        next[b.owner] = { b.index, want };
+    }
+    std::sort(blocks.begin(), blocks.end());
+    for (size_t i = 1; i < blocks.size(); i++) {
+        if (blocks[i].first < blocks[i - 1].first + blocks[i - 1].second) {
+            fprintf(stderr, "counter blocks at %u and %u overlap\n", blocks[i - 1].first,
+                    blocks[i].first);
+            return false;
+        }
+    }
+    counted.swap(next);
+    return true;
+}
+
+/* Traffic on every eighth block before the driver goes down */
+static void count_traffic(emu::asic &asic, const config &c, counted_map &counted)
+{
+    for (size_t i = 0; i < c.ctrs.size(); i += 8) {
+        const sx_wb_counter &b = c.ctrs[i];
+
+        asic.flow_count(b.index, CNT_PACKETS, CNT_PACKETS * 64);
+        counted[b.owner].second += CNT_PACKETS;
+    }
+}
+
+/* Start a driver, sync everything, check the model; the driver stops on return */
+static bool boot(const char *name, emu::asic &asic, const char *path, const size_t *max,
+                 config &c, counted_map &counted, int want_open)
+{
+    warm_image img;
+    warm_sync_stats st[4];
+    uint64_t writes = asic.stats().emad_requests.load(), changes = 0, failed = 0;
+    uint64_t t0 = emu::asic::now_ns();
+    int warm = img.open(path, max), err;
+
+    if (warm != want_open) {
+        fprintf(stderr, "%s: image open returned %d, want %d\n", name, warm, want_open);
+        return false;
+    }
+    uint64_t open_ns = emu::asic::now_ns() - t0;
+
+    driver drv(asic, img, max[SX_WB_FDB]);
+    err = drv.setup();
+    if (err) {
+        fprintf(stderr, "%s: setup failed: %d\n", name, err);
+        return false;
+    }
+
+    ssize_t nc = drv.wb.sync_counters(drv.pool, c.ctrs.data(), c.ctrs.size(), &st[0]);
+    int na = drv.wb.sync_acl(drv.acl, ACL_ID, c.acl.data(), c.acl.size(), nullptr, &st[1]);
+    ssize_t nf = drv.wb.sync_fdb(drv.e, drv.fdb, c.fdb.data(), c.fdb.size(), &st[2]);
+    ssize_t nr = drv.wb.sync_routes(drv.rb, c.routes.data(), c.routes.size(), &st[3]);
+    uint64_t ns = emu::asic::now_ns() - t0;
+
+    if (nc || na || nf || nr) {
+        fprintf(stderr, "%s: sync failed: counters %zd, acl %d, fdb %zd, routes %zd\n", name, nc,
+                na, nf, nr);
+        return false;
+    }
+    writes = asic.stats().emad_requests.load() - writes;
+    for (const warm_sync_stats &s : st) {
+        changes += s.added + s.changed + s.removed;
+        failed += s.failed;
+    }
+
+    auto secs = [](const warm_sync_stats &s) {
+        return (s.restore_ns + s.diff_ns + s.push_ns) / 1e9;
+    };
+    printf("%-22s %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f %9lu %9lu\n", name, open_ns / 1e9,
+           secs(st[3]), secs(st[2]), secs(st[1]), secs(st[0]), ns / 1e9, changes, writes);
+    if (failed || !verify(asic, drv, c, counted))
+        return false;
+    count_traffic(asic, c, counted);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t v4 = bench::arg(argc, argv, "v4", 1000000);
+    uint32_t v6 = bench::arg(argc, argv, "v6", 200000);
+    uint32_t hosts = bench::arg(argc, argv, "hosts", 65536);
+    uint32_t fdb = bench::arg(argc, argv, "fdb", 16384);
+    uint32_t acl = bench::arg(argc, argv, "acl", 4096);
+    uint32_t ctrs = bench::arg(argc, argv, "counters", 16384);
+    unsigned pct = bench::arg(argc, argv, "churn", 1);
+    emu::asic_config cfg;
+    cfg.emad_latency_ns = bench::arg(argc, argv, "latency-ns", 20000);
+    std::string path = (access("/dev/shm", W_OK) ? "/tmp" : "/dev/shm") +
+                       std::string("/sx_warm_boot.") + std::to_string(getpid());
+    generator g;
+    config c;
+    counted_map counted;
+
+    if (!v4 || !acl || !ctrs || fdb > 1u << 20 || pct > 50 || ctrs * 8ull > cfg.flow_counters / 2) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+    make_config(g, &c, v4, v6, hosts, fdb, acl, ctrs);
+
+    /* Adds go before removals: room for the churn, a quarter at least */
+    size_t max[SX_WB_TABLES], grow = std::max(pct, 25u);
+    max[SX_WB_ROUTE] = c.routes.size() + c.routes.size() * grow / 100;
+    max[SX_WB_FDB] = fdb + fdb * grow / 100;
+    max[SX_WB_ACL_REGION] = 3;
+    max[SX_WB_ACL_RULE] = acl + acl * grow / 100;
+    max[SX_WB_COUNTER] = ctrs + ctrs * grow / 100;
+
+    printf("routes=%zu (v4 %u, v6 %u, hosts %u) fdb=%u acl=%u counters=%u churn=%u%% "
+           "latency=%uns\n", c.routes.size(), v4, v6, hosts, fdb, acl, ctrs, pct,
+           cfg.emad_latency_ns);
+    printf("%-22s %8s %8s %8s %8s %8s %8s %9s %9s\n", "boot", "image s", "routes", "fdb", "acl",
+           "counters", "total s", "changes", "writes");
+
+    emu::asic asic(cfg);
+    bool ok = boot("cold, empty image", asic, path.c_str(), max, c, counted, 0) &&
+              boot("warm, unchanged", asic, path.c_str(), max, c, counted, 1);
+    if (ok) {
+        char name[32];
+
+        churn_config(g, &c, pct);
+        snprintf(name, sizeof(name), "warm, %u%% churn", pct);
+        ok = boot(name, asic, path.c_str(), max, c, counted, 1);
+    }
+
+    /* A crash between begin() and commit() */
+    if (ok) {
+        warm_image img;
+
+        ok = img.open(path.c_str(), max) == 1;
+        img.begin();
+        img.close();
+        ok = ok && img.open(path.c_str(), max) == 0 && !img.count(SX_WB_ROUTE);
+        printf("image %.1f MB; left dirty by a crash: %s\n", img.map_size() / 1048576.0,
+               ok ? "discarded, next start cold" : "NOT DISCARDED");
+    }
+    unlink(path.c_str());
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,284 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * A TCP SYN flood on the BGP port that got past the policers, --packets
+ * 64-byte frames from random sources over --ports ports, with one packet
+ * in --legit-every from a configured peer. The trap group feeds the port
+ * netdevs on --queues RDQs, each polled by its own NAPI thread.
+ *
+ *   no program   every frame becomes an skb; the stack spends --stack-ns
+ *                on it before its filter drops the flood
+ *   xdp drop     XDP_DROP on every frame
+ *   xdp filter   peers pass to the stack, the rest are dropped
+ *   xdp redirect peers pass, the rest go out of a scrubber port without
+ *                a copy, through an SDQ per queue completing on its CQ
+ *
+ * The programs count their verdicts per queue, as BPF map counters would.
+ * Reported are the rate, receive CPU per packet and the rate the busiest
+ * NAPI thread's CPU time allows. Every frame must be accounted for, every
+ * peer packet must reach the stack and every redirected frame must leave
+ * the scrubber port.
+ *
+ *   bench_xdp [--packets=N] [--ports=N] [--queues=N] [--legit-every=N]
+ *             [--stack-ns=NS]
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <endian.h>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "sx/netdev.h"
+
+using namespace sx;
+
+#define GROUP       1
+#define TRAP        SX_TRAP_ID_IPV4_BGP
+#define LOG_CQ_SIZE 11                  /* the RDQ's completions and the XDP SDQ's */
+#define LOG_SIZE    10
+#define BUF_SIZE    2048
+#define POOL_BUFS   4096
+#define FRAME_LEN   64
+#define PEER_NET    0x0a000000          /* 10.0.0.0/24 */
+#define SCRUB_PORT  63
+#define SAMPLE      64                  /* packets per CPU time sample */
+
+enum mode { NO_PROG, XDP_DROP_ALL, XDP_FILTER, XDP_SCRUB };
+
+static const char *const mode_names[] = { "no program", "xdp drop", "xdp filter",
+                                          "xdp redirect" };
+
+struct SX_CACHELINE_ALIGNED queue_state {
+    uint64_t seen = 0;                  /* by the program or the stack */
+    uint64_t sample_pkts = 0;
+    uint64_t sample_cpu_ns = 0;
+};
+
+struct run_state {
+    std::vector<queue_state> queues;
+    uint64_t                 stack_ns = 0;
+    std::atomic<uint64_t>    done{0};   /* left the stack, dropped or sent */
+    std::atomic<uint64_t>    peers{0};  /* peer packets the stack got */
+    std::atomic<uint64_t>    scrubbed{0};
+};
+
+static uint32_t get32(const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return be32toh(v);
+}
+
+/* A frame seen on @queue; every SAMPLE packets, its thread's CPU time */
+static void account(run_state &rs, unsigned queue)
+{
+    queue_state &q = rs.queues[queue];
+
+    if (++q.seen % SAMPLE == 0) {
+        q.sample_cpu_ns = thread_cpu_ns();
+        q.sample_pkts = q.seen;
+    }
+}
+
+static bool is_peer(const uint8_t *frame)
+{
+    return (get32(frame + 14 + 12) & 0xffffff00) == PEER_NET;
+}
+
+static void make_syn(uint8_t *buf, uint32_t saddr, uint16_t sport)
+{
+    uint8_t *ip = buf + 14, *tcp = ip + 20;
+
+    memset(buf, 0, FRAME_LEN);
+    buf[0] = 0x02; buf[5] = 0x01;
+    buf[6] = 0x02; buf[11] = 0x02;
+    buf[12] = 0x08;
+    ip[0] = 0x45;
+    ip[3] = 40;
+    ip[8] = 64;
+    ip[9] = 6;
+    saddr = htobe32(saddr);
+    memcpy(ip + 12, &saddr, 4);
+    ip[16] = 10; ip[17] = 1; ip[18] = 0; ip[19] = 1;
+    tcp[0] = sport >> 8; tcp[1] = sport & 0xff;
+    tcp[3] = 179;
+    tcp[12] = 5 << 4;
+    tcp[13] = 0x02;                     /* SYN */
+}
+
+static xdp_prog make_prog(run_state &rs, mode m)
+{
+    switch (m) {
+    case XDP_DROP_ALL:
+        return [&rs](xdp_buff *xdp) {
+            account(rs, xdp->queue);
+            return SX_XDP_DROP;
+        };
+    case XDP_FILTER:
+        return [&rs](xdp_buff *xdp) {
+            account(rs, xdp->queue);
+            if (xdp->data_end - xdp->data >= 34 && is_peer(xdp->data))
+                return SX_XDP_PASS;
+            return SX_XDP_DROP;
+        };
+    case XDP_SCRUB:
+        return [&rs](xdp_buff *xdp) {
+            account(rs, xdp->queue);
+            if (xdp->data_end - xdp->data >= 34 && is_peer(xdp->data))
+                return SX_XDP_PASS;
+            return xdp_redirect(xdp, SCRUB_PORT);
+        };
+    default:
+        return nullptr;
+    }
+}
+
+static bool run(mode m, uint64_t packets, unsigned ports, unsigned queues, unsigned legit_every,
+                uint64_t stack_ns)
+{
+    emu::asic asic;
+    dev d(asic);
+    run_state rs;
+    unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+    unsigned sdqs = asic.config().num_sdq;
+    std::mt19937 rng(1);
+    uint64_t peers = 0;
+    uint8_t frame[FRAME_LEN];
+    int err = d.init();
+
+    rs.queues.resize(queues);
+    rs.stack_ns = stack_ns;
+
+    std::unique_ptr<port_netdevs> nd = std::make_unique<port_netdevs>(d);
+    xdp_prog prog = make_prog(rs, m);
+    for (unsigned p = 0; p < ports && !err; p++) {
+        err = nd->register_netdev(p, "swp" + std::to_string(p + 1), [&rs, m](netdev_skb *skb) {
+            bool peer = is_peer(skb->head->data);
+
+            if (m == NO_PROG)
+                account(rs, skb->queue);
+            bench::spin_ns(rs.stack_ns);
+            if (peer)
+                rs.peers.fetch_add(1, std::memory_order_relaxed);
+            netdev_skb_free(skb);
+            rs.done.fetch_add(1, std::memory_order_release);
+        });
+        if (!err && prog)
+            err = nd->set_xdp(p, prog);
+    }
+    for (unsigned q = 0; q < queues && !err; q++) {
+        err = nd->add_rx_queue(q, BUF_SIZE, POOL_BUFS, q);
+        if (!err)
+            err = d.create_cq(sdqs + q, LOG_CQ_SIZE);
+        if (!err)
+            err = d.create_sdq(q, LOG_SIZE, sdqs + q);
+        if (!err)
+            err = d.create_rdq(q, LOG_SIZE, sdqs + q, BUF_SIZE);
+        if (!err)
+            err = d.set_napi_thread(sdqs + q, q % cpus);
+    }
+    if (!err)
+        err = d.set_trap_group_rdqs(GROUP, 0, queues);
+    if (!err)
+        err = d.set_trap_group(TRAP, GROUP);
+    if (err) {
+        fprintf(stderr, "setup failed: %d\n", err);
+        return false;
+    }
+    asic.set_egress_handler([&rs](uint16_t port, const uint8_t *data, uint32_t len) {
+        if (port == SCRUB_PORT && len == FRAME_LEN && !is_peer(data))
+            rs.scrubbed.fetch_add(1, std::memory_order_relaxed);
+    });
+    asic.set_irq_handler([&d](unsigned vector) { d.irq(vector); });
+
+    uint64_t t0 = emu::asic::now_ns();
+    for (uint64_t i = 0; i < packets; i++) {
+        bool peer = legit_every && i % legit_every == 0;
+        uint32_t saddr = peer ? PEER_NET | (i / legit_every) % 16 : 0xc0000000 | (rng() >> 2);
+
+        peers += peer;
+        make_syn(frame, saddr, 1024 + (rng() & 0x7fff));
+        while (asic.inject(TRAP, i % ports, frame, FRAME_LEN) == -ENOSPC)
+            std::this_thread::yield();
+    }
+
+    /* Done when every frame left the stack or XDP dropped or sent it */
+    netdev_stats sum;
+    for (;;) {
+        sum = {};
+        for (unsigned p = 0; p < ports; p++) {
+            netdev_stats st;
+
+            nd->get_stats(p, &st);
+            stats_add(&sum, st);
+        }
+        if (rs.done.load(std::memory_order_acquire) + sum.xdp_drop + sum.xdp_tx +
+            sum.xdp_tx_errors >= packets)
+            break;
+        std::this_thread::yield();
+    }
+    uint64_t ns = emu::asic::now_ns() - t0;
+
+    /* Sent frames are counted at the scrubber port once their SDQ completes */
+    while (m == XDP_SCRUB && rs.scrubbed.load() < sum.xdp_tx && emu::asic::now_ns() - t0 < 10 * ns)
+        std::this_thread::yield();
+
+    /* CPU time of each NAPI thread, extrapolated from its last sample */
+    double cpu_ns = 0, busiest = 0;
+    for (const queue_state &q : rs.queues) {
+        double t = q.sample_pkts ?
+                   static_cast<double>(q.sample_cpu_ns) * q.seen / q.sample_pkts : 0;
+
+        cpu_ns += t;
+        busiest = std::max(busiest, t);
+    }
+    printf("%-14s %u queue%s %8.3f Mpps %8.1f ns/pkt rx CPU %8.3f Mpps busiest-queue bound\n",
+           mode_names[m], queues, queues > 1 ? "s" : " ", packets * 1e3 / ns, cpu_ns / packets,
+           busiest ? packets * 1e3 / busiest : 0.0);
+
+    asic.set_irq_handler(nullptr);
+    asic.set_egress_handler(nullptr);
+    d.destroy_queues();
+    nd.reset();
+
+    uint64_t want_peers = m == XDP_DROP_ALL ? 0 : peers;
+    if (sum.rx_packets != packets || rs.peers.load() != want_peers || sum.xdp_tx_errors ||
+        (m == XDP_FILTER && sum.xdp_drop != packets - peers) ||
+        (m == XDP_SCRUB && (sum.xdp_tx != packets - peers || rs.scrubbed.load() != sum.xdp_tx))) {
+        fprintf(stderr, "%s: %lu packets, %lu peers at the stack (want %lu), %lu dropped, "
+                "%lu sent, %lu at the scrubber, %lu send errors\n", mode_names[m],
+                sum.rx_packets, rs.peers.load(), want_peers, sum.xdp_drop, sum.xdp_tx,
+                rs.scrubbed.load(), sum.xdp_tx_errors);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t packets = bench::arg(argc, argv, "packets", 1000000);
+    unsigned ports = bench::arg(argc, argv, "ports", 32);
+    unsigned queues = bench::arg(argc, argv, "queues", 1);
+    unsigned legit_every = bench::arg(argc, argv, "legit-every", 1000);
+    uint64_t stack_ns = bench::arg(argc, argv, "stack-ns", 1500);
+
+    if (!ports || ports > SCRUB_PORT || !queues || queues > SX_MAX_RDQ ||
+        queues > SX_MAX_SDQ) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    printf("packets=%lu ports=%u queues=%u legit-every=%u stack=%lu ns, %u CPUs\n", packets,
+           ports, queues, legit_every, stack_ns, std::thread::hardware_concurrency());
+    for (mode m : { NO_PROG, XDP_DROP_ALL, XDP_FILTER, XDP_SCRUB }) {
+        if (!run(m, packets, ports, queues, legit_every, stack_ns))
+            return 1;
+    }
+    return 0;
+}
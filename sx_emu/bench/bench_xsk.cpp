@@ -0,0 +1,307 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * Control protocol frames (LLDP, LACP) of --size bytes over --ports ports,
+ * trapped to one trap group on one RDQ with a threaded NAPI context, and
+ * read by a protocol daemon on its own thread in two ways:
+ *
+ *   PF_PACKET  the port netdevs build an skb, the packet socket queues a
+ *              copy of it (an AF_UNIX datagram socket stands in for the
+ *              socket receive queue) and the daemon recv()s it, one
+ *              system call and copy per frame
+ *   AF_XDP     an xsk bound to the RDQ with the daemon's UMEM as its
+ *              buffers; the daemon reads frames where the ASIC put them
+ *              and gives the chunks back through the fill ring
+ *
+ * Both daemons check every frame's sequence number, trap, port and
+ * payload. Reported are the rate, the daemon's CPU time per frame, and
+ * the host's: the NAPI thread, the socket and the daemon (the whole
+ * process less the thread injecting the frames into the model).
+ *
+ *   bench_xsk [--packets=N] [--size=BYTES] [--ports=N] [--chunks=N]
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "bench.h"
+#include "sx/netdev.h"
+#include "sx/xsk.h"
+
+using namespace sx;
+
+#define GROUP       1
+#define RDQ         0
+#define LOG_SIZE    10
+#define BUF_SIZE    2048
+#define CHUNK_SIZE  2048
+#define SEQ_OFF     14
+
+static const uint16_t traps[] = { SX_TRAP_ID_ETH_L2_LLDP, SX_TRAP_ID_ETH_L2_LACP };
+static const uint16_t ethertypes[] = { 0x88cc, 0x8809 };
+
+/* What a packet socket returns in front of a frame (sockaddr_ll) */
+struct pkt_addr {
+    uint16_t port;
+    uint16_t protocol;
+};
+
+struct result {
+    uint64_t ns;
+    uint64_t daemon_cpu_ns;
+    uint64_t host_cpu_ns;
+};
+
+static void make_frame(uint8_t *buf, uint32_t len, uint64_t seq)
+{
+    bench::fill_frame(buf, len, ethertypes[seq & 1], 0);
+    memcpy(buf + SEQ_OFF, &seq, sizeof(seq));
+}
+
+/* Frame @seq as make_frame() built it, received on @port */
+static bool check_frame(const uint8_t *buf, uint32_t len, uint32_t size, uint64_t seq,
+                        uint16_t port, unsigned ports)
+{
+    uint64_t got;
+
+    memcpy(&got, buf + SEQ_OFF, sizeof(got));
+    return len == size && got == seq && port == seq % ports &&
+           buf[12] == ethertypes[seq & 1] >> 8 && buf[len - 1] == static_cast<uint8_t>(len - 1);
+}
+
+static int setup(emu::asic &asic, dev &d)
+{
+    unsigned cqn = asic.config().num_sdq + RDQ;
+    int err = d.create_cq(cqn, LOG_SIZE);
+
+    if (!err)
+        err = d.create_rdq(RDQ, LOG_SIZE, cqn, BUF_SIZE);
+    if (!err)
+        err = d.set_napi_thread(cqn, -1);
+    if (!err)
+        err = d.set_trap_group_rdq(GROUP, RDQ);
+    for (unsigned i = 0; i < 2 && !err; i++)
+        err = d.set_trap_group(traps[i], GROUP);
+    return err;
+}
+
+/* Inject @packets frames and wait for the daemon to have read them */
+static void inject(emu::asic &asic, uint64_t packets, uint32_t size, unsigned ports,
+                   std::thread &daemon, result *r)
+{
+    uint8_t frame[BUF_SIZE];
+    uint64_t t0 = emu::asic::now_ns();
+    uint64_t proc0 = cpu_ns(CLOCK_PROCESS_CPUTIME_ID), self0 = thread_cpu_ns();
+
+    for (uint64_t i = 0; i < packets; i++) {
+        make_frame(frame, size, i);
+        while (asic.inject(traps[i & 1], i % ports, frame, size) == -ENOSPC)
+            std::this_thread::yield();
+    }
+    uint64_t self = thread_cpu_ns() - self0;
+    daemon.join();
+    r->ns = emu::asic::now_ns() - t0;
+    r->host_cpu_ns = cpu_ns(CLOCK_PROCESS_CPUTIME_ID) - proc0 - self;
+}
+
+static bool run_packet(uint64_t packets, uint32_t size, unsigned ports, result *r)
+{
+    emu::asic asic;
+    dev d(asic);
+    port_netdevs nd(d);
+    std::atomic<uint64_t> bad{0};
+    int sv[2], err = d.init();
+
+    if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, sv)) {
+        perror("socketpair");
+        return false;
+    }
+    for (unsigned p = 0; p < ports && !err; p++) {
+        err = nd.register_netdev(p, "swp" + std::to_string(p + 1), [&sv](netdev_skb *skb) {
+            const uint8_t *data = skb->head->data;
+            pkt_addr a = { skb->port, static_cast<uint16_t>(data[12] << 8 | data[13]) };
+            struct iovec iov[2] = { { &a, sizeof(a) },
+                                    { const_cast<uint8_t *>(data), skb->head_len } };
+            struct msghdr msg = {};
+
+            msg.msg_iov = iov;
+            msg.msg_iovlen = 2;
+            if (sendmsg(sv[0], &msg, 0) < 0)
+                perror("sendmsg");
+            netdev_skb_free(skb);
+        });
+    }
+    if (!err)
+        err = nd.add_rx_queue(RDQ, BUF_SIZE, 2u << LOG_SIZE);
+    if (!err)
+        err = setup(asic, d);
+    if (err) {
+        fprintf(stderr, "PF_PACKET setup failed: %d\n", err);
+        return false;
+    }
+    asic.set_irq_handler([&d](unsigned vector) { d.irq(vector); });
+
+    std::thread daemon([&] {
+        uint8_t buf[sizeof(pkt_addr) + BUF_SIZE];
+        uint64_t c0 = thread_cpu_ns();
+
+        for (uint64_t seq = 0; seq < packets; seq++) {
+            ssize_t n = recv(sv[1], buf, sizeof(buf), 0);
+            pkt_addr a;
+
+            memcpy(&a, buf, sizeof(a));
+            if (n < static_cast<ssize_t>(sizeof(a)) ||
+                !check_frame(buf + sizeof(a), n - sizeof(a), size, seq, a.port, ports))
+                bad.fetch_add(1, std::memory_order_relaxed);
+        }
+        r->daemon_cpu_ns = thread_cpu_ns() - c0;
+    });
+    inject(asic, packets, size, ports, daemon, r);
+
+    asic.set_irq_handler(nullptr);
+    d.destroy_queues();
+    close(sv[0]);
+    close(sv[1]);
+    if (bad) {
+        fprintf(stderr, "PF_PACKET: %lu frames lost, reordered or corrupt\n", bad.load());
+        return false;
+    }
+    return true;
+}
+
+static bool run_xsk(uint64_t packets, uint32_t size, unsigned ports, unsigned chunks,
+                    result *r)
+{
+    emu::asic asic;
+    dev d(asic);
+    xsk x;
+    xsk_socket s;
+    std::atomic<uint64_t> bad{0};
+    size_t umem_size = static_cast<size_t>(chunks) * CHUNK_SIZE;
+    unsigned cqn = asic.config().num_sdq + RDQ;
+    uint64_t kicks = 0;
+    int err = d.init();
+
+    /* The daemon's packet memory */
+    int umem_fd = memfd_create("umem", MFD_CLOEXEC);
+    if (umem_fd < 0 || ftruncate(umem_fd, umem_size)) {
+        perror("umem");
+        return false;
+    }
+    void *p = mmap(nullptr, umem_size, PROT_READ | PROT_WRITE, MAP_SHARED, umem_fd, 0);
+    if (p == MAP_FAILED) {
+        perror("mmap");
+        return false;
+    }
+    uint8_t *umem = static_cast<uint8_t *>(p);
+    std::vector<uint64_t> done(roundup_pow_of_two(chunks));
+
+    /* Rings that hold every chunk, all of them given to the driver up front */
+    if (!err)
+        err = x.reg_umem(umem_fd, umem_size, CHUNK_SIZE, 0);
+    if (!err)
+        err = x.create_rings(chunks, chunks);
+    if (!err)
+        err = s.open(x.fd(), x.event_fd(), umem);
+    if (!err) {
+        for (unsigned i = 0; i < chunks; i++)
+            done[i] = static_cast<uint64_t>(i) * CHUNK_SIZE;
+        s.fill(done.data(), chunks);
+    }
+    if (!err)
+        err = x.bind(d, RDQ, cqn);
+    if (!err)
+        err = setup(asic, d);
+    if (err) {
+        fprintf(stderr, "AF_XDP setup failed: %d\n", err);
+        return false;
+    }
+    asic.set_irq_handler([&d](unsigned vector) { d.irq(vector); });
+
+    /* The sample consumer: read in place, hand the chunks back in bulk */
+    std::thread daemon([&] {
+        uint64_t seq = 0, c0 = thread_cpu_ns();
+
+        while (seq < packets) {
+            const sx_xsk_desc *desc;
+            uint32_t i = 0;
+
+            while ((desc = s.peek(i))) {
+                const sx_xsk_meta *m = s.meta(desc);
+
+                if (m->trap_id != traps[seq & 1] ||
+                    !check_frame(s.data(desc), desc->len, size, seq, m->sys_port, ports))
+                    bad.fetch_add(1, std::memory_order_relaxed);
+                done[i++] = s.chunk(desc);
+                seq++;
+            }
+            if (i) {
+                s.release(i);
+                s.fill(done.data(), i);
+                if (s.needs_wakeup()) {
+                    x.wakeup();
+                    kicks++;
+                }
+                continue;
+            }
+            if (s.wait(-1) < 0)
+                break;
+        }
+        r->daemon_cpu_ns = thread_cpu_ns() - c0;
+    });
+    inject(asic, packets, size, ports, daemon, r);
+
+    uint64_t drops = s.drops(), wakeups = x.wakeups(), bad_addrs = x.bad_addrs();
+    asic.set_irq_handler(nullptr);
+    d.destroy_queues();
+    s.close();
+    x.destroy();
+    munmap(umem, umem_size);
+    close(umem_fd);
+
+    printf("AF_XDP: %lu eventfd wakeups, %lu fill ring kicks\n", wakeups, kicks);
+    if (bad || drops || bad_addrs) {
+        fprintf(stderr, "AF_XDP: %lu frames lost, reordered or corrupt, %lu dropped, "
+                "%lu bad fill addresses\n", bad.load(), drops, bad_addrs);
+        return false;
+    }
+    return true;
+}
+
+static void report(const char *name, uint64_t packets, const result &r)
+{
+    printf("%-10s %8.3f Mpps %8.1f ns/pkt daemon CPU %8.1f ns/pkt host CPU\n", name,
+           packets * 1e3 / r.ns, static_cast<double>(r.daemon_cpu_ns) / packets,
+           static_cast<double>(r.host_cpu_ns) / packets);
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t packets = bench::arg(argc, argv, "packets", 500000);
+    uint32_t size = bench::arg(argc, argv, "size", 128);
+    unsigned ports = bench::arg(argc, argv, "ports", 32);
+    unsigned chunks = bench::arg(argc, argv, "chunks", 2048);
+    result pf = {}, xs = {};
+
+    if (!packets || size < 64 || size > CHUNK_SIZE - sizeof(sx_xsk_meta) || !ports ||
+        ports > 64 || !chunks || chunks > 0x10000) {
+        fprintf(stderr, "invalid arguments\n");
+        return 1;
+    }
+
+    printf("packets=%lu size=%u ports=%u chunks=%u, %u CPUs\n", packets, size, ports, chunks,
+           std::thread::hardware_concurrency());
+    if (!run_packet(packets, size, ports, &pf) || !run_xsk(packets, size, ports, chunks, &xs))
+        return 1;
+    report("PF_PACKET", packets, pf);
+    report("AF_XDP", packets, xs);
+    return 0;
+}
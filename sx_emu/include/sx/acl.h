@@ -0,0 +1,150 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_ACL_H
+#define SX_ACL_H
+
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "sx/emad.h"
+
+namespace sx {
+
+struct acl_rule {
+    uint32_t priority;                  /* lower wins */
+    uint32_t action;
+    uint8_t  key_len;                   /* bytes of @key and @mask in use */
+    uint8_t  key[SX_TCAM_KEY_MAX];
+    uint8_t  mask[SX_TCAM_KEY_MAX];
+};
+
+struct acl_stats {
+    uint64_t rules;
+    uint64_t inserts;
+    uint64_t removes;
+    uint64_t replaces;
+    uint64_t writes;                    /* register accesses */
+    uint64_t moves;                     /* rules moved to make room */
+    uint64_t relayouts;                 /* regions rebuilt larger */
+    uint64_t tcam_entries;              /* entries of the ACL's regions */
+};
+
+/* The regions of an ACL, by key width (SX_TCAM_WIDTH_1/2/4); size 0 for none */
+struct acl_layout {
+    uint16_t region[3];
+    uint32_t size[3];
+};
+
+/* A rule and where it sits in the region of its key width */
+struct acl_placement {
+    uint64_t handle;
+    uint32_t offset;
+    acl_rule rule;
+};
+
+/* Smallest region allocated, in entries */
+#define SX_ACL_MIN_REGION   64
+
+/*
+ * One ACL compiled into TCAM regions. Rules go to the region of their key
+ * width (16, 32 or 64 bytes), where offsets follow (priority, insertion
+ * order); regions are laid out with @gap_pct percent free entries spread
+ * between the rules.
+ *
+ * An insert takes a free entry between its neighbours if there is one,
+ * one PTCE write. Otherwise the rules between the insert point and the
+ * nearest free entry each move one place towards it, the last first, so
+ * every intermediate state matches as before: a moved rule sits twice,
+ * next to itself. A full region is rebuilt larger into a shadow region
+ * and the ACL rebound to it with one PACL write, or grown in place if the
+ * TCAM cannot hold both. replace() loads a whole new rule set the same
+ * way: lookups see the old rules until the new ones are all written.
+ *
+ * Accesses of one call go out with up to @window in flight, in order. A
+ * failed access fails the call with its error; the regions then hold
+ * what was written before it, and replace() starts over cleanly.
+ */
+class acl_table {
+public:
+    acl_table(emad &e, uint16_t acl_id) : emad_(e), acl_id_(acl_id) {}
+
+    acl_table(const acl_table &) = delete;
+    acl_table &operator=(const acl_table &) = delete;
+
+    void set_window(unsigned window) { window_ = window; }
+    void set_gap_pct(unsigned pct) { gap_pct_ = pct; }
+
+    /*
+     * Add @rule, returning its handle in @handle. Returns 0, -EINVAL for a
+     * key beyond SX_TCAM_KEY_MAX or @key_len, -ENOSPC if the TCAM is full,
+     * or the error of a failed access.
+     */
+    int insert(const acl_rule &rule, uint64_t *handle);
+    int remove(uint64_t handle);
+
+    /* Swap in @rules as the whole ACL; their handles go to @handles if set. */
+    int replace(const acl_rule *rules, size_t n, uint64_t *handles);
+
+    /* The ACL as laid out, for a later instance to take over (warm boot). */
+    void save(acl_layout *layout, std::vector<acl_placement> *rules) const;
+
+    /*
+     * Take over an ACL an earlier instance left bound to its regions, as
+     * save() described it, writing nothing. Returns 0, -EBUSY if this
+     * table has rules or regions, or -EINVAL for a layout that does not
+     * hold together.
+     */
+    int restore(const acl_layout &layout, const acl_placement *rules, size_t n);
+
+    void get_stats(acl_stats *out) const;
+
+private:
+    /* Rules by (priority, handle) to their offset; @slots holds handles, 0 free */
+    struct region {
+        bool                                          live = false;
+        uint16_t                                      id = 0;
+        std::vector<uint64_t>                         slots;
+        std::map<std::pair<uint32_t, uint64_t>, uint32_t> order;
+    };
+
+    struct rule_state {
+        acl_rule rule;
+        uint8_t  width;                 /* regions_ index */
+    };
+
+    /* Rules at offsets @first to @last, each moved one place by @step */
+    struct slot_shift {
+        int64_t first = 0;
+        int64_t last = -1;
+        int     step = 0;
+    };
+
+    void put_write(uint16_t region, uint32_t offset, const acl_rule *rule);
+    int flush();
+    int bind(const uint16_t *ids, const bool *live);
+    int region_op(uint8_t op, uint8_t width, uint16_t *id, uint32_t size);
+    uint32_t layout_size(size_t rules) const;
+    void spread(region &r, const std::vector<uint64_t> &handles,
+                const std::unordered_map<uint64_t, rule_state> &rules);
+    int relayout(unsigned w, size_t extra);
+    void make_room(region &r, int64_t lo, int64_t hi, uint32_t *pos, slot_shift *shift);
+    void apply_shift(region &r, const slot_shift &shift);
+
+    emad                                     &emad_;
+    uint16_t                                  acl_id_;
+    unsigned                                  window_ = SX_EMAD_MAX_INFLIGHT;
+    unsigned                                  gap_pct_ = 25;
+    region                                    regions_[3];  /* SX_TCAM_WIDTH_1/2/4 */
+    std::unordered_map<uint64_t, rule_state>  rules_;
+    uint64_t                                  next_handle_ = 1;
+    std::vector<emad_op>                      ops_;
+    size_t                                    nops_ = 0;
+    acl_stats                                 stats_ = {};
+};
+
+} /* namespace sx */
+
+#endif /* SX_ACL_H */
@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_BAR_H
+#define SX_BAR_H
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+namespace sx {
+
+/*
+ * Register window of the device (PCI BAR0). The driver core performs every
+ * device access through this interface; the software ASIC model implements it
+ * so the same driver code runs with or without a Spectrum device.
+ */
+class bar {
+public:
+    virtual ~bar() = default;
+
+    virtual uint32_t read32(uint32_t off) = 0;
+    virtual void write32(uint32_t off, uint32_t val) = 0;
+
+    void write64(uint32_t off, uint64_t val)
+    {
+        write32(off, static_cast<uint32_t>(val));
+        write32(off + 4, static_cast<uint32_t>(val >> 32));
+    }
+
+    /*
+     * Read @off every @sleep_us until @cond holds for the value, left in
+     * @val; -ETIMEDOUT after @timeout_us. As readl_poll_timeout().
+     */
+    template <typename Cond>
+    int poll32(uint32_t off, Cond cond, uint32_t *val, unsigned sleep_us, unsigned timeout_us)
+    {
+        auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(timeout_us);
+
+        for (;;) {
+            bool late = std::chrono::steady_clock::now() >= end;
+
+            *val = read32(off);
+            if (cond(*val))
+                return 0;
+            if (late)
+                return -ETIMEDOUT;
+            std::this_thread::sleep_for(std::chrono::microseconds(sleep_us));
+        }
+    }
+};
+
+} /* namespace sx */
+
+#endif /* SX_BAR_H */
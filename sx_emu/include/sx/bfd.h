@@ -0,0 +1,212 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_BFD_H
+#define SX_BFD_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <sys/types.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "sx/compiler.h"
+#include "sx/dev.h"
+#include "sx/spinlock.h"
+
+namespace sx {
+
+/* Defaults: sessions, state changes queued for the reader, slow rate */
+#define SX_BFD_MAX_SESSIONS     4096
+#define SX_BFD_MAX_EVENTS       4096
+#define SX_BFD_SLOW_TX_US       1000000     /* while not Up (RFC 5880 6.8.3) */
+
+/* Timers this close to due fire together, in one batch of sends */
+#define SX_BFD_TIMER_SLACK_NS   100000
+
+/*
+ * Single-hop BFD over IPv4 (RFC 5880, 5881): Ethernet, IPv4 with TTL 255,
+ * UDP to port 3784, then the 24-byte control packet.
+ */
+#define SX_BFD_UDP_PORT         3784
+#define SX_BFD_SRC_PORT_BASE    49152
+#define SX_BFD_VERSION          1
+#define SX_BFD_CTL_LEN          24
+#define SX_BFD_CTL_OFF          (14 + 20 + 8)
+#define SX_BFD_FRAME_LEN        (SX_BFD_CTL_OFF + SX_BFD_CTL_LEN)
+
+#define SX_BFD_STATE_ADMIN_DOWN 0
+#define SX_BFD_STATE_DOWN       1
+#define SX_BFD_STATE_INIT       2
+#define SX_BFD_STATE_UP         3
+
+#define SX_BFD_DIAG_NONE        0
+#define SX_BFD_DIAG_EXPIRED     1   /* control detection time expired */
+#define SX_BFD_DIAG_NBR_DOWN    3   /* neighbor signaled session down */
+
+#define SX_BFD_FLAG_POLL        0x20
+#define SX_BFD_FLAG_FINAL       0x10
+#define SX_BFD_FLAG_AUTH        0x04    /* not supported: such packets are dropped */
+#define SX_BFD_FLAG_MULTIPOINT  0x01
+
+struct bfd_session_cfg {
+    uint16_t port;
+    uint8_t  src_mac[6];
+    uint8_t  dst_mac[6];
+    uint32_t src_ip;            /* host byte order */
+    uint32_t dst_ip;            /* the neighbor; one session per port and neighbor */
+    uint32_t tx_us;             /* desired min TX interval */
+    uint32_t rx_us;             /* required min RX interval */
+    uint8_t  detect_mult;
+};
+
+/* One state change, for the control plane */
+struct bfd_event {
+    uint32_t session;
+    uint8_t  state;
+    uint8_t  old_state;
+    uint8_t  diag;
+    uint8_t  rsvd;
+    uint64_t timestamp;         /* ns, steady clock */
+};
+
+struct bfd_stats {
+    uint64_t tx_packets;
+    uint64_t tx_errors;         /* sends that failed, retried on the next interval */
+    uint64_t rx_packets;
+    uint64_t rx_invalid;        /* failed validation or matched no session */
+    uint64_t state_changes;
+    uint64_t events_dropped;    /* changes lost on a full event queue */
+    uint64_t timer_late_max_ns; /* worst lateness of a timer */
+    uint64_t cpu_ns;            /* timer thread CPU time */
+};
+
+/*
+ * BFD sessions run in the driver. Each session keeps its control packet
+ * prebuilt, rewritten only when the state or the neighbor's discriminator
+ * changes; a timer thread sends the templates of every session due, with
+ * the 0-25% jitter of RFC 5880, as one batch of sends per wakeup. Received
+ * packets are handled in the SX_TRAP_ID_IPV4_BFD listener itself: they
+ * find their session by discriminator and only refresh its detection
+ * time, unless the state changes. Nothing reaches the reader but state
+ * changes, queued for read().
+ *
+ * Sends go out on @sdq, whose completions are reaped by the usual interrupt
+ * path of its CQ. The trap group of SX_TRAP_ID_IPV4_BFD must already have
+ * its RDQ.
+ *
+ * Sessions transmit at SX_BFD_SLOW_TX_US until Up (set_slow_tx_us()).
+ * There are no poll sequences: a Poll is answered with a Final and new
+ * intervals apply from the next packet.
+ */
+class bfd {
+public:
+    bfd(dev &d, unsigned sdq, unsigned max_sessions = SX_BFD_MAX_SESSIONS,
+        size_t max_events = SX_BFD_MAX_EVENTS);
+    ~bfd();
+
+    bfd(const bfd &) = delete;
+    bfd &operator=(const bfd &) = delete;
+
+    void set_slow_tx_us(uint32_t us) { slow_tx_ns_ = us * 1000ull; }
+
+    /* Take the trap and start the timer thread. */
+    int start();
+    void stop();
+
+    /* A session starts Down and sends at once. */
+    int add_session(const bfd_session_cfg &cfg, uint32_t *id);
+    int del_session(uint32_t id);
+    int get_state(uint32_t id, uint8_t *state);
+
+    /*
+     * Copy up to @max pending state changes into @ev. Returns their number,
+     * or -EAGAIN if @nonblock and none is pending.
+     */
+    ssize_t read(bfd_event *ev, size_t max, bool nonblock = false);
+
+    void get_stats(bfd_stats *out);
+
+private:
+    enum timer_kind : uint8_t { TIMER_TX, TIMER_DETECT };
+
+    struct timer {
+        uint64_t   due_ns;
+        uint32_t   id;
+        uint32_t   gen;             /* session::tx_gen or detect_gen when armed */
+        timer_kind kind;
+
+        bool operator>(const timer &o) const { return due_ns > o.due_ns; }
+    };
+
+    struct SX_CACHELINE_ALIGNED session {
+        spinlock        lock;
+        bool            live = false;
+        uint32_t        gen = 0;            /* bumped per add, part of the discriminator */
+        uint32_t        tx_gen = 0;         /* bumped per re-arm: earlier timers lapse */
+        uint32_t        detect_gen = 0;
+        uint32_t        local_disc = 0;
+        uint32_t        remote_disc = 0;
+        uint8_t         state = SX_BFD_STATE_DOWN;
+        uint8_t         diag = SX_BFD_DIAG_NONE;
+        bool            detect_armed = false;
+        uint64_t        detect_due = 0;     /* of the armed detection timer */
+        uint64_t        last_rx_ns = 0;
+        uint64_t        detect_ns = 0;
+        uint64_t        remote_tx_ns = 0;   /* neighbor's desired min TX */
+        uint64_t        remote_rx_ns = 0;   /* neighbor's required min RX */
+        bfd_session_cfg cfg = {};
+        uint8_t         tpl[SX_BFD_FRAME_LEN] = {};
+    };
+
+    void build(session &s);
+    void rewrite(session &s);
+    uint64_t tx_interval(const session &s) const;
+    bfd_event change(session &s, uint32_t id, uint8_t state, uint8_t diag, uint64_t now);
+    void notify(const bfd_event &ev);
+    void arm(uint32_t id, uint32_t gen, timer_kind kind, uint64_t due);
+    void receive(const rx_info &info, pkt_buf *buf);
+    bool transmit(const timer &t, uint64_t now, std::vector<timer> &next);
+    void expire(const timer &t, uint64_t now, std::vector<timer> &next);
+    void thread_fn();
+
+    dev                                    &dev_;
+    unsigned                                sdq_;
+    unsigned                                max_sessions_;
+    size_t                                  max_events_;
+    uint64_t                                slow_tx_ns_ = SX_BFD_SLOW_TX_US * 1000ull;
+    bool                                    started_ = false;
+    std::unique_ptr<session[]>              sessions_;
+
+    std::mutex                              cfg_lock_;      /* add/del, the neighbor map */
+    std::vector<uint32_t>                   free_;
+    std::unordered_map<uint64_t, uint32_t>  by_nbr_;        /* port, neighbor IP: session */
+
+    std::mutex                              timer_lock_;
+    std::condition_variable                 timer_wq_;
+    std::priority_queue<timer, std::vector<timer>, std::greater<timer>> timers_;
+    bool                                    stop_ = false;
+    std::thread                             thread_;
+    uint64_t                                rng_ = 0x9e3779b97f4a7c15ull;  /* timer thread */
+
+    std::mutex                              ev_lock_;
+    std::condition_variable                 ev_wq_;
+    std::deque<bfd_event>                   events_;
+
+    std::atomic<uint64_t>                   tx_packets_{0};
+    std::atomic<uint64_t>                   tx_errors_{0};
+    std::atomic<uint64_t>                   rx_packets_{0};
+    std::atomic<uint64_t>                   rx_invalid_{0};
+    std::atomic<uint64_t>                   state_changes_{0};
+    std::atomic<uint64_t>                   events_dropped_{0};
+    std::atomic<uint64_t>                   timer_late_max_ns_{0};
+    std::atomic<uint64_t>                   cpu_ns_{0};
+};
+
+} /* namespace sx */
+
+#endif /* SX_BFD_H */
@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_CDEV_H
+#define SX_CDEV_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <sys/types.h>
+#include <vector>
+
+#include "sx/dev.h"
+
+namespace sx {
+
+/* Header returned in front of every packet by cdev_file::read(). */
+struct ku_read {
+    uint16_t trap_id;
+    uint16_t sys_port;
+    uint32_t length;
+    uint64_t timestamp;
+};
+
+/*
+ * An open file of the driver character device. Packets of the traps bound to
+ * the file are queued and copied out, one per read().
+ */
+class cdev_file {
+public:
+    explicit cdev_file(dev &d, size_t max_queued = 4096);
+    ~cdev_file();
+
+    cdev_file(const cdev_file &) = delete;
+    cdev_file &operator=(const cdev_file &) = delete;
+
+    int add_trap(uint16_t trap_id);
+
+    /*
+     * Copy the next packet, preceded by a ku_read header, into @buf.
+     * Returns the number of bytes copied, -EAGAIN if @nonblock and nothing is
+     * queued, or -ENOBUFS if @count cannot hold the packet.
+     */
+    ssize_t read(void *buf, size_t count, bool nonblock = false);
+
+    uint64_t dropped() const { return dropped_; }
+
+private:
+    struct entry {
+        rx_info  info;
+        pkt_buf *buf;
+    };
+
+    void enqueue(const rx_info &info, pkt_buf *buf);
+
+    dev                    &dev_;
+    size_t                  max_queued_;
+    std::vector<uint16_t>   traps_;
+    std::mutex              lock_;
+    std::condition_variable wq_;
+    std::deque<entry>       queue_;
+    uint64_t                dropped_ = 0;
+};
+
+} /* namespace sx */
+
+#endif /* SX_CDEV_H */
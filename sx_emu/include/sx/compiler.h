@@ -0,0 +1,103 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_COMPILER_H
+#define SX_COMPILER_H
+
+#include <cstdint>
+#include <ctime>
+
+#define SX_CACHELINE 64
+#define SX_CACHELINE_ALIGNED alignas(SX_CACHELINE)
+
+#define sx_likely(x)   __builtin_expect(!!(x), 1)
+#define sx_unlikely(x) __builtin_expect(!!(x), 0)
+
+namespace sx {
+
+/*
+ * Ordering helpers for memory shared between the host and the device (or
+ * between the driver and user space). They mirror the kernel's
+ * READ_ONCE()/WRITE_ONCE()/smp_load_acquire()/smp_store_release().
+ */
+template <typename T>
+static inline T read_once(const T *p)
+{
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+template <typename T>
+static inline void write_once(T *p, T v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELAXED);
+}
+
+template <typename T>
+static inline T load_acquire(const T *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+template <typename T>
+static inline void store_release(T *p, T v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+/* Free-running CPU cycle counter for timing short intervals; 0 if none. */
+static inline uint64_t get_cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+    uint64_t v;
+
+    asm volatile("mrs %0, cntvct_el0" : "=r"(v));
+    return v;
+#else
+    return 0;
+#endif
+}
+
+/* CPU time on @clk (CLOCK_THREAD_CPUTIME_ID, ...) in ns */
+static inline uint64_t cpu_ns(clockid_t clk)
+{
+    struct timespec ts;
+
+    clock_gettime(clk, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+/* Monotonic time in ns: timeouts, intervals and timestamps of host and model */
+static inline uint64_t now_ns()
+{
+    return cpu_ns(CLOCK_MONOTONIC);
+}
+
+/* CPU time the calling thread has used, in ns */
+static inline uint64_t thread_cpu_ns()
+{
+    return cpu_ns(CLOCK_THREAD_CPUTIME_ID);
+}
+
+static inline uint32_t roundup_pow_of_two(uint32_t v)
+{
+    return v <= 1 ? 1 : 1u << (32 - __builtin_clz(v - 1));
+}
+
+static inline unsigned ilog2(uint32_t v)
+{
+    return 31 - __builtin_clz(v);
+}
+
+} /* namespace sx */
+
+#endif /* SX_COMPILER_H */
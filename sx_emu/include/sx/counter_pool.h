@@ -0,0 +1,119 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_COUNTER_POOL_H
+#define SX_COUNTER_POOL_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "sx/dma.h"
+#include "sx/emad.h"
+#include "sx/kvd.h"
+
+namespace sx {
+
+/* Counters per bank: one MOCS transaction reads a bank */
+#define SX_CNT_BANK_SIZE    4096
+
+struct counter_pool_stats {
+    uint64_t banks;                     /* in use */
+    uint64_t counters;                  /* allocated */
+    uint64_t refreshes;
+    uint64_t accesses;                  /* register accesses of refreshes */
+    uint64_t refresh_ns;                /* duration of the last refresh */
+    uint64_t interval_ns;               /* between the last two refreshes */
+    uint64_t read_retries;              /* reads that overlapped a refresh */
+};
+
+/*
+ * Flow counters of one device. Counters are handed out from banks of
+ * SX_CNT_BANK_SIZE contiguous hardware counters, a bank only taken into
+ * use when the ones in use are full, so refreshes cover few banks.
+ *
+ * refresh() reads every bank in use into host memory, by default with one
+ * MOCS DMA per bank, all in flight together; set_bulk(false) reads each
+ * counter with MGPC instead. Each bank has two buffers: a refresh fills
+ * the one readers are not using, computes per-counter deltas against the
+ * previous refresh, and then publishes it. read() takes no lock and never
+ * waits; it only retries should two refreshes overtake one read.
+ *
+ * alloc(), free() and refresh() serialize on the pool's lock. A counter
+ * reads zero from the first refresh after its allocation.
+ */
+class counter_pool {
+public:
+    /* Hardware counters [0, @size) belong to the pool. */
+    counter_pool(emad &e, uint32_t size);
+    ~counter_pool();
+
+    counter_pool(const counter_pool &) = delete;
+    counter_pool &operator=(const counter_pool &) = delete;
+
+    void set_bulk(bool on) { bulk_ = on; }
+    void set_window(unsigned window) { window_ = window; }
+
+    /*
+     * @n contiguous counters, the first at @index. Returns 0, -EINVAL for
+     * @n above SX_KVD_CHUNK, -ENOSPC, -ENOMEM or the error of clearing them.
+     */
+    int alloc(uint32_t n, uint32_t *index);
+    void free(uint32_t index);
+
+    /*
+     * Take over the @n counters at @index, allocated by an earlier
+     * instance, without clearing them (warm boot). Their first refresh
+     * reports what they counted so far as delta. Returns 0, -EINVAL,
+     * -EBUSY if they overlap counters in use, or -ENOMEM.
+     */
+    int restore(uint32_t index, uint32_t n);
+
+    /* Returns 0 or the error of a failed access, publishing nothing. */
+    int refresh();
+
+    /*
+     * Counter @index as of the last refresh, and its change over the last
+     * interval. Returns -ENOENT for a counter of a bank not in use.
+     */
+    int read(uint32_t index, sx_flow_cnt *value, sx_flow_cnt *delta);
+
+    /* Refreshes published so far */
+    uint64_t generation() const { return gen_.load(std::memory_order_acquire); }
+
+    void get_stats(counter_pool_stats *out);
+
+private:
+    struct bank {
+        std::atomic<bool>          active{false};
+        std::unique_ptr<kvd_alloc> alloc;
+        dma_region                 buf[2] = {};         /* sx_flow_cnt per counter */
+        std::vector<sx_flow_cnt>   delta[2];
+        std::vector<sx_flow_cnt>   prev;                /* values of the last refresh */
+        std::vector<uint16_t>      size;                /* of the block at an offset */
+        std::vector<bool>          dirty;               /* counted since last cleared */
+    };
+
+    int activate(uint32_t b, bool fresh);
+    int clear(uint32_t index, uint32_t n);
+    int fill(unsigned buf);
+
+    emad                     &emad_;
+    uint32_t                  nbanks_;
+    std::unique_ptr<bank[]>   banks_;
+    std::vector<uint32_t>     active_;             /* banks in use, in order */
+    bool                      bulk_ = true;
+    unsigned                  window_ = SX_EMAD_MAX_INFLIGHT;
+    std::mutex                lock_;
+    std::vector<emad_op>      ops_;
+    std::atomic<uint64_t>     gen_{0};              /* published */
+    std::atomic<uint64_t>     filling_{0};          /* being filled */
+    uint64_t                  last_refresh_ = 0;
+    counter_pool_stats        stats_ = {};
+    std::atomic<uint64_t>     read_retries_{0};
+};
+
+} /* namespace sx */
+
+#endif /* SX_COUNTER_POOL_H */
@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_CQ_H
+#define SX_CQ_H
+
+#include "sx/bar.h"
+#include "sx/compiler.h"
+#include "sx/desc.h"
+#include "sx/dma.h"
+#include "sx/regs.h"
+
+namespace sx {
+
+/* Host side of a completion queue. */
+class cq {
+public:
+    cq(bar &b, unsigned cqn) : bar_(b), cqn_(cqn) {}
+    ~cq() { destroy(); }
+
+    cq(const cq &) = delete;
+    cq &operator=(const cq &) = delete;
+
+    /* Sleeps until the firmware has the queue set up. */
+    int create(unsigned log_size, unsigned vector);
+    void destroy();
+
+    /* Next CQE owned by software, or nullptr. Does not consume it. */
+    sx_cqe *peek()
+    {
+        sx_cqe *cqe = &ring_[ci_ & mask_];
+        uint8_t owner = load_acquire(&cqe->owner);
+
+        if ((owner & SX_CQE_OWNER) != ((ci_ >> log_size_) & 1))
+            return nullptr;
+        return cqe;
+    }
+
+    void consume() { ci_++; }
+
+    /* Return consumed CQEs to the device. */
+    void update_ci() { bar_.write32(SX_DB_CQ_CI(cqn_), ci_); }
+
+    /* Request an interrupt on the next completion. */
+    void arm() { bar_.write32(SX_DB_CQ_ARM(cqn_), ci_); }
+
+    /* Hold the interrupt for up to @count completions or @usecs (SX_Q_MOD). */
+    void set_moderation(unsigned usecs, unsigned count)
+    {
+        bar_.write32(SX_REG_CQ(cqn_) + SX_Q_MOD, SX_Q_MOD_USECS(usecs) | SX_Q_MOD_COUNT(count));
+    }
+
+    unsigned cqn() const { return cqn_; }
+    unsigned size() const { return mask_ + 1; }
+    bool created() const { return ring_ != nullptr; }
+
+private:
+    bar       &bar_;
+    unsigned   cqn_;
+    dma_region mem_ = {};
+    sx_cqe    *ring_ = nullptr;
+    uint32_t   ci_ = 0;
+    uint32_t   mask_ = 0;
+    unsigned   log_size_ = 0;
+};
+
+} /* namespace sx */
+
+#endif /* SX_CQ_H */
@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_DESC_H
+#define SX_DESC_H
+
+#include <cstdint>
+
+namespace sx {
+
+/*
+ * Descriptor queue element. The same layout is used by send (SDQ) and
+ * receive (RDQ) queues; a WQE may carry up to SX_WQE_MAX_FRAGS buffers.
+ */
+#define SX_WQE_MAX_FRAGS 3
+
+struct sx_wqe {
+    uint16_t flags;
+    uint16_t byte_count[SX_WQE_MAX_FRAGS];
+    uint64_t dma_addr[SX_WQE_MAX_FRAGS];
+};
+static_assert(sizeof(sx_wqe) == 32, "sx_wqe must be 32 bytes");
+
+/*
+ * Completion queue element. Hardware writes the owner bit last; software owns
+ * the CQE when the owner bit matches the wrap parity of its consumer index.
+ */
+#define SX_CQE_F_SR     0x01    /* completion of a send descriptor */
+#define SX_CQE_F_ERR    0x02    /* descriptor completed with error */
+#define SX_CQE_F_TRUNC  0x04    /* packet larger than the posted buffer */
+
+#define SX_CQE_OWNER    0x01
+
+#define SX_CQE_NO_PORT  0xffff  /* egress_port of traps not from a forwarded packet */
+
+struct sx_cqe {
+    uint16_t trap_id;
+    uint16_t byte_count;
+    uint16_t wqe_counter;
+    uint16_t sys_port;
+    uint8_t  dqn;
+    uint8_t  flags;
+    uint16_t pkt_len;           /* RDQ: before trap group truncation */
+    uint32_t flow_hash;
+    uint64_t timestamp;         /* ASIC time, ns */
+    uint16_t egress_port;       /* RDQ: sampled packets, else SX_CQE_NO_PORT */
+    uint8_t  rsvd1[5];
+    uint8_t  owner;
+};
+static_assert(sizeof(sx_cqe) == 32, "sx_cqe must be 32 bytes");
+
+/*
+ * Header prepended by the host to every packet posted on an SDQ. It tells
+ * the ASIC where to send the packet.
+ */
+#define SX_TX_HDR_VER       1
+#define SX_TX_CTL_TO_PORT   0   /* send out of dest_port as is */
+#define SX_TX_CTL_EMAD      1   /* register access, consumed by the ASIC */
+
+struct sx_tx_hdr {
+    uint8_t  version;
+    uint8_t  ctl;
+    uint16_t dest_port;
+    uint8_t  tclass;
+    uint8_t  rsvd[11];
+};
+static_assert(sizeof(sx_tx_hdr) == 16, "sx_tx_hdr must be 16 bytes");
+
+} /* namespace sx */
+
+#endif /* SX_DESC_H */
@@ -0,0 +1,369 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_DEV_H
+#define SX_DEV_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sx/bar.h"
+#include "sx/cq.h"
+#include "sx/dq.h"
+#include "sx/lat_trace.h"
+#include "sx/page_pool.h"
+#include "sx/pcpu.h"
+#include "sx/pkt_buf.h"
+#include "sx/regs.h"
+
+namespace sx {
+
+/* Default and maximum completions reaped per NAPI poll of one CQ */
+#define SX_NAPI_WEIGHT      64
+#define SX_NAPI_WEIGHT_MAX  1024
+
+/* send() flag: more sends follow, leave the doorbell to the last (xmit_more) */
+#define SX_SEND_MORE        0x1
+
+/* Buffers of a scatter-gather send that fit its WQE; more are linearized */
+#define SX_SEND_MAX_FRAGS   (SX_WQE_MAX_FRAGS - 1)
+
+/* create_rdq() pool size: twice the ring, so a full ring can be in flight */
+#define SX_RDQ_POOL_AUTO    (~0u)
+
+struct dev_caps {
+    uint32_t fw_rev;
+    uint32_t hw_id;
+    unsigned num_sdq;
+    unsigned num_rdq;
+    unsigned num_cq;
+    unsigned num_ports;
+};
+
+/* Metadata of a trapped packet, taken from its CQE. */
+struct rx_info {
+    uint16_t trap_id;
+    uint16_t sys_port;
+    uint16_t egress_port;       /* samples only, else SX_CQE_NO_PORT */
+    uint16_t pkt_len;           /* on the wire; longer than the buffer if truncated */
+    uint8_t  rdq;
+    uint32_t flow_hash;
+    uint64_t timestamp;
+    uint64_t deliver_ns;        /* hand-off to the listener, if traced */
+};
+
+/* The listener takes ownership of @buf and releases it with pkt_buf_free(). */
+using rx_handler_fn = std::function<void(const rx_info &info, pkt_buf *buf)>;
+
+/*
+ * Takes over one RDQ: supplies the buffers posted to it and receives every
+ * packet completed on it, bypassing the listener table. Used by zero-copy
+ * consumers whose buffers live in memory shared with user space.
+ */
+class rdq_consumer {
+public:
+    virtual ~rdq_consumer() = default;
+
+    virtual uint32_t buf_size() const = 0;
+
+    /* Buffer to post, or nullptr when none is free. */
+    virtual pkt_buf *alloc_buf() = 0;
+
+    /* Takes ownership of @buf. */
+    virtual void deliver(const rx_info &info, pkt_buf *buf) = 0;
+
+    /* End of a poll batch. */
+    virtual void flush() {}
+};
+
+/*
+ * Interrupt moderation of one CQ, after ethtool's rx coalesce parameters.
+ * With @adaptive set, usecs and max_frames are picked from the completion
+ * rate and reported back by get_coalesce().
+ */
+struct cq_coalesce {
+    unsigned usecs;         /* longest hold after the first completion */
+    unsigned max_frames;    /* completions per interrupt; 0/1: no batching */
+    bool     adaptive;
+};
+
+/* Adaptive moderation: rate sample period and interrupt rate it aims for */
+#define SX_DIM_SAMPLE_NS    1000000
+#define SX_DIM_IRQ_RATE     20000
+
+struct port_counters {
+    uint64_t rx_packets;
+    uint64_t rx_bytes;
+    uint64_t tx_packets;
+    uint64_t tx_bytes;
+};
+
+struct trap_counters {
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t no_listener;
+};
+
+struct queue_counters {
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t errors;
+};
+
+/*
+ * Driver core instance of one ASIC: owns the completion and descriptor
+ * queues, the trap configuration and the listener table.
+ */
+class dev {
+public:
+    explicit dev(bar &b);
+    ~dev();
+
+    dev(const dev &) = delete;
+    dev &operator=(const dev &) = delete;
+
+    /*
+     * Reload the firmware and sleep until it is up again, at most
+     * @timeout_ms, as probe does first. -EBUSY once queues exist.
+     */
+    int reset_fw(unsigned timeout_ms = SX_FW_BOOT_TIMEOUT_MS);
+
+    int init();
+    const dev_caps &caps() const { return caps_; }
+    bar &regs() { return bar_; }
+
+    /*
+     * Queues may be created from several threads at once, each queue by
+     * one of them; RDQs completing on one CQ one after the other.
+     */
+    int create_cq(unsigned cqn, unsigned log_size);
+
+    /*
+     * Receive buffers come from a page pool of @pool_bufs buffers, recycled
+     * as listeners free them; 0 allocates a buffer per packet instead.
+     */
+    int create_rdq(unsigned rdq, unsigned log_size, unsigned cqn, uint32_t buf_size,
+                   unsigned pool_bufs = SX_RDQ_POOL_AUTO);
+
+    /*
+     * Hand @rdq over to @c. Must precede create_rdq(), which then posts
+     * buffers from @c and ignores its buf_size argument. An RDQ that @c
+     * cannot fill yet is left partly posted; polls of its CQ post the rest.
+     */
+    int bind_rdq(unsigned rdq, rdq_consumer *c);
+    int create_sdq(unsigned sdq, unsigned log_size, unsigned cqn);
+    void destroy_queues();
+
+    int set_trap_group(uint16_t trap_id, uint8_t group);
+    int set_trap_group_rdq(uint8_t group, uint8_t rdq);
+
+    /*
+     * Spread @group over RDQs @first .. @first + @count - 1 by flow hash, so
+     * one trap group can use several queues (and CPUs). Packets of one flow
+     * stay on one RDQ and are delivered in order.
+     */
+    int set_trap_group_rdqs(uint8_t group, uint8_t first, unsigned count);
+
+    /*
+     * Completions reaped per poll of the CQ serving @group's RDQ. A larger
+     * budget amortizes refills and doorbells over more packets; a smaller
+     * one bounds how long a trap storm holds the CPU before other groups run.
+     */
+    int set_trap_group_budget(uint8_t group, unsigned budget);
+
+    /*
+     * DMA at most @bytes of each packet trapped to @group (0: all of it),
+     * so traps only the headers matter for, such as samples, take small
+     * buffers and little bus bandwidth. rx_info::pkt_len keeps the length
+     * the packet had.
+     */
+    int set_trap_group_trunc(uint8_t group, uint16_t bytes);
+
+    int add_listener(uint16_t trap_id, rx_handler_fn fn);
+    void del_listener(uint16_t trap_id);
+
+    /*
+     * Send @len bytes out of @port, or to the ASIC itself for @ctl other
+     * than SX_TX_CTL_TO_PORT. The payload is copied into a new buffer.
+     * With SX_SEND_MORE in @flags the doorbell waits for a later send
+     * without it, or for flush_sdq().
+     */
+    int send(unsigned sdq, uint16_t port, const void *data, uint32_t len,
+             uint8_t ctl = SX_TX_CTL_TO_PORT, unsigned flags = 0);
+
+    /*
+     * Send the concatenation of @frags out of @port without copying it:
+     * the WQE points at the buffers, which the driver frees once the send
+     * completes. On error they stay with the caller. More than
+     * SX_SEND_MAX_FRAGS buffers are copied into one first.
+     */
+    int send_sg(unsigned sdq, uint16_t port, pkt_buf *const *frags, unsigned nfrags,
+                unsigned flags = 0);
+
+    /* Ring the doorbell for sends left pending by SX_SEND_MORE. */
+    int flush_sdq(unsigned sdq);
+
+    /*
+     * NAPI poll: reap up to @budget completions of @cqn, refill the RDQs they
+     * came from in bulk and ring each doorbell once. Returns the number
+     * reaped; fewer than @budget means the CQ is drained.
+     */
+    int poll_cq(unsigned cqn, int budget);
+
+    /* Reap every pending completion of @cqn. Returns the number handled. */
+    int process_cq(unsigned cqn);
+
+    /*
+     * Interrupt entry point; vector n belongs to CQ n. Schedules the CQ's
+     * NAPI context and polls scheduled contexts round-robin, each with its
+     * own budget, re-arming a CQ once it is drained.
+     */
+    void irq(unsigned vector);
+
+    /*
+     * Poll @cqn from its own thread, bound to @cpu (-1: any CPU), instead
+     * of in interrupt context; the interrupt only wakes the thread
+     * (threaded NAPI). Gives every CQ an independent poll context.
+     * Returns -EBUSY while an irq() is polling @cqn; try again later.
+     */
+    int set_napi_thread(unsigned cqn, int cpu);
+
+    /*
+     * Interrupt moderation of @cqn. A frame bound needs a time bound as
+     * well, or a lone completion could wait forever (-EINVAL).
+     */
+    int set_coalesce(unsigned cqn, const cq_coalesce &c);
+    int get_coalesce(unsigned cqn, cq_coalesce *c);
+
+    /*
+     * Counter snapshots, summed over the per-CPU copies without blocking
+     * the data path. Packets and bytes of one copy are read consistently.
+     */
+    void get_port_counters(unsigned port, port_counters *out);
+    void get_trap_counters(uint16_t trap_id, trap_counters *out);
+    void get_rdq_counters(unsigned rdq, queue_counters *out);
+    int get_rdq_pool_stats(unsigned rdq, page_pool_stats *out);
+    void get_sdq_counters(unsigned sdq, queue_counters *out);
+
+    /*
+     * Per-packet latency tracing of @trap_id into one histogram per
+     * lat_stage. Costs a clock read and a per-CPU histogram update per
+     * traced packet, nothing for others. Up to SX_LAT_MAX_TRAPS traps can
+     * be traced; their histograms survive turning tracing off and on.
+     */
+    int set_latency_trace(uint16_t trap_id, bool on);
+    int get_latency_hist(uint16_t trap_id, unsigned stage, lat_hist *out);
+
+    /* A consumer outside the driver dequeued a traced packet (SX_LAT_USER). */
+    void trace_dequeue(const rx_info &info);
+
+    /* Text dump of every traced trap, as a debugfs file would read. */
+    std::string latency_debugfs();
+
+private:
+    struct listener {
+        rx_handler_fn fn;
+    };
+
+    struct napi {
+        unsigned weight = SX_NAPI_WEIGHT;
+        bool     scheduled = false;
+
+        /* Moderation in force, and the adaptive state behind it */
+        cq_coalesce coal = {};
+        unsigned    dim_level = 0;
+        uint64_t    dim_start = 0;
+        uint64_t    dim_packets = 0;
+
+        /* First interrupt since the last re-arm, while tracing */
+        std::atomic<uint64_t> irq_ns{0};
+    };
+
+    /* Times of the current poll, for latency tracing */
+    struct lat_poll {
+        uint64_t irq_ns;
+        uint64_t poll_ns;
+        uint64_t poll_cycles;
+    };
+
+    struct lat_counters {
+        lat_hist hist[SX_LAT_MAX_TRAPS][SX_LAT_STAGES];
+    };
+
+    struct napi_thread {
+        std::thread             thread;
+        std::mutex              lock;
+        std::condition_variable wq;
+        bool                    pending = false;
+        bool                    stop = false;
+    };
+
+    void handle_rx(const sx_cqe &cqe, const lat_poll *lp);
+    void trace_rx(rx_info &info, const lat_poll &lp);
+    void handle_tx(const sx_cqe &cqe);
+    void count_tx(uint16_t port, uint32_t len);
+    int refill_rdq(dq &q);
+    void update_napi_weight(uint8_t group);
+    void napi_complete(unsigned cqn, unsigned packets);
+    void napi_thread_fn(unsigned cqn, napi_thread *t);
+    void stop_napi_thread(napi_thread *t);
+    void stop_napi_threads();
+
+    bar     &bar_;
+    dev_caps caps_ = {};
+
+    std::unique_ptr<cq> cqs_[SX_MAX_CQ];
+    std::unique_ptr<dq> sdqs_[SX_MAX_SDQ];
+    std::unique_ptr<dq> rdqs_[SX_MAX_RDQ];
+    uint32_t            rdq_buf_size_[SX_MAX_RDQ] = {};
+    rdq_consumer       *rdq_consumer_[SX_MAX_RDQ] = {};
+    page_pool          *rdq_pool_[SX_MAX_RDQ] = {};
+    std::mutex          sdq_lock_[SX_MAX_SDQ];
+
+    uint8_t             group_rdq_[SX_MAX_TRAP_GROUP];
+    uint8_t             group_rdq_count_[SX_MAX_TRAP_GROUP];
+    unsigned            group_budget_[SX_MAX_TRAP_GROUP];
+    napi                napi_[SX_MAX_CQ];
+    uint64_t            cq_starved_[SX_MAX_CQ] = {};    /* RDQs short of buffers */
+    uint64_t            cq_rdqs_[SX_MAX_CQ] = {};       /* RDQs with a page pool */
+    std::mutex          poll_lock_;
+    std::deque<unsigned> poll_list_;
+    std::atomic<napi_thread *> napi_thread_[SX_MAX_CQ] = {};
+
+    /*
+     * Listeners are looked up on every packet without a lock. Removed
+     * entries are retired rather than freed, as a packet may still be in
+     * flight to them.
+     */
+    std::atomic<listener *>                listeners_[SX_MAX_TRAP_ID] = {};
+    std::mutex                             listeners_lock_;
+    std::vector<std::unique_ptr<listener>> retired_;
+
+    struct counters {
+        port_counters  port[SX_MAX_PORTS];
+        trap_counters  trap[SX_MAX_TRAP_ID];
+        queue_counters rdq[SX_MAX_RDQ];
+        queue_counters sdq[SX_MAX_SDQ];
+    };
+
+    pcpu_stats<counters> stats_;
+
+    /* Histogram slot + 1 of each traced trap; slots stay with their trap */
+    std::atomic<uint8_t>     lat_slot_[SX_MAX_TRAP_ID] = {};
+    uint16_t                 lat_trap_[SX_LAT_MAX_TRAPS] = {};
+    unsigned                 lat_nslots_ = 0;
+    std::atomic<unsigned>    lat_traced_{0};
+    double                   lat_ns_per_cycle_ = 0;  /* 0: no cycle counter */
+    std::mutex               lat_lock_;
+    pcpu_stats<lat_counters> lat_;
+};
+
+} /* namespace sx */
+
+#endif /* SX_DEV_H */
@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_DMA_H
+#define SX_DMA_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace sx {
+
+/*
+ * Coherent DMA memory. Host and device share one address space in the
+ * software model, so the bus address is the CPU address.
+ */
+struct dma_region {
+    void    *cpu;
+    uint64_t dma;
+    size_t   size;
+};
+
+int dma_alloc_coherent(size_t size, dma_region *region);
+void dma_free_coherent(dma_region *region);
+
+static inline uint64_t dma_map_single(void *cpu)
+{
+    return reinterpret_cast<uintptr_t>(cpu);
+}
+
+static inline void *dma_to_virt(uint64_t dma)
+{
+    return reinterpret_cast<void *>(static_cast<uintptr_t>(dma));
+}
+
+} /* namespace sx */
+
+#endif /* SX_DMA_H */
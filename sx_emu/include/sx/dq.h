@@ -0,0 +1,90 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_DQ_H
+#define SX_DQ_H
+
+#include "sx/bar.h"
+#include "sx/desc.h"
+#include "sx/dma.h"
+#include "sx/pkt_buf.h"
+#include "sx/regs.h"
+
+namespace sx {
+
+enum class dq_type { sdq, rdq };
+
+/*
+ * Host side of a descriptor queue. Every posted WQE owns its pkt_bufs until
+ * its completion is reaped; pi/ci are free running. Send queues also keep
+ * a DMA-mapped sx_tx_hdr per WQE, so a scatter-gather send needs no buffer
+ * of its own for the header.
+ */
+class dq {
+public:
+    dq(bar &b, dq_type type, unsigned dqn) : bar_(b), type_(type), dqn_(dqn) {}
+    ~dq() { destroy(); }
+
+    dq(const dq &) = delete;
+    dq &operator=(const dq &) = delete;
+
+    /* Sleeps until the firmware has the queue set up. */
+    int create(unsigned log_size, unsigned cqn);
+    void destroy();
+
+    /* Fill the next WQE with @buf. The caller checks room(). */
+    void post(pkt_buf *buf);
+
+    /* Header slot of the next send WQE, for post_sg(). */
+    sx_tx_hdr *next_tx_hdr() { return &hdrs_[pi_ & mask_]; }
+
+    /*
+     * Fill the next send WQE with its header slot followed by the @nfrags
+     * (at most SX_WQE_MAX_FRAGS - 1) buffers of @frags. The caller checks
+     * room().
+     */
+    void post_sg(pkt_buf *const *frags, unsigned nfrags);
+
+    /* Release the (first) buffer of the WQE completed at @wqe_counter. */
+    pkt_buf *complete(uint16_t wqe_counter);
+
+    /*
+     * Release every buffer of the send WQE completed at @wqe_counter into
+     * @frags. Returns their number.
+     */
+    unsigned complete_sg(uint16_t wqe_counter, pkt_buf **frags);
+
+    void ring_doorbell()
+    {
+        bar_.write32(type_ == dq_type::sdq ? SX_DB_SDQ(dqn_) : SX_DB_RDQ(dqn_), pi_);
+        db_pi_ = pi_;
+    }
+
+    /* WQEs posted since the last doorbell */
+    bool doorbell_pending() const { return db_pi_ != pi_; }
+
+    unsigned room() const { return size() - (pi_ - ci_); }
+    unsigned size() const { return mask_ + 1; }
+    unsigned dqn() const { return dqn_; }
+    unsigned cqn() const { return cqn_; }
+    dq_type type() const { return type_; }
+    bool created() const { return ring_ != nullptr; }
+
+private:
+    bar       &bar_;
+    dq_type    type_;
+    unsigned   dqn_;
+    unsigned   cqn_ = 0;
+    dma_region mem_ = {};
+    sx_wqe    *ring_ = nullptr;
+    sx_tx_hdr *hdrs_ = nullptr;     /* send queues, after the ring in mem_ */
+    pkt_buf  **bufs_ = nullptr;     /* nfrags_ per WQE */
+    unsigned   nfrags_ = 1;
+    uint32_t   pi_ = 0;
+    uint32_t   ci_ = 0;
+    uint32_t   db_pi_ = 0;
+    uint32_t   mask_ = 0;
+};
+
+} /* namespace sx */
+
+#endif /* SX_DQ_H */
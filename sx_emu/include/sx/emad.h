@@ -0,0 +1,104 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_EMAD_H
+#define SX_EMAD_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "sx/dev.h"
+#include "sx/emad_defs.h"
+
+namespace sx {
+
+/* One register access. @payload is the request in and the response out. */
+struct emad_op {
+    uint16_t             reg_id = 0;
+    uint8_t              method = SX_EMAD_METHOD_QUERY;
+    std::vector<uint8_t> payload;
+    uint8_t              status = 0;    /* EMAD status of the response */
+    int                  err = 0;       /* 0, -EIO (status set) or -ETIMEDOUT */
+};
+
+#define SX_EMAD_MAX_INFLIGHT        256
+#define SX_EMAD_TIMEOUT_MS          200
+
+/*
+ * EMAD transport of one device. Any number of threads may issue accesses.
+ * Responses are matched to requests by transaction ID, so they may arrive
+ * in any order.
+ */
+class emad {
+public:
+    /*
+     * Requests go out on @sdq; responses arrive on the RDQ of the
+     * SX_TRAP_ID_EMAD trap group. @cqn is the CQ serving both.
+     */
+    emad(dev &d, unsigned sdq, unsigned cqn);
+    ~emad();
+
+    emad(const emad &) = delete;
+    emad &operator=(const emad &) = delete;
+
+    int init();
+
+    /*
+     * Waiters poll the response CQ themselves instead of sleeping until
+     * the interrupt path delivers. Use when no interrupt handler serves it.
+     */
+    void set_busy_poll(bool on) { busy_poll_ = on; }
+    void set_timeout_ms(unsigned ms) { timeout_ms_ = ms; }
+
+    /* One request, then wait for its response. Returns op.err. */
+    int access(emad_op &op);
+
+    /*
+     * Issue @ops keeping up to @window of them in flight. Each op's
+     * status and err report its own outcome; returns 0 once every op has
+     * completed or timed out, or -ENODEV before init().
+     */
+    int transact(std::vector<emad_op> &ops, unsigned window);
+    int transact(emad_op *ops, size_t n, unsigned window);
+
+    uint64_t timeouts() const { return timeouts_; }
+
+private:
+    struct batch {
+        unsigned completed = 0;
+    };
+
+    struct slot {
+        uint64_t  tid;
+        emad_op  *op;
+        batch    *b;
+        uint64_t  deadline;
+        bool      busy;
+    };
+
+    int run(emad_op *ops, size_t n, unsigned window);
+    int submit(emad_op &op, batch &b);
+    void on_response(const rx_info &info, pkt_buf *buf);
+    void wait_progress(std::unique_lock<std::mutex> &guard);
+    void expire(uint64_t now);
+
+    dev                    &dev_;
+    unsigned                sdq_;
+    unsigned                cqn_;
+    bool                    busy_poll_ = false;
+    unsigned                timeout_ms_ = SX_EMAD_TIMEOUT_MS;
+    uint64_t                next_tid_ = 1;
+    uint64_t                timeouts_ = 0;
+    uint64_t                next_expire_ = 0;
+    std::mutex              lock_;
+    std::mutex              poll_lock_;
+    std::condition_variable wq_;
+    slot                    slots_[SX_EMAD_MAX_INFLIGHT] = {};
+    unsigned                inflight_ = 0;
+    bool                    registered_ = false;
+};
+
+} /* namespace sx */
+
+#endif /* SX_EMAD_H */
@@ -0,0 +1,319 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_EMAD_DEFS_H
+#define SX_EMAD_DEFS_H
+
+#include <cstdint>
+
+namespace sx {
+
+/*
+ * EMAD: register access carried in Ethernet frames. Requests go out on an
+ * SDQ with SX_TX_CTL_EMAD; the ASIC answers with the same frame, response bit
+ * and status set, trapped with SX_TRAP_ID_EMAD. Multi-byte fields are big
+ * endian on the wire.
+ */
+#define SX_EMAD_ETHERTYPE           0x8932
+#define SX_EMAD_MLX_PROTO           0
+
+#define SX_EMAD_TLV_END             0
+#define SX_EMAD_TLV_OP              1
+#define SX_EMAD_TLV_REG             3
+
+#define SX_EMAD_METHOD_QUERY        1
+#define SX_EMAD_METHOD_WRITE        2
+#define SX_EMAD_CLASS_REG_ACCESS    1
+#define SX_EMAD_OP_R                0x80    /* response */
+
+#define SX_EMAD_STATUS_OK           0x00
+#define SX_EMAD_STATUS_BUSY         0x01
+#define SX_EMAD_STATUS_BAD_TLV      0x03
+#define SX_EMAD_STATUS_BAD_REG      0x04
+#define SX_EMAD_STATUS_BAD_METHOD   0x06
+#define SX_EMAD_STATUS_BAD_PARAM    0x07
+#define SX_EMAD_STATUS_NO_RESOURCES 0x08
+#define SX_EMAD_STATUS_INTERNAL     0x70
+
+#define SX_EMAD_MAX_REG_LEN         1024    /* bytes of register payload */
+
+/* Register IDs */
+#define SX_REG_ID_SFD               0x200a  /* FDB records */
+#define SX_REG_ID_MGPC              0x2081  /* flow counter */
+#define SX_REG_ID_PACL              0x3004  /* ACL to TCAM region binding */
+#define SX_REG_ID_PTAR              0x3006  /* TCAM region allocation */
+#define SX_REG_ID_PTCE              0x3017  /* TCAM entries */
+#define SX_REG_ID_PAOS              0x5006  /* port admin and operational status */
+#define SX_REG_ID_PPCNT             0x5008  /* port counters */
+#define SX_REG_ID_RALUE             0x8013  /* LPM routes */
+#define SX_REG_ID_RAUHT             0x8014  /* host (neighbour) entries */
+#define SX_REG_ID_MGIR              0x9020  /* general information */
+#define SX_REG_ID_MPSC              0x9080  /* packet sampling */
+#define SX_REG_ID_MOCS              0x9087  /* flow counter snapshot to host memory */
+
+struct sx_emad_eth_hdr {
+    uint8_t  dmac[6];
+    uint8_t  smac[6];
+    uint16_t ethertype;
+    uint8_t  mlx_proto;
+    uint8_t  ver;
+} __attribute__((packed));
+
+/* TLV header: type in bits 15:11, length in dwords (header included) in 10:0 */
+static inline uint16_t sx_emad_tlv(unsigned type, unsigned len_dw)
+{
+    return static_cast<uint16_t>(type << 11 | (len_dw & 0x7ff));
+}
+
+struct sx_emad_op_tlv {
+    uint16_t type_len;
+    uint8_t  status;
+    uint8_t  rsvd0;
+    uint16_t register_id;
+    uint8_t  r_method;
+    uint8_t  reg_class;
+    uint64_t tid;
+} __attribute__((packed));
+
+struct sx_emad_reg_tlv {
+    uint16_t type_len;
+    uint16_t rsvd0;
+    uint8_t  data[];
+} __attribute__((packed));
+
+/*
+ * SFD payload: a header and up to SX_SFD_MAX_REC records. A write adds
+ * (SX_SFD_OP_ADD) or removes (SX_SFD_OP_DEL) @num_rec static entries, which
+ * raise no learning notification. A query either looks up rec[0]
+ * (SX_SFD_OP_LOOKUP: @num_rec comes back 1 with the port if found, else 0)
+ * or returns the entries from key @cursor on in key order, as many as fit
+ * the payload (SX_SFD_OP_DUMP: @cursor comes back as the key to continue
+ * from, SX_SFD_CURSOR_END after the last entry).
+ */
+#define SX_SFD_OP_ADD               1
+#define SX_SFD_OP_DEL               2
+#define SX_SFD_OP_LOOKUP            3
+#define SX_SFD_OP_DUMP              4
+
+#define SX_SFD_CURSOR_END           (~0ull)
+
+struct sx_sfd_rec {
+    uint16_t fid;
+    uint8_t  mac[6];
+    uint16_t port;
+    uint16_t rsvd0;
+} __attribute__((packed));
+
+struct sx_sfd_reg {
+    uint8_t    op;
+    uint8_t    num_rec;
+    uint16_t   rsvd0;
+    uint32_t   rsvd1;
+    uint64_t   cursor;          /* sx_fdb_key() */
+    sx_sfd_rec rec[];
+} __attribute__((packed));
+
+#define SX_SFD_MAX_REC  ((SX_EMAD_MAX_REG_LEN - sizeof(sx_sfd_reg)) / sizeof(sx_sfd_rec))
+
+/*
+ * RALUE payload: up to SX_RALUE_MAX_REC LPM routes of one KVD region, that
+ * is of one protocol, virtual router and prefix length whose addresses
+ * share their top SX_LPM_REGION_BITS_V4/_V6 bits, given in @region. Every
+ * record comes back with its own EMAD status; the access itself fails only
+ * on a bad header. Deleting a route that is not there succeeds.
+ */
+#define SX_RALUE_PROTO_IPV4         0
+#define SX_RALUE_PROTO_IPV6         1
+
+#define SX_RALUE_OP_WRITE           0
+#define SX_RALUE_OP_DELETE          1
+
+#define SX_LPM_REGION_BITS_V4       8
+#define SX_LPM_REGION_BITS_V6       12
+
+struct sx_ralue_rec {
+    uint8_t  dip[16];           /* IPv4 in the first 4 bytes */
+    uint32_t adj_index;         /* big endian */
+    uint8_t  status;            /* response */
+    uint8_t  rsvd0[3];
+} __attribute__((packed));
+
+struct sx_ralue_reg {
+    uint8_t      protocol;
+    uint8_t      op;
+    uint16_t     virtual_router;    /* big endian */
+    uint8_t      prefix_len;
+    uint8_t      num_rec;
+    uint16_t     rsvd0;
+    uint32_t     region;            /* big endian */
+    uint32_t     rsvd1;
+    sx_ralue_rec rec[];
+} __attribute__((packed));
+
+#define SX_RALUE_MAX_REC ((SX_EMAD_MAX_REG_LEN - sizeof(sx_ralue_reg)) / sizeof(sx_ralue_rec))
+
+/* KVD region of a route to @dip */
+static inline uint32_t sx_lpm_region(uint8_t protocol, const uint8_t *dip)
+{
+    unsigned bits = protocol == SX_RALUE_PROTO_IPV4 ? SX_LPM_REGION_BITS_V4 : SX_LPM_REGION_BITS_V6;
+
+    return static_cast<uint32_t>(dip[0] << 8 | dip[1]) >> (16 - bits);
+}
+
+/*
+ * TCAM. PTAR allocates a region of @size entries of one key width, from
+ * SX_TCAM_WIDTH_1 (16 key bytes) to SX_TCAM_WIDTH_4 (64), each entry
+ * taking @key_width slots of the TCAM; a resize keeps the entries below
+ * the new size. PTCE writes or clears the entry at @offset of a region.
+ * Within a region the lowest valid offset that matches wins; mask and key
+ * bytes beyond the region's width must be zero.
+ *
+ * PACL binds an ACL to up to SX_ACL_MAX_REGIONS regions in one write, so
+ * an ACL moves to another set of regions atomically. A lookup takes the
+ * match of each region and of those the one of the lowest @priority.
+ */
+#define SX_TCAM_SLOT_BYTES          16
+#define SX_TCAM_WIDTH_1             1
+#define SX_TCAM_WIDTH_2             2
+#define SX_TCAM_WIDTH_4             4
+#define SX_TCAM_KEY_MAX             (SX_TCAM_WIDTH_4 * SX_TCAM_SLOT_BYTES)
+
+#define SX_PTAR_OP_ALLOC            0
+#define SX_PTAR_OP_RESIZE           1
+#define SX_PTAR_OP_FREE             2
+
+struct sx_ptar_reg {
+    uint8_t  op;
+    uint8_t  key_width;
+    uint16_t region;            /* big endian; allocated region in the response */
+    uint32_t size;              /* entries, big endian */
+} __attribute__((packed));
+
+#define SX_PTCE_OP_WRITE            0
+#define SX_PTCE_OP_CLEAR            1
+
+struct sx_ptce_reg {
+    uint8_t  op;
+    uint8_t  rsvd0;
+    uint16_t region;            /* big endian */
+    uint32_t offset;            /* big endian */
+    uint32_t priority;          /* big endian */
+    uint32_t action;            /* big endian */
+    uint8_t  key[SX_TCAM_KEY_MAX];
+    uint8_t  mask[SX_TCAM_KEY_MAX];
+} __attribute__((packed));
+
+#define SX_ACL_MAX_REGIONS          4
+
+struct sx_pacl_reg {
+    uint16_t acl_id;            /* big endian */
+    uint8_t  num_regions;
+    uint8_t  rsvd0;
+    uint16_t region[SX_ACL_MAX_REGIONS];    /* big endian */
+} __attribute__((packed));
+
+/*
+ * Flow counters. An MGPC query reads the counter at @index; a write with
+ * SX_MGPC_OP_CLEAR zeroes @num counters from @index on. A MOCS write DMAs
+ * @num counters from @base on to host memory at @dma_addr, as sx_flow_cnt
+ * in host order like descriptors, before it is answered.
+ */
+#define SX_MGPC_OP_NOP              0
+#define SX_MGPC_OP_CLEAR            1
+
+struct sx_mgpc_reg {
+    uint8_t  op;
+    uint8_t  rsvd0;
+    uint16_t num;               /* big endian */
+    uint32_t index;             /* big endian */
+    uint64_t packets;           /* big endian */
+    uint64_t bytes;             /* big endian */
+} __attribute__((packed));
+
+struct sx_mocs_reg {
+    uint32_t base;              /* big endian */
+    uint32_t num;               /* big endian */
+    uint64_t dma_addr;          /* big endian */
+} __attribute__((packed));
+
+#define SX_MOCS_MAX_COUNTERS        65536
+
+struct sx_flow_cnt {
+    uint64_t packets;
+    uint64_t bytes;
+};
+
+/*
+ * Packet sampling of @local_port: with @enable set, one in @rate packets
+ * received on it, on average, is trapped with SX_TRAP_ID_PKT_SAMPLE.
+ */
+struct sx_mpsc_reg {
+    uint16_t local_port;        /* big endian */
+    uint8_t  enable;
+    uint8_t  rsvd0;
+    uint32_t rate;              /* big endian */
+} __attribute__((packed));
+
+/*
+ * Counters of one port, its priority groups (ingress buffers) and traffic
+ * classes (egress queues). Occupancies are gauges, in buffer cells. A
+ * PPCNT query returns them for @local_port, every field big endian.
+ */
+#define SX_PORT_PRIOS               8
+
+struct sx_port_cnt {
+    uint64_t rx_packets;
+    uint64_t rx_bytes;
+    uint64_t tx_packets;
+    uint64_t tx_bytes;
+    uint64_t rx_discards;
+    uint64_t tx_discards;
+    uint64_t pg_rx_bytes[SX_PORT_PRIOS];
+    uint64_t tc_tx_bytes[SX_PORT_PRIOS];
+    uint64_t tc_discards[SX_PORT_PRIOS];
+    uint32_t pg_occupancy[SX_PORT_PRIOS];
+    uint32_t tc_occupancy[SX_PORT_PRIOS];
+} __attribute__((packed));
+
+struct sx_ppcnt_reg {
+    uint16_t    local_port;     /* big endian */
+    uint16_t    rsvd0;
+    uint32_t    rsvd1;
+    sx_port_cnt cnt;
+} __attribute__((packed));
+
+/*
+ * Port status. A PAOS write with @ase set takes @local_port administratively
+ * up or down; the link (operational status) comes up once trained, a while
+ * after the port went up, and goes down with it. Both come back in the
+ * response of a query or write.
+ */
+#define SX_PORT_STATUS_UP           1
+#define SX_PORT_STATUS_DOWN         2
+
+struct sx_paos_reg {
+    uint16_t local_port;        /* big endian */
+    uint8_t  admin_status;
+    uint8_t  oper_status;       /* response */
+    uint8_t  ase;               /* admin status enable */
+    uint8_t  rsvd0[3];
+} __attribute__((packed));
+
+static_assert(sizeof(sx_emad_eth_hdr) == 16, "sx_emad_eth_hdr must be 16 bytes");
+static_assert(sizeof(sx_emad_op_tlv) == 16, "sx_emad_op_tlv must be 16 bytes");
+static_assert(sizeof(sx_sfd_rec) == 12, "sx_sfd_rec must be 12 bytes");
+static_assert(sizeof(sx_sfd_reg) == 16, "sx_sfd_reg must be 16 bytes");
+static_assert(sizeof(sx_ralue_rec) == 24, "sx_ralue_rec must be 24 bytes");
+static_assert(sizeof(sx_ralue_reg) == 16, "sx_ralue_reg must be 16 bytes");
+static_assert(sizeof(sx_ptar_reg) == 8, "sx_ptar_reg must be 8 bytes");
+static_assert(sizeof(sx_ptce_reg) == 144, "sx_ptce_reg must be 144 bytes");
+static_assert(sizeof(sx_pacl_reg) == 12, "sx_pacl_reg must be 12 bytes");
+static_assert(sizeof(sx_mgpc_reg) == 24, "sx_mgpc_reg must be 24 bytes");
+static_assert(sizeof(sx_mocs_reg) == 16, "sx_mocs_reg must be 16 bytes");
+static_assert(sizeof(sx_mpsc_reg) == 8, "sx_mpsc_reg must be 8 bytes");
+static_assert(sizeof(sx_paos_reg) == 8, "sx_paos_reg must be 8 bytes");
+static_assert(sizeof(sx_port_cnt) == 304, "sx_port_cnt must be 304 bytes");
+static_assert(sizeof(sx_ppcnt_reg) == 312, "sx_ppcnt_reg must be 312 bytes");
+
+} /* namespace sx */
+
+#endif /* SX_EMAD_DEFS_H */
@@ -0,0 +1,366 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_EMU_ASIC_H
+#define SX_EMU_ASIC_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "sx/bar.h"
+#include "sx/desc.h"
+#include "sx/emad_defs.h"
+#include "sx/ptp_defs.h"
+#include "sx/regs.h"
+#include "sx/spinlock.h"
+
+namespace sx {
+namespace emu {
+
+struct asic_config {
+    uint32_t fw_rev = 0x001e2008;
+    uint32_t hw_id = 0xcf6c;
+    unsigned num_sdq = SX_MAX_SDQ;
+    unsigned num_rdq = SX_MAX_RDQ;
+    unsigned num_ports = 64;
+    /* CPU time charged to every BAR access, as an uncached MMIO would cost */
+    unsigned mmio_delay_ns = 0;
+    /* Time from an EMAD request reaching the ASIC to its response */
+    unsigned emad_latency_ns = 0;
+    /* KVD sizes: LPM routes, adjacency (next hop) entries */
+    unsigned kvd_lpm_entries = 1u << 21;
+    unsigned kvd_adj_entries = 1u << 16;
+    /* TCAM size in SX_TCAM_SLOT_BYTES key slots */
+    unsigned tcam_slots = 1u << 18;
+    unsigned flow_counters = 1u << 18;
+    /* PTP timestamps the FIFO holds before it drops them */
+    unsigned ptp_fifo_size = 1024;
+    /* Firmware boot after SX_REG_FW_RESET, queue set-up, link training */
+    unsigned fw_boot_ns = 0;
+    unsigned queue_init_ns = 0;
+    unsigned port_up_ns = 0;
+};
+
+struct asic_stats {
+    std::atomic<uint64_t> trapped{0};
+    std::atomic<uint64_t> trap_discard{0};
+    std::atomic<uint64_t> rdq_no_desc{0};
+    std::atomic<uint64_t> tx_packets{0};
+    std::atomic<uint64_t> tx_bytes{0};
+    std::atomic<uint64_t> tx_errors{0};
+    std::atomic<uint64_t> tx_cq_stalls{0};      /* SDQ waited for room in its CQ */
+    std::atomic<uint64_t> tx_cqe_dropped{0};    /* send whose completion was lost */
+    std::atomic<uint64_t> cq_overflow{0};
+    std::atomic<uint64_t> irqs{0};
+    std::atomic<uint64_t> doorbells{0};
+    std::atomic<uint64_t> emad_requests{0};
+    std::atomic<uint64_t> emad_dropped{0};
+    std::atomic<uint64_t> ptp_ts_dropped{0};
+};
+
+/*
+ * Software model of the switch ASIC. It implements BAR0 (configuration
+ * registers and doorbells), the descriptor-ring DMA engine and completion
+ * generation, so the driver core runs against it unchanged.
+ *
+ * Trapped traffic enters through inject(); packets the host sends out of a
+ * port leave through the egress handler. Both run in the caller's context.
+ * Interrupts are delivered from a dedicated thread, as they would be on
+ * another CPU, once an interrupt handler is installed.
+ *
+ * EMAD requests are served by register handlers in firmware context and
+ * answered through the SX_TRAP_ID_EMAD trap, after emad_latency_ns if set.
+ *
+ * SX_REG_FW_RESET reloads the firmware: FW_REV reads 0 for fw_boot_ns and
+ * every port goes down. A queue being enabled reads SX_Q_CTRL_BUSY for
+ * queue_init_ns, and a port's link comes up port_up_ns after the port.
+ */
+class asic : public bar {
+public:
+    using irq_fn = std::function<void(unsigned vector)>;
+    using egress_fn = std::function<void(uint16_t port, const uint8_t *data, uint32_t len)>;
+    /* Serves one register access on @data in place; returns the EMAD status. */
+    using reg_fn = std::function<uint8_t(uint8_t method, uint8_t *data, uint32_t len)>;
+
+    explicit asic(const asic_config &cfg = asic_config());
+    ~asic() override;
+
+    asic(const asic &) = delete;
+    asic &operator=(const asic &) = delete;
+
+    uint32_t read32(uint32_t off) override;
+    void write32(uint32_t off, uint32_t val) override;
+
+    /*
+     * Install @fn, or remove the handler with nullptr. Returns once no call
+     * to the previous handler is in progress; not callable from a handler.
+     */
+    void set_irq_handler(irq_fn fn);
+    void set_egress_handler(egress_fn fn);
+
+    void register_reg(uint16_t reg_id, reg_fn fn);
+
+    /* Back @reg_id by a plain store keyed by the first @key_len payload bytes. */
+    void add_reg_file(uint16_t reg_id, unsigned key_len);
+
+    /*
+     * Trap a packet received on @port to the CPU. Returns 0 once the packet
+     * and its CQE are written, -ENOENT if the trap is discarded and -ENOSPC
+     * if its RDQ has no posted descriptor or its CQ is full.
+     */
+    int inject(uint16_t trap_id, uint16_t port, const void *data, uint32_t len);
+
+    /*
+     * MAC learning, as traffic would trigger it: learn @mac in @fid on
+     * @port (a move if known on another port), or age it out. Every change
+     * is trapped as an sx_fdb_rec with SX_TRAP_ID_FDB_EVENT. Returns
+     * -ENOSPC, changing nothing, if the record cannot be trapped yet, and
+     * -ENOENT from fdb_age() for an unknown entry.
+     */
+    int fdb_learn(uint16_t fid, const uint8_t *mac, uint16_t port);
+    int fdb_age(uint16_t fid, const uint8_t *mac);
+
+    /* Snapshot of the MAC table: sx_fdb_key() to port. */
+    std::unordered_map<uint64_t, uint16_t> fdb_dump();
+
+    /*
+     * PTP event message received on @port: its ingress timestamp, also
+     * returned in @ts, joins the timestamp FIFO and the packet is trapped
+     * with SX_TRAP_ID_PTP_EVENT. Event messages sent out of a port queue
+     * their egress timestamp the same way. Returns inject()'s error, or
+     * -EINVAL for no event message.
+     */
+    int ptp_rx(uint16_t port, const void *data, uint32_t len, uint64_t *ts);
+
+    /*
+     * Read up to @max timestamps out of the FIFO to the host, trapped with
+     * SX_TRAP_ID_PTP_TS. A nonzero @seed shuffles them first, as draining
+     * the FIFOs of several ports in turn would. Returns the number trapped;
+     * those left untrapped stay at the head of the FIFO.
+     */
+    int ptp_ts_drain(unsigned max, uint64_t seed);
+
+    /*
+     * LPM table, as written through RALUE: the number of routes, and the
+     * adjacency index of one route or -ENOENT.
+     */
+    size_t lpm_routes();
+    int lpm_route(uint8_t protocol, uint16_t vr, const uint8_t *dip, uint8_t prefix_len,
+                  uint32_t *adj_index);
+
+    /*
+     * ACL lookup of @key (SX_TCAM_KEY_MAX bytes) in the TCAM regions bound
+     * to @acl_id: the action of the winning entry, or -ENOENT. Also the
+     * TCAM slots held by allocated regions.
+     */
+    int acl_lookup(uint16_t acl_id, const uint8_t *key, uint32_t *action);
+    size_t tcam_used();
+
+    /* Traffic hitting flow counter @index; ignored beyond flow_counters. */
+    void flow_count(uint32_t index, uint64_t packets, uint64_t bytes);
+
+    /*
+     * Traffic of priority @prio received on @port and sent back out of it,
+     * @drops of the packets discarded at egress; and the buffer occupancy
+     * of the port's priority group and traffic class @prio. Ignored for a
+     * port or priority out of range.
+     */
+    void port_traffic(uint16_t port, unsigned prio, uint64_t packets, uint64_t bytes,
+                      uint64_t drops);
+    void port_occupancy(uint16_t port, unsigned prio, uint32_t pg_cells, uint32_t tc_cells);
+
+    /*
+     * A packet forwarded from @port out of @egress_port, for packet
+     * sampling: if MPSC on @port picks it, it is trapped with
+     * SX_TRAP_ID_PKT_SAMPLE. Returns 1 for a trapped sample, 0 if not
+     * picked, or the error of inject().
+     */
+    int port_forward(uint16_t port, uint16_t egress_port, const void *data, uint32_t len);
+
+    const asic_stats &stats() const { return stats_; }
+    const asic_config &config() const { return cfg_; }
+
+    /* ASIC free-running clock, ns. */
+    static uint64_t now_ns();
+
+private:
+    struct hw_cq {
+        spinlock              lock;
+        sx_cqe               *ring = nullptr;
+        unsigned              log_size = 0;
+        unsigned              vector = 0;
+        uint32_t              pi = 0;
+        std::atomic<uint32_t> ci{0};
+        std::atomic<bool>     armed{false};
+        unsigned              mod_usecs = 0;        /* of the armed period */
+        unsigned              mod_count = 0;
+        uint32_t              mod_next = 0;         /* SX_Q_MOD, latched on arm */
+        unsigned              mod_events = 0;       /* since armed */
+        std::atomic<uint64_t> mod_deadline{0};
+        std::atomic<uint64_t> ready_ns{0};          /* set up from then on */
+    };
+
+    struct hw_dq {
+        spinlock              lock;
+        sx_wqe               *ring = nullptr;
+        unsigned              log_size = 0;
+        unsigned              cqn = 0;
+        std::atomic<uint32_t> pi{0};
+        uint32_t              ci = 0;
+        std::atomic<uint64_t> ready_ns{0};
+        std::atomic<bool>     stalled{false};   /* SDQ: CQ full, retried on its CI */
+    };
+
+    void mmio_delay() const;
+    std::atomic<uint64_t> *queue_ready(uint32_t off);
+    void fw_reset();
+    void config_write(uint32_t off, uint32_t val);
+    void doorbell_write(uint32_t off, uint32_t val);
+    void enable_cq(unsigned cqn, bool en);
+    void enable_dq(hw_dq &q, uint32_t regs, bool en);
+    int complete(unsigned cqn, sx_cqe &cqe);
+    int trap(uint16_t trap_id, uint16_t port, uint16_t egress_port, const void *data,
+             uint32_t len);
+    void sdq_process(unsigned sdq);
+    void cq_arm(unsigned cqn, uint32_t ci);
+    bool cq_full(unsigned cqn);
+    void raise_irq(unsigned vector);
+    void irq_thread();
+    uint64_t mod_next_deadline() const;
+    void mod_expire(uint64_t now);
+    void set_cq_moderation(unsigned cqn, uint32_t val);
+    void emad_process(const uint8_t *frame, uint32_t len);
+    uint8_t mgir(uint8_t method, uint8_t *data, uint32_t len);
+    uint8_t sfd(uint8_t method, uint8_t *data, uint32_t len);
+    uint8_t ralue(uint8_t method, uint8_t *data, uint32_t len);
+    uint8_t ptar(uint8_t method, uint8_t *data, uint32_t len);
+    uint8_t ptce(uint8_t method, uint8_t *data, uint32_t len);
+    uint8_t pacl(uint8_t method, uint8_t *data, uint32_t len);
+    uint8_t mgpc(uint8_t method, uint8_t *data, uint32_t len);
+    uint8_t mocs(uint8_t method, uint8_t *data, uint32_t len);
+    uint8_t ppcnt(uint8_t method, uint8_t *data, uint32_t len);
+    uint8_t paos(uint8_t method, uint8_t *data, uint32_t len);
+    uint8_t mpsc(uint8_t method, uint8_t *data, uint32_t len);
+    int fdb_event(uint8_t type, uint64_t key, uint16_t port);
+    void ptp_stamp(uint16_t port, uint8_t dir, const uint8_t *data, uint32_t len, uint64_t ts);
+    void fw_thread();
+
+    uint32_t reg(uint32_t off) const { return regs_[off / 4]; }
+
+    asic_config           cfg_;
+    std::vector<uint32_t> regs_;
+    hw_cq                 cqs_[SX_MAX_CQ];
+    hw_dq                 sdqs_[SX_MAX_SDQ];
+    hw_dq                 rdqs_[SX_MAX_RDQ];
+    asic_stats            stats_;
+    egress_fn             egress_;
+    std::atomic<uint64_t> fw_ready_ns_{0};      /* FW_REV reads 0 until then */
+
+    irq_fn                  irq_;
+    std::thread             irq_thread_;
+    std::mutex              irq_lock_;
+    std::condition_variable irq_wq_;
+    std::vector<bool>       irq_pending_;
+    std::condition_variable irq_idle_;
+    bool                    irq_busy_ = false;
+    bool                    irq_any_ = false;
+    bool                    mod_kick_ = false;  /* new moderation deadline */
+    bool                    irq_stop_ = false;
+
+    struct fw_resp {
+        uint64_t             due;
+        std::vector<uint8_t> frame;
+    };
+
+    std::mutex                          fw_lock_;
+    std::unordered_map<uint16_t, reg_fn> reg_fns_;
+    std::thread                         fw_thread_;
+    std::mutex                          fw_queue_lock_;
+    std::condition_variable             fw_wq_;
+    std::deque<fw_resp>                 fw_queue_;     /* due times are monotonic */
+    bool                                fw_stop_ = false;
+
+    std::mutex                   fdb_lock_;
+    std::map<uint64_t, uint16_t> fdb_;          /* ordered for SFD dumps */
+
+    std::mutex                   ptp_lock_;
+    std::deque<sx_ptp_ts_rec>    ptp_fifo_;
+
+    /* Protocol, VR and prefix length in @meta; IPv4 in the top of @hi */
+    struct lpm_key {
+        uint64_t hi, lo;
+        uint32_t meta;
+
+        bool operator==(const lpm_key &o) const { return hi == o.hi && lo == o.lo && meta == o.meta; }
+    };
+
+    struct lpm_hash {
+        size_t operator()(const lpm_key &k) const
+        {
+            return (k.hi * 0x9e3779b97f4a7c15ull) ^ (k.lo * 0xc2b2ae3d27d4eb4full) ^ k.meta;
+        }
+    };
+
+    static lpm_key make_lpm_key(uint8_t protocol, uint16_t vr, const uint8_t *dip,
+                                uint8_t prefix_len);
+
+    std::mutex                                      lpm_lock_;
+    std::unordered_map<lpm_key, uint32_t, lpm_hash> lpm_;
+
+    struct tcam_entry {
+        bool     valid;
+        uint32_t priority;
+        uint32_t action;
+        uint8_t  key[SX_TCAM_KEY_MAX];      /* masked */
+        uint8_t  mask[SX_TCAM_KEY_MAX];
+    };
+
+    struct tcam_region {
+        uint8_t                 key_width;
+        std::vector<tcam_entry> entries;
+    };
+
+    std::mutex                                           tcam_lock_;
+    std::unordered_map<uint16_t, tcam_region>            tcam_regions_;
+    std::unordered_map<uint16_t, std::vector<uint16_t>>  acls_;     /* PACL bindings */
+    size_t                                               tcam_used_ = 0;
+    uint16_t                                             next_region_ = 0;
+
+    /* Flow counters: packets at 2 * index, bytes at 2 * index + 1 */
+    std::vector<std::atomic<uint64_t>> flow_cnt_;
+
+    struct port_cnt {
+        spinlock    lock;
+        sx_port_cnt cnt = {};
+    };
+
+    port_cnt port_cnt_[SX_MAX_PORTS];
+
+    struct port_sampler {
+        spinlock lock;
+        uint32_t rate = 0;          /* 0: off */
+        uint32_t skip = 0;          /* packets before the next sample */
+        uint64_t rng = 0;
+    };
+
+    port_sampler sampler_[SX_MAX_PORTS];
+
+    struct port_state {
+        spinlock lock;
+        bool     admin_up = false;
+        uint64_t up_ns = 0;         /* link up from then on, while admin up */
+    };
+
+    port_state port_state_[SX_MAX_PORTS];
+};
+
+} /* namespace emu */
+} /* namespace sx */
+
+#endif /* SX_EMU_ASIC_H */
@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_FDB_DEFS_H
+#define SX_FDB_DEFS_H
+
+#include <cstdint>
+
+namespace sx {
+
+/*
+ * FDB learning notification. The ASIC traps one record per change of its
+ * MAC table with SX_TRAP_ID_FDB_EVENT; fields are in host byte order.
+ */
+#define SX_FDB_EV_NONE      0
+#define SX_FDB_EV_LEARN     1   /* new entry */
+#define SX_FDB_EV_MOVE      2   /* known entry, new port */
+#define SX_FDB_EV_AGE       3   /* entry removed */
+
+struct sx_fdb_rec {
+    uint8_t  type;
+    uint8_t  rsvd;
+    uint16_t fid;
+    uint8_t  mac[6];
+    uint16_t port;
+} __attribute__((packed));
+
+static_assert(sizeof(sx_fdb_rec) == 12, "sx_fdb_rec must be 12 bytes");
+
+/* {FID, MAC} as one 64-bit key: FID in bits 63:48, MAC in 47:0 */
+static inline uint64_t sx_fdb_key(uint16_t fid, const uint8_t *mac)
+{
+    uint64_t key = fid;
+
+    for (unsigned i = 0; i < 6; i++)
+        key = key << 8 | mac[i];
+    return key;
+}
+
+static inline void sx_fdb_key_mac(uint64_t key, uint8_t *mac)
+{
+    for (unsigned i = 0; i < 6; i++)
+        mac[i] = static_cast<uint8_t>(key >> (40 - 8 * i));
+}
+
+} /* namespace sx */
+
+#endif /* SX_FDB_DEFS_H */
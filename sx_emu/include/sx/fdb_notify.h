@@ -0,0 +1,95 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_FDB_NOTIFY_H
+#define SX_FDB_NOTIFY_H
+
+#include <condition_variable>
+#include <mutex>
+#include <sys/types.h>
+#include <unordered_map>
+#include <vector>
+
+#include "sx/dev.h"
+#include "sx/fdb_defs.h"
+#include "sx/fdb_shadow.h"
+
+namespace sx {
+
+/* Default events per wakeup and hold time of a batch */
+#define SX_FDB_NOTIFY_BATCH     1024
+#define SX_FDB_NOTIFY_WINDOW_US 1000
+
+struct fdb_notify_stats {
+    uint64_t received;      /* records trapped by the ASIC */
+    uint64_t coalesced;     /* merged into a pending event of the same entry */
+    uint64_t cancelled;     /* pending learns undone by an age */
+    uint64_t delivered;     /* events handed to the reader */
+    uint64_t wakeups;       /* reads that returned events */
+    uint64_t overflow;      /* records dropped on a full buffer */
+};
+
+/*
+ * Batched FDB learning notifications for user space. Records trapped with
+ * SX_TRAP_ID_FDB_EVENT are collected per {FID, MAC}: a pending event takes
+ * in later changes of its entry (a learn then moves stays a learn on the
+ * last port, an age then a learn becomes a move) and a learn followed by
+ * an age before delivery cancels out. read() wakes once @batch events are
+ * pending or the first has waited @window_us, and returns them in the
+ * order their entries first changed.
+ *
+ * A record dropped on overflow loses a change: the reader must then resync
+ * from a full FDB dump. An attached fdb_shadow sees every record before
+ * coalescing, overflow or not.
+ */
+class fdb_notify {
+public:
+    explicit fdb_notify(dev &d, unsigned batch = SX_FDB_NOTIFY_BATCH,
+                        unsigned window_us = SX_FDB_NOTIFY_WINDOW_US,
+                        size_t max_pending = 1u << 20);
+    ~fdb_notify();
+
+    fdb_notify(const fdb_notify &) = delete;
+    fdb_notify &operator=(const fdb_notify &) = delete;
+
+    /* Keep @shadow current from the records; call before start(). */
+    void set_shadow(fdb_shadow *shadow) { shadow_ = shadow; }
+
+    /* Start taking SX_TRAP_ID_FDB_EVENT. */
+    int start();
+
+    /*
+     * Copy up to @max pending events into @ev. Returns their number, or
+     * -EAGAIN if @nonblock and nothing is pending; @nonblock returns a
+     * batch early.
+     */
+    ssize_t read(sx_fdb_rec *ev, size_t max, bool nonblock = false);
+
+    void get_stats(fdb_notify_stats *out);
+
+private:
+    void enqueue(const rx_info &info, pkt_buf *buf);
+    void merge(size_t i, const sx_fdb_rec &rec, uint64_t key);
+
+    dev                                   &dev_;
+    unsigned                               batch_;
+    uint64_t                               window_ns_;
+    size_t                                 max_pending_;
+    bool                                   started_ = false;
+    fdb_shadow                            *shadow_ = nullptr;
+
+    std::mutex                             lock_;
+    std::condition_variable                wq_;
+    /* Pending events in arrival order; cancelled ones are SX_FDB_EV_NONE */
+    std::vector<sx_fdb_rec>                pending_;
+    std::vector<uint64_t>                  pending_ns_;   /* arrival of each */
+    size_t                                 head_ = 0;
+    uint64_t                               base_ = 0;     /* sequence of pending_[0] */
+    size_t                                 live_ = 0;
+    uint64_t                               first_ns_ = 0; /* opened the reader's window */
+    std::unordered_map<uint64_t, uint64_t> index_;        /* key to sequence */
+    fdb_notify_stats                       stats_ = {};
+};
+
+} /* namespace sx */
+
+#endif /* SX_FDB_NOTIFY_H */
@@ -0,0 +1,96 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_FDB_SHADOW_H
+#define SX_FDB_SHADOW_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "sx/emad.h"
+#include "sx/fdb_defs.h"
+#include "sx/pcpu.h"
+#include "sx/spinlock.h"
+
+namespace sx {
+
+/* Differences between the shadow and the ASIC found by check() */
+struct fdb_check_report {
+    uint64_t asic_entries;
+    uint64_t shadow_entries;
+    uint64_t missing;       /* in the ASIC only */
+    uint64_t stale;         /* in the shadow only */
+    uint64_t mismatched;    /* on another port in the ASIC */
+    uint64_t accesses;      /* SFD dump queries issued */
+};
+
+/*
+ * Host copy of the ASIC's MAC table, so "get MAC entry" and full dumps
+ * need no EMAD round trips. It is kept current by the learning records
+ * (apply(), fed by fdb_notify or any SX_TRAP_ID_FDB_EVENT listener) and by
+ * static entries written through add()/del().
+ *
+ * The table is open-addressing with linear probing over 16-byte slots,
+ * sized to stay at most half full. Writers serialize on a spinlock;
+ * lookup() takes no lock and retries if a writer moved entries under it.
+ */
+class fdb_shadow {
+public:
+    explicit fdb_shadow(size_t max_entries = 1u << 20);
+    ~fdb_shadow();
+
+    fdb_shadow(const fdb_shadow &) = delete;
+    fdb_shadow &operator=(const fdb_shadow &) = delete;
+
+    /* One learning record. Learns beyond max_entries are counted, not kept. */
+    void apply(const sx_fdb_rec &rec);
+
+    /*
+     * Write a static entry to the ASIC over @e (an SFD write), then to the
+     * shadow. Returns 0, -ENOSPC if the shadow is full or the EMAD error.
+     */
+    int add(emad &e, uint16_t fid, const uint8_t *mac, uint16_t port);
+    int del(emad &e, uint16_t fid, const uint8_t *mac);
+
+    /* Port of {@fid, @mac}, or -ENOENT. */
+    int lookup(uint16_t fid, const uint8_t *mac) const;
+
+    /* Every entry, in no particular order; @type is SX_FDB_EV_NONE. */
+    void dump(std::vector<sx_fdb_rec> *out) const;
+
+    size_t size() const { return read_once(&size_); }
+    size_t max_entries() const { return max_entries_; }
+    uint64_t overflow() const { return read_once(&overflow_); }
+
+    /*
+     * Compare with the ASIC's table, read by SFD dumps over @e. Returns 0
+     * if they match, -EUCLEAN if they differ (see @out) or the EMAD error.
+     * Learning that goes on meanwhile shows up as differences.
+     */
+    int check(emad &e, fdb_check_report *out);
+
+private:
+    struct slot {
+        uint64_t key;
+        uint32_t port;
+        uint32_t rsvd;
+    };
+
+    size_t home(uint64_t key) const { return (key * 0x9e3779b97f4a7c15ull) >> shift_; }
+    int insert(uint64_t key, uint16_t port);
+    void erase(uint64_t key);
+    int sfd_write(emad &e, uint8_t op, uint64_t key, uint16_t port);
+
+    slot            *slots_;
+    size_t           mask_;
+    unsigned         shift_;
+    size_t           max_entries_;
+    size_t           size_ = 0;
+    uint64_t         overflow_ = 0;
+    mutable spinlock lock_;
+    seqcount         seq_;
+};
+
+} /* namespace sx */
+
+#endif /* SX_FDB_SHADOW_H */
@@ -0,0 +1,86 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_INIT_GRAPH_H
+#define SX_INIT_GRAPH_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace sx {
+
+/*
+ * Initialization as a dependency graph: each stage runs once the stages it
+ * depends on are done, on a pool of threads, so independent stages (other
+ * devices, queues of one device, ports) overlap their waits for the
+ * hardware. Every stage is timed.
+ */
+class init_graph {
+public:
+    using stage_fn = std::function<int()>;
+
+    /* Times from the start of run(); err -ECANCELED: skipped, a dependency failed */
+    struct stage_time {
+        uint64_t start_ns;
+        uint64_t end_ns;
+        int      err;
+    };
+
+    init_graph() = default;
+
+    init_graph(const init_graph &) = delete;
+    init_graph &operator=(const init_graph &) = delete;
+
+    /*
+     * Add stage @name running @fn after every stage in @deps, which must
+     * have been added before. Returns its ID, in the order of adding.
+     */
+    unsigned add(std::string name, stage_fn fn, const std::vector<unsigned> &deps = {});
+
+    /*
+     * Run every stage on up to @threads threads, the caller's included;
+     * of the stages ready, the one added first goes first, so a single
+     * thread runs them in the order added. Returns 0 or the first error;
+     * stages depending on a failed one are skipped. -EINVAL for a stage
+     * depending on one added after it.
+     */
+    int run(unsigned threads);
+
+    size_t size() const { return stages_.size(); }
+    const std::string &name(unsigned id) const { return stages_[id].name; }
+    const stage_time &time(unsigned id) const { return stages_[id].t; }
+    uint64_t elapsed_ns() const { return elapsed_ns_; }
+
+    /* One line per stage: start, duration, error, as a debugfs file would read. */
+    std::string report() const;
+
+private:
+    struct stage {
+        std::string           name;
+        stage_fn              fn;
+        std::vector<unsigned> next;         /* stages depending on this one */
+        unsigned              ndeps = 0;
+        unsigned              pending = 0;  /* dependencies not done, in run() */
+        bool                  cancel = false;
+        stage_time            t = {};
+    };
+
+    void worker();
+
+    std::vector<stage>      stages_;
+    bool                    bad_deps_ = false;
+    std::mutex              lock_;
+    std::condition_variable wq_;
+    std::vector<unsigned>   ready_;         /* min-heap of stage IDs */
+    size_t                  done_ = 0;
+    int                     err_ = 0;
+    uint64_t                start_ns_ = 0;
+    uint64_t                elapsed_ns_ = 0;
+};
+
+} /* namespace sx */
+
+#endif /* SX_INIT_GRAPH_H */
@@ -0,0 +1,127 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_KVD_H
+#define SX_KVD_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace sx {
+
+/* Size classes: blocks of 2^0 .. 2^SX_KVD_MAX_ORDER entries */
+#define SX_KVD_MAX_ORDER    9
+#define SX_KVD_ORDERS       (SX_KVD_MAX_ORDER + 1)
+#define SX_KVD_CHUNK        (1u << SX_KVD_MAX_ORDER)
+
+struct kvd_stats {
+    uint64_t capacity;                  /* entries */
+    uint64_t used;                      /* entries asked for */
+    uint64_t allocated;                 /* entries held, rounded up to the class */
+    uint64_t free_blocks[SX_KVD_ORDERS];
+    uint64_t largest_free;              /* entries in the largest free block */
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t failed;                    /* allocations that found no block */
+    uint64_t failed_fragmented;         /* ... with enough free entries in total */
+    uint64_t moves;                     /* blocks relocated by defrag() */
+    uint64_t move_failed;               /* relocations the owner refused */
+};
+
+/*
+ * Share of the free entries that sit in blocks too small for an order
+ * @order request, in percent: 0 with one large free block, close to 100
+ * when only scattered small blocks are left.
+ */
+static inline double kvd_unusable_pct(const kvd_stats &s, unsigned order)
+{
+    uint64_t free = 0, small = 0;
+
+    for (unsigned o = 0; o < SX_KVD_ORDERS; o++) {
+        free += s.free_blocks[o] << o;
+        if (o < order)
+            small += s.free_blocks[o] << o;
+    }
+    return free ? 100.0 * small / free : 0;
+}
+
+/*
+ * Allocator of one KVD partition (a range of linear or hash memory
+ * indexes), a buddy allocator: requests round up to a power-of-two size
+ * class, each class has its own free list, and freed buddies merge. Blocks
+ * come from the lowest free address of the smallest class that fits, so
+ * the top of the partition drains first.
+ *
+ * Churn still scatters small blocks across chunks (blocks of the largest
+ * class) until large requests fail with free entries to spare. defrag()
+ * then empties the least used chunk by relocating its blocks elsewhere,
+ * make-before-break: the owner's move callback writes the entries at the
+ * new index and repoints their users before the old block is freed, so
+ * lookups hit a valid copy throughout. It runs a bounded number of moves
+ * per call, for the owner's periodic work, which holds whatever locks the
+ * callback needs.
+ */
+class kvd_alloc {
+public:
+    /*
+     * Relocate block @handle of @size entries from @from to @to. Called
+     * with the allocator locked: it must not call back into it. A non-zero
+     * return leaves the block where it is.
+     */
+    using move_fn = std::function<int(uint64_t handle, uint32_t from, uint32_t to, uint32_t size)>;
+
+    /* @size entries from @base on; @size is a multiple of SX_KVD_CHUNK. */
+    kvd_alloc(uint32_t base, uint32_t size, move_fn move = nullptr);
+
+    kvd_alloc(const kvd_alloc &) = delete;
+    kvd_alloc &operator=(const kvd_alloc &) = delete;
+
+    /*
+     * @size entries for @handle. Returns 0 with the first index in @index,
+     * -EINVAL for a size above SX_KVD_CHUNK or -ENOSPC.
+     */
+    int alloc(uint32_t size, uint64_t handle, uint32_t *index);
+
+    /*
+     * The block of @size entries at @index for @handle, taken over as a
+     * warm boot finds it in use. Returns 0, -EINVAL for a size above
+     * SX_KVD_CHUNK or an index off its class's alignment, or -EBUSY if any
+     * of it is not free.
+     */
+    int reserve(uint32_t index, uint32_t size, uint64_t handle);
+    void free(uint32_t index);
+
+    /* Relocate up to @max_moves blocks. Returns the number moved. */
+    unsigned defrag(unsigned max_moves);
+
+    void get_stats(kvd_stats *out);
+
+private:
+    struct block {
+        uint32_t size;
+        uint8_t  order;
+        uint64_t handle;
+    };
+
+    void put_free(uint32_t off, unsigned order);
+    void add_free_range(uint32_t off, unsigned order);
+    int take(unsigned order, uint32_t *off, unsigned max_order = SX_KVD_MAX_ORDER);
+    bool fits_elsewhere(uint32_t chunk) const;
+    bool defrag_chunk(uint32_t chunk, unsigned *budget);
+
+    uint32_t                      base_;
+    uint32_t                      size_;
+    move_fn                       move_;
+    std::mutex                    lock_;
+    std::set<uint32_t>            free_[SX_KVD_ORDERS];     /* offsets */
+    std::map<uint32_t, block>     blocks_;                  /* allocated, by offset */
+    std::vector<uint32_t>         chunk_used_;              /* allocated entries */
+    kvd_stats                     stats_ = {};
+};
+
+} /* namespace sx */
+
+#endif /* SX_KVD_H */
@@ -0,0 +1,65 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_LAT_TRACE_H
+#define SX_LAT_TRACE_H
+
+#include <cstdint>
+
+namespace sx {
+
+/* Legs of a trapped packet's way from the ASIC to its consumer */
+enum lat_stage {
+    SX_LAT_HW,          /* ASIC timestamp to interrupt (poll start if polled) */
+    SX_LAT_SCHED,       /* interrupt to NAPI poll start */
+    SX_LAT_DRIVER,      /* poll start to hand-off to the listener */
+    SX_LAT_USER,        /* hand-off to user-space dequeue (cdev read) */
+    SX_LAT_STAGES
+};
+
+/* Traps that can be traced at once */
+#define SX_LAT_MAX_TRAPS    64
+
+/*
+ * Log2 latency histogram: bucket 0 counts 0 ns, bucket b > 0 counts
+ * [2^(b-1), 2^b) ns, the last bucket everything above.
+ */
+#define SX_LAT_BUCKETS      26
+
+struct lat_hist {
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t bucket[SX_LAT_BUCKETS];
+};
+
+static inline unsigned lat_bucket(uint64_t ns)
+{
+    unsigned b = ns ? 64 - __builtin_clzll(ns) : 0;
+
+    return b < SX_LAT_BUCKETS ? b : SX_LAT_BUCKETS - 1;
+}
+
+/* Upper bound of bucket @b, in ns */
+static inline uint64_t lat_bucket_max(unsigned b)
+{
+    return b ? (1ull << b) - 1 : 0;
+}
+
+/* Upper bound of the bucket holding the @pct percentile, in ns */
+static inline uint64_t lat_hist_pct(const lat_hist &h, double pct)
+{
+    uint64_t want = static_cast<uint64_t>(h.count * pct / 100), seen = 0;
+
+    if (want >= h.count)
+        want = h.count ? h.count - 1 : 0;
+
+    for (unsigned b = 0; b < SX_LAT_BUCKETS; b++) {
+        seen += h.bucket[b];
+        if (seen > want)
+            return lat_bucket_max(b);
+    }
+    return lat_bucket_max(SX_LAT_BUCKETS - 1);
+}
+
+} /* namespace sx */
+
+#endif /* SX_LAT_TRACE_H */
@@ -0,0 +1,182 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_NETDEV_H
+#define SX_NETDEV_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "sx/dev.h"
+#include "sx/page_pool.h"
+#include "sx/pcpu.h"
+
+namespace sx {
+
+/* GRO: segments merged into one skb at most, and its IP length bound */
+#define SX_GRO_MAX_SEGS     44
+#define SX_GRO_MAX_SIZE     65535
+
+/* TCP flows a receive queue holds packets of at once; the oldest goes up first */
+#define SX_GRO_MAX_HELD     8
+
+/* Payload of a merged segment: where it lies in the buffer it came in */
+struct netdev_frag {
+    pkt_buf *buf;
+    uint32_t off;
+    uint32_t len;
+};
+
+/*
+ * Packet handed to a netdev: the buffer it was received in, and with GRO
+ * the buffers of the segments merged after it, whose headers are skipped.
+ * The head's IPv4 and TCP headers describe the merged packet.
+ */
+struct netdev_skb {
+    pkt_buf     *head;
+    uint32_t     head_len;          /* bytes of the packet in head->data */
+    uint32_t     len;               /* head_len and every frag */
+    unsigned     nr_frags;
+    netdev_frag  frags[SX_GRO_MAX_SEGS - 1];
+    uint16_t     gso_size;          /* GRO: payload per segment, else 0 */
+    uint16_t     gso_segs;          /* packets on the wire, 1 without GRO */
+    uint16_t     port;
+    uint8_t      queue;
+    uint32_t     flow_hash;
+    uint64_t     timestamp;
+};
+
+/* Frees the skb with every buffer in it. */
+void netdev_skb_free(netdev_skb *skb);
+
+/* Counters of one netdev; packets are as received, before XDP and merging */
+struct netdev_stats {
+    uint64_t rx_packets;
+    uint64_t rx_bytes;
+    uint64_t rx_skbs;           /* handed to the stack */
+    uint64_t gro_merged;        /* packets merged into an earlier one */
+    uint64_t xdp_drop;          /* XDP_DROP and XDP_ABORTED */
+    uint64_t xdp_tx;            /* sent by XDP_TX or XDP_REDIRECT */
+    uint64_t xdp_tx_errors;     /* XDP sends that failed, dropped */
+};
+
+/* XDP verdicts, as enum xdp_action */
+#define SX_XDP_ABORTED      0
+#define SX_XDP_DROP         1
+#define SX_XDP_PASS         2
+#define SX_XDP_TX           3   /* back out of the ingress port */
+#define SX_XDP_REDIRECT     4   /* out of xdp_buff::redirect_port */
+
+/*
+ * Frame an XDP program sees, in the RDQ buffer it was received in. The
+ * program may rewrite the bytes between data and data_end in place.
+ */
+struct xdp_buff {
+    uint8_t  *data;
+    uint8_t  *data_end;
+    uint16_t  port;             /* ingress */
+    uint16_t  trap_id;
+    uint8_t   queue;
+    uint16_t  redirect_port;    /* set by xdp_redirect() */
+};
+
+/* bpf_redirect(): send the frame out of @port. */
+static inline int xdp_redirect(xdp_buff *xdp, uint16_t port)
+{
+    xdp->redirect_port = port;
+    return SX_XDP_REDIRECT;
+}
+
+/* Returns an SX_XDP_* verdict; anything else counts as SX_XDP_ABORTED. */
+using xdp_prog = std::function<int(xdp_buff *xdp)>;
+
+/* The handler takes ownership of @skb and releases it with netdev_skb_free(). */
+using netdev_rx_fn = std::function<void(netdev_skb *skb)>;
+
+/*
+ * Netdevs of the front-panel ports for traffic the host terminates (BGP
+ * with a full table, telemetry over TCP). Receive queues are RDQs the
+ * netdevs take over; a trap group spread over them by flow hash keeps
+ * each flow on one queue, and each queue has its own NAPI context.
+ *
+ * A queue hands a packet to the netdev of its ingress port by moving the
+ * buffer into an skb; nothing is copied. With GRO on, the TCP segments of
+ * a flow arriving in order within one poll are merged into one skb, the
+ * buffers chained as frags, as napi_gro_receive() does; held packets go
+ * up at the end of the poll, or earlier once their flow stops merging.
+ * An XDP program attached to the netdev sees each packet first and can
+ * drop or send it back out before it costs an skb.
+ */
+class port_netdevs {
+public:
+    explicit port_netdevs(dev &d);
+    ~port_netdevs();
+
+    port_netdevs(const port_netdevs &) = delete;
+    port_netdevs &operator=(const port_netdevs &) = delete;
+
+    /*
+     * Netdev @name of @port; skbs go to @fn in the NAPI context of their
+     * queue. Netdevs stay until the port_netdevs goes.
+     */
+    int register_netdev(uint16_t port, const std::string &name, netdev_rx_fn fn);
+
+    /*
+     * Receive on @rdq from buffers of a page pool of @pool_bufs of
+     * @buf_size. Binds the RDQ with dev::bind_rdq(), so it must precede
+     * dev::create_rdq(), and the RDQ must be destroyed before this goes.
+     * Packets of ports without a netdev are dropped.
+     *
+     * XDP_TX and XDP_REDIRECT frames of the queue leave on @xdp_sdq
+     * without a copy, one doorbell per poll. The caller creates it on the
+     * RDQ's CQ, so the poll that receives also reaps the sends, as a
+     * driver's XDP send queue is. -1: those verdicts drop the frame.
+     */
+    int add_rx_queue(unsigned rdq, uint32_t buf_size, unsigned pool_bufs, int xdp_sdq = -1);
+
+    /* GRO on or off, as ethtool -K gro; takes effect from the next poll. */
+    void set_gro(bool on) { gro_.store(on, std::memory_order_relaxed); }
+
+    /*
+     * Run @prog on every packet of @port's netdev before an skb is built
+     * for it (native XDP); an empty @prog detaches. Takes effect from the
+     * next packet; a program replaced is kept until the port_netdevs goes,
+     * as a poll may still be running it.
+     */
+    int set_xdp(uint16_t port, xdp_prog prog);
+
+    int get_stats(uint16_t port, netdev_stats *out) const;
+    const std::string *name(uint16_t port) const;
+    uint64_t rx_dropped() const;
+
+private:
+    struct netdev {
+        std::string                     name;
+        uint16_t                        port;
+        netdev_rx_fn                    fn;
+        std::atomic<const xdp_prog *>   xdp{nullptr};
+    };
+
+    struct counters {
+        netdev_stats port[SX_MAX_PORTS];
+        uint64_t     rx_dropped;        /* no netdev on the ingress port */
+    };
+
+    class rx_queue;
+
+    dev                                   &dev_;
+    std::atomic<netdev *>                  netdevs_[SX_MAX_PORTS] = {};
+    std::vector<std::unique_ptr<rx_queue>> rxqs_;
+    std::atomic<bool>                      gro_{false};
+    std::mutex                             xdp_lock_;
+    std::vector<std::unique_ptr<xdp_prog>> xdp_progs_;      /* every one attached */
+    pcpu_stats<counters>                   stats_;
+};
+
+} /* namespace sx */
+
+#endif /* SX_NETDEV_H */
@@ -0,0 +1,99 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_PAGE_POOL_H
+#define SX_PAGE_POOL_H
+
+#include <atomic>
+#include <cstdint>
+#include <pthread.h>
+#include <vector>
+
+#include "sx/compiler.h"
+#include "sx/dma.h"
+#include "sx/pkt_buf.h"
+#include "sx/spinlock.h"
+
+namespace sx {
+
+/* Buffers kept in the lockless cache of the polling context */
+#define SX_PAGE_POOL_CACHE  128
+#define SX_PAGE_POOL_REFILL 64
+
+struct page_pool_stats {
+    uint64_t alloc_fast;        /* from the cache */
+    uint64_t alloc_slow;        /* cache refilled from the recycle ring */
+    uint64_t alloc_fallback;    /* pool empty: pkt_buf_alloc() */
+    uint64_t recycle_cached;    /* released in the polling context */
+    uint64_t recycle_ring;      /* released from elsewhere */
+};
+
+/*
+ * Receive buffer recycler of one RDQ, after the kernel's page_pool. All
+ * buffers come from one DMA region mapped once at create(). The RDQ's
+ * polling context allocates from a lockless cache; buffers released
+ * inside that context (the listener is done with the packet before the
+ * poll ends) go straight back to it, others through a locked recycle
+ * ring. Only an empty pool falls back to the allocator.
+ *
+ * Buffers may outlive the RDQ: destroy() frees the pool once the last one
+ * is back.
+ */
+class page_pool : public pkt_buf_owner {
+public:
+    static page_pool *create(unsigned nbufs, uint32_t buf_size);
+    static void destroy(page_pool *pool);
+
+    page_pool(const page_pool &) = delete;
+    page_pool &operator=(const page_pool &) = delete;
+
+    /* Polling context only. */
+    pkt_buf *alloc()
+    {
+        if (sx_likely(cache_count_)) {
+            stats_.alloc_fast++;
+            held_++;
+            return cache_[--cache_count_];
+        }
+        return alloc_slow();
+    }
+
+    void release(pkt_buf *buf) override;
+
+    /* Bracket a poll of the RDQ; releases in between may use the cache. */
+    void napi_enter() { napi_owner_.store(pthread_self(), std::memory_order_relaxed); }
+    void napi_exit() { napi_owner_.store(0, std::memory_order_relaxed); }
+
+    uint32_t buf_size() const { return buf_size_; }
+    unsigned nbufs() const { return nbufs_; }
+    void get_stats(page_pool_stats *out) const;
+
+private:
+    page_pool() = default;
+    ~page_pool();
+
+    pkt_buf *alloc_slow();
+
+    dma_region             mem_ = {};
+    std::vector<pkt_buf>   bufs_;
+    uint32_t               buf_size_ = 0;
+    unsigned               nbufs_ = 0;
+
+    /* Polling context */
+    pkt_buf               *cache_[SX_PAGE_POOL_CACHE];
+    unsigned               cache_count_ = 0;
+    uint64_t               held_ = 0;           /* handed out less recycled to the cache */
+    page_pool_stats        stats_ = {};
+    std::atomic<pthread_t> napi_owner_{0};
+
+    /* Any context, under ring_lock_ */
+    SX_CACHELINE_ALIGNED spinlock ring_lock_;
+    std::vector<pkt_buf *> ring_;
+    unsigned               ring_head_ = 0;
+    unsigned               ring_count_ = 0;
+    uint64_t               recycle_ring_ = 0;
+    bool                   dying_ = false;
+};
+
+} /* namespace sx */
+
+#endif /* SX_PAGE_POOL_H */
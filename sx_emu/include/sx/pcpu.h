@@ -0,0 +1,184 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_PCPU_H
+#define SX_PCPU_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+
+#include "sx/compiler.h"
+#include "sx/spinlock.h"
+
+namespace sx {
+
+/*
+ * Per-CPU data for user space. Every thread that touches per-CPU data owns
+ * one slot ("CPU") for as long as it lives, so a slot has a single writer
+ * and needs no atomic read-modify-write. Slots are recycled when their
+ * thread exits. Threads beyond SX_NR_CPUS share the overflow slot
+ * SX_NR_CPUS, whose writers serialize on a lock.
+ */
+#define SX_NR_CPUS 128
+
+/* Slot of the calling thread, in [0, SX_NR_CPUS]. */
+unsigned this_cpu();
+
+/*
+ * Sequence count of one writer, read locklessly (u64_stats_sync). Readers
+ * retry until they see the same even count before and after reading.
+ */
+class seqcount {
+public:
+    void write_begin()
+    {
+        seq_.store(seq_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void write_end()
+    {
+        seq_.store(seq_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    uint32_t read_begin() const
+    {
+        uint32_t s;
+
+        while ((s = seq_.load(std::memory_order_acquire)) & 1)
+            cpu_relax();
+        return s;
+    }
+
+    bool read_retry(uint32_t s) const
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return seq_.load(std::memory_order_relaxed) != s;
+    }
+
+private:
+    std::atomic<uint32_t> seq_{0};
+};
+
+/* Counter update by the single writer of a slot. */
+static inline void stats_inc(uint64_t *c, uint64_t v = 1)
+{
+    write_once(c, *c + v);
+}
+
+/* @sum += @c, field by field; @C holds uint64_t counters only. */
+template <typename C>
+static inline void stats_add(C *sum, const C &c)
+{
+    static_assert(sizeof(C) % sizeof(uint64_t) == 0, "counters must be uint64_t");
+    uint64_t *dst = reinterpret_cast<uint64_t *>(sum);
+    const uint64_t *src = reinterpret_cast<const uint64_t *>(&c);
+
+    for (size_t i = 0; i < sizeof(C) / sizeof(uint64_t); i++)
+        dst[i] += read_once(&src[i]);
+}
+
+/*
+ * Per-CPU copies of the counter block @T. Writers update their own copy
+ * under its seqcount; readers sum the copies without stopping writers and
+ * see, per CPU, either all or none of an update. Copies are allocated on a
+ * CPU's first update.
+ */
+template <typename T>
+class pcpu_stats {
+    struct SX_CACHELINE_ALIGNED copy {
+        seqcount seq;
+        T        val = {};
+    };
+
+public:
+    /* Writer section on the calling CPU's copy. */
+    class update {
+    public:
+        explicit update(pcpu_stats &s) : cpu_(this_cpu()), copy_(s.get(cpu_))
+        {
+            if (sx_unlikely(cpu_ == SX_NR_CPUS))
+                s.overflow_lock_.lock();
+            lock_ = cpu_ == SX_NR_CPUS ? &s.overflow_lock_ : nullptr;
+            copy_->seq.write_begin();
+        }
+
+        ~update()
+        {
+            copy_->seq.write_end();
+            if (sx_unlikely(lock_ != nullptr))
+                lock_->unlock();
+        }
+
+        update(const update &) = delete;
+        update &operator=(const update &) = delete;
+
+        T *operator->() { return &copy_->val; }
+        T &operator*() { return copy_->val; }
+
+    private:
+        unsigned  cpu_;
+        copy     *copy_;
+        spinlock *lock_;
+    };
+
+    pcpu_stats() = default;
+    ~pcpu_stats()
+    {
+        for (auto &p : cpus_)
+            delete p.load(std::memory_order_relaxed);
+    }
+
+    pcpu_stats(const pcpu_stats &) = delete;
+    pcpu_stats &operator=(const pcpu_stats &) = delete;
+
+    /*
+     * Sum over every CPU of the counter block @pick selects from a copy,
+     * e.g. [&](const T &t) -> const port_counters & { return t.port[3]; }.
+     */
+    template <typename C, typename F>
+    void read(C *out, F pick) const
+    {
+        memset(out, 0, sizeof(*out));
+        for (const auto &p : cpus_) {
+            const copy *c = p.load(std::memory_order_acquire);
+            C v;
+            uint32_t s;
+
+            if (!c)
+                continue;
+            do {
+                memset(&v, 0, sizeof(v));
+                s = c->seq.read_begin();
+                stats_add(&v, pick(c->val));
+            } while (c->seq.read_retry(s));
+            stats_add(out, v);
+        }
+    }
+
+private:
+    copy *get(unsigned cpu)
+    {
+        copy *c = cpus_[cpu].load(std::memory_order_acquire);
+
+        if (sx_likely(c != nullptr))
+            return c;
+
+        std::lock_guard<std::mutex> guard(alloc_lock_);
+        c = cpus_[cpu].load(std::memory_order_relaxed);
+        if (!c) {
+            c = new copy;
+            cpus_[cpu].store(c, std::memory_order_release);
+        }
+        return c;
+    }
+
+    std::atomic<copy *> cpus_[SX_NR_CPUS + 1] = {};
+    std::mutex          alloc_lock_;
+    spinlock            overflow_lock_;
+};
+
+} /* namespace sx */
+
+#endif /* SX_PCPU_H */
@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_PKT_BUF_H
+#define SX_PKT_BUF_H
+
+#include <cstdint>
+
+namespace sx {
+
+struct pkt_buf;
+
+/* Backing store of buffers not obtained from pkt_buf_alloc(). */
+class pkt_buf_owner {
+public:
+    virtual ~pkt_buf_owner() = default;
+    virtual void release(pkt_buf *buf) = 0;
+};
+
+/*
+ * Packet buffer posted to a descriptor queue. Header and data come from one
+ * allocation; data is DMA-mapped for the lifetime of the buffer. Buffers
+ * with an owner go back to it on pkt_buf_free().
+ */
+struct pkt_buf {
+    uint8_t       *data;
+    uint32_t       len;
+    uint32_t       size;
+    uint64_t       dma;
+    pkt_buf_owner *owner;
+};
+
+pkt_buf *pkt_buf_alloc(uint32_t size);
+void pkt_buf_free(pkt_buf *buf);
+
+} /* namespace sx */
+
+#endif /* SX_PKT_BUF_H */
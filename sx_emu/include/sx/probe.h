@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_PROBE_H
+#define SX_PROBE_H
+
+#include <cstdint>
+#include <string>
+
+#include "sx/dev.h"
+#include "sx/emad.h"
+#include "sx/init_graph.h"
+
+namespace sx {
+
+/* Port bring-up: how often the link is checked, and for how long */
+#define SX_PORT_POLL_US         1000
+#define SX_PORT_UP_TIMEOUT_MS   5000
+
+/*
+ * What probe sets up on one device, one SDQ and one RDQ at least. SDQ n
+ * completes on CQ n, RDQ n on CQ num_sdq + n. EMAD goes out on SDQ 0 and
+ * comes back on RDQ 0, through trap group 0.
+ */
+struct probe_config {
+    unsigned num_sdq;
+    unsigned num_rdq;
+    unsigned log_cq_size;
+    unsigned log_dq_size;
+    uint32_t rdq_buf_size;
+    unsigned num_ports;         /* brought up, from port 0 on */
+    unsigned fw_timeout_ms;
+};
+
+/*
+ * Add the stages probing @d to @g, named "<name>/<stage>": firmware reset,
+ * capabilities, each CQ, SDQ and RDQ after what it needs, the EMAD trap,
+ * EMAD, each port, then "ready" after all of them. Devices can share a
+ * graph. @d and @e must outlive its run(). Returns the ID of "ready".
+ */
+unsigned probe_stages(init_graph &g, const std::string &name, dev &d, emad &e,
+                      const probe_config &cfg);
+
+/* Take @port up and sleep until its link is, at most @timeout_ms. */
+int port_up(emad &e, uint16_t port, unsigned timeout_ms = SX_PORT_UP_TIMEOUT_MS);
+
+} /* namespace sx */
+
+#endif /* SX_PROBE_H */
@@ -0,0 +1,129 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_PTP_H
+#define SX_PTP_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#include "sx/compiler.h"
+#include "sx/dev.h"
+#include "sx/ptp_defs.h"
+#include "sx/spinlock.h"
+
+namespace sx {
+
+/* Defaults: pending halves held (a power of two) and how long one waits */
+#define SX_PTP_TABLE_SIZE       4096
+#define SX_PTP_MAX_AGE_US       10000
+#define SX_PTP_BUCKET_WAYS      4
+
+struct ptp_stats {
+    uint64_t rx_matched;        /* packets delivered with their timestamp */
+    uint64_t tx_matched;
+    uint64_t rx_unmatched;      /* packets delivered without: aged or collided */
+    uint64_t tx_unmatched;
+    uint64_t ts_dropped;        /* timestamps that found no packet in time */
+    uint64_t collisions;        /* both buckets full of other keys, none aged */
+};
+
+/* @hwts is 0 for a packet whose timestamp never came */
+using ptp_rx_fn = std::function<void(const rx_info &info, pkt_buf *buf, uint64_t hwts)>;
+using ptp_tx_fn = std::function<void(uint64_t cookie, uint64_t hwts)>;
+
+/*
+ * PTP event packets and their hardware timestamps, which the ASIC traps
+ * separately (SX_TRAP_ID_PTP_EVENT, SX_TRAP_ID_PTP_TS) and in either order.
+ * Whichever half of a pair arrives first waits in a fixed table, in one
+ * of the two buckets its {port, direction, message type, domain, sequence
+ * ID} key hashes to, until the other half claims it: matching looks at two
+ * buckets of SX_PTP_BUCKET_WAYS entries, whatever the number of pairs
+ * pending. The two buckets' spinlocks, taken in index order, are held only
+ * for that look and a copy in or out; the poll contexts of the two traps
+ * share no other lock. With two choices a table a quarter full practically
+ * never has both of a key's buckets full.
+ *
+ * A half finding both buckets full of other keys not yet @max_age_us old
+ * is not kept: a packet goes on without timestamp, a timestamp is dropped.
+ * age() expires halves left waiting longer than that, the same way; call
+ * it periodically. Ages are of the host clock, not the ASIC's.
+ */
+class ptp {
+public:
+    explicit ptp(dev &d, unsigned size = SX_PTP_TABLE_SIZE,
+                 unsigned max_age_us = SX_PTP_MAX_AGE_US);
+    ~ptp();
+
+    ptp(const ptp &) = delete;
+    ptp &operator=(const ptp &) = delete;
+
+    /* Take both traps; @rx gets every event packet, @tx every send's stamp. */
+    int start(ptp_rx_fn rx, ptp_tx_fn tx);
+
+    /*
+     * Send event message @data out of @port and have @cookie reported to
+     * the tx callback with its egress timestamp. Returns send()'s error,
+     * -EINVAL for no event message or -EBUSY if both its buckets are full.
+     */
+    int xmit(unsigned sdq, uint16_t port, const void *data, uint32_t len, uint64_t cookie);
+
+    /* Expire halves waiting longer than the maximum age; returns how many. */
+    unsigned age();
+
+    void get_stats(ptp_stats *out) const;
+
+private:
+    /* Entry tag: kind in bits 63:62, key in 47:0 */
+    enum : uint64_t {
+        TAG_EMPTY = 0,
+        TAG_PKT = 2ull << 62,           /* packet or send waiting for its stamp */
+        TAG_TS = 3ull << 62,            /* stamp waiting for its packet */
+        TAG_KIND = 3ull << 62,
+        TAG_KEY = (1ull << 48) - 1,
+    };
+
+    struct half {
+        uint64_t tag;
+        uint64_t val;                   /* pkt_buf *, cookie or timestamp */
+        rx_info  info;
+    };
+
+    struct entry {
+        half     h;
+        uint64_t since_ns;
+    };
+
+    struct SX_CACHELINE_ALIGNED bucket {
+        spinlock lock;
+        entry    e[SX_PTP_BUCKET_WAYS] = {};
+    };
+
+    void buckets_of(uint64_t key, bucket *b[2]);
+    static void lock(bucket *const b[2]);
+    static void unlock(bucket *const b[2]);
+    int settle(const half &h, uint64_t now, half *other);
+    void expire(const half &h);
+    void event(const rx_info &info, pkt_buf *buf);
+    void stamps(const rx_info &info, pkt_buf *buf);
+
+    dev                      &dev_;
+    std::unique_ptr<bucket[]> buckets_;
+    unsigned                  nbuckets_;
+    unsigned                  shift_;
+    uint64_t                  max_age_ns_;
+    bool                      started_ = false;
+    ptp_rx_fn                 rx_;
+    ptp_tx_fn                 tx_;
+
+    std::atomic<uint64_t>     rx_matched_{0};
+    std::atomic<uint64_t>     tx_matched_{0};
+    std::atomic<uint64_t>     rx_unmatched_{0};
+    std::atomic<uint64_t>     tx_unmatched_{0};
+    std::atomic<uint64_t>     ts_dropped_{0};
+    std::atomic<uint64_t>     collisions_{0};
+};
+
+} /* namespace sx */
+
+#endif /* SX_PTP_H */
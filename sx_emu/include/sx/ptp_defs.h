@@ -0,0 +1,76 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_PTP_DEFS_H
+#define SX_PTP_DEFS_H
+
+#include <cstdint>
+
+namespace sx {
+
+/*
+ * PTP (IEEE 1588, over Ethernet) event messages are timestamped by the
+ * ports as they pass. The packets trap with SX_TRAP_ID_PTP_EVENT and carry
+ * no timestamp; the timestamps queue in a FIFO which the ASIC traps with
+ * SX_TRAP_ID_PTP_TS, up to SX_PTP_TS_PER_TRAP records at a time, in no
+ * particular order relative to the packets. Fields are in host byte order.
+ */
+#define SX_PTP_ETHERTYPE        0x88f7
+#define SX_PTP_HDR_LEN          34
+
+#define SX_PTP_MSG_SYNC         0x0
+#define SX_PTP_MSG_DELAY_REQ    0x1
+#define SX_PTP_MSG_PDELAY_REQ   0x2
+#define SX_PTP_MSG_PDELAY_RESP  0x3     /* the last event message */
+
+#define SX_PTP_DIR_RX           0
+#define SX_PTP_DIR_TX           1
+
+#define SX_PTP_TS_PER_TRAP      64
+
+struct sx_ptp_ts_rec {
+    uint64_t timestamp;         /* port time, ns */
+    uint16_t port;
+    uint16_t seq_id;
+    uint8_t  msg_type;
+    uint8_t  domain;
+    uint8_t  dir;
+    uint8_t  rsvd;
+} __attribute__((packed));
+
+static_assert(sizeof(sx_ptp_ts_rec) == 16, "sx_ptp_ts_rec must be 16 bytes");
+
+/*
+ * What ties a timestamp to its packet, as one 48-bit key: port in bits
+ * 47:32, direction in 28, message type in 27:24, domain in 23:16 and
+ * sequence ID in 15:0.
+ */
+static inline uint64_t sx_ptp_key(uint16_t port, uint8_t dir, uint8_t msg_type, uint8_t domain,
+                                  uint16_t seq_id)
+{
+    return static_cast<uint64_t>(port) << 32 | static_cast<uint64_t>(dir & 1) << 28 |
+           static_cast<uint64_t>(msg_type & 0xf) << 24 | static_cast<uint64_t>(domain) << 16 |
+           seq_id;
+}
+
+static inline uint64_t sx_ptp_rec_key(const sx_ptp_ts_rec &rec)
+{
+    return sx_ptp_key(rec.port, rec.dir, rec.msg_type, rec.domain, rec.seq_id);
+}
+
+/* Fills the fields of @rec an event message @frame keys on; false if it is none */
+static inline bool sx_ptp_parse(const uint8_t *frame, uint32_t len, sx_ptp_ts_rec *rec)
+{
+    const uint8_t *hdr = frame + 14;
+
+    if (len < 14 + SX_PTP_HDR_LEN || (frame[12] << 8 | frame[13]) != SX_PTP_ETHERTYPE ||
+        (hdr[0] & 0xf) > SX_PTP_MSG_PDELAY_RESP)
+        return false;
+    rec->msg_type = hdr[0] & 0xf;
+    rec->domain = hdr[4];
+    rec->seq_id = static_cast<uint16_t>(hdr[30] << 8 | hdr[31]);
+    return true;
+}
+
+} /* namespace sx */
+
+#endif /* SX_PTP_DEFS_H */
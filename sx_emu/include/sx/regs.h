@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_REGS_H
+#define SX_REGS_H
+
+#include <cstdint>
+
+/*
+ * BAR0 layout of the switch ASIC as seen by the driver core.
+ *
+ * The layout is shared by the driver and the software ASIC model; the driver
+ * never touches the device other than through these offsets.
+ */
+
+#define SX_BAR0_SIZE            0x20000
+
+#define SX_MAX_SDQ              24
+#define SX_MAX_RDQ              56
+#define SX_MAX_CQ               (SX_MAX_SDQ + SX_MAX_RDQ)
+#define SX_MAX_TRAP_ID          1024
+#define SX_MAX_TRAP_GROUP       64
+#define SX_MAX_PORTS            128
+
+/* Global registers, read-only but for SX_REG_FW_RESET */
+#define SX_REG_FW_REV           0x0000  /* 0 until the firmware is up */
+#define SX_REG_HW_ID            0x0004
+#define SX_REG_CAP_DQ           0x0008  /* [31:16] num RDQ, [15:0] num SDQ */
+#define SX_REG_CAP_CQ           0x000c
+#define SX_REG_CAP_PORTS        0x0010
+#define SX_REG_FW_RESET         0x0014  /* write 1: reload the firmware */
+
+/* Queue configuration blocks */
+#define SX_REG_CQ(n)            (0x1000 + (n) * 0x20)
+#define SX_REG_SDQ(n)           (0x4000 + (n) * 0x20)
+#define SX_REG_RDQ(n)           (0x6000 + (n) * 0x20)
+
+#define SX_Q_ADDR_LO            0x00
+#define SX_Q_ADDR_HI            0x04
+#define SX_Q_LOG_SIZE           0x08
+#define SX_Q_CTRL               0x0c    /* bit 0: enable */
+#define SX_Q_CQN                0x10    /* DQ only: completion queue */
+#define SX_Q_VECTOR             0x10    /* CQ only: interrupt vector */
+#define SX_Q_MOD                0x14    /* CQ only: interrupt moderation */
+
+#define SX_Q_CTRL_EN            0x1
+#define SX_Q_CTRL_BUSY          0x2     /* read: firmware still setting the queue up */
+
+/* Waiting for the firmware: poll interval, queue set-up and boot bounds */
+#define SX_FW_POLL_US           50
+#define SX_Q_INIT_TIMEOUT_US    1000000
+#define SX_FW_BOOT_TIMEOUT_MS   10000
+
+/*
+ * CQ interrupt moderation: once armed, the interrupt waits for
+ * SX_Q_MOD_COUNT completions or SX_Q_MOD_USECS after the first one,
+ * whichever comes first. Zero disables either bound; both zero interrupts
+ * on every completion.
+ */
+#define SX_Q_MOD_USECS(v)       (((v) & 0xffff) << 16)
+#define SX_Q_MOD_COUNT(v)       ((v) & 0xffff)
+
+/* Host packet trap tables */
+#define SX_REG_HPKT(trap)       (0x8000 + (trap) * 4)       /* trap group */
+#define SX_REG_HTGT(grp)        (0xa000 + (grp) * 0x10)
+
+#define SX_HTGT_RDQ             0x00    /* first RDQ of the group */
+#define SX_HTGT_RDQ_COUNT       0x04    /* RDQs spread over by flow hash; 0: 1 */
+#define SX_HTGT_TRUNC           0x08    /* bytes of a packet DMA'd, rest dropped; 0: all */
+#define SX_HPKT_DISCARD         0xff
+
+/* Doorbells */
+#define SX_DB_BASE              0x10000
+#define SX_DB_SDQ(n)            (SX_DB_BASE + 0x0000 + (n) * 8)
+#define SX_DB_RDQ(n)            (SX_DB_BASE + 0x1000 + (n) * 8)
+#define SX_DB_CQ_CI(n)          (SX_DB_BASE + 0x2000 + (n) * 8)
+#define SX_DB_CQ_ARM(n)         (SX_DB_BASE + 0x3000 + (n) * 8)
+
+/* Trap IDs used by the model and the benchmarks */
+#define SX_TRAP_ID_EMAD                 0x005   /* EMAD responses */
+#define SX_TRAP_ID_FDB_EVENT            0x006   /* FDB learn/age records */
+#define SX_TRAP_ID_PTP_TS               0x007   /* PTP timestamp records */
+#define SX_TRAP_ID_PKT_SAMPLE           0x008   /* sampled packets (sFlow) */
+#define SX_TRAP_ID_ETH_L2_STP           0x010
+#define SX_TRAP_ID_ETH_L2_LACP          0x011
+#define SX_TRAP_ID_ETH_L2_EAPOL         0x012
+#define SX_TRAP_ID_ETH_L2_LLDP          0x013
+#define SX_TRAP_ID_PTP_EVENT            0x028   /* PTP event messages */
+#define SX_TRAP_ID_ARP_REQUEST          0x050
+#define SX_TRAP_ID_ARP_RESPONSE         0x051
+#define SX_TRAP_ID_IP2ME                0x05f   /* IP packets to the switch's own addresses */
+#define SX_TRAP_ID_IPV4_BGP             0x088
+#define SX_TRAP_ID_IPV4_BFD             0x0d0   /* single-hop BFD control packets */
+
+#endif /* SX_REGS_H */
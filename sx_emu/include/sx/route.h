@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_ROUTE_H
+#define SX_ROUTE_H
+
+#include <cstdint>
+#include <sys/types.h>
+#include <vector>
+
+#include "sx/emad.h"
+
+namespace sx {
+
+struct route_entry {
+    uint8_t  protocol;      /* SX_RALUE_PROTO_* */
+    uint8_t  prefix_len;
+    uint16_t vr;            /* virtual router */
+    uint8_t  dip[16];       /* network order, IPv4 in the first 4 bytes */
+    uint32_t adj_index;
+    int      err;           /* result of the last add()/del() */
+};
+
+struct route_bulk_stats {
+    uint64_t routes;        /* handed in */
+    uint64_t writes;        /* RALUE accesses */
+    uint64_t failed;        /* routes that got an error */
+};
+
+/* RALUE accesses built and issued at a time */
+#define SX_ROUTE_BULK_OPS   4096
+
+/*
+ * Bulk LPM route programming over EMAD. Routes are sorted by protocol,
+ * virtual router, prefix length and address, which brings the routes of a
+ * KVD region together and puts a VR's covering routes before their more
+ * specifics. Routes of one region then share a RALUE write, up to @batch
+ * of them, and writes go out with up to @window in flight. Every route
+ * gets its own result: a route with host bits set fails with -EINVAL
+ * without being sent, per-record statuses map to -EINVAL (rejected) or
+ * -ENOSPC (KVD full), a failed access fails its routes with its error.
+ * Of duplicate routes the last one wins.
+ */
+class route_bulk {
+public:
+    explicit route_bulk(emad &e) : emad_(e) {}
+
+    void set_window(unsigned window) { window_ = window; }
+    void set_batch(unsigned batch) { batch_ = batch; }
+    /* Keep the caller's order; only neighbours of one region share a write */
+    void set_sort(bool on) { sort_ = on; }
+
+    /* Returns the number of routes that failed, or -ENODEV before emad::init(). */
+    ssize_t add(route_entry *routes, size_t n);
+    ssize_t del(route_entry *routes, size_t n);
+
+    void get_stats(route_bulk_stats *out) const { *out = stats_; }
+
+private:
+    /* Protocol, VR and prefix length in @meta, then the address */
+    struct sort_key {
+        uint64_t hi, lo;
+        uint32_t meta;
+        uint32_t idx;
+    };
+
+    ssize_t run(route_entry *routes, size_t n, uint8_t op);
+    int flush(route_entry *routes, size_t nops);
+
+    emad                 &emad_;
+    unsigned              window_ = SX_EMAD_MAX_INFLIGHT;
+    unsigned              batch_ = SX_RALUE_MAX_REC;
+    bool                  sort_ = true;
+    std::vector<size_t>   order_;
+    std::vector<sort_key> keys_;
+    std::vector<emad_op>  ops_;
+    std::vector<size_t>   first_;       /* order_ index of each op's first route */
+    route_bulk_stats      stats_ = {};
+};
+
+} /* namespace sx */
+
+#endif /* SX_ROUTE_H */
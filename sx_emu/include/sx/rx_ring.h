@@ -0,0 +1,167 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_RX_RING_H
+#define SX_RX_RING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "sx/compiler.h"
+#include "sx/dev.h"
+
+namespace sx {
+
+/*
+ * Zero-copy receive ring shared with user space.
+ *
+ * The driver posts buffers of a shared memory area to an RDQ; completed
+ * packets are published in place as descriptors carrying the buffer offset.
+ * User space reads them through its own mapping and advances the consumer
+ * index to give the buffers back. Neither side copies packet data.
+ *
+ * Mapping layout: one header page, the descriptor array, then the buffers.
+ */
+#define SX_RX_RING_MAGIC    0x53585252  /* "SXRR" */
+#define SX_RX_RING_VERSION  1
+
+struct sx_rx_ring_hdr {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nent;          /* descriptors, power of two */
+    uint32_t nbufs;
+    uint32_t buf_size;
+    uint32_t desc_off;
+    uint32_t data_off;
+    uint32_t rsvd;
+    SX_CACHELINE_ALIGNED uint32_t prod;     /* written by the driver */
+    uint64_t drops;                         /* written by the driver */
+    SX_CACHELINE_ALIGNED uint32_t cons;     /* written by user space */
+};
+
+struct sx_rx_ring_desc {
+    uint32_t buf_off;       /* from the start of the mapping */
+    uint16_t len;
+    uint16_t trap_id;
+    uint16_t sys_port;
+    uint16_t rsvd0;
+    uint32_t rsvd1;
+    uint64_t timestamp;
+};
+static_assert(sizeof(sx_rx_ring_desc) == 24, "sx_rx_ring_desc must be 24 bytes");
+
+/*
+ * Driver side. Bind it to a dedicated RDQ with dev::bind_rdq() before the RDQ
+ * is created; it must outlive the RDQ. Offsets the driver trusts are kept in
+ * private memory, so user space cannot redirect DMA by corrupting the ring.
+ */
+class rx_ring : public rdq_consumer, public pkt_buf_owner {
+public:
+    rx_ring() = default;
+    ~rx_ring() override;
+
+    rx_ring(const rx_ring &) = delete;
+    rx_ring &operator=(const rx_ring &) = delete;
+
+    /*
+     * @nent descriptors (rounded up to a power of two) and as many buffers.
+     * Buffers held by user space are not reposted, so a slow reader runs
+     * the RDQ dry and the ASIC drops, instead of the ring overflowing.
+     */
+    int create(unsigned nent, uint32_t buf_size);
+    void destroy();
+
+    /* memfd to mmap() from user space, and the eventfd to poll() on */
+    int fd() const { return mem_fd_; }
+    int event_fd() const { return event_fd_; }
+    size_t map_size() const { return map_size_; }
+
+    uint64_t wakeups() const { return wakeups_; }
+
+    uint32_t buf_size() const override { return buf_size_; }
+    pkt_buf *alloc_buf() override;
+    void deliver(const rx_info &info, pkt_buf *buf) override;
+    void flush() override;
+    void release(pkt_buf *buf) override;
+
+private:
+    void reclaim();
+
+    int                   mem_fd_ = -1;
+    int                   event_fd_ = -1;
+    uint8_t              *map_ = nullptr;
+    size_t                map_size_ = 0;
+    sx_rx_ring_hdr       *hdr_ = nullptr;
+    sx_rx_ring_desc      *desc_ = nullptr;
+    uint32_t              nent_ = 0;
+    uint32_t              buf_size_ = 0;
+    uint32_t              prod_ = 0;        /* published, not yet flushed */
+    uint32_t              flushed_ = 0;     /* last value of hdr_->prod */
+    uint32_t              reclaimed_ = 0;   /* ring slots whose buffer came back */
+    uint64_t              wakeups_ = 0;
+    std::vector<pkt_buf>  bufs_;
+    std::vector<uint32_t> slot_buf_;        /* ring slot -> buffer index */
+    std::vector<uint32_t> free_;
+};
+
+/*
+ * User-space side: maps the ring and consumes descriptors in place.
+ *
+ *     while (running) {
+ *         while ((d = r.peek(i)))
+ *             handle(r.data(d), d->len), i++;
+ *         r.release(i);
+ *         r.wait(-1);
+ *     }
+ */
+class rx_ring_reader {
+public:
+    rx_ring_reader() = default;
+    ~rx_ring_reader();
+
+    rx_ring_reader(const rx_ring_reader &) = delete;
+    rx_ring_reader &operator=(const rx_ring_reader &) = delete;
+
+    int open(int fd, int event_fd);
+    void close();
+
+    /* Descriptors ready for consumption */
+    uint32_t available() const { return load_acquire(&hdr_->prod) - cons_; }
+
+    /* The @n-th unconsumed descriptor, or nullptr. */
+    const sx_rx_ring_desc *peek(uint32_t n) const
+    {
+        if (n >= available())
+            return nullptr;
+        return &desc_[(cons_ + n) & (hdr_->nent - 1)];
+    }
+
+    const uint8_t *data(const sx_rx_ring_desc *d) const { return map_ + d->buf_off; }
+
+    /* Return the first @n descriptors and their buffers to the driver. */
+    void release(uint32_t n)
+    {
+        cons_ += n;
+        store_release(&hdr_->cons, cons_);
+    }
+
+    /*
+     * Sleep until the ring is non-empty. Returns the number of descriptors
+     * available, 0 on timeout or a negative errno.
+     */
+    int wait(int timeout_ms);
+
+    uint64_t drops() const { return read_once(&hdr_->drops); }
+
+private:
+    uint8_t         *map_ = nullptr;
+    size_t           map_size_ = 0;
+    sx_rx_ring_hdr  *hdr_ = nullptr;
+    sx_rx_ring_desc *desc_ = nullptr;
+    uint32_t         cons_ = 0;
+    int              event_fd_ = -1;
+};
+
+} /* namespace sx */
+
+#endif /* SX_RX_RING_H */
@@ -0,0 +1,126 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_SFLOW_H
+#define SX_SFLOW_H
+
+#include <condition_variable>
+#include <mutex>
+#include <sys/types.h>
+#include <vector>
+
+#include "sx/dev.h"
+#include "sx/emad.h"
+
+namespace sx {
+
+/* Defaults: header bytes kept per sample, datagram payload, hold time */
+#define SX_SFLOW_HEADER_BYTES   128
+#define SX_SFLOW_DGRAM_BYTES    1400
+#define SX_SFLOW_WINDOW_US      1000
+
+/*
+ * sFlow v5 flow_sample, XDR encoded: the fixed fields and one raw packet
+ * header record take SX_SFLOW_SAMPLE_FIXED bytes, then the header bytes,
+ * padded to four.
+ */
+#define SX_SFLOW_FLOW_SAMPLE    1
+#define SX_SFLOW_RAW_HEADER     1
+#define SX_SFLOW_PROTO_ETHERNET 1
+#define SX_SFLOW_IF_UNKNOWN     0x3fffffff
+#define SX_SFLOW_SAMPLE_FIXED   64
+
+struct sflow_stats {
+    uint64_t sampled;       /* samples trapped by the ASIC */
+    uint64_t limited;       /* dropped over a session's rate limit */
+    uint64_t no_session;    /* on a port without a session */
+    uint64_t overflow;      /* dropped on a full buffer */
+    uint64_t records;       /* flow samples handed to the reader */
+    uint64_t datagrams;     /* reads that returned samples */
+};
+
+/*
+ * Packet sampling for an sFlow agent. A session samples one in @rate
+ * packets received on a port (MPSC); samples are trapped with
+ * SX_TRAP_ID_PKT_SAMPLE to trap group @group, which must already have its
+ * RDQ, truncated by the ASIC to @header_bytes so only headers cross the
+ * bus. Each session is rate limited here, before any copy, to
+ * @max_per_sec samples with a tenth of a second of burst; samples over it
+ * are dropped and reported as the session's drops.
+ *
+ * Samples are kept encoded as sFlow v5 flow samples carrying the ingress
+ * and egress port, the rate and the sample pool. read() returns whole
+ * samples for one datagram once @dgram_bytes of them are pending or the
+ * first has waited @window_us: an agent prepends the datagram header and
+ * sends them as they are.
+ */
+class sflow {
+public:
+    sflow(dev &d, emad &e, uint8_t group, uint16_t header_bytes = SX_SFLOW_HEADER_BYTES,
+          size_t dgram_bytes = SX_SFLOW_DGRAM_BYTES, unsigned window_us = SX_SFLOW_WINDOW_US,
+          size_t max_pending = 1u << 22);
+    ~sflow();
+
+    sflow(const sflow &) = delete;
+    sflow &operator=(const sflow &) = delete;
+
+    /* Truncate @group's traps and start taking SX_TRAP_ID_PKT_SAMPLE. */
+    int start();
+
+    /*
+     * Sample one in @rate packets received on @port, at most @max_per_sec
+     * of them (0: no limit). Replaces the port's session, if any.
+     */
+    int add_session(uint16_t port, uint32_t rate, uint32_t max_per_sec);
+    int del_session(uint16_t port);
+
+    /*
+     * Copy whole pending samples, at most @len bytes and one datagram
+     * (@dgram_bytes, or the first sample if larger) of them, to @buf and
+     * their number to @nsamples. Returns the bytes copied, -EINVAL if @len
+     * cannot hold the largest sample, or -EAGAIN if @nonblock and nothing
+     * is pending; @nonblock returns a datagram early.
+     */
+    ssize_t read(uint8_t *buf, size_t len, unsigned *nsamples, bool nonblock = false);
+
+    /* Bytes a sample takes at most */
+    size_t max_sample() const { return SX_SFLOW_SAMPLE_FIXED + ((header_bytes_ + 3) & ~3u); }
+
+    void get_stats(sflow_stats *out);
+
+private:
+    struct session {
+        uint32_t rate = 0;              /* 0: none */
+        uint64_t cost_ns = 0;           /* of one sample at the limit; 0: none */
+        uint64_t burst_ns = 0;
+        uint64_t credit_ns = 0;
+        uint64_t last_ns = 0;
+        uint32_t seq = 0;
+        uint32_t pool = 0;              /* packets the samples stand for */
+        uint32_t drops = 0;
+    };
+
+    int write_mpsc(uint16_t port, uint32_t rate);
+    void enqueue(const rx_info &info, pkt_buf *buf);
+
+    dev                    &dev_;
+    emad                   &emad_;
+    uint8_t                 group_;
+    uint16_t                header_bytes_;
+    size_t                  dgram_bytes_;
+    uint64_t                window_ns_;
+    size_t                  max_pending_;
+    bool                    started_ = false;
+
+    std::mutex              lock_;
+    std::condition_variable wq_;
+    session                 sessions_[SX_MAX_PORTS];
+    std::vector<uint8_t>    pending_;           /* encoded samples */
+    std::vector<uint32_t>   ends_;              /* of each sample in pending_ */
+    size_t                  head_ = 0;          /* first unread sample */
+    uint64_t                first_ns_ = 0;      /* arrival of the first unread one */
+    sflow_stats             stats_ = {};
+};
+
+} /* namespace sx */
+
+#endif /* SX_SFLOW_H */
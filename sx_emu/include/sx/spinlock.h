@@ -0,0 +1,49 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_SPINLOCK_H
+#define SX_SPINLOCK_H
+
+#include <atomic>
+#include <sched.h>
+
+#include "sx/compiler.h"
+
+namespace sx {
+
+/*
+ * Test-and-test-and-set lock for short critical sections on the data path.
+ * Yields after a bounded spin so an oversubscribed host still makes progress.
+ */
+class spinlock {
+public:
+    void lock()
+    {
+        for (unsigned spins = 0;;) {
+            if (!locked_.exchange(true, std::memory_order_acquire))
+                return;
+            while (locked_.load(std::memory_order_relaxed)) {
+                if (++spins < 128) {
+                    cpu_relax();
+                } else {
+                    spins = 0;
+                    sched_yield();
+                }
+            }
+        }
+    }
+
+    bool try_lock()
+    {
+        return !locked_.load(std::memory_order_relaxed) &&
+               !locked_.exchange(true, std::memory_order_acquire);
+    }
+
+    void unlock() { locked_.store(false, std::memory_order_release); }
+
+private:
+    std::atomic<bool> locked_{false};
+};
+
+} /* namespace sx */
+
+#endif /* SX_SPINLOCK_H */
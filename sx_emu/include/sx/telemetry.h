@@ -0,0 +1,165 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_TELEMETRY_H
+#define SX_TELEMETRY_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "sx/compiler.h"
+#include "sx/emad.h"
+
+namespace sx {
+
+/*
+ * Streaming telemetry ring shared with user space.
+ *
+ * The driver snapshots the counters of every port at an interval and
+ * appends one fixed-layout record per port to a ring in shared memory.
+ * Records are never held back for readers: the oldest are overwritten.
+ * Each record carries its own sequence number, odd while the driver
+ * writes it, so any number of readers can copy records out of their own
+ * mapping without a syscall and without writing to the ring.
+ *
+ * Mapping layout: one header page, then the records.
+ */
+#define SX_TELE_MAGIC       0x53585454  /* "SXTT" */
+#define SX_TELE_VERSION     1
+
+struct sx_tele_hdr {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nent;          /* records, power of two */
+    uint32_t rec_size;
+    uint32_t rec_off;
+    uint32_t nports;        /* records per snapshot */
+    uint32_t interval_ms;
+    uint32_t rsvd;
+    SX_CACHELINE_ALIGNED uint64_t head;     /* records published, by the driver */
+};
+
+/* Record n lives in slot n % nent; seq is 2n + 2 once it is complete. */
+struct SX_CACHELINE_ALIGNED sx_tele_rec {
+    uint64_t    seq;
+    uint64_t    snapshot;   /* from 0, one per interval */
+    uint64_t    timestamp;  /* ns, steady clock, when the snapshot started */
+    uint16_t    local_port;
+    uint16_t    rsvd0;
+    uint32_t    rsvd1;
+    sx_port_cnt cnt;
+};
+static_assert(sizeof(sx_tele_rec) == 384, "sx_tele_rec must be 384 bytes");
+
+struct telemetry_stats {
+    uint64_t snapshots;
+    uint64_t records;
+    uint64_t errors;        /* snapshots dropped on a failed access */
+    uint64_t snapshot_ns;   /* duration of the last snapshot */
+    uint64_t cpu_ns;        /* thread CPU time of all snapshots */
+};
+
+/*
+ * Driver side. A snapshot reads every port with PPCNT, all in flight
+ * together, then publishes their records; a port whose read failed
+ * fails the snapshot and nothing of it is published.
+ */
+class telemetry {
+public:
+    explicit telemetry(emad &e) : emad_(e) {}
+    ~telemetry();
+
+    telemetry(const telemetry &) = delete;
+    telemetry &operator=(const telemetry &) = delete;
+
+    /* Ports [0, @nports), with room for @nent records (rounded up to a power of two). */
+    int create(unsigned nent, unsigned nports);
+    void destroy();
+
+    /* memfd to mmap() from user space */
+    int fd() const { return mem_fd_; }
+    size_t map_size() const { return map_size_; }
+
+    void set_interval_ms(unsigned ms);
+    void set_window(unsigned window) { window_ = window; }
+
+    /* Snapshot every interval from a thread of its own, until stop(). */
+    int start();
+    void stop();
+
+    /* One snapshot, now. Returns 0 or the error of a failed access. */
+    int snapshot();
+
+    void get_stats(telemetry_stats *out);
+
+private:
+    void thread_fn();
+
+    emad                    &emad_;
+    int                      mem_fd_ = -1;
+    uint8_t                 *map_ = nullptr;
+    size_t                   map_size_ = 0;
+    sx_tele_hdr             *hdr_ = nullptr;
+    sx_tele_rec             *rec_ = nullptr;
+    uint32_t                 nent_ = 0;
+    uint32_t                 nports_ = 0;
+    uint64_t                 head_ = 0;
+    unsigned                 interval_ms_ = 1000;
+    unsigned                 window_ = SX_EMAD_MAX_INFLIGHT;
+    std::vector<emad_op>     ops_;
+    std::mutex               lock_;             /* snapshots, stats */
+    telemetry_stats          stats_ = {};
+    std::thread              thread_;
+    std::mutex               wait_lock_;
+    std::condition_variable  wq_;
+    bool                     stop_ = false;
+};
+
+/*
+ * Reference consumer: maps the ring read-only and copies records out in
+ * order. Records overwritten before it got to them are skipped and
+ * counted as lost.
+ *
+ *     while (running) {
+ *         while (r.next(&rec) > 0)
+ *             export(rec);
+ *         sleep_until_next_interval();
+ *     }
+ */
+class telemetry_reader {
+public:
+    telemetry_reader() = default;
+    ~telemetry_reader();
+
+    telemetry_reader(const telemetry_reader &) = delete;
+    telemetry_reader &operator=(const telemetry_reader &) = delete;
+
+    /* Starts at the oldest record still in the ring. */
+    int open(int fd);
+    void close();
+
+    /* Copy the next record to @out. Returns 1, or 0 when none is ready. */
+    int next(sx_tele_rec *out);
+
+    uint64_t lost() const { return lost_; }
+    uint32_t interval_ms() const { return read_once(&hdr_->interval_ms); }
+    uint32_t nports() const { return hdr_->nports; }
+
+private:
+    void resync(uint64_t head);
+
+    uint8_t           *map_ = nullptr;
+    size_t             map_size_ = 0;
+    const sx_tele_hdr *hdr_ = nullptr;
+    const sx_tele_rec *rec_ = nullptr;
+    uint32_t           nent_ = 0;
+    uint64_t           cursor_ = 0;     /* next record to read */
+    uint64_t           lost_ = 0;
+};
+
+} /* namespace sx */
+
+#endif /* SX_TELEMETRY_H */
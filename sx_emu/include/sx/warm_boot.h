@@ -0,0 +1,95 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_WARM_BOOT_H
+#define SX_WARM_BOOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <set>
+
+#include "sx/acl.h"
+#include "sx/counter_pool.h"
+#include "sx/fdb_shadow.h"
+#include "sx/route.h"
+#include "sx/warm_image.h"
+
+namespace sx {
+
+/* What one sync found and did */
+struct warm_sync_stats {
+    uint64_t kept;          /* already programmed as wanted */
+    uint64_t added;
+    uint64_t changed;
+    uint64_t removed;
+    uint64_t failed;        /* changes the device refused */
+    uint64_t restore_ns;    /* handing the image back to the module, first sync */
+    uint64_t diff_ns;       /* comparing with the image */
+    uint64_t push_ns;       /* programming the difference, recording it */
+};
+
+/*
+ * Programs the device through a warm_image. Each sync_*() takes the whole
+ * set of objects of its kind the control plane wants, compares it with
+ * what the image says is programmed and pushes only the difference, adds
+ * and changes before removals; the image then records what took effect.
+ *
+ * After a restart of the driver alone the device still holds everything:
+ * the first sync of each kind first hands what the image holds back to
+ * the module that owns it (FDB shadow, ACL table, counter pool) without a
+ * write, so that module carries on where the old instance left off. With
+ * an empty image it all goes out, as a cold start would.
+ *
+ * A crash between a sync's image begin() and commit() leaves the image
+ * dirty, and the next open() discards it: that start is cold.
+ */
+class warm_boot {
+public:
+    explicit warm_boot(warm_image &img) : img_(img) {}
+
+    warm_boot(const warm_boot &) = delete;
+    warm_boot &operator=(const warm_boot &) = delete;
+
+    /*
+     * Routes get route_bulk's per-route result in err. Returns the number
+     * of routes failed, removals included, -ENOSPC for a full image, or
+     * route_bulk's error, which every route to push then has in err.
+     */
+    ssize_t sync_routes(route_bulk &rb, route_entry *routes, size_t n,
+                        warm_sync_stats *st = nullptr);
+
+    /* Static MAC entries. Returns the number failed, or -ENOSPC as above. */
+    ssize_t sync_fdb(emad &e, fdb_shadow &fdb, const sx_wb_fdb *entries, size_t n,
+                     warm_sync_stats *st = nullptr);
+
+    /*
+     * The rules of ACL @acl_id, whose handles go to @handles if set. A
+     * rule is matched by priority and key; one changing its action is
+     * inserted anew before the old is removed. More changes than half
+     * the rules rebuild the ACL with acl_table::replace() instead. Returns
+     * 0 or the error of the failed change.
+     */
+    int sync_acl(acl_table &acl, uint16_t acl_id, const acl_rule *rules, size_t n,
+                 uint64_t *handles, warm_sync_stats *st = nullptr);
+
+    /*
+     * Flow counter blocks by owner, their index going to @ctrs[i].index:
+     * kept where they are unless their count changed. Returns the number
+     * of blocks failed, their index set to UINT32_MAX.
+     */
+    ssize_t sync_counters(counter_pool &pool, sx_wb_counter *ctrs, size_t n,
+                          warm_sync_stats *st = nullptr);
+
+private:
+    int restore_acl(acl_table &acl, uint16_t acl_id);
+    void record_acl(const acl_table &acl, uint16_t acl_id);
+
+    warm_image        &img_;
+    bool               fdb_restored_ = false;
+    bool               counters_restored_ = false;
+    size_t             counters_next_ = 0;     /* image slot to restore next */
+    std::set<uint16_t> acls_restored_;
+};
+
+} /* namespace sx */
+
+#endif /* SX_WARM_BOOT_H */
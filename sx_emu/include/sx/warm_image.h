@@ -0,0 +1,148 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_WARM_IMAGE_H
+#define SX_WARM_IMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+
+#include "sx/acl.h"
+
+namespace sx {
+
+/*
+ * Shadow image of what the driver programmed, kept in a memory-mapped file
+ * so it outlives the process: a restart maps it back and only pushes the
+ * difference to what the control plane wants now (warm boot).
+ *
+ * Mapping layout: one header page, then a table per kind of object. A
+ * table is an open-addressing hash of fixed-size records, kept at most half
+ * full: a slot is a nonzero 32-bit key hash, 4 reserved bytes, then the
+ * record, whose first key_len bytes are its key. Records are in host byte
+ * order; the image is only for the host that wrote it.
+ */
+#define SX_WB_MAGIC         0x53585742  /* "SXWB" */
+#define SX_WB_VERSION       1
+
+#define SX_WB_ROUTE         0           /* sx_wb_route */
+#define SX_WB_FDB           1           /* sx_wb_fdb: static MAC entries */
+#define SX_WB_ACL_REGION    2           /* sx_wb_acl_region */
+#define SX_WB_ACL_RULE      3           /* sx_wb_acl_rule */
+#define SX_WB_COUNTER       4           /* sx_wb_counter: flow counter blocks */
+#define SX_WB_TABLES        5
+
+struct sx_wb_table {
+    uint32_t rec_size;
+    uint32_t key_len;
+    uint64_t off;           /* of the first slot in the mapping */
+    uint64_t nslots;        /* power of two */
+    uint64_t count;
+};
+
+struct sx_wb_hdr {
+    uint32_t    magic;
+    uint32_t    version;
+    uint64_t    size;       /* of the mapping */
+    uint64_t    generation; /* commits so far */
+    uint32_t    dirty;      /* from begin() to commit(): not to be trusted */
+    uint32_t    ntables;
+    sx_wb_table table[SX_WB_TABLES];
+};
+
+struct sx_wb_route {
+    uint8_t  protocol;      /* key */
+    uint8_t  prefix_len;
+    uint16_t vr;
+    uint8_t  dip[16];
+    uint32_t adj_index;
+};
+
+struct sx_wb_fdb {
+    uint16_t fid;           /* key */
+    uint8_t  mac[6];
+    uint16_t port;
+    uint16_t rsvd;
+};
+
+struct sx_wb_acl_region {
+    uint16_t acl_id;        /* key */
+    uint8_t  width;         /* acl_layout index */
+    uint8_t  rsvd0;
+    uint16_t region;
+    uint16_t rsvd1;
+    uint32_t size;
+};
+
+struct sx_wb_acl_rule {
+    uint16_t acl_id;        /* key */
+    uint8_t  rsvd0[6];
+    uint64_t handle;
+    uint32_t offset;
+    uint32_t rsvd1;
+    acl_rule rule;
+};
+
+struct sx_wb_counter {
+    uint64_t owner;         /* key: the caller's name for the block */
+    uint32_t index;
+    uint32_t count;
+};
+
+class warm_image {
+public:
+    warm_image() = default;
+    ~warm_image();
+
+    warm_image(const warm_image &) = delete;
+    warm_image &operator=(const warm_image &) = delete;
+
+    /*
+     * Map the image at @path. Returns 1 if it holds a usable image, or 0
+     * once it holds an empty one with room for @max[t] records of table t:
+     * the file was missing, of another version, or left dirty. Or -errno.
+     */
+    int open(const char *path, const size_t *max);
+    void close();
+
+    uint64_t generation() const { return hdr_->generation; }
+    size_t count(unsigned t) const { return hdr_->table[t].count; }
+    size_t nslots(unsigned t) const { return hdr_->table[t].nslots; }
+    size_t map_size() const { return map_size_; }
+
+    /* Slot of the record with the key @rec starts with, or -1. */
+    ssize_t find(unsigned t, const void *rec) const;
+
+    /* Record in slot @slot, or nullptr if empty. */
+    const void *at(unsigned t, size_t slot) const;
+
+    /*
+     * Changes go between begin() and commit(). put() adds @rec or replaces
+     * the record of its key; -ENOSPC if the table is full.
+     */
+    void begin();
+    int put(unsigned t, const void *rec);
+    void del(unsigned t, const void *rec);
+
+    /* Flush the changes to the file, then mark the image clean. */
+    int commit();
+
+private:
+    uint8_t *slot(unsigned t, size_t i) const
+    {
+        return map_ + hdr_->table[t].off + i * slot_size_[t];
+    }
+    uint64_t hash(unsigned t, const void *rec) const;
+    bool valid(size_t size) const;
+    int create(const size_t *max);
+
+    int        fd_ = -1;
+    uint8_t   *map_ = nullptr;
+    size_t     map_size_ = 0;
+    sx_wb_hdr *hdr_ = nullptr;
+    size_t     slot_size_[SX_WB_TABLES] = {};
+};
+
+} /* namespace sx */
+
+#endif /* SX_WARM_IMAGE_H */
@@ -0,0 +1,232 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#ifndef SX_XSK_H
+#define SX_XSK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "sx/compiler.h"
+#include "sx/dev.h"
+
+namespace sx {
+
+/*
+ * AF_XDP-style zero-copy socket on one RDQ.
+ *
+ * User space owns the packet memory (UMEM), a memfd cut into equal chunks,
+ * and registers it; the driver posts chunks straight to the RDQ, so the
+ * ASIC DMAs frames into user memory. Chunks travel through two rings the
+ * driver allocates and user space maps: the fill ring hands chunk
+ * addresses to the driver, the RX ring returns them with a frame in. User
+ * space decides when and in which order chunks go back. Neither side
+ * copies packet data.
+ *
+ * Addresses are byte offsets into the UMEM. A frame lands in its chunk
+ * after @headroom bytes and an sx_xsk_meta; the RX descriptor points at
+ * the frame and the metadata sits right in front of it.
+ *
+ * Mapping layout: one header page, the fill ring, then the RX ring.
+ */
+#define SX_XSK_MAGIC            0x53584b53  /* "SXKS" */
+#define SX_XSK_VERSION          1
+
+/* Fill ring flag: the driver ran out of chunks, call xsk::wakeup() after filling */
+#define SX_XSK_NEED_WAKEUP      0x1
+
+struct sx_xsk_hdr {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t fill_nent;     /* power of two */
+    uint32_t rx_nent;       /* power of two */
+    uint32_t fill_off;
+    uint32_t rx_off;
+    uint32_t chunk_size;
+    uint32_t headroom;
+    uint64_t umem_size;
+    SX_CACHELINE_ALIGNED uint32_t fill_prod;    /* written by user space */
+    SX_CACHELINE_ALIGNED uint32_t fill_cons;    /* written by the driver */
+    uint32_t fill_flags;                        /* written by the driver */
+    SX_CACHELINE_ALIGNED uint32_t rx_prod;      /* written by the driver */
+    uint64_t rx_drops;                          /* written by the driver */
+    SX_CACHELINE_ALIGNED uint32_t rx_cons;      /* written by user space */
+};
+
+struct sx_xsk_desc {
+    uint64_t addr;          /* of the frame, in the UMEM */
+    uint32_t len;
+    uint32_t options;
+};
+static_assert(sizeof(sx_xsk_desc) == 16, "sx_xsk_desc must be 16 bytes");
+
+/* In front of every frame, as XDP metadata */
+struct sx_xsk_meta {
+    uint64_t timestamp;
+    uint16_t trap_id;
+    uint16_t sys_port;
+    uint32_t rsvd;
+};
+static_assert(sizeof(sx_xsk_meta) == 16, "sx_xsk_meta must be 16 bytes");
+
+/*
+ * Driver side. reg_umem(), create_rings() and bind() in that order, then
+ * dev::create_rdq(); the socket must outlive the RDQ. Chunks the fill ring
+ * does not yet hold leave the RDQ partly posted, and polls of its CQ top
+ * it up. Addresses from user space are checked against the UMEM before
+ * they reach a descriptor, so a bad one cannot redirect DMA.
+ */
+class xsk : public rdq_consumer, public pkt_buf_owner {
+public:
+    xsk() = default;
+    ~xsk() override;
+
+    xsk(const xsk &) = delete;
+    xsk &operator=(const xsk &) = delete;
+
+    /*
+     * The UMEM: @size bytes of memfd @fd, in chunks of @chunk_size (a power
+     * of two, at least 2 KB), frames placed @headroom bytes (a multiple
+     * of 8, keeping the metadata aligned) into each.
+     */
+    int reg_umem(int fd, size_t size, uint32_t chunk_size, uint32_t headroom);
+
+    /* Fill and RX rings of @fill_nent and @rx_nent entries, rounded up to powers of two. */
+    int create_rings(unsigned fill_nent, unsigned rx_nent);
+
+    /* Take over @rdq of @d, whose CQ is @cqn; before dev::create_rdq(). */
+    int bind(dev &d, unsigned rdq, unsigned cqn);
+
+    /* sendto(): schedule the CQ's poll, which refills the RDQ from the fill ring. */
+    int wakeup();
+
+    void destroy();
+
+    /* memfd of the rings to mmap() from user space, and the eventfd to poll() on */
+    int fd() const { return ring_fd_; }
+    int event_fd() const { return event_fd_; }
+
+    uint64_t wakeups() const { return wakeups_; }
+    uint64_t bad_addrs() const { return bad_addrs_; }
+
+    uint32_t buf_size() const override { return frame_size_; }
+    pkt_buf *alloc_buf() override;
+    void deliver(const rx_info &info, pkt_buf *buf) override;
+    void flush() override;
+    void release(pkt_buf *buf) override;
+
+private:
+    uint8_t              *umem_ = nullptr;
+    size_t                umem_size_ = 0;
+    uint32_t              chunk_shift_ = 0;
+    uint32_t              headroom_ = 0;
+    uint32_t              frame_size_ = 0; /* chunk less headroom and metadata */
+    std::vector<pkt_buf>  bufs_;            /* one per chunk */
+    std::vector<uint32_t> free_;            /* chunks dropped by the driver */
+
+    int                   ring_fd_ = -1;
+    int                   event_fd_ = -1;
+    uint8_t              *map_ = nullptr;
+    size_t                map_size_ = 0;
+    sx_xsk_hdr           *hdr_ = nullptr;
+    uint64_t             *fill_ = nullptr;
+    sx_xsk_desc          *rx_ = nullptr;
+    uint32_t              fill_nent_ = 0;
+    uint32_t              rx_nent_ = 0;
+    uint32_t              fill_cons_ = 0;
+    uint32_t              rx_prod_ = 0;     /* published, not yet flushed */
+    uint32_t              rx_flushed_ = 0;  /* last value of hdr_->rx_prod */
+    uint64_t              wakeups_ = 0;
+    uint64_t              bad_addrs_ = 0;
+
+    dev                  *dev_ = nullptr;
+    unsigned              cqn_ = 0;
+};
+
+/*
+ * User-space side: owns the UMEM mapping, maps the rings.
+ *
+ *     s.fill(addrs, n);
+ *     while (running) {
+ *         while ((d = s.peek(i)))
+ *             handle(s.data(d), d->len), addrs[i] = s.chunk(d), i++;
+ *         s.release(i);
+ *         s.fill(addrs, i);
+ *         if (s.needs_wakeup())
+ *             x.wakeup();
+ *         s.wait(-1);
+ *     }
+ */
+class xsk_socket {
+public:
+    xsk_socket() = default;
+    ~xsk_socket();
+
+    xsk_socket(const xsk_socket &) = delete;
+    xsk_socket &operator=(const xsk_socket &) = delete;
+
+    /*
+     * @umem: this process's mapping of the memory registered with
+     * xsk::reg_umem(). Returns -EINVAL if @fd cannot hold the header, or
+     * -EPROTO if its rings do not fit in it.
+     */
+    int open(int fd, int event_fd, uint8_t *umem);
+    void close();
+
+    /* Give @n chunks to the driver; returns how many fit. */
+    unsigned fill(const uint64_t *addrs, unsigned n);
+    bool needs_wakeup() const { return load_acquire(&hdr_->fill_flags) & SX_XSK_NEED_WAKEUP; }
+
+    /* Frames ready for consumption */
+    uint32_t available() const { return load_acquire(&hdr_->rx_prod) - rx_cons_; }
+
+    /* The @n-th unconsumed frame, or nullptr. */
+    const sx_xsk_desc *peek(uint32_t n) const
+    {
+        if (n >= available())
+            return nullptr;
+        return &rx_[(rx_cons_ + n) & (hdr_->rx_nent - 1)];
+    }
+
+    const uint8_t *data(const sx_xsk_desc *d) const { return umem_ + d->addr; }
+    const sx_xsk_meta *meta(const sx_xsk_desc *d) const
+    {
+        return reinterpret_cast<const sx_xsk_meta *>(umem_ + d->addr - sizeof(sx_xsk_meta));
+    }
+
+    /* Chunk of @d, to fill again */
+    uint64_t chunk(const sx_xsk_desc *d) const
+    {
+        return d->addr & ~static_cast<uint64_t>(hdr_->chunk_size - 1);
+    }
+
+    /* Consume the first @n frames; their chunks stay with user space. */
+    void release(uint32_t n)
+    {
+        rx_cons_ += n;
+        store_release(&hdr_->rx_cons, rx_cons_);
+    }
+
+    /*
+     * Sleep until frames are ready. Returns the number available, 0 on
+     * timeout or a negative errno.
+     */
+    int wait(int timeout_ms);
+
+    uint64_t drops() const { return read_once(&hdr_->rx_drops); }
+
+private:
+    uint8_t     *umem_ = nullptr;
+    uint8_t     *map_ = nullptr;
+    size_t       map_size_ = 0;
+    sx_xsk_hdr  *hdr_ = nullptr;
+    uint64_t    *fill_ = nullptr;
+    sx_xsk_desc *rx_ = nullptr;
+    uint32_t     fill_prod_ = 0;
+    uint32_t     rx_cons_ = 0;
+    int          event_fd_ = -1;
+};
+
+} /* namespace sx */
+
+#endif /* SX_XSK_H */
@@ -0,0 +1,461 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <endian.h>
+
+#include "sx/acl.h"
+
+namespace sx {
+
+static const uint8_t acl_widths[] = { SX_TCAM_WIDTH_1, SX_TCAM_WIDTH_2, SX_TCAM_WIDTH_4 };
+
+static unsigned width_index(uint8_t key_len)
+{
+    return key_len <= SX_TCAM_SLOT_BYTES ? 0 : key_len <= 2 * SX_TCAM_SLOT_BYTES ? 1 : 2;
+}
+
+static bool rule_valid(const acl_rule &r)
+{
+    if (r.key_len > SX_TCAM_KEY_MAX)
+        return false;
+    for (unsigned i = r.key_len; i < SX_TCAM_KEY_MAX; i++) {
+        if (r.key[i] || r.mask[i])
+            return false;
+    }
+    return true;
+}
+
+static int acl_errno(const emad_op &op)
+{
+    if (op.err != -EIO)
+        return op.err;
+    switch (op.status) {
+    case SX_EMAD_STATUS_BAD_PARAM:
+        return -EINVAL;
+    case SX_EMAD_STATUS_NO_RESOURCES:
+        return -ENOSPC;
+    default:
+        return -EIO;
+    }
+}
+
+void acl_table::put_write(uint16_t region, uint32_t offset, const acl_rule *rule)
+{
+    if (nops_ == ops_.size())
+        ops_.emplace_back();
+
+    emad_op &o = ops_[nops_++];
+    o.reg_id = SX_REG_ID_PTCE;
+    o.method = SX_EMAD_METHOD_WRITE;
+    o.payload.assign(sizeof(sx_ptce_reg), 0);
+
+    sx_ptce_reg *reg = reinterpret_cast<sx_ptce_reg *>(o.payload.data());
+    reg->op = rule ? SX_PTCE_OP_WRITE : SX_PTCE_OP_CLEAR;
+    reg->region = htobe16(region);
+    reg->offset = htobe32(offset);
+    if (rule) {
+        reg->priority = htobe32(rule->priority);
+        reg->action = htobe32(rule->action);
+        memcpy(reg->key, rule->key, sizeof(reg->key));
+        memcpy(reg->mask, rule->mask, sizeof(reg->mask));
+    }
+}
+
+int acl_table::flush()
+{
+    size_t n = nops_;
+    int err = n ? emad_.transact(ops_.data(), n, window_) : 0;
+
+    nops_ = 0;
+    if (err)
+        return err;
+    stats_.writes += n;
+    for (size_t i = 0; i < n; i++) {
+        if (ops_[i].err)
+            return acl_errno(ops_[i]);
+    }
+    return 0;
+}
+
+int acl_table::region_op(uint8_t op, uint8_t width, uint16_t *id, uint32_t size)
+{
+    emad_op o;
+    int err;
+
+    o.reg_id = SX_REG_ID_PTAR;
+    o.method = SX_EMAD_METHOD_WRITE;
+    o.payload.assign(sizeof(sx_ptar_reg), 0);
+
+    sx_ptar_reg *reg = reinterpret_cast<sx_ptar_reg *>(o.payload.data());
+    reg->op = op;
+    reg->key_width = width;
+    reg->region = htobe16(*id);
+    reg->size = htobe32(size);
+
+    err = emad_.access(o);
+    stats_.writes++;
+    if (err)
+        return acl_errno(o);
+    *id = be16toh(reg->region);
+    return 0;
+}
+
+/* The ACL's regions in one PACL write: where lookups switch over */
+int acl_table::bind(const uint16_t *ids, const bool *live)
+{
+    emad_op o;
+    int err;
+
+    o.reg_id = SX_REG_ID_PACL;
+    o.method = SX_EMAD_METHOD_WRITE;
+    o.payload.assign(sizeof(sx_pacl_reg), 0);
+
+    sx_pacl_reg *reg = reinterpret_cast<sx_pacl_reg *>(o.payload.data());
+    reg->acl_id = htobe16(acl_id_);
+    for (unsigned w = 0; w < 3; w++) {
+        if (live[w])
+            reg->region[reg->num_regions++] = htobe16(ids[w]);
+    }
+
+    err = emad_.access(o);
+    stats_.writes++;
+    return err ? acl_errno(o) : 0;
+}
+
+uint32_t acl_table::layout_size(size_t rules) const
+{
+    uint64_t size = rules + rules * gap_pct_ / 100 + 1;
+
+    return std::min<uint64_t>(std::max<uint64_t>(size, SX_ACL_MIN_REGION), UINT32_MAX);
+}
+
+/* Lay @handles, sorted, out evenly over the empty region @r */
+void acl_table::spread(region &r, const std::vector<uint64_t> &handles,
+                       const std::unordered_map<uint64_t, rule_state> &rules)
+{
+    uint64_t size = r.slots.size(), n = handles.size();
+
+    for (uint64_t i = 0; i < n; i++) {
+        uint32_t off = static_cast<uint32_t>((2 * i + 1) * size / (2 * n));
+        const acl_rule &rule = rules.at(handles[i]).rule;
+
+        r.slots[off] = handles[i];
+        r.order[{ rule.priority, handles[i] }] = off;
+        put_write(r.id, off, &rule);
+    }
+}
+
+/* Rebuild region @w with room for @extra more rules, into a shadow */
+int acl_table::relayout(unsigned w, size_t extra)
+{
+    region &old = regions_[w];
+    region shadow;
+    uint32_t size = layout_size(old.order.size() + extra);
+    uint16_t ids[3];
+    bool live[3];
+    int err;
+
+    err = region_op(SX_PTAR_OP_ALLOC, acl_widths[w], &shadow.id, size);
+    if (err == -ENOSPC && old.live) {
+        /* No room for both: grow in place, the new entries free at the end */
+        err = region_op(SX_PTAR_OP_RESIZE, acl_widths[w], &old.id, size);
+        if (!err) {
+            old.slots.resize(size, 0);
+            stats_.relayouts++;
+        }
+        return err;
+    }
+    if (err)
+        return err;
+
+    std::vector<uint64_t> handles;
+    handles.reserve(old.order.size());
+    for (const auto &o : old.order)
+        handles.push_back(o.first.second);
+    shadow.live = true;
+    shadow.slots.assign(size, 0);
+    spread(shadow, handles, rules_);
+
+    for (unsigned i = 0; i < 3; i++) {
+        ids[i] = i == w ? shadow.id : regions_[i].id;
+        live[i] = i == w || regions_[i].live;
+    }
+    err = flush();
+    if (!err)
+        err = bind(ids, live);
+    if (err) {
+        region_op(SX_PTAR_OP_FREE, acl_widths[w], &shadow.id, 0);
+        return err;
+    }
+
+    if (old.live)
+        err = region_op(SX_PTAR_OP_FREE, acl_widths[w], &old.id, 0);
+    regions_[w] = std::move(shadow);
+    stats_.relayouts++;
+    return err;
+}
+
+/*
+ * No free entry between offsets @lo and @hi (-1 and the size for none):
+ * queue the writes moving the rules up to the nearest free entry one
+ * place towards it, the one next to it first, freeing @pos for the new
+ * rule. The region's software state is left alone; apply_shift() moves
+ * the rules there too once the writes went through.
+ */
+void acl_table::make_room(region &r, int64_t lo, int64_t hi, uint32_t *pos, slot_shift *shift)
+{
+    int64_t size = r.slots.size();
+
+    for (int64_t d = 1;; d++) {
+        if (lo - d >= 0 && !r.slots[lo - d]) {
+            for (int64_t k = lo - d + 1; k <= lo; k++)
+                put_write(r.id, k - 1, &rules_[r.slots[k]].rule);
+            *shift = { lo - d + 1, lo, -1 };
+            *pos = lo;
+            return;
+        }
+        if (hi + d < size && !r.slots[hi + d]) {
+            for (int64_t k = hi + d - 1; k >= hi; k--)
+                put_write(r.id, k + 1, &rules_[r.slots[k]].rule);
+            *shift = { hi, hi + d - 1, 1 };
+            *pos = hi;
+            return;
+        }
+    }
+}
+
+/* Record in @r the moves make_room() wrote; the entry they free stays set */
+void acl_table::apply_shift(region &r, const slot_shift &shift)
+{
+    int64_t n = shift.last - shift.first + 1;
+
+    for (int64_t i = 0; i < n; i++) {
+        int64_t k = shift.step < 0 ? shift.first + i : shift.last - i;
+        uint64_t h = r.slots[k];
+
+        r.slots[k + shift.step] = h;
+        r.order[{ rules_[h].rule.priority, h }] = k + shift.step;
+    }
+    stats_.moves += n;
+}
+
+int acl_table::insert(const acl_rule &rule, uint64_t *handle)
+{
+    unsigned w = width_index(rule.key_len);
+    region &r = regions_[w];
+    slot_shift shift;
+    uint64_t h;
+    uint32_t pos;
+    int err;
+
+    if (!rule_valid(rule))
+        return -EINVAL;
+    if (!r.live || r.order.size() == r.slots.size()) {
+        err = relayout(w, 1);
+        if (err)
+            return err;
+    }
+
+    /* After every rule of its priority: handles only grow */
+    auto next = r.order.upper_bound({ rule.priority, UINT64_MAX });
+    int64_t hi = next == r.order.end() ? r.slots.size() : next->second;
+    int64_t lo = next == r.order.begin() ? -1 : static_cast<int64_t>(std::prev(next)->second);
+
+    if (hi - lo > 1)
+        pos = lo + (hi - lo) / 2;
+    else
+        make_room(r, lo, hi, &pos, &shift);
+
+    h = next_handle_++;
+    put_write(r.id, pos, &rule);
+    err = flush();
+    if (err)
+        return err;
+
+    apply_shift(r, shift);
+    rules_[h] = { rule, static_cast<uint8_t>(w) };
+    r.slots[pos] = h;
+    r.order[{ rule.priority, h }] = pos;
+    stats_.inserts++;
+    *handle = h;
+    return 0;
+}
+
+int acl_table::remove(uint64_t handle)
+{
+    auto it = rules_.find(handle);
+    int err;
+
+    if (it == rules_.end())
+        return -ENOENT;
+
+    region &r = regions_[it->second.width];
+    auto o = r.order.find({ it->second.rule.priority, handle });
+    uint32_t off = o->second;
+
+    put_write(r.id, off, nullptr);
+    err = flush();
+    if (err)
+        return err;
+
+    r.slots[off] = 0;
+    r.order.erase(o);
+    rules_.erase(it);
+    stats_.removes++;
+    return 0;
+}
+
+int acl_table::replace(const acl_rule *rules, size_t n, uint64_t *handles)
+{
+    std::unordered_map<uint64_t, rule_state> next_rules;
+    std::vector<uint64_t> by_width[3];
+    region fresh[3];
+    uint16_t ids[3];
+    bool live[3];
+    int err = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        if (!rule_valid(rules[i]))
+            return -EINVAL;
+    }
+
+    next_rules.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        unsigned w = width_index(rules[i].key_len);
+        uint64_t h = next_handle_++;
+
+        next_rules[h] = { rules[i], static_cast<uint8_t>(w) };
+        by_width[w].push_back(h);
+        if (handles)
+            handles[i] = h;
+    }
+
+    for (unsigned w = 0; w < 3 && !err; w++) {
+        std::vector<uint64_t> &hs = by_width[w];
+
+        if (hs.empty())
+            continue;
+        std::sort(hs.begin(), hs.end(), [&next_rules](uint64_t a, uint64_t b) {
+            uint32_t pa = next_rules[a].rule.priority, pb = next_rules[b].rule.priority;
+
+            return pa != pb ? pa < pb : a < b;
+        });
+
+        uint32_t size = layout_size(hs.size());
+        err = region_op(SX_PTAR_OP_ALLOC, acl_widths[w], &fresh[w].id, size);
+        if (err)
+            break;
+        fresh[w].live = true;
+        fresh[w].slots.assign(size, 0);
+        spread(fresh[w], hs, next_rules);
+    }
+
+    for (unsigned w = 0; w < 3; w++) {
+        ids[w] = fresh[w].id;
+        live[w] = fresh[w].live;
+    }
+    if (!err)
+        err = flush();
+    else
+        nops_ = 0;
+    if (!err)
+        err = bind(ids, live);
+    if (err) {
+        for (unsigned w = 0; w < 3; w++) {
+            if (fresh[w].live)
+                region_op(SX_PTAR_OP_FREE, acl_widths[w], &fresh[w].id, 0);
+        }
+        return err;
+    }
+
+    /* The new rules are live; the old regions only hold space now */
+    for (unsigned w = 0; w < 3; w++) {
+        if (regions_[w].live) {
+            int ret = region_op(SX_PTAR_OP_FREE, acl_widths[w], &regions_[w].id, 0);
+
+            err = err ? err : ret;
+        }
+        regions_[w] = std::move(fresh[w]);
+    }
+    rules_ = std::move(next_rules);
+    stats_.replaces++;
+    return err;
+}
+
+void acl_table::save(acl_layout *layout, std::vector<acl_placement> *rules) const
+{
+    rules->clear();
+    rules->reserve(rules_.size());
+    for (unsigned w = 0; w < 3; w++) {
+        const region &r = regions_[w];
+
+        layout->region[w] = r.live ? r.id : 0;
+        layout->size[w] = r.live ? static_cast<uint32_t>(r.slots.size()) : 0;
+        for (const auto &o : r.order)
+            rules->push_back({ o.first.second, o.second, rules_.at(o.first.second).rule });
+    }
+}
+
+int acl_table::restore(const acl_layout &layout, const acl_placement *rules, size_t n)
+{
+    region next[3];
+    std::unordered_map<uint64_t, rule_state> next_rules;
+    uint64_t last = 0;
+
+    if (!rules_.empty() || regions_[0].live || regions_[1].live || regions_[2].live)
+        return -EBUSY;
+
+    for (unsigned w = 0; w < 3; w++) {
+        if (!layout.size[w])
+            continue;
+        next[w].live = true;
+        next[w].id = layout.region[w];
+        next[w].slots.assign(layout.size[w], 0);
+    }
+    next_rules.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        const acl_placement &p = rules[i];
+        unsigned w = width_index(p.rule.key_len);
+        region &r = next[w];
+
+        if (!rule_valid(p.rule) || !p.handle || !r.live || p.offset >= r.slots.size() ||
+            r.slots[p.offset] || next_rules.count(p.handle))
+            return -EINVAL;
+        next_rules[p.handle] = { p.rule, static_cast<uint8_t>(w) };
+        r.slots[p.offset] = p.handle;
+        r.order[{ p.rule.priority, p.handle }] = p.offset;
+        last = std::max(last, p.handle);
+    }
+
+    /* Offsets must follow (priority, handle), as insert() relies on */
+    for (const region &r : next) {
+        int64_t prev = -1;
+
+        for (const auto &o : r.order) {
+            if (static_cast<int64_t>(o.second) <= prev)
+                return -EINVAL;
+            prev = o.second;
+        }
+    }
+
+    for (unsigned w = 0; w < 3; w++)
+        regions_[w] = std::move(next[w]);
+    rules_ = std::move(next_rules);
+    next_handle_ = std::max(next_handle_, last + 1);
+    return 0;
+}
+
+void acl_table::get_stats(acl_stats *out) const
+{
+    *out = stats_;
+    out->rules = rules_.size();
+    out->tcam_entries = 0;
+    for (const region &r : regions_) {
+        if (r.live)
+            out->tcam_entries += r.slots.size();
+    }
+}
+
+} /* namespace sx */
@@ -0,0 +1,539 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <endian.h>
+
+#include "sx/bfd.h"
+#include "sx/compiler.h"
+
+namespace sx {
+
+static bool before(uint64_t a, uint64_t b)
+{
+    return static_cast<int64_t>(a - b) < 0;
+}
+
+static uint64_t nbr_key(uint16_t port, uint32_t ip)
+{
+    return static_cast<uint64_t>(port) << 32 | ip;
+}
+
+static void put16(uint8_t *p, uint16_t v)
+{
+    v = htobe16(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    v = htobe32(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+    uint16_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return be16toh(v);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return be32toh(v);
+}
+
+bfd::bfd(dev &d, unsigned sdq, unsigned max_sessions, size_t max_events)
+    : dev_(d), sdq_(sdq), max_sessions_(std::min(max_sessions, 0xffffu)),
+      max_events_(max_events), sessions_(new session[max_sessions_])
+{
+    for (unsigned i = max_sessions_; i > 0; i--)
+        free_.push_back(i - 1);
+}
+
+bfd::~bfd()
+{
+    stop();
+}
+
+int bfd::start()
+{
+    int err;
+
+    if (started_)
+        return -EBUSY;
+    err = dev_.add_listener(SX_TRAP_ID_IPV4_BFD, [this](const rx_info &info, pkt_buf *buf) {
+        receive(info, buf);
+    });
+    if (err)
+        return err;
+
+    stop_ = false;
+    thread_ = std::thread(&bfd::thread_fn, this);
+    started_ = true;
+    return 0;
+}
+
+void bfd::stop()
+{
+    if (!started_)
+        return;
+    dev_.del_listener(SX_TRAP_ID_IPV4_BFD);
+    {
+        std::lock_guard<std::mutex> guard(timer_lock_);
+        stop_ = true;
+    }
+    timer_wq_.notify_all();
+    thread_.join();
+    started_ = false;
+}
+
+/* The whole frame; only the control packet changes after this */
+void bfd::build(session &s)
+{
+    uint8_t *f = s.tpl, *ip = f + 14, *udp = ip + 20;
+    uint32_t sum = 0;
+
+    memset(f, 0, sizeof(s.tpl));
+    memcpy(f, s.cfg.dst_mac, 6);
+    memcpy(f + 6, s.cfg.src_mac, 6);
+    put16(f + 12, 0x0800);
+
+    ip[0] = 0x45;
+    ip[1] = 0xc0;                       /* CS6, network control */
+    put16(ip + 2, 20 + 8 + SX_BFD_CTL_LEN);
+    put16(ip + 6, 0x4000);              /* DF */
+    ip[8] = 255;                        /* GTSM, RFC 5881 */
+    ip[9] = 17;
+    put32(ip + 12, s.cfg.src_ip);
+    put32(ip + 16, s.cfg.dst_ip);
+    for (unsigned i = 0; i < 20; i += 2)
+        sum += get16(ip + i);
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    put16(ip + 10, ~sum & 0xffff);
+
+    /* A source port per session; no UDP checksum over IPv4 */
+    put16(udp, SX_BFD_SRC_PORT_BASE + (s.local_disc & 0x3fff));
+    put16(udp + 2, SX_BFD_UDP_PORT);
+    put16(udp + 4, 8 + SX_BFD_CTL_LEN);
+
+    rewrite(s);
+}
+
+void bfd::rewrite(session &s)
+{
+    uint8_t *c = s.tpl + SX_BFD_CTL_OFF;
+    uint64_t tx_us = s.cfg.tx_us;
+
+    /* Not Up, a session advertises the rate it sends at */
+    if (s.state != SX_BFD_STATE_UP)
+        tx_us = std::max(tx_us, slow_tx_ns_ / 1000);
+
+    c[0] = SX_BFD_VERSION << 5 | s.diag;
+    c[1] = s.state << 6;
+    c[2] = s.cfg.detect_mult;
+    c[3] = SX_BFD_CTL_LEN;
+    put32(c + 4, s.local_disc);
+    put32(c + 8, s.remote_disc);
+    put32(c + 12, static_cast<uint32_t>(tx_us));
+    put32(c + 16, s.cfg.rx_us);
+    put32(c + 20, 0);                   /* no echo */
+}
+
+uint64_t bfd::tx_interval(const session &s) const
+{
+    uint64_t ns = std::max<uint64_t>(s.cfg.tx_us * 1000ull, s.remote_rx_ns);
+
+    return s.state == SX_BFD_STATE_UP ? ns : std::max(ns, slow_tx_ns_);
+}
+
+/* Called with the session locked; the event goes out after unlocking */
+bfd_event bfd::change(session &s, uint32_t id, uint8_t state, uint8_t diag, uint64_t now)
+{
+    bfd_event ev = { id, state, s.state, diag, 0, now };
+
+    s.state = state;
+    s.diag = diag;
+    if (state < SX_BFD_STATE_INIT)
+        s.remote_disc = 0;
+    rewrite(s);
+    return ev;
+}
+
+void bfd::notify(const bfd_event &ev)
+{
+    state_changes_.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> guard(ev_lock_);
+
+        if (events_.size() >= max_events_) {
+            events_dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        events_.push_back(ev);
+    }
+    ev_wq_.notify_one();
+}
+
+void bfd::arm(uint32_t id, uint32_t gen, timer_kind kind, uint64_t due)
+{
+    bool first;
+    {
+        std::lock_guard<std::mutex> guard(timer_lock_);
+
+        first = timers_.empty() || before(due, timers_.top().due_ns);
+        timers_.push({ due, id, gen, kind });
+    }
+    if (first)
+        timer_wq_.notify_one();
+}
+
+int bfd::add_session(const bfd_session_cfg &cfg, uint32_t *id)
+{
+    uint32_t tx_gen;
+
+    if (cfg.port >= dev_.caps().num_ports || !cfg.tx_us || !cfg.rx_us || !cfg.detect_mult)
+        return -EINVAL;
+    {
+        std::lock_guard<std::mutex> guard(cfg_lock_);
+        uint64_t key = nbr_key(cfg.port, cfg.dst_ip);
+
+        if (by_nbr_.count(key))
+            return -EEXIST;
+        if (free_.empty())
+            return -ENOSPC;
+        *id = free_.back();
+        free_.pop_back();
+        by_nbr_[key] = *id;
+
+        session &s = sessions_[*id];
+        s.lock.lock();
+        s.live = true;
+        tx_gen = ++s.tx_gen;
+        s.detect_gen++;
+        s.local_disc = (++s.gen & 0xffff) << 16 | (*id + 1);
+        s.remote_disc = 0;
+        s.state = SX_BFD_STATE_DOWN;
+        s.diag = SX_BFD_DIAG_NONE;
+        s.detect_armed = false;
+        s.remote_tx_ns = 0;
+        s.remote_rx_ns = 0;
+        s.cfg = cfg;
+        build(s);
+        s.lock.unlock();
+    }
+    arm(*id, tx_gen, TIMER_TX, now_ns());
+    return 0;
+}
+
+int bfd::del_session(uint32_t id)
+{
+    std::lock_guard<std::mutex> guard(cfg_lock_);
+
+    if (id >= max_sessions_)
+        return -EINVAL;
+
+    session &s = sessions_[id];
+    s.lock.lock();
+    if (!s.live) {
+        s.lock.unlock();
+        return -ENOENT;
+    }
+    s.live = false;
+    by_nbr_.erase(nbr_key(s.cfg.port, s.cfg.dst_ip));
+    s.lock.unlock();
+
+    /* Its timers find it gone and lapse */
+    free_.push_back(id);
+    return 0;
+}
+
+int bfd::get_state(uint32_t id, uint8_t *state)
+{
+    int err = 0;
+
+    if (id >= max_sessions_)
+        return -EINVAL;
+
+    session &s = sessions_[id];
+    s.lock.lock();
+    if (s.live)
+        *state = s.state;
+    else
+        err = -ENOENT;
+    s.lock.unlock();
+    return err;
+}
+
+/* RFC 5880 6.8.6, in the trap path */
+void bfd::receive(const rx_info &info, pkt_buf *buf)
+{
+    const uint8_t *f = buf->data, *ip = f + 14, *c = f + SX_BFD_CTL_OFF;
+    uint32_t your_disc, id;
+    uint8_t state, final[SX_BFD_FRAME_LEN];
+    bool send_final = false, arm_tx = false, arm_detect = false, changed = false;
+    uint32_t gen = 0, tx_gen = 0;
+    uint64_t now = now_ns(), detect_due = 0;
+    bfd_event ev = {};
+
+    /* No authentication configured: RFC 5880 6.8.6 discards A bit packets */
+    rx_packets_.fetch_add(1, std::memory_order_relaxed);
+    if (buf->len < SX_BFD_FRAME_LEN || get16(f + 12) != 0x0800 || ip[0] != 0x45 ||
+        ip[8] != 255 || ip[9] != 17 || get16(ip + 22) != SX_BFD_UDP_PORT ||
+        c[0] >> 5 != SX_BFD_VERSION || c[3] < SX_BFD_CTL_LEN ||
+        c[3] > buf->len - SX_BFD_CTL_OFF || !c[2] ||
+        (c[1] & (SX_BFD_FLAG_AUTH | SX_BFD_FLAG_MULTIPOINT)) || !get32(c + 4))
+        goto invalid;
+
+    state = c[1] >> 6;
+    your_disc = get32(c + 8);
+    if (your_disc) {
+        id = (your_disc & 0xffff) - 1;
+    } else {
+        if (state != SX_BFD_STATE_DOWN && state != SX_BFD_STATE_ADMIN_DOWN)
+            goto invalid;
+
+        std::lock_guard<std::mutex> guard(cfg_lock_);
+        auto it = by_nbr_.find(nbr_key(info.sys_port, get32(ip + 12)));
+        if (it == by_nbr_.end())
+            goto invalid;
+        id = it->second;
+    }
+    if (id >= max_sessions_)
+        goto invalid;
+
+    {
+        session &s = sessions_[id];
+
+        s.lock.lock();
+        if (!s.live || (your_disc && your_disc != s.local_disc) || s.cfg.port != info.sys_port) {
+            s.lock.unlock();
+            goto invalid;
+        }
+        if (s.remote_disc != get32(c + 4)) {
+            s.remote_disc = get32(c + 4);
+            rewrite(s);
+        }
+        s.remote_tx_ns = get32(c + 12) * 1000ull;
+        s.remote_rx_ns = get32(c + 16) * 1000ull;
+        s.detect_ns = c[2] * std::max<uint64_t>(s.cfg.rx_us * 1000ull, s.remote_tx_ns);
+        s.last_rx_ns = now;
+
+        if (state == SX_BFD_STATE_ADMIN_DOWN) {
+            if (s.state != SX_BFD_STATE_DOWN) {
+                ev = change(s, id, SX_BFD_STATE_DOWN, SX_BFD_DIAG_NBR_DOWN, now);
+                changed = true;
+            }
+        } else if (s.state == SX_BFD_STATE_DOWN) {
+            if (state == SX_BFD_STATE_DOWN || state == SX_BFD_STATE_INIT) {
+                ev = change(s, id, state == SX_BFD_STATE_DOWN ? SX_BFD_STATE_INIT : SX_BFD_STATE_UP,
+                            SX_BFD_DIAG_NONE, now);
+                changed = true;
+            }
+        } else if (s.state == SX_BFD_STATE_INIT) {
+            if (state == SX_BFD_STATE_INIT || state == SX_BFD_STATE_UP) {
+                ev = change(s, id, SX_BFD_STATE_UP, SX_BFD_DIAG_NONE, now);
+                changed = true;
+            }
+        } else if (state == SX_BFD_STATE_DOWN) {
+            ev = change(s, id, SX_BFD_STATE_DOWN, SX_BFD_DIAG_NBR_DOWN, now);
+            changed = true;
+        }
+
+        /* A change goes out now, not an interval later */
+        if (changed) {
+            arm_tx = true;
+            tx_gen = ++s.tx_gen;
+        }
+        /* Armed lazily: refreshed by last_rx_ns, re-armed only to fire sooner */
+        detect_due = now + s.detect_ns;
+        if (s.state >= SX_BFD_STATE_INIT && (!s.detect_armed || before(detect_due, s.detect_due))) {
+            s.detect_armed = true;
+            s.detect_due = detect_due;
+            gen = ++s.detect_gen;
+            arm_detect = true;
+        }
+        if (c[1] & SX_BFD_FLAG_POLL) {
+            memcpy(final, s.tpl, sizeof(final));
+            final[SX_BFD_CTL_OFF + 1] |= SX_BFD_FLAG_FINAL;
+            send_final = true;
+        }
+        s.lock.unlock();
+    }
+    pkt_buf_free(buf);
+
+    if (changed)
+        notify(ev);
+    if (arm_tx)
+        arm(id, tx_gen, TIMER_TX, now);
+    if (arm_detect)
+        arm(id, gen, TIMER_DETECT, detect_due);
+    if (send_final) {
+        if (dev_.send(sdq_, info.sys_port, final, sizeof(final)))
+            tx_errors_.fetch_add(1, std::memory_order_relaxed);
+        else
+            tx_packets_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return;
+
+invalid:
+    rx_invalid_.fetch_add(1, std::memory_order_relaxed);
+    pkt_buf_free(buf);
+}
+
+/* Sends the session's template; false if the SDQ was full */
+bool bfd::transmit(const timer &t, uint64_t now, std::vector<timer> &next)
+{
+    session &s = sessions_[t.id];
+    uint8_t frame[SX_BFD_FRAME_LEN];
+    uint64_t ival;
+    uint16_t port;
+    int err;
+
+    s.lock.lock();
+    if (!s.live || s.tx_gen != t.gen) {
+        s.lock.unlock();
+        return true;
+    }
+    memcpy(frame, s.tpl, sizeof(frame));
+    port = s.cfg.port;
+    ival = tx_interval(s);
+
+    /* 75-100% of the interval, 75-90% with a multiplier of one */
+    rng_ ^= rng_ << 13;
+    rng_ ^= rng_ >> 7;
+    rng_ ^= rng_ << 17;
+    if (s.cfg.detect_mult == 1)
+        ival -= ival * (10 + rng_ % 16) / 100;
+    else
+        ival -= ival * (rng_ % 26) / 100;
+    s.lock.unlock();
+
+    next.push_back({ now + ival, t.id, t.gen, TIMER_TX });
+    err = dev_.send(sdq_, port, frame, sizeof(frame), SX_TX_CTL_TO_PORT, SX_SEND_MORE);
+    if (err) {
+        tx_errors_.fetch_add(1, std::memory_order_relaxed);
+        return err != -EAGAIN;
+    }
+    tx_packets_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void bfd::expire(const timer &t, uint64_t now, std::vector<timer> &next)
+{
+    session &s = sessions_[t.id];
+    bool changed = false;
+    uint32_t tx_gen = 0;
+    bfd_event ev = {};
+
+    s.lock.lock();
+    if (!s.live || s.detect_gen != t.gen) {
+        s.lock.unlock();
+        return;
+    }
+    if (s.state < SX_BFD_STATE_INIT) {
+        s.detect_armed = false;
+    } else if (before(now, s.last_rx_ns + s.detect_ns)) {
+        /* Heard from since: sleep until the new deadline */
+        s.detect_due = s.last_rx_ns + s.detect_ns;
+        next.push_back({ s.detect_due, t.id, t.gen, TIMER_DETECT });
+    } else {
+        ev = change(s, t.id, SX_BFD_STATE_DOWN, SX_BFD_DIAG_EXPIRED, now);
+        s.detect_armed = false;
+        tx_gen = ++s.tx_gen;
+        changed = true;
+    }
+    s.lock.unlock();
+
+    if (changed) {
+        notify(ev);
+        next.push_back({ now, t.id, tx_gen, TIMER_TX });
+    }
+}
+
+void bfd::thread_fn()
+{
+    std::unique_lock<std::mutex> guard(timer_lock_);
+    std::vector<timer> due, next;
+
+    while (!stop_) {
+        uint64_t now = now_ns();
+
+        if (timers_.empty()) {
+            timer_wq_.wait(guard);
+            continue;
+        }
+        if (before(now + SX_BFD_TIMER_SLACK_NS, timers_.top().due_ns)) {
+            timer_wq_.wait_until(guard, std::chrono::steady_clock::time_point(
+                                            std::chrono::nanoseconds(timers_.top().due_ns)));
+            continue;
+        }
+        due.clear();
+        while (!timers_.empty() && !before(now + SX_BFD_TIMER_SLACK_NS, timers_.top().due_ns)) {
+            due.push_back(timers_.top());
+            timers_.pop();
+        }
+        guard.unlock();
+
+        uint64_t c0 = thread_cpu_ns(), late = 0;
+        next.clear();
+        for (const timer &t : due) {
+            if (before(t.due_ns, now))
+                late = std::max(late, now - t.due_ns);
+            if (t.kind == TIMER_DETECT) {
+                expire(t, now, next);
+            } else if (!transmit(t, now, next)) {
+                /* SDQ full: hand over what is pending and try once more */
+                dev_.flush_sdq(sdq_);
+                next.pop_back();
+                transmit(t, now, next);
+            }
+        }
+        dev_.flush_sdq(sdq_);
+        if (late > timer_late_max_ns_.load(std::memory_order_relaxed))
+            timer_late_max_ns_.store(late, std::memory_order_relaxed);
+        cpu_ns_.fetch_add(thread_cpu_ns() - c0, std::memory_order_relaxed);
+
+        guard.lock();
+        for (const timer &t : next)
+            timers_.push(t);
+    }
+}
+
+ssize_t bfd::read(bfd_event *ev, size_t max, bool nonblock)
+{
+    std::unique_lock<std::mutex> guard(ev_lock_);
+    size_t n = 0;
+
+    while (events_.empty()) {
+        if (nonblock)
+            return -EAGAIN;
+        ev_wq_.wait(guard);
+    }
+    while (n < max && !events_.empty()) {
+        ev[n++] = events_.front();
+        events_.pop_front();
+    }
+    return n;
+}
+
+void bfd::get_stats(bfd_stats *out)
+{
+    out->tx_packets = tx_packets_.load(std::memory_order_relaxed);
+    out->tx_errors = tx_errors_.load(std::memory_order_relaxed);
+    out->rx_packets = rx_packets_.load(std::memory_order_relaxed);
+    out->rx_invalid = rx_invalid_.load(std::memory_order_relaxed);
+    out->state_changes = state_changes_.load(std::memory_order_relaxed);
+    out->events_dropped = events_dropped_.load(std::memory_order_relaxed);
+    out->timer_late_max_ns = timer_late_max_ns_.load(std::memory_order_relaxed);
+    out->cpu_ns = cpu_ns_.load(std::memory_order_relaxed);
+}
+
+} /* namespace sx */
@@ -0,0 +1,80 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#include <cerrno>
+#include <cstring>
+
+#include "sx/cdev.h"
+
+namespace sx {
+
+cdev_file::cdev_file(dev &d, size_t max_queued) : dev_(d), max_queued_(max_queued)
+{
+}
+
+cdev_file::~cdev_file()
+{
+    for (uint16_t trap_id : traps_)
+        dev_.del_listener(trap_id);
+    for (entry &e : queue_)
+        pkt_buf_free(e.buf);
+}
+
+int cdev_file::add_trap(uint16_t trap_id)
+{
+    int err = dev_.add_listener(trap_id, [this](const rx_info &info, pkt_buf *buf) {
+        enqueue(info, buf);
+    });
+
+    if (err)
+        return err;
+    traps_.push_back(trap_id);
+    return 0;
+}
+
+void cdev_file::enqueue(const rx_info &info, pkt_buf *buf)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+
+        if (queue_.size() >= max_queued_) {
+            dropped_++;
+            pkt_buf_free(buf);
+            return;
+        }
+        queue_.push_back({info, buf});
+    }
+    wq_.notify_one();
+}
+
+ssize_t cdev_file::read(void *buf, size_t count, bool nonblock)
+{
+    std::unique_lock<std::mutex> guard(lock_);
+    entry e;
+
+    if (queue_.empty()) {
+        if (nonblock)
+            return -EAGAIN;
+        wq_.wait(guard, [this] { return !queue_.empty(); });
+    }
+
+    e = queue_.front();
+    if (count < sizeof(ku_read) + e.buf->len)
+        return -ENOBUFS;
+    queue_.pop_front();
+    guard.unlock();
+
+    ku_read hdr;
+    hdr.trap_id = e.info.trap_id;
+    hdr.sys_port = e.info.sys_port;
+    hdr.length = e.buf->len;
+    hdr.timestamp = e.info.timestamp;
+    memcpy(buf, &hdr, sizeof(hdr));
+    memcpy(static_cast<uint8_t *>(buf) + sizeof(hdr), e.buf->data, e.buf->len);
+
+    ssize_t ret = sizeof(hdr) + e.buf->len;
+    pkt_buf_free(e.buf);
+    dev_.trace_dequeue(e.info);
+    return ret;
+}
+
+} /* namespace sx */
@@ -0,0 +1,289 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#include <cerrno>
+#include <endian.h>
+
+#include "sx/compiler.h"
+#include "sx/counter_pool.h"
+
+namespace sx {
+
+counter_pool::counter_pool(emad &e, uint32_t size)
+    : emad_(e), nbanks_(size / SX_CNT_BANK_SIZE), banks_(new bank[nbanks_])
+{
+}
+
+counter_pool::~counter_pool()
+{
+    for (uint32_t b : active_) {
+        dma_free_coherent(&banks_[b].buf[0]);
+        dma_free_coherent(&banks_[b].buf[1]);
+    }
+}
+
+int counter_pool::clear(uint32_t index, uint32_t n)
+{
+    emad_op o;
+
+    o.reg_id = SX_REG_ID_MGPC;
+    o.method = SX_EMAD_METHOD_WRITE;
+    o.payload.assign(sizeof(sx_mgpc_reg), 0);
+
+    sx_mgpc_reg *reg = reinterpret_cast<sx_mgpc_reg *>(o.payload.data());
+    reg->op = SX_MGPC_OP_CLEAR;
+    reg->num = htobe16(n);
+    reg->index = htobe32(index);
+    return emad_.access(o);
+}
+
+/* Bank @b into use; @fresh clears it, else its counters count as dirty */
+int counter_pool::activate(uint32_t b, bool fresh)
+{
+    bank &k = banks_[b];
+    size_t len = SX_CNT_BANK_SIZE * sizeof(sx_flow_cnt);
+    int err;
+
+    err = dma_alloc_coherent(len, &k.buf[0]);
+    if (err)
+        return err;
+    err = dma_alloc_coherent(len, &k.buf[1]);
+    if (!err && fresh)
+        err = clear(b * SX_CNT_BANK_SIZE, SX_CNT_BANK_SIZE);
+    if (err) {
+        dma_free_coherent(&k.buf[0]);
+        if (k.buf[1].cpu)
+            dma_free_coherent(&k.buf[1]);
+        k.buf[0] = k.buf[1] = {};
+        return err;
+    }
+
+    k.alloc.reset(new kvd_alloc(b * SX_CNT_BANK_SIZE, SX_CNT_BANK_SIZE));
+    k.delta[0].assign(SX_CNT_BANK_SIZE, sx_flow_cnt());
+    k.delta[1].assign(SX_CNT_BANK_SIZE, sx_flow_cnt());
+    k.prev.assign(SX_CNT_BANK_SIZE, sx_flow_cnt());
+    k.size.assign(SX_CNT_BANK_SIZE, 0);
+    k.dirty.assign(SX_CNT_BANK_SIZE, !fresh);
+    active_.push_back(b);
+    stats_.banks++;
+    k.active.store(true, std::memory_order_release);
+    return 0;
+}
+
+int counter_pool::alloc(uint32_t n, uint32_t *index)
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    uint32_t b = nbanks_;
+    int err;
+
+    if (!n || n > SX_KVD_CHUNK)
+        return -EINVAL;
+
+    for (uint32_t a : active_) {
+        if (!banks_[a].alloc->alloc(n, 0, index)) {
+            b = a;
+            break;
+        }
+    }
+    if (b == nbanks_) {
+        /* All banks in use are full: take the lowest free one */
+        for (b = 0; b < nbanks_ && banks_[b].active.load(std::memory_order_relaxed); b++)
+            ;
+        if (b == nbanks_)
+            return -ENOSPC;
+        err = activate(b, true);
+        if (err)
+            return err;
+        err = banks_[b].alloc->alloc(n, 0, index);
+        if (err)
+            return err;
+    }
+
+    bank &k = banks_[b];
+    uint32_t off = *index - b * SX_CNT_BANK_SIZE;
+    bool dirty = false;
+
+    for (uint32_t i = off; i < off + n; i++)
+        dirty |= k.dirty[i];
+    if (dirty) {
+        err = clear(*index, n);
+        if (err) {
+            k.alloc->free(*index);
+            return err;
+        }
+    }
+    for (uint32_t i = off; i < off + n; i++) {
+        k.dirty[i] = false;
+        k.prev[i] = sx_flow_cnt();
+    }
+    k.size[off] = n;
+    stats_.counters += n;
+    return 0;
+}
+
+int counter_pool::restore(uint32_t index, uint32_t n)
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    uint32_t b = index / SX_CNT_BANK_SIZE, off = index % SX_CNT_BANK_SIZE;
+    int err;
+
+    if (!n || n > SX_KVD_CHUNK || b >= nbanks_)
+        return -EINVAL;
+    if (!banks_[b].active.load(std::memory_order_relaxed)) {
+        err = activate(b, false);
+        if (err)
+            return err;
+    }
+
+    bank &k = banks_[b];
+    err = k.alloc->reserve(index, n, 0);
+    if (err)
+        return err;
+    for (uint32_t i = off; i < off + n; i++) {
+        k.dirty[i] = false;
+        k.prev[i] = sx_flow_cnt();
+    }
+    k.size[off] = n;
+    stats_.counters += n;
+    return 0;
+}
+
+void counter_pool::free(uint32_t index)
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    uint32_t b = index / SX_CNT_BANK_SIZE, off = index % SX_CNT_BANK_SIZE;
+
+    if (b >= nbanks_ || !banks_[b].active.load(std::memory_order_relaxed) || !banks_[b].size[off])
+        return;
+
+    bank &k = banks_[b];
+    uint32_t n = k.size[off];
+
+    k.alloc->free(index);
+    for (uint32_t i = off; i < off + n; i++)
+        k.dirty[i] = true;
+    k.size[off] = 0;
+    stats_.counters -= n;
+}
+
+/* Read every bank in use into buffer @buf */
+int counter_pool::fill(unsigned buf)
+{
+    size_t n = 0;
+    int err;
+
+    ops_.resize(bulk_ ? active_.size() : active_.size() * SX_CNT_BANK_SIZE);
+    for (uint32_t b : active_) {
+        for (uint32_t i = 0; i < (bulk_ ? 1 : SX_CNT_BANK_SIZE); i++) {
+            emad_op &o = ops_[n++];
+
+            o.method = bulk_ ? SX_EMAD_METHOD_WRITE : SX_EMAD_METHOD_QUERY;
+            if (bulk_) {
+                o.reg_id = SX_REG_ID_MOCS;
+                o.payload.assign(sizeof(sx_mocs_reg), 0);
+
+                sx_mocs_reg *reg = reinterpret_cast<sx_mocs_reg *>(o.payload.data());
+                reg->base = htobe32(b * SX_CNT_BANK_SIZE);
+                reg->num = htobe32(SX_CNT_BANK_SIZE);
+                reg->dma_addr = htobe64(banks_[b].buf[buf].dma);
+            } else {
+                o.reg_id = SX_REG_ID_MGPC;
+                o.payload.assign(sizeof(sx_mgpc_reg), 0);
+
+                sx_mgpc_reg *reg = reinterpret_cast<sx_mgpc_reg *>(o.payload.data());
+                reg->index = htobe32(b * SX_CNT_BANK_SIZE + i);
+            }
+        }
+    }
+
+    err = emad_.transact(ops_.data(), n, window_);
+    if (err)
+        return err;
+    stats_.accesses += n;
+    for (size_t i = 0; i < n; i++) {
+        if (ops_[i].err)
+            return ops_[i].err;
+    }
+    if (bulk_)
+        return 0;
+
+    /* MGPC answers land where the DMA would have put them */
+    n = 0;
+    for (uint32_t b : active_) {
+        sx_flow_cnt *out = static_cast<sx_flow_cnt *>(banks_[b].buf[buf].cpu);
+
+        for (uint32_t i = 0; i < SX_CNT_BANK_SIZE; i++) {
+            const sx_mgpc_reg *reg = reinterpret_cast<const sx_mgpc_reg *>(ops_[n++].payload.data());
+
+            out[i].packets = be64toh(reg->packets);
+            out[i].bytes = be64toh(reg->bytes);
+        }
+    }
+    return 0;
+}
+
+int counter_pool::refresh()
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    uint64_t next = gen_.load(std::memory_order_relaxed) + 1, t0 = now_ns();
+    unsigned buf = next & 1;
+    int err;
+
+    /* Readers still on the buffer about to be overwritten will retry */
+    filling_.store(next, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    err = fill(buf);
+    if (err)
+        return err;
+
+    for (uint32_t b : active_) {
+        bank &k = banks_[b];
+        const sx_flow_cnt *val = static_cast<const sx_flow_cnt *>(k.buf[buf].cpu);
+        sx_flow_cnt *delta = k.delta[buf].data();
+
+        for (uint32_t i = 0; i < SX_CNT_BANK_SIZE; i++) {
+            delta[i].packets = val[i].packets - k.prev[i].packets;
+            delta[i].bytes = val[i].bytes - k.prev[i].bytes;
+            k.prev[i] = val[i];
+        }
+    }
+    gen_.store(next, std::memory_order_release);
+
+    uint64_t now = now_ns();
+    stats_.refreshes++;
+    stats_.refresh_ns = now - t0;
+    stats_.interval_ns = last_refresh_ ? now - last_refresh_ : 0;
+    last_refresh_ = now;
+    return 0;
+}
+
+int counter_pool::read(uint32_t index, sx_flow_cnt *value, sx_flow_cnt *delta)
+{
+    uint32_t b = index / SX_CNT_BANK_SIZE, off = index % SX_CNT_BANK_SIZE;
+
+    if (b >= nbanks_ || !banks_[b].active.load(std::memory_order_acquire))
+        return -ENOENT;
+
+    const bank &k = banks_[b];
+    for (;;) {
+        uint64_t g = gen_.load(std::memory_order_acquire);
+        unsigned buf = g & 1;
+
+        *value = static_cast<const sx_flow_cnt *>(k.buf[buf].cpu)[off];
+        *delta = k.delta[buf][off];
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (filling_.load(std::memory_order_relaxed) < g + 2)
+            return 0;
+        read_retries_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void counter_pool::get_stats(counter_pool_stats *out)
+{
+    std::lock_guard<std::mutex> guard(lock_);
+
+    *out = stats_;
+    out->read_retries = read_retries_.load(std::memory_order_relaxed);
+}
+
+} /* namespace sx */
@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#include <cerrno>
+
+#include "sx/cq.h"
+#include "sx/regs.h"
+
+namespace sx {
+
+int cq::create(unsigned log_size, unsigned vector)
+{
+    size_t nent = 1u << log_size;
+    int err;
+
+    if (ring_)
+        return -EBUSY;
+    if (log_size > 16)
+        return -EINVAL;
+
+    err = dma_alloc_coherent(nent * sizeof(sx_cqe), &mem_);
+    if (err)
+        return err;
+
+    ring_ = static_cast<sx_cqe *>(mem_.cpu);
+    for (size_t i = 0; i < nent; i++)
+        ring_[i].owner = SX_CQE_OWNER;
+    ci_ = 0;
+    mask_ = nent - 1;
+    log_size_ = log_size;
+
+    bar_.write64(SX_REG_CQ(cqn_) + SX_Q_ADDR_LO, mem_.dma);
+    bar_.write32(SX_REG_CQ(cqn_) + SX_Q_LOG_SIZE, log_size);
+    bar_.write32(SX_REG_CQ(cqn_) + SX_Q_VECTOR, vector);
+    bar_.write32(SX_REG_CQ(cqn_) + SX_Q_CTRL, SX_Q_CTRL_EN);
+
+    uint32_t ctrl;
+    err = bar_.poll32(SX_REG_CQ(cqn_) + SX_Q_CTRL, [](uint32_t v) { return !(v & SX_Q_CTRL_BUSY); },
+                      &ctrl, SX_FW_POLL_US, SX_Q_INIT_TIMEOUT_US);
+    if (err)
+        destroy();
+    return err;
+}
+
+void cq::destroy()
+{
+    if (!ring_)
+        return;
+    bar_.write32(SX_REG_CQ(cqn_) + SX_Q_CTRL, 0);
+    dma_free_coherent(&mem_);
+    ring_ = nullptr;
+}
+
+} /* namespace sx */
@@ -0,0 +1,982 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <pthread.h>
+
+#include "sx/compiler.h"
+#include "sx/dev.h"
+
+namespace sx {
+
+dev::dev(bar &b) : bar_(b)
+{
+    for (unsigned g = 0; g < SX_MAX_TRAP_GROUP; g++) {
+        group_rdq_[g] = SX_HPKT_DISCARD;
+        group_rdq_count_[g] = 1;
+        group_budget_[g] = SX_NAPI_WEIGHT;
+    }
+}
+
+dev::~dev()
+{
+    destroy_queues();
+    for (auto &l : listeners_)
+        delete l.exchange(nullptr);
+}
+
+int dev::reset_fw(unsigned timeout_ms)
+{
+    uint32_t rev;
+
+    for (const auto &q : cqs_) {
+        if (q)
+            return -EBUSY;
+    }
+    bar_.write32(SX_REG_FW_RESET, 1);
+    return bar_.poll32(SX_REG_FW_REV, [](uint32_t v) { return v != 0; }, &rev, SX_FW_POLL_US,
+                       timeout_ms * 1000);
+}
+
+int dev::init()
+{
+    uint32_t dq_cap = bar_.read32(SX_REG_CAP_DQ);
+
+    caps_.fw_rev = bar_.read32(SX_REG_FW_REV);
+    caps_.hw_id = bar_.read32(SX_REG_HW_ID);
+    caps_.num_sdq = dq_cap & 0xffff;
+    caps_.num_rdq = dq_cap >> 16;
+    caps_.num_cq = bar_.read32(SX_REG_CAP_CQ);
+    caps_.num_ports = bar_.read32(SX_REG_CAP_PORTS);
+
+    if (!caps_.fw_rev)
+        return -ENODEV;
+    if (caps_.num_sdq > SX_MAX_SDQ || caps_.num_rdq > SX_MAX_RDQ ||
+        caps_.num_cq > SX_MAX_CQ || caps_.num_ports > SX_MAX_PORTS)
+        return -EINVAL;
+    return 0;
+}
+
+int dev::create_cq(unsigned cqn, unsigned log_size)
+{
+    int err;
+
+    if (cqn >= caps_.num_cq)
+        return -EINVAL;
+    if (cqs_[cqn])
+        return -EBUSY;
+
+    auto q = std::make_unique<cq>(bar_, cqn);
+    err = q->create(log_size, cqn);
+    if (err)
+        return err;
+    q->arm();
+    cqs_[cqn] = std::move(q);
+    return 0;
+}
+
+int dev::create_rdq(unsigned rdq, unsigned log_size, unsigned cqn, uint32_t buf_size,
+                    unsigned pool_bufs)
+{
+    int err;
+
+    if (rdq >= caps_.num_rdq || cqn >= caps_.num_cq || !cqs_[cqn])
+        return -EINVAL;
+    if (rdqs_[rdq])
+        return -EBUSY;
+    if (rdq_consumer_[rdq])
+        buf_size = rdq_consumer_[rdq]->buf_size();
+    if (!buf_size || buf_size > 0xffff)
+        return -EINVAL;
+
+    auto q = std::make_unique<dq>(bar_, dq_type::rdq, rdq);
+    err = q->create(log_size, cqn);
+    if (err)
+        return err;
+
+    rdq_buf_size_[rdq] = buf_size;
+    if (!rdq_consumer_[rdq] && pool_bufs) {
+        if (pool_bufs == SX_RDQ_POOL_AUTO)
+            pool_bufs = 2u << log_size;
+        rdq_pool_[rdq] = page_pool::create(pool_bufs, buf_size);
+        if (!rdq_pool_[rdq])
+            return -ENOMEM;
+    }
+    err = refill_rdq(*q);
+    if (err == -ENOBUFS) {
+        /* A consumer short of buffers: the CQ's polls post the rest */
+        cq_starved_[cqn] |= 1ull << rdq;
+        err = 0;
+    }
+    if (err) {
+        q.reset();
+        page_pool::destroy(rdq_pool_[rdq]);
+        rdq_pool_[rdq] = nullptr;
+        return err;
+    }
+    q->ring_doorbell();
+    rdqs_[rdq] = std::move(q);
+    if (rdq_pool_[rdq])
+        cq_rdqs_[cqn] |= 1ull << rdq;
+    return 0;
+}
+
+int dev::bind_rdq(unsigned rdq, rdq_consumer *c)
+{
+    if (rdq >= SX_MAX_RDQ)
+        return -EINVAL;
+    if (rdqs_[rdq])
+        return -EBUSY;
+    rdq_consumer_[rdq] = c;
+    return 0;
+}
+
+int dev::create_sdq(unsigned sdq, unsigned log_size, unsigned cqn)
+{
+    int err;
+
+    if (sdq >= caps_.num_sdq || cqn >= caps_.num_cq || !cqs_[cqn])
+        return -EINVAL;
+    if (sdqs_[sdq])
+        return -EBUSY;
+
+    auto q = std::make_unique<dq>(bar_, dq_type::sdq, sdq);
+    err = q->create(log_size, cqn);
+    if (err)
+        return err;
+    sdqs_[sdq] = std::move(q);
+    return 0;
+}
+
+void dev::destroy_queues()
+{
+    stop_napi_threads();
+    for (auto &q : rdqs_)
+        q.reset();
+    for (auto &p : rdq_pool_) {
+        page_pool::destroy(p);
+        p = nullptr;
+    }
+    memset(cq_rdqs_, 0, sizeof(cq_rdqs_));
+    for (auto &q : sdqs_)
+        q.reset();
+    for (auto &q : cqs_)
+        q.reset();
+}
+
+int dev::set_trap_group(uint16_t trap_id, uint8_t group)
+{
+    if (trap_id >= SX_MAX_TRAP_ID)
+        return -EINVAL;
+    if (group >= SX_MAX_TRAP_GROUP && group != SX_HPKT_DISCARD)
+        return -EINVAL;
+    bar_.write32(SX_REG_HPKT(trap_id), group);
+    return 0;
+}
+
+int dev::set_trap_group_rdq(uint8_t group, uint8_t rdq)
+{
+    return set_trap_group_rdqs(group, rdq, 1);
+}
+
+int dev::set_trap_group_rdqs(uint8_t group, uint8_t first, unsigned count)
+{
+    if (group >= SX_MAX_TRAP_GROUP || !count || first + count > caps_.num_rdq)
+        return -EINVAL;
+    for (unsigned rdq = first; rdq < first + count; rdq++) {
+        if (!rdqs_[rdq])
+            return -EINVAL;
+    }
+
+    /* Narrow the spread before moving its base, so no packet goes astray */
+    bar_.write32(SX_REG_HTGT(group) + SX_HTGT_RDQ_COUNT, 1);
+    bar_.write32(SX_REG_HTGT(group) + SX_HTGT_RDQ, first);
+    bar_.write32(SX_REG_HTGT(group) + SX_HTGT_RDQ_COUNT, count);
+    group_rdq_[group] = first;
+    group_rdq_count_[group] = count;
+    update_napi_weight(group);
+    return 0;
+}
+
+int dev::set_trap_group_budget(uint8_t group, unsigned budget)
+{
+    if (group >= SX_MAX_TRAP_GROUP || !budget || budget > SX_NAPI_WEIGHT_MAX)
+        return -EINVAL;
+    group_budget_[group] = budget;
+    update_napi_weight(group);
+    return 0;
+}
+
+int dev::set_trap_group_trunc(uint8_t group, uint16_t bytes)
+{
+    if (group >= SX_MAX_TRAP_GROUP)
+        return -EINVAL;
+    bar_.write32(SX_REG_HTGT(group) + SX_HTGT_TRUNC, bytes);
+    return 0;
+}
+
+void dev::update_napi_weight(uint8_t group)
+{
+    unsigned first = group_rdq_[group];
+    std::lock_guard<std::mutex> guard(poll_lock_);
+
+    for (unsigned rdq = first; rdq < first + group_rdq_count_[group] && rdq < SX_MAX_RDQ; rdq++) {
+        if (rdqs_[rdq])
+            napi_[rdqs_[rdq]->cqn()].weight = group_budget_[group];
+    }
+}
+
+int dev::add_listener(uint16_t trap_id, rx_handler_fn fn)
+{
+    std::lock_guard<std::mutex> guard(listeners_lock_);
+    listener *expected = nullptr;
+
+    if (trap_id >= SX_MAX_TRAP_ID || !fn)
+        return -EINVAL;
+
+    auto l = std::make_unique<listener>();
+    l->fn = std::move(fn);
+    if (!listeners_[trap_id].compare_exchange_strong(expected, l.get()))
+        return -EEXIST;
+    l.release();
+    return 0;
+}
+
+void dev::del_listener(uint16_t trap_id)
+{
+    std::lock_guard<std::mutex> guard(listeners_lock_);
+
+    if (trap_id >= SX_MAX_TRAP_ID)
+        return;
+
+    listener *l = listeners_[trap_id].exchange(nullptr);
+    if (l)
+        retired_.emplace_back(l);
+}
+
+int dev::send(unsigned sdq, uint16_t port, const void *data, uint32_t len, uint8_t ctl,
+               unsigned flags)
+{
+    uint32_t total = sizeof(sx_tx_hdr) + len;
+    pkt_buf *buf;
+
+    if (sdq >= SX_MAX_SDQ || !sdqs_[sdq] || port >= caps_.num_ports)
+        return -EINVAL;
+    if (total > 0xffff)
+        return -EMSGSIZE;
+
+    buf = pkt_buf_alloc(total);
+    if (!buf)
+        return -ENOMEM;
+
+    sx_tx_hdr *hdr = reinterpret_cast<sx_tx_hdr *>(buf->data);
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->version = SX_TX_HDR_VER;
+    hdr->ctl = ctl;
+    hdr->dest_port = port;
+    memcpy(buf->data + sizeof(*hdr), data, len);
+    buf->len = total;
+
+    {
+        std::lock_guard<std::mutex> guard(sdq_lock_[sdq]);
+        dq &q = *sdqs_[sdq];
+
+        if (!q.room()) {
+            /* Sends deferred so far must not wait for one that failed */
+            if (q.doorbell_pending())
+                q.ring_doorbell();
+            pkt_buf_free(buf);
+            return -EAGAIN;
+        }
+        q.post(buf);
+        if (!(flags & SX_SEND_MORE))
+            q.ring_doorbell();
+    }
+
+    if (ctl == SX_TX_CTL_TO_PORT)
+        count_tx(port, len);
+    return 0;
+}
+
+int dev::send_sg(unsigned sdq, uint16_t port, pkt_buf *const *frags, unsigned nfrags,
+                 unsigned flags)
+{
+    uint32_t len = 0;
+
+    if (sdq >= SX_MAX_SDQ || !sdqs_[sdq] || port >= caps_.num_ports || !nfrags)
+        return -EINVAL;
+    for (unsigned i = 0; i < nfrags; i++) {
+        /* A zero byte count ends the WQE's fragment list */
+        if (!frags[i]->len)
+            return -EINVAL;
+        len += frags[i]->len;
+    }
+    if (sizeof(sx_tx_hdr) + len > 0xffff)
+        return -EMSGSIZE;
+
+    if (nfrags > SX_SEND_MAX_FRAGS) {
+        pkt_buf *buf = pkt_buf_alloc(len);
+        int err;
+
+        if (!buf)
+            return -ENOMEM;
+        for (unsigned i = 0; i < nfrags; i++) {
+            memcpy(buf->data + buf->len, frags[i]->data, frags[i]->len);
+            buf->len += frags[i]->len;
+        }
+        err = send_sg(sdq, port, &buf, 1, flags);
+        if (err) {
+            pkt_buf_free(buf);
+            return err;
+        }
+        for (unsigned i = 0; i < nfrags; i++)
+            pkt_buf_free(frags[i]);
+        return 0;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(sdq_lock_[sdq]);
+        dq &q = *sdqs_[sdq];
+
+        if (!q.room()) {
+            if (q.doorbell_pending())
+                q.ring_doorbell();
+            return -EAGAIN;
+        }
+
+        sx_tx_hdr *hdr = q.next_tx_hdr();
+        memset(hdr, 0, sizeof(*hdr));
+        hdr->version = SX_TX_HDR_VER;
+        hdr->ctl = SX_TX_CTL_TO_PORT;
+        hdr->dest_port = port;
+        q.post_sg(frags, nfrags);
+        if (!(flags & SX_SEND_MORE))
+            q.ring_doorbell();
+    }
+
+    count_tx(port, len);
+    return 0;
+}
+
+int dev::flush_sdq(unsigned sdq)
+{
+    if (sdq >= SX_MAX_SDQ || !sdqs_[sdq])
+        return -EINVAL;
+
+    std::lock_guard<std::mutex> guard(sdq_lock_[sdq]);
+    if (sdqs_[sdq]->doorbell_pending())
+        sdqs_[sdq]->ring_doorbell();
+    return 0;
+}
+
+void dev::count_tx(uint16_t port, uint32_t len)
+{
+    pcpu_stats<counters>::update st(stats_);
+
+    stats_inc(&st->port[port].tx_packets);
+    stats_inc(&st->port[port].tx_bytes, len);
+}
+
+int dev::refill_rdq(dq &q)
+{
+    uint32_t buf_size = rdq_buf_size_[q.dqn()];
+    rdq_consumer *c = rdq_consumer_[q.dqn()];
+    page_pool *pool = rdq_pool_[q.dqn()];
+
+    while (q.room()) {
+        pkt_buf *buf = c ? c->alloc_buf() : pool ? pool->alloc() : pkt_buf_alloc(buf_size);
+
+        if (!buf)
+            return c ? -ENOBUFS : -ENOMEM;
+        q.post(buf);
+    }
+    return 0;
+}
+
+void dev::handle_rx(const sx_cqe &cqe, const lat_poll *lp)
+{
+    dq *q = cqe.dqn < SX_MAX_RDQ ? rdqs_[cqe.dqn].get() : nullptr;
+    pkt_buf *buf;
+
+    if (!q)
+        return;
+
+    buf = q->complete(cqe.wqe_counter);
+
+    if (cqe.flags & (SX_CQE_F_ERR | SX_CQE_F_TRUNC)) {
+        {
+            pcpu_stats<counters>::update st(stats_);
+            stats_inc(&st->rdq[cqe.dqn].errors);
+        }
+        pkt_buf_free(buf);
+        return;
+    }
+
+    buf->len = cqe.byte_count;
+
+    rx_info info;
+    info.trap_id = cqe.trap_id;
+    info.sys_port = cqe.sys_port;
+    info.egress_port = cqe.egress_port;
+    info.pkt_len = cqe.pkt_len;
+    info.rdq = cqe.dqn;
+    info.flow_hash = cqe.flow_hash;
+    info.timestamp = cqe.timestamp;
+    info.deliver_ns = 0;
+
+    rdq_consumer *c = rdq_consumer_[cqe.dqn];
+    listener *l = c || info.trap_id >= SX_MAX_TRAP_ID ? nullptr :
+                  listeners_[info.trap_id].load(std::memory_order_acquire);
+    {
+        pcpu_stats<counters>::update st(stats_);
+
+        stats_inc(&st->rdq[cqe.dqn].packets);
+        stats_inc(&st->rdq[cqe.dqn].bytes, buf->len);
+        if (info.sys_port < SX_MAX_PORTS) {
+            stats_inc(&st->port[info.sys_port].rx_packets);
+            stats_inc(&st->port[info.sys_port].rx_bytes, buf->len);
+        }
+        if (info.trap_id < SX_MAX_TRAP_ID) {
+            stats_inc(&st->trap[info.trap_id].packets);
+            stats_inc(&st->trap[info.trap_id].bytes, buf->len);
+            if (!l && !c)
+                stats_inc(&st->trap[info.trap_id].no_listener);
+        }
+    }
+
+    if (lp && info.trap_id < SX_MAX_TRAP_ID && lat_slot_[info.trap_id].load(std::memory_order_relaxed))
+        trace_rx(info, *lp);
+
+    if (c) {
+        c->deliver(info, buf);
+        return;
+    }
+    if (!l) {
+        pkt_buf_free(buf);
+        return;
+    }
+    l->fn(info, buf);
+}
+
+void dev::handle_tx(const sx_cqe &cqe)
+{
+    dq *q = cqe.dqn < SX_MAX_SDQ ? sdqs_[cqe.dqn].get() : nullptr;
+    pkt_buf *frags[SX_WQE_MAX_FRAGS];
+    unsigned n;
+
+    if (!q)
+        return;
+
+    {
+        std::lock_guard<std::mutex> guard(sdq_lock_[cqe.dqn]);
+        n = q->complete_sg(cqe.wqe_counter, frags);
+    }
+
+    {
+        pcpu_stats<counters>::update st(stats_);
+
+        if (cqe.flags & SX_CQE_F_ERR) {
+            stats_inc(&st->sdq[cqe.dqn].errors);
+        } else {
+            stats_inc(&st->sdq[cqe.dqn].packets);
+            stats_inc(&st->sdq[cqe.dqn].bytes, cqe.byte_count);
+        }
+    }
+    for (unsigned i = 0; i < n; i++)
+        pkt_buf_free(frags[i]);
+}
+
+int dev::poll_cq(unsigned cqn, int budget)
+{
+    cq *q = cqn < SX_MAX_CQ ? cqs_[cqn].get() : nullptr;
+    uint64_t rdq_mask = 0, pools;
+    lat_poll lp, *lpp = nullptr;
+    sx_cqe *cqe;
+    int done = 0;
+
+    static_assert(SX_MAX_RDQ <= 64, "rdq_mask too narrow");
+
+    if (!q)
+        return -EINVAL;
+
+    /* Buffers freed by the listeners during this poll go to the pool caches */
+    for (pools = cq_rdqs_[cqn]; pools; pools &= pools - 1)
+        rdq_pool_[__builtin_ctzll(pools)]->napi_enter();
+
+    /* One clock read per poll; traced packets add a cycle counter read */
+    if (lat_traced_.load(std::memory_order_acquire)) {
+        lp.poll_cycles = get_cycles();
+        lp.poll_ns = now_ns();
+        lp.irq_ns = napi_[cqn].irq_ns.load(std::memory_order_relaxed);
+        lpp = &lp;
+    }
+
+    while (done < budget && (cqe = q->peek())) {
+        sx_cqe c = *cqe;
+
+        q->consume();
+        if (c.flags & SX_CQE_F_SR) {
+            handle_tx(c);
+        } else {
+            handle_rx(c, lpp);
+            if (c.dqn < SX_MAX_RDQ)
+                rdq_mask |= 1ull << c.dqn;
+        }
+        done++;
+    }
+    /* RDQs left short of buffers by an earlier poll get another try */
+    rdq_mask |= cq_starved_[cqn];
+
+    /* Return the whole batch of descriptors and CQEs with one doorbell each */
+    while (rdq_mask) {
+        unsigned rdq = __builtin_ctzll(rdq_mask);
+        dq *rq = rdqs_[rdq].get();
+
+        rdq_mask &= rdq_mask - 1;
+        if (rdq_consumer_[rdq])
+            rdq_consumer_[rdq]->flush();
+        if (!rq)
+            continue;
+
+        unsigned room = rq->room();
+        refill_rdq(*rq);
+        if (rq->room() != room)
+            rq->ring_doorbell();
+        if (rq->room())
+            cq_starved_[cqn] |= 1ull << rdq;
+        else
+            cq_starved_[cqn] &= ~(1ull << rdq);
+    }
+    if (done)
+        q->update_ci();
+    for (pools = cq_rdqs_[cqn]; pools; pools &= pools - 1)
+        rdq_pool_[__builtin_ctzll(pools)]->napi_exit();
+    return done;
+}
+
+int dev::process_cq(unsigned cqn)
+{
+    int done, total = 0;
+
+    do {
+        done = poll_cq(cqn, SX_NAPI_WEIGHT);
+        if (done < 0)
+            return done;
+        total += done;
+    } while (done == SX_NAPI_WEIGHT);
+    return total;
+}
+
+void dev::irq(unsigned vector)
+{
+    napi_thread *t = vector < SX_MAX_CQ ? napi_thread_[vector].load(std::memory_order_acquire) : nullptr;
+
+    if (vector < SX_MAX_CQ && lat_traced_.load(std::memory_order_relaxed) &&
+        !napi_[vector].irq_ns.load(std::memory_order_relaxed))
+        napi_[vector].irq_ns.store(now_ns(), std::memory_order_relaxed);
+
+    if (t) {
+        {
+            std::lock_guard<std::mutex> guard(t->lock);
+            t->pending = true;
+        }
+        t->wq.notify_one();
+        return;
+    }
+
+    std::unique_lock<std::mutex> guard(poll_lock_);
+
+    if (vector >= SX_MAX_CQ || !cqs_[vector] || napi_[vector].scheduled)
+        return;
+    if (napi_thread_[vector].load(std::memory_order_relaxed)) {
+        /* Taken over by a thread since the look above */
+        guard.unlock();
+        irq(vector);
+        return;
+    }
+    napi_[vector].scheduled = true;
+    poll_list_.push_back(vector);
+
+    while (!poll_list_.empty()) {
+        unsigned cqn = poll_list_.front();
+        int weight = napi_[cqn].weight;
+
+        poll_list_.pop_front();
+        guard.unlock();
+        int done = poll_cq(cqn, weight);
+        guard.lock();
+
+        if (done > 0)
+            napi_[cqn].dim_packets += done;
+        if (done == weight) {
+            /* Budget exhausted: more work pending, go to the back of the list */
+            poll_list_.push_back(cqn);
+        } else {
+            napi_[cqn].scheduled = false;
+            napi_complete(cqn, 0);
+            cqs_[cqn]->arm();
+        }
+    }
+}
+
+int dev::set_napi_thread(unsigned cqn, int cpu)
+{
+    if (cqn >= SX_MAX_CQ || !cqs_[cqn] || napi_thread_[cqn].load() || cpu >= CPU_SETSIZE)
+        return -EINVAL;
+
+    auto t = std::make_unique<napi_thread>();
+    t->thread = std::thread(&dev::napi_thread_fn, this, cqn, t.get());
+    if (cpu >= 0) {
+        cpu_set_t set;
+        int err;
+
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        err = pthread_setaffinity_np(t->thread.native_handle(), sizeof(set), &set);
+        if (err) {
+            stop_napi_thread(t.get());
+            return -err;
+        }
+    }
+
+    /*
+     * Not while an irq() loop polls the CQ: poll_cq() has one consumer.
+     * Published under poll_lock_, so no irq() schedules it afterwards.
+     */
+    bool busy;
+    {
+        std::lock_guard<std::mutex> guard(poll_lock_);
+
+        busy = napi_[cqn].scheduled;
+        if (!busy)
+            napi_thread_[cqn].store(t.get(), std::memory_order_release);
+    }
+    if (busy) {
+        stop_napi_thread(t.get());
+        return -EBUSY;
+    }
+    t.release();
+
+    /* Anything that completed before the thread took over */
+    irq(cqn);
+    return 0;
+}
+
+void dev::napi_thread_fn(unsigned cqn, napi_thread *t)
+{
+    std::unique_lock<std::mutex> guard(t->lock);
+
+    for (;;) {
+        t->wq.wait(guard, [t] { return t->pending || t->stop; });
+        if (t->stop)
+            return;
+        t->pending = false;
+        guard.unlock();
+
+        int weight, done;
+        unsigned packets = 0;
+        {
+            std::lock_guard<std::mutex> poll_guard(poll_lock_);
+            weight = napi_[cqn].weight;
+        }
+        while ((done = poll_cq(cqn, weight)) > 0) {
+            packets += done;
+            if (done < weight)
+                break;
+        }
+        {
+            std::lock_guard<std::mutex> poll_guard(poll_lock_);
+            napi_complete(cqn, packets);
+        }
+        cqs_[cqn]->arm();
+
+        guard.lock();
+    }
+}
+
+void dev::stop_napi_thread(napi_thread *t)
+{
+    {
+        std::lock_guard<std::mutex> guard(t->lock);
+        t->stop = true;
+    }
+    t->wq.notify_one();
+    t->thread.join();
+}
+
+void dev::stop_napi_threads()
+{
+    for (auto &p : napi_thread_) {
+        std::unique_ptr<napi_thread> t(p.exchange(nullptr));
+
+        if (t)
+            stop_napi_thread(t.get());
+    }
+}
+
+/* Adaptive moderation profiles, least to most batching */
+static const struct {
+    unsigned usecs;
+    unsigned frames;
+} dim_profiles[] = {
+    {   0,   0 },
+    {   8,   8 },
+    {  32,  32 },
+    {  64,  64 },
+    { 128, 128 },
+};
+#define SX_DIM_LEVELS (sizeof(dim_profiles) / sizeof(dim_profiles[0]))
+
+int dev::set_coalesce(unsigned cqn, const cq_coalesce &c)
+{
+    if (cqn >= SX_MAX_CQ || !cqs_[cqn])
+        return -EINVAL;
+    if (!c.adaptive && (c.usecs > 0xffff || c.max_frames > 0xffff ||
+                        (c.max_frames > 1 && !c.usecs)))
+        return -EINVAL;
+
+    std::lock_guard<std::mutex> guard(poll_lock_);
+    napi &n = napi_[cqn];
+
+    n.coal = c;
+    n.dim_level = 0;
+    n.dim_start = now_ns();
+    n.dim_packets = 0;
+    if (c.adaptive) {
+        n.coal.usecs = dim_profiles[0].usecs;
+        n.coal.max_frames = dim_profiles[0].frames;
+    }
+    cqs_[cqn]->set_moderation(n.coal.usecs, n.coal.max_frames);
+    return 0;
+}
+
+int dev::get_coalesce(unsigned cqn, cq_coalesce *c)
+{
+    if (cqn >= SX_MAX_CQ || !cqs_[cqn])
+        return -EINVAL;
+
+    std::lock_guard<std::mutex> guard(poll_lock_);
+    *c = napi_[cqn].coal;
+    return 0;
+}
+
+/*
+ * End of a NAPI cycle of @cqn, before it is re-armed; poll_lock_ held.
+ * Adaptive moderation samples the completion rate and steps one profile
+ * at a time toward the one that keeps interrupts near SX_DIM_IRQ_RATE:
+ * no delay at low rates, deeper batching as the rate climbs.
+ */
+void dev::napi_complete(unsigned cqn, unsigned packets)
+{
+    napi &n = napi_[cqn];
+
+    n.irq_ns.store(0, std::memory_order_relaxed);
+    n.dim_packets += packets;
+    if (!n.coal.adaptive)
+        return;
+
+    uint64_t now = now_ns(), elapsed = now - n.dim_start;
+    if (elapsed < SX_DIM_SAMPLE_NS)
+        return;
+
+    uint64_t rate = n.dim_packets * 1000000000ull / elapsed;
+    unsigned target = 0;
+
+    while (target + 1 < SX_DIM_LEVELS &&
+           std::max(1u, dim_profiles[target].frames) * static_cast<uint64_t>(SX_DIM_IRQ_RATE) < rate)
+        target++;
+    if (target > n.dim_level)
+        n.dim_level++;
+    else if (target < n.dim_level)
+        n.dim_level--;
+
+    if (n.coal.usecs != dim_profiles[n.dim_level].usecs) {
+        n.coal.usecs = dim_profiles[n.dim_level].usecs;
+        n.coal.max_frames = dim_profiles[n.dim_level].frames;
+        cqs_[cqn]->set_moderation(n.coal.usecs, n.coal.max_frames);
+    }
+    n.dim_start = now;
+    n.dim_packets = 0;
+}
+
+void dev::get_port_counters(unsigned port, port_counters *out)
+{
+    if (port >= SX_MAX_PORTS) {
+        *out = {};
+        return;
+    }
+    stats_.read(out, [port](const counters &c) -> const port_counters & { return c.port[port]; });
+}
+
+void dev::get_trap_counters(uint16_t trap_id, trap_counters *out)
+{
+    if (trap_id >= SX_MAX_TRAP_ID) {
+        *out = {};
+        return;
+    }
+    stats_.read(out, [trap_id](const counters &c) -> const trap_counters & { return c.trap[trap_id]; });
+}
+
+void dev::get_rdq_counters(unsigned rdq, queue_counters *out)
+{
+    if (rdq >= SX_MAX_RDQ) {
+        *out = {};
+        return;
+    }
+    stats_.read(out, [rdq](const counters &c) -> const queue_counters & { return c.rdq[rdq]; });
+}
+
+int dev::get_rdq_pool_stats(unsigned rdq, page_pool_stats *out)
+{
+    if (rdq >= SX_MAX_RDQ || !rdq_pool_[rdq])
+        return -ENOENT;
+    rdq_pool_[rdq]->get_stats(out);
+    return 0;
+}
+
+void dev::get_sdq_counters(unsigned sdq, queue_counters *out)
+{
+    if (sdq >= SX_MAX_SDQ) {
+        *out = {};
+        return;
+    }
+    stats_.read(out, [sdq](const counters &c) -> const queue_counters & { return c.sdq[sdq]; });
+}
+
+static void lat_record(lat_hist *h, uint64_t from, uint64_t to)
+{
+    uint64_t ns = to > from ? to - from : 0;
+
+    stats_inc(&h->count);
+    stats_inc(&h->sum_ns, ns);
+    stats_inc(&h->bucket[lat_bucket(ns)]);
+}
+
+int dev::set_latency_trace(uint16_t trap_id, bool on)
+{
+    std::lock_guard<std::mutex> guard(lat_lock_);
+    unsigned slot = 0;
+
+    if (trap_id >= SX_MAX_TRAP_ID)
+        return -EINVAL;
+    if (on && !lat_nslots_) {
+        /* Rate of the cycle counter, which times the driver within a poll */
+        uint64_t ns = now_ns(), cycles = get_cycles();
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        cycles = get_cycles() - cycles;
+        if (cycles)
+            lat_ns_per_cycle_ = static_cast<double>(now_ns() - ns) / cycles;
+    }
+    for (unsigned i = 0; i < lat_nslots_; i++) {
+        if (lat_trap_[i] == trap_id)
+            slot = i + 1;
+    }
+    if (!on) {
+        if (slot && lat_slot_[trap_id].exchange(0, std::memory_order_relaxed))
+            lat_traced_.fetch_sub(1, std::memory_order_relaxed);
+        return 0;
+    }
+    if (!slot) {
+        if (lat_nslots_ == SX_LAT_MAX_TRAPS)
+            return -ENOSPC;
+        lat_trap_[lat_nslots_] = trap_id;
+        slot = ++lat_nslots_;
+    }
+    if (!lat_slot_[trap_id].exchange(slot, std::memory_order_relaxed))
+        lat_traced_.fetch_add(1, std::memory_order_release);
+    return 0;
+}
+
+void dev::trace_rx(rx_info &info, const lat_poll &lp)
+{
+    unsigned slot = lat_slot_[info.trap_id].load(std::memory_order_relaxed) - 1;
+    /* Packets that completed after the interrupt did not wait for it */
+    uint64_t irq_ns = lp.irq_ns ? std::max(lp.irq_ns, info.timestamp) : lp.poll_ns;
+    pcpu_stats<lat_counters>::update st(lat_);
+    lat_hist *h = st->hist[slot];
+
+    if (lat_ns_per_cycle_ > 0)
+        info.deliver_ns = lp.poll_ns + static_cast<uint64_t>((get_cycles() - lp.poll_cycles) *
+                                                             lat_ns_per_cycle_);
+    else
+        info.deliver_ns = now_ns();
+    lat_record(&h[SX_LAT_HW], info.timestamp, irq_ns);
+    if (lp.irq_ns)
+        lat_record(&h[SX_LAT_SCHED], irq_ns, lp.poll_ns);
+    lat_record(&h[SX_LAT_DRIVER], lp.poll_ns, info.deliver_ns);
+}
+
+void dev::trace_dequeue(const rx_info &info)
+{
+    unsigned slot;
+
+    if (!info.deliver_ns || info.trap_id >= SX_MAX_TRAP_ID)
+        return;
+    slot = lat_slot_[info.trap_id].load(std::memory_order_relaxed);
+    if (!slot)
+        return;
+
+    pcpu_stats<lat_counters>::update st(lat_);
+    lat_record(&st->hist[slot - 1][SX_LAT_USER], info.deliver_ns, now_ns());
+}
+
+int dev::get_latency_hist(uint16_t trap_id, unsigned stage, lat_hist *out)
+{
+    unsigned slot = 0;
+
+    if (trap_id >= SX_MAX_TRAP_ID || stage >= SX_LAT_STAGES)
+        return -EINVAL;
+    {
+        std::lock_guard<std::mutex> guard(lat_lock_);
+
+        for (unsigned i = 0; i < lat_nslots_; i++) {
+            if (lat_trap_[i] == trap_id)
+                slot = i + 1;
+        }
+    }
+    if (!slot)
+        return -ENOENT;
+    lat_.read(out, [slot, stage](const lat_counters &c) -> const lat_hist & {
+        return c.hist[slot - 1][stage];
+    });
+    return 0;
+}
+
+std::string dev::latency_debugfs()
+{
+    static const char *const names[SX_LAT_STAGES] = { "hw", "sched", "driver", "user" };
+    std::string out;
+    unsigned n;
+    char line[160];
+
+    {
+        std::lock_guard<std::mutex> guard(lat_lock_);
+        n = lat_nslots_;
+    }
+    for (unsigned i = 0; i < n; i++) {
+        uint16_t trap_id = lat_trap_[i];
+
+        snprintf(line, sizeof(line), "trap 0x%03x%s\n", trap_id,
+                 lat_slot_[trap_id].load(std::memory_order_relaxed) ? "" : " (off)");
+        out += line;
+        for (unsigned stage = 0; stage < SX_LAT_STAGES; stage++) {
+            lat_hist h;
+
+            get_latency_hist(trap_id, stage, &h);
+            if (!h.count)
+                continue;
+            snprintf(line, sizeof(line),
+                     "  %-6s count %-10lu avg %-9lu p50 <%-9lu p99 <%-9lu max <%lu ns\n",
+                     names[stage], h.count, h.sum_ns / h.count, lat_hist_pct(h, 50),
+                     lat_hist_pct(h, 99), lat_hist_pct(h, 100));
+            out += line;
+        }
+    }
+    return out;
+}
+
+} /* namespace sx */
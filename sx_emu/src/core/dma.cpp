@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include "sx/dma.h"
+
+namespace sx {
+
+#define SX_DMA_ALIGN 4096
+
+int dma_alloc_coherent(size_t size, dma_region *region)
+{
+    size_t len = (size + SX_DMA_ALIGN - 1) & ~static_cast<size_t>(SX_DMA_ALIGN - 1);
+    void *p = std::aligned_alloc(SX_DMA_ALIGN, len);
+
+    if (!p)
+        return -ENOMEM;
+    memset(p, 0, len);
+    region->cpu = p;
+    region->dma = dma_map_single(p);
+    region->size = len;
+    return 0;
+}
+
+void dma_free_coherent(dma_region *region)
+{
+    std::free(region->cpu);
+    region->cpu = nullptr;
+    region->dma = 0;
+    region->size = 0;
+}
+
+} /* namespace sx */
@@ -0,0 +1,131 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#include <cerrno>
+#include <new>
+
+#include "sx/dq.h"
+
+namespace sx {
+
+static uint32_t dq_regs(dq_type type, unsigned dqn)
+{
+    return type == dq_type::sdq ? SX_REG_SDQ(dqn) : SX_REG_RDQ(dqn);
+}
+
+int dq::create(unsigned log_size, unsigned cqn)
+{
+    size_t nent = 1u << log_size;
+    uint32_t regs = dq_regs(type_, dqn_);
+    int err;
+
+    if (ring_)
+        return -EBUSY;
+    if (log_size > 16)
+        return -EINVAL;
+
+    nfrags_ = type_ == dq_type::sdq ? SX_WQE_MAX_FRAGS - 1 : 1;
+    err = dma_alloc_coherent(nent * (sizeof(sx_wqe) + (type_ == dq_type::sdq ? sizeof(sx_tx_hdr) : 0)),
+                             &mem_);
+    if (err)
+        return err;
+
+    bufs_ = new (std::nothrow) pkt_buf *[nent * nfrags_]();
+    if (!bufs_) {
+        dma_free_coherent(&mem_);
+        return -ENOMEM;
+    }
+
+    ring_ = static_cast<sx_wqe *>(mem_.cpu);
+    hdrs_ = type_ == dq_type::sdq ? reinterpret_cast<sx_tx_hdr *>(ring_ + nent) : nullptr;
+    pi_ = ci_ = db_pi_ = 0;
+    mask_ = nent - 1;
+    cqn_ = cqn;
+
+    bar_.write64(regs + SX_Q_ADDR_LO, mem_.dma);
+    bar_.write32(regs + SX_Q_LOG_SIZE, log_size);
+    bar_.write32(regs + SX_Q_CQN, cqn);
+    bar_.write32(regs + SX_Q_CTRL, SX_Q_CTRL_EN);
+
+    uint32_t ctrl;
+    err = bar_.poll32(regs + SX_Q_CTRL, [](uint32_t v) { return !(v & SX_Q_CTRL_BUSY); }, &ctrl,
+                      SX_FW_POLL_US, SX_Q_INIT_TIMEOUT_US);
+    if (err)
+        destroy();
+    return err;
+}
+
+void dq::destroy()
+{
+    if (!ring_)
+        return;
+
+    bar_.write32(dq_regs(type_, dqn_) + SX_Q_CTRL, 0);
+    for (; ci_ != pi_; ci_++) {
+        for (unsigned i = 0; i < nfrags_; i++)
+            pkt_buf_free(bufs_[(ci_ & mask_) * nfrags_ + i]);
+    }
+    delete[] bufs_;
+    bufs_ = nullptr;
+    dma_free_coherent(&mem_);
+    ring_ = nullptr;
+    hdrs_ = nullptr;
+}
+
+void dq::post(pkt_buf *buf)
+{
+    uint32_t idx = pi_ & mask_;
+    sx_wqe *wqe = &ring_[idx];
+
+    wqe->flags = 0;
+    wqe->byte_count[0] = type_ == dq_type::sdq ? buf->len : buf->size;
+    wqe->byte_count[1] = 0;
+    wqe->byte_count[2] = 0;
+    wqe->dma_addr[0] = buf->dma;
+    bufs_[idx * nfrags_] = buf;
+    pi_++;
+}
+
+void dq::post_sg(pkt_buf *const *frags, unsigned nfrags)
+{
+    uint32_t idx = pi_ & mask_;
+    sx_wqe *wqe = &ring_[idx];
+
+    wqe->flags = 0;
+    wqe->byte_count[0] = sizeof(sx_tx_hdr);
+    wqe->dma_addr[0] = mem_.dma + (reinterpret_cast<uint8_t *>(&hdrs_[idx]) -
+                                   static_cast<uint8_t *>(mem_.cpu));
+    for (unsigned i = 0; i < nfrags_; i++) {
+        pkt_buf *buf = i < nfrags ? frags[i] : nullptr;
+
+        wqe->byte_count[1 + i] = buf ? buf->len : 0;
+        wqe->dma_addr[1 + i] = buf ? buf->dma : 0;
+        bufs_[idx * nfrags_ + i] = buf;
+    }
+    pi_++;
+}
+
+pkt_buf *dq::complete(uint16_t wqe_counter)
+{
+    uint32_t idx = wqe_counter & mask_;
+    pkt_buf *buf = bufs_[idx * nfrags_];
+
+    bufs_[idx * nfrags_] = nullptr;
+    ci_++;
+    return buf;
+}
+
+unsigned dq::complete_sg(uint16_t wqe_counter, pkt_buf **frags)
+{
+    pkt_buf **slot = &bufs_[(wqe_counter & mask_) * nfrags_];
+    unsigned n = 0;
+
+    for (unsigned i = 0; i < nfrags_; i++) {
+        if (slot[i])
+            frags[n++] = slot[i];
+        slot[i] = nullptr;
+    }
+    ci_++;
+    return n;
+}
+
+} /* namespace sx */
@@ -0,0 +1,227 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <endian.h>
+#include <thread>
+
+#include "sx/compiler.h"
+#include "sx/emad.h"
+
+namespace sx {
+
+#define SX_EMAD_FRAME_MAX (sizeof(sx_emad_eth_hdr) + sizeof(sx_emad_op_tlv) + \
+                           sizeof(sx_emad_reg_tlv) + SX_EMAD_MAX_REG_LEN + 4)
+
+static const uint8_t emad_dmac[6] = { 0x01, 0x02, 0xc9, 0x00, 0x00, 0x01 };
+static const uint8_t emad_smac[6] = { 0x00, 0x02, 0xc9, 0x01, 0x02, 0x03 };
+
+emad::emad(dev &d, unsigned sdq, unsigned cqn) : dev_(d), sdq_(sdq), cqn_(cqn)
+{
+}
+
+emad::~emad()
+{
+    if (registered_)
+        dev_.del_listener(SX_TRAP_ID_EMAD);
+}
+
+int emad::init()
+{
+    int err = dev_.add_listener(SX_TRAP_ID_EMAD, [this](const rx_info &info, pkt_buf *buf) {
+        on_response(info, buf);
+    });
+
+    if (err)
+        return err;
+    registered_ = true;
+    return 0;
+}
+
+int emad::submit(emad_op &op, batch &b)
+{
+    uint8_t frame[SX_EMAD_FRAME_MAX];
+    uint32_t len = op.payload.size();
+    uint64_t tid;
+    slot *s;
+    int err;
+
+    if (inflight_ >= SX_EMAD_MAX_INFLIGHT)
+        return -EAGAIN;
+    if (len > SX_EMAD_MAX_REG_LEN || len & 3) {
+        op.err = -EINVAL;
+        b.completed++;
+        return 0;
+    }
+
+    /* Skip IDs whose slot is still held by a slow transaction */
+    do {
+        tid = next_tid_++;
+        s = &slots_[tid & (SX_EMAD_MAX_INFLIGHT - 1)];
+    } while (s->busy);
+
+    sx_emad_eth_hdr *eth = reinterpret_cast<sx_emad_eth_hdr *>(frame);
+    memcpy(eth->dmac, emad_dmac, sizeof(eth->dmac));
+    memcpy(eth->smac, emad_smac, sizeof(eth->smac));
+    eth->ethertype = htobe16(SX_EMAD_ETHERTYPE);
+    eth->mlx_proto = SX_EMAD_MLX_PROTO;
+    eth->ver = 0;
+
+    sx_emad_op_tlv *op_tlv = reinterpret_cast<sx_emad_op_tlv *>(eth + 1);
+    memset(op_tlv, 0, sizeof(*op_tlv));
+    op_tlv->type_len = htobe16(sx_emad_tlv(SX_EMAD_TLV_OP, sizeof(*op_tlv) / 4));
+    op_tlv->register_id = htobe16(op.reg_id);
+    op_tlv->r_method = op.method;
+    op_tlv->reg_class = SX_EMAD_CLASS_REG_ACCESS;
+    op_tlv->tid = htobe64(tid);
+
+    sx_emad_reg_tlv *reg_tlv = reinterpret_cast<sx_emad_reg_tlv *>(op_tlv + 1);
+    reg_tlv->type_len = htobe16(sx_emad_tlv(SX_EMAD_TLV_REG, 1 + len / 4));
+    reg_tlv->rsvd0 = 0;
+    if (len)
+        memcpy(reg_tlv->data, op.payload.data(), len);
+
+    uint16_t *end = reinterpret_cast<uint16_t *>(reg_tlv->data + len);
+    end[0] = htobe16(sx_emad_tlv(SX_EMAD_TLV_END, 1));
+    end[1] = 0;
+
+    s->tid = tid;
+    s->op = &op;
+    s->b = &b;
+    s->deadline = now_ns() + timeout_ms_ * 1000000ull;
+    s->busy = true;
+    inflight_++;
+
+    err = dev_.send(sdq_, 0, frame, reinterpret_cast<uint8_t *>(end + 2) - frame, SX_TX_CTL_EMAD);
+    if (err) {
+        s->busy = false;
+        inflight_--;
+        /* SDQ full: the caller retries once completions free it */
+        if (err == -EAGAIN)
+            return err;
+        op.err = err;
+        b.completed++;
+    }
+    return 0;
+}
+
+void emad::on_response(const rx_info &, pkt_buf *buf)
+{
+    const uint8_t *p = buf->data;
+    uint32_t len = buf->len;
+
+    if (len < sizeof(sx_emad_eth_hdr) + sizeof(sx_emad_op_tlv) + sizeof(sx_emad_reg_tlv)) {
+        pkt_buf_free(buf);
+        return;
+    }
+
+    const sx_emad_op_tlv *op_tlv = reinterpret_cast<const sx_emad_op_tlv *>(p + sizeof(sx_emad_eth_hdr));
+    const sx_emad_reg_tlv *reg_tlv = reinterpret_cast<const sx_emad_reg_tlv *>(op_tlv + 1);
+    uint64_t tid = be64toh(op_tlv->tid);
+    uint32_t reg_dw = be16toh(reg_tlv->type_len) & 0x7ff;
+    uint32_t reg_len = reg_dw ? (reg_dw - 1) * 4 : 0;
+    uint32_t room = len - (reg_tlv->data - p);
+
+    std::lock_guard<std::mutex> guard(lock_);
+    slot *s = &slots_[tid & (SX_EMAD_MAX_INFLIGHT - 1)];
+
+    /* Late answer to a transaction that already timed out */
+    if (!s->busy || s->tid != tid || !(op_tlv->r_method & SX_EMAD_OP_R)) {
+        pkt_buf_free(buf);
+        return;
+    }
+
+    emad_op *op = s->op;
+    op->status = op_tlv->status & 0x7f;
+    op->err = op->status ? -EIO : 0;
+    reg_len = std::min({ reg_len, room, static_cast<uint32_t>(op->payload.size()) });
+    memcpy(op->payload.data(), reg_tlv->data, reg_len);
+
+    s->busy = false;
+    s->b->completed++;
+    inflight_--;
+    pkt_buf_free(buf);
+    wq_.notify_all();
+}
+
+void emad::expire(uint64_t now)
+{
+    if (now < next_expire_)
+        return;
+    next_expire_ = now + 1000000;
+
+    for (slot &s : slots_) {
+        if (!s.busy || s.deadline > now)
+            continue;
+        s.op->err = -ETIMEDOUT;
+        s.busy = false;
+        s.b->completed++;
+        inflight_--;
+        timeouts_++;
+    }
+}
+
+void emad::wait_progress(std::unique_lock<std::mutex> &guard)
+{
+    if (busy_poll_) {
+        guard.unlock();
+        if (poll_lock_.try_lock()) {
+            int done = dev_.poll_cq(cqn_, SX_NAPI_WEIGHT);
+
+            poll_lock_.unlock();
+            if (done <= 0)
+                std::this_thread::yield();
+        } else {
+            std::this_thread::yield();
+        }
+        guard.lock();
+    } else {
+        wq_.wait_for(guard, std::chrono::milliseconds(1));
+    }
+    expire(now_ns());
+}
+
+int emad::run(emad_op *ops, size_t n, unsigned window)
+{
+    std::unique_lock<std::mutex> guard(lock_);
+    size_t next = 0;
+    batch b;
+
+    if (!registered_)
+        return -ENODEV;
+    window = std::max(1u, std::min(window, static_cast<unsigned>(SX_EMAD_MAX_INFLIGHT)));
+
+    while (b.completed < n) {
+        while (next < n && next - b.completed < window) {
+            ops[next].status = 0;
+            ops[next].err = 0;
+            if (submit(ops[next], b))
+                break;
+            next++;
+        }
+        if (b.completed < n)
+            wait_progress(guard);
+    }
+    return 0;
+}
+
+int emad::access(emad_op &op)
+{
+    int err = run(&op, 1, 1);
+
+    return err ? err : op.err;
+}
+
+int emad::transact(std::vector<emad_op> &ops, unsigned window)
+{
+    return run(ops.data(), ops.size(), window);
+}
+
+int emad::transact(emad_op *ops, size_t n, unsigned window)
+{
+    return run(ops, n, window);
+}
+
+} /* namespace sx */
@@ -0,0 +1,162 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#include "sx/compiler.h"
+#include "sx/fdb_notify.h"
+
+namespace sx {
+
+fdb_notify::fdb_notify(dev &d, unsigned batch, unsigned window_us, size_t max_pending)
+    : dev_(d), batch_(batch ? batch : 1), window_ns_(window_us * 1000ull), max_pending_(max_pending)
+{
+}
+
+fdb_notify::~fdb_notify()
+{
+    if (started_)
+        dev_.del_listener(SX_TRAP_ID_FDB_EVENT);
+}
+
+int fdb_notify::start()
+{
+    int err = dev_.add_listener(SX_TRAP_ID_FDB_EVENT, [this](const rx_info &info, pkt_buf *buf) {
+        enqueue(info, buf);
+    });
+
+    if (!err)
+        started_ = true;
+    return err;
+}
+
+void fdb_notify::merge(size_t i, const sx_fdb_rec &rec, uint64_t key)
+{
+    sx_fdb_rec *p = &pending_[i];
+
+    switch (p->type) {
+    case SX_FDB_EV_LEARN:
+        if (rec.type == SX_FDB_EV_AGE) {
+            /* Came and went before anyone was told */
+            p->type = SX_FDB_EV_NONE;
+            index_.erase(key);
+            live_--;
+            stats_.cancelled++;
+
+            /* It opened the reader's window: the oldest live event does now */
+            if (live_ && pending_ns_[i] == first_ns_) {
+                while (pending_[i].type == SX_FDB_EV_NONE)
+                    i++;
+                first_ns_ = pending_ns_[i];
+            }
+            return;
+        }
+        p->port = rec.port;
+        break;
+    case SX_FDB_EV_MOVE:
+        p->type = rec.type == SX_FDB_EV_AGE ? SX_FDB_EV_AGE : SX_FDB_EV_MOVE;
+        p->port = rec.port;
+        break;
+    case SX_FDB_EV_AGE:
+        /* Gone and back: the reader still has it, maybe on another port */
+        if (rec.type != SX_FDB_EV_AGE) {
+            p->type = SX_FDB_EV_MOVE;
+            p->port = rec.port;
+        }
+        break;
+    }
+    stats_.coalesced++;
+}
+
+void fdb_notify::enqueue(const rx_info &, pkt_buf *buf)
+{
+    sx_fdb_rec rec;
+    bool wake = false;
+
+    if (buf->len < sizeof(rec)) {
+        pkt_buf_free(buf);
+        return;
+    }
+    memcpy(&rec, buf->data, sizeof(rec));
+    pkt_buf_free(buf);
+    if (shadow_)
+        shadow_->apply(rec);
+
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        uint64_t key = sx_fdb_key(rec.fid, rec.mac);
+        auto it = index_.find(key);
+
+        stats_.received++;
+        if (it != index_.end()) {
+            merge(it->second - base_, rec, key);
+            return;
+        }
+        if (rec.type == SX_FDB_EV_NONE)
+            return;
+        if (pending_.size() - head_ >= max_pending_) {
+            stats_.overflow++;
+            return;
+        }
+        uint64_t now = now_ns();
+
+        index_.emplace(key, base_ + pending_.size());
+        pending_.push_back(rec);
+        pending_ns_.push_back(now);
+        if (!live_++)
+            first_ns_ = now;
+        /* The first event starts the reader's window, the batch-th ends it */
+        wake = live_ == 1 || live_ == batch_;
+    }
+    if (wake)
+        wq_.notify_one();
+}
+
+ssize_t fdb_notify::read(sx_fdb_rec *ev, size_t max, bool nonblock)
+{
+    std::unique_lock<std::mutex> guard(lock_);
+    size_t n = 0;
+
+    for (;;) {
+        if (live_ && (nonblock || live_ >= batch_ || now_ns() >= first_ns_ + window_ns_))
+            break;
+        if (nonblock)
+            return -EAGAIN;
+        if (live_)
+            wq_.wait_until(guard, std::chrono::steady_clock::time_point(
+                                      std::chrono::nanoseconds(first_ns_ + window_ns_)));
+        else
+            wq_.wait(guard);
+    }
+
+    while (n < max && head_ < pending_.size()) {
+        const sx_fdb_rec &rec = pending_[head_++];
+
+        if (rec.type == SX_FDB_EV_NONE)
+            continue;
+        ev[n++] = rec;
+        index_.erase(sx_fdb_key(rec.fid, rec.mac));
+        live_--;
+    }
+
+    /* Drop the consumed prefix; what is left is due right away */
+    if (head_ == pending_.size() || head_ >= pending_.size() / 2) {
+        pending_.erase(pending_.begin(), pending_.begin() + head_);
+        pending_ns_.erase(pending_ns_.begin(), pending_ns_.begin() + head_);
+        base_ += head_;
+        head_ = 0;
+    }
+    stats_.delivered += n;
+    stats_.wakeups++;
+    return n;
+}
+
+void fdb_notify::get_stats(fdb_notify_stats *out)
+{
+    std::lock_guard<std::mutex> guard(lock_);
+
+    *out = stats_;
+}
+
+} /* namespace sx */
@@ -0,0 +1,253 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <endian.h>
+#include <mutex>
+#include <new>
+
+#include "sx/fdb_shadow.h"
+
+namespace sx {
+
+/* Never a real key: FIDs are 12 bits */
+#define SX_FDB_SHADOW_EMPTY UINT64_MAX
+
+fdb_shadow::fdb_shadow(size_t max_entries) : max_entries_(max_entries)
+{
+    size_t want = std::max<size_t>(2 * max_entries, SX_CACHELINE / sizeof(slot));
+    size_t n;
+
+    if (max_entries > SIZE_MAX / (4 * sizeof(slot)))
+        throw std::bad_alloc();
+    n = size_t(1) << (64 - __builtin_clzll(want - 1));
+
+    slots_ = static_cast<slot *>(aligned_alloc(SX_CACHELINE, n * sizeof(slot)));
+    if (!slots_)
+        throw std::bad_alloc();
+    for (size_t i = 0; i < n; i++)
+        slots_[i] = { SX_FDB_SHADOW_EMPTY, 0, 0 };
+    mask_ = n - 1;
+    shift_ = 64 - __builtin_ctzll(n);
+}
+
+fdb_shadow::~fdb_shadow()
+{
+    free(slots_);
+}
+
+int fdb_shadow::insert(uint64_t key, uint16_t port)
+{
+    size_t i = home(key);
+
+    while (slots_[i].key != key && slots_[i].key != SX_FDB_SHADOW_EMPTY)
+        i = (i + 1) & mask_;
+    if (slots_[i].key == key) {
+        write_once(&slots_[i].port, static_cast<uint32_t>(port));
+        return 0;
+    }
+    if (size_ >= max_entries_) {
+        write_once(&overflow_, overflow_ + 1);
+        return -ENOSPC;
+    }
+
+    seq_.write_begin();
+    write_once(&slots_[i].port, static_cast<uint32_t>(port));
+    write_once(&slots_[i].key, key);
+    seq_.write_end();
+    write_once(&size_, size_ + 1);
+    return 0;
+}
+
+/* Backward-shift deletion: no tombstones, probe chains stay short */
+void fdb_shadow::erase(uint64_t key)
+{
+    size_t i = home(key), j;
+
+    while (slots_[i].key != key) {
+        if (slots_[i].key == SX_FDB_SHADOW_EMPTY)
+            return;
+        i = (i + 1) & mask_;
+    }
+
+    seq_.write_begin();
+    for (j = i;;) {
+        j = (j + 1) & mask_;
+        if (slots_[j].key == SX_FDB_SHADOW_EMPTY)
+            break;
+
+        /* Leave entries whose home lies cyclically in (i, j] */
+        size_t k = home(slots_[j].key);
+        if (i <= j ? i < k && k <= j : i < k || k <= j)
+            continue;
+        write_once(&slots_[i].port, slots_[j].port);
+        write_once(&slots_[i].key, slots_[j].key);
+        i = j;
+    }
+    write_once(&slots_[i].key, SX_FDB_SHADOW_EMPTY);
+    seq_.write_end();
+    write_once(&size_, size_ - 1);
+}
+
+void fdb_shadow::apply(const sx_fdb_rec &rec)
+{
+    uint64_t key = sx_fdb_key(rec.fid, rec.mac);
+    std::lock_guard<spinlock> guard(lock_);
+
+    if (key == SX_FDB_SHADOW_EMPTY)
+        return;
+    if (rec.type == SX_FDB_EV_LEARN || rec.type == SX_FDB_EV_MOVE)
+        insert(key, rec.port);
+    else if (rec.type == SX_FDB_EV_AGE)
+        erase(key);
+}
+
+int fdb_shadow::sfd_write(emad &e, uint8_t op, uint64_t key, uint16_t port)
+{
+    emad_op req;
+
+    req.reg_id = SX_REG_ID_SFD;
+    req.method = SX_EMAD_METHOD_WRITE;
+    req.payload.assign(sizeof(sx_sfd_reg) + sizeof(sx_sfd_rec), 0);
+
+    sx_sfd_reg *reg = reinterpret_cast<sx_sfd_reg *>(req.payload.data());
+    reg->op = op;
+    reg->num_rec = 1;
+    reg->rec[0].fid = htobe16(static_cast<uint16_t>(key >> 48));
+    sx_fdb_key_mac(key, reg->rec[0].mac);
+    reg->rec[0].port = htobe16(port);
+    return e.access(req);
+}
+
+int fdb_shadow::add(emad &e, uint16_t fid, const uint8_t *mac, uint16_t port)
+{
+    uint64_t key = sx_fdb_key(fid, mac);
+    int err;
+
+    if (key == SX_FDB_SHADOW_EMPTY)
+        return -EINVAL;
+    {
+        std::lock_guard<spinlock> guard(lock_);
+
+        if (size_ >= max_entries_ && lookup(fid, mac) < 0)
+            return -ENOSPC;
+    }
+
+    err = sfd_write(e, SX_SFD_OP_ADD, key, port);
+    if (err)
+        return err;
+
+    {
+        std::lock_guard<spinlock> guard(lock_);
+
+        err = insert(key, port);
+    }
+    if (err)
+        /*
+         * Filled up by learning meanwhile: keep the ASIC in step. Not under
+         * lock_, which apply() takes in NAPI context, maybe the very one
+         * that completes this EMAD.
+         */
+        sfd_write(e, SX_SFD_OP_DEL, key, 0);
+    return err;
+}
+
+int fdb_shadow::del(emad &e, uint16_t fid, const uint8_t *mac)
+{
+    uint64_t key = sx_fdb_key(fid, mac);
+    int err = sfd_write(e, SX_SFD_OP_DEL, key, 0);
+
+    if (err)
+        return err;
+
+    std::lock_guard<spinlock> guard(lock_);
+    erase(key);
+    return 0;
+}
+
+int fdb_shadow::lookup(uint16_t fid, const uint8_t *mac) const
+{
+    uint64_t key = sx_fdb_key(fid, mac);
+
+    for (;;) {
+        uint32_t s = seq_.read_begin();
+        int port = -ENOENT;
+
+        /* Bounded: a torn read may miss the empty slot that ends the chain */
+        for (size_t i = home(key), n = 0; n <= mask_; i = (i + 1) & mask_, n++) {
+            uint64_t k = read_once(&slots_[i].key);
+
+            if (k == key) {
+                port = read_once(&slots_[i].port);
+                break;
+            }
+            if (k == SX_FDB_SHADOW_EMPTY)
+                break;
+        }
+        if (!seq_.read_retry(s))
+            return port;
+    }
+}
+
+void fdb_shadow::dump(std::vector<sx_fdb_rec> *out) const
+{
+    std::lock_guard<spinlock> guard(lock_);
+    sx_fdb_rec rec = {};
+
+    out->clear();
+    out->reserve(size_);
+    for (size_t i = 0; i <= mask_; i++) {
+        if (slots_[i].key == SX_FDB_SHADOW_EMPTY)
+            continue;
+        rec.fid = static_cast<uint16_t>(slots_[i].key >> 48);
+        sx_fdb_key_mac(slots_[i].key, rec.mac);
+        rec.port = static_cast<uint16_t>(slots_[i].port);
+        out->push_back(rec);
+    }
+}
+
+int fdb_shadow::check(emad &e, fdb_check_report *out)
+{
+    uint64_t cursor = 0, found = 0;
+    emad_op op;
+    int err;
+
+    memset(out, 0, sizeof(*out));
+    out->shadow_entries = size();
+    op.reg_id = SX_REG_ID_SFD;
+
+    do {
+        op.method = SX_EMAD_METHOD_QUERY;
+        op.payload.assign(sizeof(sx_sfd_reg) + SX_SFD_MAX_REC * sizeof(sx_sfd_rec), 0);
+
+        sx_sfd_reg *reg = reinterpret_cast<sx_sfd_reg *>(op.payload.data());
+        reg->op = SX_SFD_OP_DUMP;
+        reg->cursor = htobe64(cursor);
+        err = e.access(op);
+        out->accesses++;
+        if (err)
+            return err;
+
+        for (unsigned i = 0; i < std::min<unsigned>(reg->num_rec, SX_SFD_MAX_REC); i++) {
+            const sx_sfd_rec &rec = reg->rec[i];
+            int port = lookup(be16toh(rec.fid), rec.mac);
+
+            out->asic_entries++;
+            if (port < 0) {
+                out->missing++;
+                continue;
+            }
+            found++;
+            if (port != be16toh(rec.port))
+                out->mismatched++;
+        }
+        cursor = be64toh(reg->cursor);
+    } while (cursor != SX_SFD_CURSOR_END);
+
+    out->stale = out->shadow_entries > found ? out->shadow_entries - found : 0;
+    return out->missing || out->stale || out->mismatched ? -EUCLEAN : 0;
+}
+
+} /* namespace sx */
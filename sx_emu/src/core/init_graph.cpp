@@ -0,0 +1,129 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <functional>
+#include <thread>
+
+#include "sx/compiler.h"
+#include "sx/init_graph.h"
+
+namespace sx {
+
+unsigned init_graph::add(std::string name, stage_fn fn, const std::vector<unsigned> &deps)
+{
+    unsigned id = stages_.size();
+    stage s;
+
+    s.name = std::move(name);
+    s.fn = std::move(fn);
+    for (unsigned d : deps) {
+        if (d >= id) {
+            bad_deps_ = true;
+            continue;
+        }
+        stages_[d].next.push_back(id);
+        s.ndeps++;
+    }
+    stages_.push_back(std::move(s));
+    return id;
+}
+
+void init_graph::worker()
+{
+    std::unique_lock<std::mutex> guard(lock_);
+
+    for (;;) {
+        wq_.wait(guard, [this] { return !ready_.empty() || done_ == stages_.size(); });
+        if (ready_.empty())
+            return;
+
+        std::pop_heap(ready_.begin(), ready_.end(), std::greater<unsigned>());
+        unsigned id = ready_.back();
+        ready_.pop_back();
+
+        stage &s = stages_[id];
+        int err = -ECANCELED;
+
+        s.t.start_ns = now_ns() - start_ns_;
+        if (!s.cancel) {
+            guard.unlock();
+            err = s.fn();
+            guard.lock();
+        }
+        s.t.end_ns = now_ns() - start_ns_;
+        s.t.err = err;
+        if (err && !err_)
+            err_ = err;
+
+        unsigned woken = 0;
+        for (unsigned n : s.next) {
+            stages_[n].cancel |= err != 0;
+            if (--stages_[n].pending)
+                continue;
+            ready_.push_back(n);
+            std::push_heap(ready_.begin(), ready_.end(), std::greater<unsigned>());
+            woken++;
+        }
+        if (++done_ == stages_.size() || woken > 1)
+            wq_.notify_all();
+        else if (woken)
+            wq_.notify_one();
+    }
+}
+
+int init_graph::run(unsigned threads)
+{
+    std::vector<std::thread> workers;
+
+    if (bad_deps_)
+        return -EINVAL;
+
+    ready_.clear();
+    for (unsigned id = 0; id < stages_.size(); id++) {
+        stage &s = stages_[id];
+
+        s.pending = s.ndeps;
+        s.cancel = false;
+        s.t = {};
+        if (!s.ndeps)
+            ready_.push_back(id);
+    }
+    std::make_heap(ready_.begin(), ready_.end(), std::greater<unsigned>());
+    done_ = 0;
+    err_ = 0;
+    start_ns_ = now_ns();
+
+    threads = std::max(1u, std::min<unsigned>(threads, stages_.size()));
+    for (unsigned i = 1; i < threads; i++)
+        workers.emplace_back(&init_graph::worker, this);
+    worker();
+    for (auto &t : workers)
+        t.join();
+
+    elapsed_ns_ = now_ns() - start_ns_;
+    return err_;
+}
+
+std::string init_graph::report() const
+{
+    std::string out;
+    char line[160];
+
+    for (const stage &s : stages_) {
+        int n = snprintf(line, sizeof(line), "%-20s start %9.3f ms  took %9.3f ms",
+                         s.name.c_str(), s.t.start_ns / 1e6, (s.t.end_ns - s.t.start_ns) / 1e6);
+
+        n = std::min<int>(n, sizeof(line) - 1);
+        if (s.t.err == -ECANCELED)
+            snprintf(line + n, sizeof(line) - n, "  skipped");
+        else if (s.t.err)
+            snprintf(line + n, sizeof(line) - n, "  error %d", s.t.err);
+        out += line;
+        out += '\n';
+    }
+    return out;
+}
+
+} /* namespace sx */
@@ -0,0 +1,288 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#include <algorithm>
+#include <cerrno>
+#include <iterator>
+
+#include "sx/kvd.h"
+
+namespace sx {
+
+kvd_alloc::kvd_alloc(uint32_t base, uint32_t size, move_fn move)
+    : base_(base), size_(size & ~(SX_KVD_CHUNK - 1)), move_(std::move(move)),
+      chunk_used_(size_ / SX_KVD_CHUNK)
+{
+    for (uint32_t off = 0; off < size_; off += SX_KVD_CHUNK)
+        free_[SX_KVD_MAX_ORDER].insert(off);
+    stats_.capacity = size_;
+}
+
+/* Free a block, merging it with its free buddies */
+void kvd_alloc::put_free(uint32_t off, unsigned order)
+{
+    while (order < SX_KVD_MAX_ORDER) {
+        auto it = free_[order].find(off ^ (1u << order));
+
+        if (it == free_[order].end())
+            break;
+        free_[order].erase(it);
+        off &= ~(1u << order);
+        order++;
+    }
+    free_[order].insert(off);
+}
+
+/* Free what no allocated block covers in the order @order block at @off */
+void kvd_alloc::add_free_range(uint32_t off, unsigned order)
+{
+    auto it = blocks_.lower_bound(off);
+
+    if (it == blocks_.end() || it->first >= off + (1u << order)) {
+        put_free(off, order);
+        return;
+    }
+    if (it->first == off && it->second.order == order)
+        return;
+    add_free_range(off, order - 1);
+    add_free_range(off + (1u << (order - 1)), order - 1);
+}
+
+/* Lowest block of the smallest class up to @max_order that fits, split down to @order */
+int kvd_alloc::take(unsigned order, uint32_t *off, unsigned max_order)
+{
+    for (unsigned o = order; o <= max_order; o++) {
+        if (free_[o].empty())
+            continue;
+        *off = *free_[o].begin();
+        free_[o].erase(free_[o].begin());
+        while (o > order) {
+            o--;
+            free_[o].insert(*off + (1u << o));
+        }
+        return 0;
+    }
+    return -ENOSPC;
+}
+
+int kvd_alloc::alloc(uint32_t size, uint64_t handle, uint32_t *index)
+{
+    unsigned order = size > 1 ? 32 - __builtin_clz(size - 1) : 0;
+    std::lock_guard<std::mutex> guard(lock_);
+    uint32_t off;
+
+    if (!size || order > SX_KVD_MAX_ORDER)
+        return -EINVAL;
+    if (take(order, &off)) {
+        stats_.failed++;
+        if (stats_.capacity - stats_.allocated >= 1u << order)
+            stats_.failed_fragmented++;
+        return -ENOSPC;
+    }
+
+    blocks_[off] = { size, static_cast<uint8_t>(order), handle };
+    chunk_used_[off / SX_KVD_CHUNK] += 1u << order;
+    stats_.used += size;
+    stats_.allocated += 1u << order;
+    stats_.allocs++;
+    *index = base_ + off;
+    return 0;
+}
+
+int kvd_alloc::reserve(uint32_t index, uint32_t size, uint64_t handle)
+{
+    unsigned order = size > 1 ? 32 - __builtin_clz(size - 1) : 0;
+    std::lock_guard<std::mutex> guard(lock_);
+    uint32_t off = index - base_;
+
+    if (!size || order > SX_KVD_MAX_ORDER || index < base_ || off >= size_ ||
+        off & ((1u << order) - 1))
+        return -EINVAL;
+
+    /* The free block holding it, split down around it */
+    for (unsigned o = order; o < SX_KVD_ORDERS; o++) {
+        uint32_t start = off & ~((1u << o) - 1);
+        auto it = free_[o].find(start);
+
+        if (it == free_[o].end())
+            continue;
+        free_[o].erase(it);
+        while (o > order) {
+            o--;
+            if (off & (1u << o)) {
+                free_[o].insert(start);
+                start += 1u << o;
+            } else {
+                free_[o].insert(start + (1u << o));
+            }
+        }
+
+        blocks_[off] = { size, static_cast<uint8_t>(order), handle };
+        chunk_used_[off / SX_KVD_CHUNK] += 1u << order;
+        stats_.used += size;
+        stats_.allocated += 1u << order;
+        stats_.allocs++;
+        return 0;
+    }
+    return -EBUSY;
+}
+
+void kvd_alloc::free(uint32_t index)
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    auto it = blocks_.find(index - base_);
+
+    if (it == blocks_.end())
+        return;
+
+    uint32_t off = it->first;
+    unsigned order = it->second.order;
+
+    chunk_used_[off / SX_KVD_CHUNK] -= 1u << order;
+    stats_.used -= it->second.size;
+    stats_.allocated -= 1u << order;
+    stats_.frees++;
+    blocks_.erase(it);
+    put_free(off, order);
+}
+
+/*
+ * Whether the blocks of @chunk fit in the free blocks of other chunks
+ * without splitting a free chunk: placed largest first, each in the
+ * smallest free block that holds it, as defrag_chunk() places them.
+ */
+bool kvd_alloc::fits_elsewhere(uint32_t chunk) const
+{
+    uint32_t start = chunk * SX_KVD_CHUNK, end = start + SX_KVD_CHUNK;
+    uint64_t nfree[SX_KVD_MAX_ORDER];
+    uint32_t need[SX_KVD_MAX_ORDER] = {};
+
+    for (unsigned o = 0; o < SX_KVD_MAX_ORDER; o++) {
+        const std::set<uint32_t> &fl = free_[o];
+
+        nfree[o] = fl.size() - std::distance(fl.lower_bound(start), fl.lower_bound(end));
+    }
+    for (auto it = blocks_.lower_bound(start); it != blocks_.end() && it->first < end; ++it)
+        need[it->second.order]++;
+
+    for (unsigned o = SX_KVD_MAX_ORDER; o-- > 0;) {
+        for (; need[o]; need[o]--) {
+            unsigned f = o;
+
+            while (f < SX_KVD_MAX_ORDER && !nfree[f])
+                f++;
+            if (f == SX_KVD_MAX_ORDER)
+                return false;
+            /* A split leaves one free block of each order in between */
+            nfree[f]--;
+            while (f > o)
+                nfree[--f]++;
+        }
+    }
+    return true;
+}
+
+/*
+ * Move the blocks of @chunk elsewhere, largest first, within @budget. Its
+ * free blocks are taken off the free lists meanwhile so nothing lands back
+ * in it, and no free chunk is split for them. Returns false if it could
+ * not be emptied.
+ */
+bool kvd_alloc::defrag_chunk(uint32_t chunk, unsigned *budget)
+{
+    uint32_t start = chunk * SX_KVD_CHUNK, end = start + SX_KVD_CHUNK;
+    std::vector<std::pair<uint32_t, block>> victims;
+    bool emptied = true;
+
+    for (std::set<uint32_t> &fl : free_)
+        fl.erase(fl.lower_bound(start), fl.lower_bound(end));
+
+    for (auto it = blocks_.lower_bound(start); it != blocks_.end() && it->first < end; ++it)
+        victims.push_back(*it);
+    std::stable_sort(victims.begin(), victims.end(), [](const auto &a, const auto &b) {
+        return a.second.order > b.second.order;
+    });
+
+    for (const auto &v : victims) {
+        const block &b = v.second;
+        uint32_t to;
+
+        if (!*budget || take(b.order, &to, SX_KVD_MAX_ORDER - 1)) {
+            emptied = false;
+            break;
+        }
+        if (move_(b.handle, base_ + v.first, base_ + to, b.size)) {
+            put_free(to, b.order);
+            stats_.move_failed++;
+            emptied = false;
+            break;
+        }
+        blocks_[to] = b;
+        chunk_used_[to / SX_KVD_CHUNK] += 1u << b.order;
+        chunk_used_[chunk] -= 1u << b.order;
+        blocks_.erase(v.first);
+        stats_.moves++;
+        (*budget)--;
+    }
+
+    add_free_range(start, SX_KVD_MAX_ORDER);
+    return emptied;
+}
+
+unsigned kvd_alloc::defrag(unsigned max_moves)
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    unsigned budget = max_moves;
+
+    if (!move_)
+        return 0;
+
+    while (budget) {
+        /* Free entries outside free chunks: worth a chunk once gathered? */
+        uint64_t scattered = stats_.capacity - stats_.allocated -
+                             free_[SX_KVD_MAX_ORDER].size() * SX_KVD_CHUNK;
+        std::vector<uint32_t> cand;
+        uint32_t victim = UINT32_MAX;
+
+        if (scattered < SX_KVD_CHUNK)
+            break;
+
+        /*
+         * The least used chunk whose blocks fit in the free blocks elsewhere,
+         * block by block: enough free entries in total is not enough if
+         * they are all smaller than its blocks.
+         */
+        for (uint32_t c = 0; c < chunk_used_.size(); c++) {
+            uint32_t used = chunk_used_[c];
+
+            if (used && used != SX_KVD_CHUNK && used <= scattered - (SX_KVD_CHUNK - used))
+                cand.push_back(c);
+        }
+        std::stable_sort(cand.begin(), cand.end(), [this](uint32_t a, uint32_t b) {
+            return chunk_used_[a] < chunk_used_[b];
+        });
+        for (uint32_t c : cand) {
+            if (fits_elsewhere(c)) {
+                victim = c;
+                break;
+            }
+        }
+        if (victim == UINT32_MAX || !defrag_chunk(victim, &budget))
+            break;
+    }
+    return max_moves - budget;
+}
+
+void kvd_alloc::get_stats(kvd_stats *out)
+{
+    std::lock_guard<std::mutex> guard(lock_);
+
+    *out = stats_;
+    out->largest_free = 0;
+    for (unsigned o = 0; o < SX_KVD_ORDERS; o++) {
+        out->free_blocks[o] = free_[o].size();
+        if (!free_[o].empty())
+            out->largest_free = 1u << o;
+    }
+}
+
+} /* namespace sx */
@@ -0,0 +1,464 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#include <cerrno>
+#include <cstring>
+#include <endian.h>
+
+#include "sx/netdev.h"
+
+namespace sx {
+
+#define ETH_HLEN        14
+#define IP_HLEN         20
+#define IP_OFF_TOS      1
+#define IP_OFF_LEN      2
+#define IP_OFF_FRAG     6
+#define IP_OFF_TTL      8
+#define IP_OFF_PROTO    9
+#define IP_OFF_CSUM     10
+#define IP_OFF_SADDR    12
+#define IP_MF_OFFSET    0x3fff      /* more fragments, fragment offset */
+#define IP_PROTO_TCP    6
+#define TCP_OFF_SEQ     4
+#define TCP_OFF_ACK     8
+#define TCP_OFF_DOFF    12
+#define TCP_OFF_FLAGS   13
+#define TCP_OFF_WIN     14
+#define TCP_F_PSH       0x08
+#define TCP_F_ACK       0x10
+
+static void put16(uint8_t *p, uint16_t v)
+{
+    v = htobe16(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+    uint16_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return be16toh(v);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return be32toh(v);
+}
+
+static uint16_t ip_csum(const uint8_t *ip)
+{
+    uint32_t sum = 0;
+
+    for (unsigned i = 0; i < IP_HLEN; i += 2)
+        sum += i == IP_OFF_CSUM ? 0 : get16(ip + i);
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return static_cast<uint16_t>(~sum);
+}
+
+/*
+ * TCP segment as GRO sees it; valid only if parse_tcp() accepted it. Of
+ * the flags only ACK and PSH may be set: SYN, FIN, RST, URG and ECN
+ * signalling each go up on their own, as tcp_gro_receive() has it.
+ */
+struct tcp_seg {
+    const uint8_t *ip;
+    const uint8_t *tcp;
+    uint32_t       hlen;        /* Ethernet, IP and TCP headers */
+    uint32_t       payload;
+    uint32_t       seq;
+    uint8_t        flags;
+};
+
+static bool parse_tcp(const pkt_buf *buf, tcp_seg *s)
+{
+    const uint8_t *p = buf->data;
+    uint32_t ip_len, doff;
+
+    if (buf->len < ETH_HLEN + IP_HLEN + 20 || get16(p + 12) != 0x0800)
+        return false;
+    s->ip = p + ETH_HLEN;
+    if (s->ip[0] != 0x45 || (get16(s->ip + IP_OFF_FRAG) & IP_MF_OFFSET) ||
+        s->ip[IP_OFF_PROTO] != IP_PROTO_TCP)
+        return false;
+
+    ip_len = get16(s->ip + IP_OFF_LEN);
+    s->tcp = s->ip + IP_HLEN;
+    doff = (s->tcp[TCP_OFF_DOFF] >> 4) * 4;
+    if (doff < 20 || ETH_HLEN + ip_len > buf->len || ip_len < IP_HLEN + doff)
+        return false;
+
+    s->flags = s->tcp[TCP_OFF_FLAGS];
+    if ((s->flags & ~TCP_F_PSH) != TCP_F_ACK || (s->tcp[TCP_OFF_DOFF] & 0x0f))
+        return false;
+    s->hlen = ETH_HLEN + IP_HLEN + doff;
+    s->payload = ETH_HLEN + ip_len - s->hlen;
+    s->seq = get32(s->tcp + TCP_OFF_SEQ);
+    return s->payload != 0;
+}
+
+void netdev_skb_free(netdev_skb *skb)
+{
+    pkt_buf_free(skb->head);
+    for (unsigned i = 0; i < skb->nr_frags; i++)
+        pkt_buf_free(skb->frags[i].buf);
+    delete skb;
+}
+
+/*
+ * Receive queue: consumer of one RDQ. Touched by its NAPI context only;
+ * a poll's deliver() calls and its flush() are one GRO batch.
+ */
+class port_netdevs::rx_queue : public rdq_consumer {
+public:
+    rx_queue(port_netdevs &nd, unsigned rdq, int xdp_sdq)
+        : nd_(nd), rdq_(rdq), xdp_sdq_(xdp_sdq) {}
+    ~rx_queue() override { page_pool::destroy(pool_); }
+
+    int create(uint32_t buf_size, unsigned pool_bufs)
+    {
+        pool_ = page_pool::create(pool_bufs, buf_size);
+        return pool_ ? 0 : -ENOMEM;
+    }
+
+    uint32_t buf_size() const override { return pool_->buf_size(); }
+    pkt_buf *alloc_buf() override { return pool_->alloc(); }
+    void deliver(const rx_info &info, pkt_buf *buf) override;
+    void flush() override;
+
+private:
+    /* A flow with packets held, merged into skb */
+    struct held_flow {
+        netdev_skb *skb;
+        netdev     *nd;
+        uint64_t    age;            /* batch order of the first packet */
+        uint32_t    next_seq;
+    };
+
+    netdev_skb *new_skb(const rx_info &info, pkt_buf *buf, uint32_t len);
+    bool merge(held_flow &h, pkt_buf *buf, const tcp_seg &s);
+    void hold(netdev *nd, netdev_skb *skb, const tcp_seg &s);
+    void flush_flow(unsigned i);
+    void up(netdev *nd, netdev_skb *skb);
+    bool run_xdp(const xdp_prog &prog, netdev *nd, const rx_info &info, pkt_buf *buf);
+
+    port_netdevs &nd_;
+    unsigned      rdq_;
+    page_pool    *pool_ = nullptr;
+    bool          in_poll_ = false;
+    bool          gro_ = false;         /* sampled at the start of a poll */
+    int           xdp_sdq_;
+    bool          xdp_sent_ = false;    /* sends on xdp_sdq_ wait for a doorbell */
+    uint64_t      age_ = 0;
+    unsigned      nheld_ = 0;
+    held_flow     held_[SX_GRO_MAX_HELD];
+};
+
+netdev_skb *port_netdevs::rx_queue::new_skb(const rx_info &info, pkt_buf *buf, uint32_t len)
+{
+    netdev_skb *skb = new netdev_skb;
+
+    skb->head = buf;
+    skb->head_len = len;
+    skb->len = len;
+    skb->nr_frags = 0;
+    skb->gso_size = 0;
+    skb->gso_segs = 1;
+    skb->port = info.sys_port;
+    skb->queue = rdq_;
+    skb->flow_hash = info.flow_hash;
+    skb->timestamp = info.timestamp;
+    return skb;
+}
+
+void port_netdevs::rx_queue::up(netdev *nd, netdev_skb *skb)
+{
+    {
+        pcpu_stats<counters>::update st(nd_.stats_);
+        netdev_stats &ns = st->port[nd->port];
+
+        stats_inc(&ns.rx_skbs);
+        stats_inc(&ns.gro_merged, skb->gso_segs - 1);
+    }
+    nd->fn(skb);
+}
+
+/*
+ * Same flow, next in sequence, and headers that differ from the held ones
+ * only in sequence number and length. The last segment may be short.
+ */
+bool port_netdevs::rx_queue::merge(held_flow &h, pkt_buf *buf, const tcp_seg &s)
+{
+    netdev_skb *skb = h.skb;
+    uint8_t *ip = skb->head->data + ETH_HLEN;
+    uint8_t *tcp = ip + IP_HLEN;
+    uint32_t hlen = skb->head_len - skb->gso_size;
+
+    if (s.hlen != hlen || s.seq != h.next_seq || s.payload > skb->gso_size ||
+        skb->nr_frags == SX_GRO_MAX_SEGS - 1 ||
+        skb->len - ETH_HLEN + s.payload > SX_GRO_MAX_SIZE ||
+        s.ip[IP_OFF_TOS] != ip[IP_OFF_TOS] || s.ip[IP_OFF_TTL] != ip[IP_OFF_TTL] ||
+        memcmp(s.tcp + TCP_OFF_ACK, tcp + TCP_OFF_ACK, 4) ||
+        memcmp(s.tcp + TCP_OFF_WIN, tcp + TCP_OFF_WIN, 2) ||
+        memcmp(s.tcp + 20, tcp + 20, hlen - ETH_HLEN - IP_HLEN - 20))
+        return false;
+
+    skb->frags[skb->nr_frags++] = { buf, s.hlen, s.payload };
+    skb->len += s.payload;
+    skb->gso_segs++;
+    tcp[TCP_OFF_FLAGS] |= s.flags & TCP_F_PSH;
+    h.next_seq += s.payload;
+    return true;
+}
+
+void port_netdevs::rx_queue::hold(netdev *nd, netdev_skb *skb, const tcp_seg &s)
+{
+    unsigned oldest = 0;
+
+    if (nheld_ == SX_GRO_MAX_HELD) {
+        for (unsigned i = 1; i < nheld_; i++) {
+            if (held_[i].age < held_[oldest].age)
+                oldest = i;
+        }
+        flush_flow(oldest);
+    }
+    skb->gso_size = s.payload;
+    held_[nheld_++] = { skb, nd, age_++, s.seq + s.payload };
+}
+
+/* Send held flow @i up, its headers describing every segment merged */
+void port_netdevs::rx_queue::flush_flow(unsigned i)
+{
+    held_flow h = held_[i];
+    netdev_skb *skb = h.skb;
+
+    held_[i] = held_[--nheld_];
+    if (skb->gso_segs > 1) {
+        uint8_t *ip = skb->head->data + ETH_HLEN;
+
+        put16(ip + IP_OFF_LEN, skb->len - ETH_HLEN);
+        put16(ip + IP_OFF_CSUM, ip_csum(ip));
+    } else {
+        skb->gso_size = 0;
+    }
+    up(h.nd, skb);
+}
+
+/* Returns false for XDP_PASS; else the frame is gone, dropped or sent */
+bool port_netdevs::rx_queue::run_xdp(const xdp_prog &prog, netdev *nd, const rx_info &info,
+                                     pkt_buf *buf)
+{
+    xdp_buff xdp = { buf->data, buf->data + buf->len, info.sys_port, info.trap_id,
+                     static_cast<uint8_t>(rdq_), info.sys_port };
+    int act = prog(&xdp), err = -ENODEV;
+    uint16_t port = act == SX_XDP_TX ? info.sys_port : xdp.redirect_port;
+    uint64_t netdev_stats::*c = &netdev_stats::xdp_drop;
+
+    if (act == SX_XDP_PASS)
+        return false;
+    if (act == SX_XDP_TX || act == SX_XDP_REDIRECT) {
+        if (xdp_sdq_ >= 0)
+            err = nd_.dev_.send_sg(xdp_sdq_, port, &buf, 1, SX_SEND_MORE);
+        xdp_sent_ |= !err;
+        c = err ? &netdev_stats::xdp_tx_errors : &netdev_stats::xdp_tx;
+    }
+    {
+        pcpu_stats<counters>::update st(nd_.stats_);
+        stats_inc(&(st->port[nd->port].*c));
+    }
+    if (err)
+        pkt_buf_free(buf);
+    return true;
+}
+
+void port_netdevs::rx_queue::deliver(const rx_info &info, pkt_buf *buf)
+{
+    netdev *nd = info.sys_port < SX_MAX_PORTS ?
+                 nd_.netdevs_[info.sys_port].load(std::memory_order_acquire) : nullptr;
+    tcp_seg s;
+    unsigned i;
+
+    if (!in_poll_) {
+        in_poll_ = true;
+        gro_ = nd_.gro_.load(std::memory_order_relaxed);
+        pool_->napi_enter();
+    }
+    if (!nd) {
+        {
+            pcpu_stats<counters>::update st(nd_.stats_);
+            stats_inc(&st->rx_dropped);
+        }
+        pkt_buf_free(buf);
+        return;
+    }
+    {
+        pcpu_stats<counters>::update st(nd_.stats_);
+
+        stats_inc(&st->port[nd->port].rx_packets);
+        stats_inc(&st->port[nd->port].rx_bytes, buf->len);
+    }
+
+    const xdp_prog *prog = nd->xdp.load(std::memory_order_acquire);
+    if (prog && run_xdp(*prog, nd, info, buf))
+        return;
+
+    if (!gro_ || !parse_tcp(buf, &s)) {
+        /* A packet of a held flow must not overtake it */
+        for (i = 0; i < nheld_; i++) {
+            if (held_[i].skb->flow_hash == info.flow_hash &&
+                held_[i].skb->port == info.sys_port)
+                flush_flow(i--);
+        }
+        up(nd, new_skb(info, buf, buf->len));
+        return;
+    }
+
+    for (i = 0; i < nheld_; i++) {
+        const netdev_skb *h = held_[i].skb;
+        const uint8_t *ip = h->head->data + ETH_HLEN;
+
+        if (h->flow_hash == info.flow_hash && h->port == info.sys_port &&
+            !memcmp(ip + IP_OFF_SADDR, s.ip + IP_OFF_SADDR, 8) &&
+            !memcmp(ip + IP_HLEN, s.tcp, 4))
+            break;
+    }
+    if (i < nheld_) {
+        held_flow &h = held_[i];
+
+        if (merge(h, buf, s)) {
+            if (s.payload < h.skb->gso_size || (s.flags & TCP_F_PSH))
+                flush_flow(i);
+            return;
+        }
+        flush_flow(i);
+    }
+
+    /* Padding past the IP length is not part of the segment */
+    netdev_skb *skb = new_skb(info, buf, s.hlen + s.payload);
+    if (s.flags & TCP_F_PSH) {
+        up(nd, skb);
+        return;
+    }
+    hold(nd, skb, s);
+}
+
+/* End of the poll: whatever is held goes up, oldest first */
+void port_netdevs::rx_queue::flush()
+{
+    if (!in_poll_)
+        return;
+    if (xdp_sent_) {
+        nd_.dev_.flush_sdq(xdp_sdq_);
+        xdp_sent_ = false;
+    }
+    while (nheld_) {
+        unsigned oldest = 0;
+
+        for (unsigned i = 1; i < nheld_; i++) {
+            if (held_[i].age < held_[oldest].age)
+                oldest = i;
+        }
+        flush_flow(oldest);
+    }
+    age_ = 0;
+    pool_->napi_exit();
+    in_poll_ = false;
+}
+
+port_netdevs::port_netdevs(dev &d) : dev_(d)
+{
+}
+
+port_netdevs::~port_netdevs()
+{
+    rxqs_.clear();
+    for (auto &p : netdevs_)
+        delete p.load(std::memory_order_relaxed);
+}
+
+int port_netdevs::register_netdev(uint16_t port, const std::string &name, netdev_rx_fn fn)
+{
+    netdev *expected = nullptr;
+
+    if (port >= SX_MAX_PORTS || !fn)
+        return -EINVAL;
+    if (netdevs_[port].load(std::memory_order_relaxed))
+        return -EEXIST;
+
+    /* Two registrations of one port: only the first gets in */
+    netdev *nd = new netdev{ name, port, std::move(fn) };
+    if (!netdevs_[port].compare_exchange_strong(expected, nd, std::memory_order_release,
+                                                std::memory_order_relaxed)) {
+        delete nd;
+        return -EEXIST;
+    }
+    return 0;
+}
+
+int port_netdevs::add_rx_queue(unsigned rdq, uint32_t buf_size, unsigned pool_bufs,
+                               int xdp_sdq)
+{
+    int err;
+
+    if (rdq >= SX_MAX_RDQ || !buf_size || buf_size > 0xffff || !pool_bufs ||
+        xdp_sdq >= SX_MAX_SDQ)
+        return -EINVAL;
+
+    auto q = std::make_unique<rx_queue>(*this, rdq, xdp_sdq < 0 ? -1 : xdp_sdq);
+    err = q->create(buf_size, pool_bufs);
+    if (err)
+        return err;
+    err = dev_.bind_rdq(rdq, q.get());
+    if (err)
+        return err;
+    rxqs_.push_back(std::move(q));
+    return 0;
+}
+
+int port_netdevs::set_xdp(uint16_t port, xdp_prog prog)
+{
+    netdev *nd = port < SX_MAX_PORTS ? netdevs_[port].load(std::memory_order_acquire) : nullptr;
+    const xdp_prog *p = nullptr;
+
+    if (!nd)
+        return -ENODEV;
+    if (prog) {
+        std::lock_guard<std::mutex> guard(xdp_lock_);
+
+        xdp_progs_.push_back(std::make_unique<xdp_prog>(std::move(prog)));
+        p = xdp_progs_.back().get();
+    }
+    nd->xdp.store(p, std::memory_order_release);
+    return 0;
+}
+
+int port_netdevs::get_stats(uint16_t port, netdev_stats *out) const
+{
+    if (port >= SX_MAX_PORTS || !netdevs_[port].load(std::memory_order_acquire))
+        return -ENODEV;
+    stats_.read(out, [port](const counters &c) -> const netdev_stats & {
+        return c.port[port];
+    });
+    return 0;
+}
+
+const std::string *port_netdevs::name(uint16_t port) const
+{
+    netdev *nd = port < SX_MAX_PORTS ? netdevs_[port].load(std::memory_order_acquire) : nullptr;
+
+    return nd ? &nd->name : nullptr;
+}
+
+uint64_t port_netdevs::rx_dropped() const
+{
+    uint64_t out;
+
+    stats_.read(&out, [](const counters &c) -> const uint64_t & { return c.rx_dropped; });
+    return out;
+}
+
+} /* namespace sx */
@@ -0,0 +1,119 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#include <mutex>
+
+#include "sx/page_pool.h"
+
+namespace sx {
+
+page_pool *page_pool::create(unsigned nbufs, uint32_t buf_size)
+{
+    uint32_t stride = (buf_size + SX_CACHELINE - 1) & ~(SX_CACHELINE - 1);
+    page_pool *pool;
+
+    if (!nbufs || !buf_size || buf_size > 0xffff)
+        return nullptr;
+
+    pool = new page_pool;
+    if (dma_alloc_coherent(static_cast<size_t>(nbufs) * stride, &pool->mem_)) {
+        delete pool;
+        return nullptr;
+    }
+
+    pool->buf_size_ = buf_size;
+    pool->nbufs_ = nbufs;
+    pool->bufs_.resize(nbufs);
+    pool->ring_.resize(nbufs);
+    for (unsigned i = 0; i < nbufs; i++) {
+        pkt_buf *buf = &pool->bufs_[i];
+
+        buf->data = static_cast<uint8_t *>(pool->mem_.cpu) + static_cast<size_t>(i) * stride;
+        buf->len = 0;
+        buf->size = buf_size;
+        buf->dma = pool->mem_.dma + static_cast<uint64_t>(i) * stride;
+        buf->owner = pool;
+        pool->ring_[i] = buf;
+    }
+    pool->ring_count_ = nbufs;
+    return pool;
+}
+
+/* No allocation or poll may be running; buffers still out keep it alive. */
+void page_pool::destroy(page_pool *pool)
+{
+    bool idle;
+
+    if (!pool)
+        return;
+    {
+        std::lock_guard<spinlock> guard(pool->ring_lock_);
+
+        pool->dying_ = true;
+        idle = pool->held_ == pool->recycle_ring_;
+    }
+    if (idle)
+        delete pool;
+}
+
+page_pool::~page_pool()
+{
+    dma_free_coherent(&mem_);
+}
+
+pkt_buf *page_pool::alloc_slow()
+{
+    {
+        std::lock_guard<spinlock> guard(ring_lock_);
+
+        while (ring_count_ && cache_count_ < SX_PAGE_POOL_REFILL) {
+            cache_[cache_count_++] = ring_[ring_head_];
+            ring_head_ = ring_head_ + 1 == nbufs_ ? 0 : ring_head_ + 1;
+            ring_count_--;
+        }
+    }
+    if (cache_count_) {
+        stats_.alloc_slow++;
+        held_++;
+        return cache_[--cache_count_];
+    }
+
+    /* Every buffer is out: borrow one from the allocator */
+    stats_.alloc_fallback++;
+    return pkt_buf_alloc(buf_size_);
+}
+
+void page_pool::release(pkt_buf *buf)
+{
+    bool last;
+
+    if (pthread_equal(napi_owner_.load(std::memory_order_relaxed), pthread_self()) &&
+        cache_count_ < SX_PAGE_POOL_CACHE) {
+        stats_.recycle_cached++;
+        held_--;
+        cache_[cache_count_++] = buf;
+        return;
+    }
+
+    {
+        std::lock_guard<spinlock> guard(ring_lock_);
+        unsigned tail = ring_head_ + ring_count_;
+
+        ring_[tail >= nbufs_ ? tail - nbufs_ : tail] = buf;
+        ring_count_++;
+        recycle_ring_++;
+        last = dying_ && held_ == recycle_ring_;
+    }
+    if (last)
+        delete this;
+}
+
+void page_pool::get_stats(page_pool_stats *out) const
+{
+    out->alloc_fast = read_once(&stats_.alloc_fast);
+    out->alloc_slow = read_once(&stats_.alloc_slow);
+    out->alloc_fallback = read_once(&stats_.alloc_fallback);
+    out->recycle_cached = read_once(&stats_.recycle_cached);
+    out->recycle_ring = read_once(&recycle_ring_);
+}
+
+} /* namespace sx */
@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#include <mutex>
+#include <vector>
+
+#include "sx/pcpu.h"
+
+namespace sx {
+
+static std::mutex cpu_ids_lock;
+static std::vector<unsigned> cpu_ids_free;
+static unsigned cpu_ids_next;
+
+/* Slot owned by one thread; given back when the thread exits. */
+struct cpu_id {
+    unsigned id;
+
+    cpu_id()
+    {
+        std::lock_guard<std::mutex> guard(cpu_ids_lock);
+
+        if (!cpu_ids_free.empty()) {
+            id = cpu_ids_free.back();
+            cpu_ids_free.pop_back();
+        } else if (cpu_ids_next < SX_NR_CPUS) {
+            id = cpu_ids_next++;
+        } else {
+            id = SX_NR_CPUS;
+        }
+    }
+
+    ~cpu_id()
+    {
+        std::lock_guard<std::mutex> guard(cpu_ids_lock);
+
+        if (id != SX_NR_CPUS)
+            cpu_ids_free.push_back(id);
+    }
+};
+
+unsigned this_cpu()
+{
+    static thread_local cpu_id cpu;
+
+    return cpu.id;
+}
+
+} /* namespace sx */
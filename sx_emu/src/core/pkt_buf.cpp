@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#include <cstdlib>
+
+#include "sx/compiler.h"
+#include "sx/dma.h"
+#include "sx/pkt_buf.h"
+
+namespace sx {
+
+#define SX_PKT_HDR_ROOM ((sizeof(pkt_buf) + SX_CACHELINE - 1) & ~(SX_CACHELINE - 1))
+
+pkt_buf *pkt_buf_alloc(uint32_t size)
+{
+    void *p = std::aligned_alloc(SX_CACHELINE, SX_PKT_HDR_ROOM +
+                                 ((size + SX_CACHELINE - 1) & ~(SX_CACHELINE - 1)));
+    if (!p)
+        return nullptr;
+
+    pkt_buf *buf = static_cast<pkt_buf *>(p);
+    buf->data = static_cast<uint8_t *>(p) + SX_PKT_HDR_ROOM;
+    buf->len = 0;
+    buf->size = size;
+    buf->dma = dma_map_single(buf->data);
+    buf->owner = nullptr;
+    return buf;
+}
+
+void pkt_buf_free(pkt_buf *buf)
+{
+    if (buf && buf->owner)
+        buf->owner->release(buf);
+    else
+        std::free(buf);
+}
+
+} /* namespace sx */
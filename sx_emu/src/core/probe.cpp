@@ -0,0 +1,92 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#include <cerrno>
+#include <chrono>
+#include <endian.h>
+#include <thread>
+#include <vector>
+
+#include "sx/probe.h"
+
+namespace sx {
+
+#define SX_PROBE_EMAD_GROUP 0
+
+int port_up(emad &e, uint16_t port, unsigned timeout_ms)
+{
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    emad_op op;
+    int err;
+
+    op.reg_id = SX_REG_ID_PAOS;
+    op.method = SX_EMAD_METHOD_WRITE;
+    op.payload.assign(sizeof(sx_paos_reg), 0);
+
+    sx_paos_reg *reg = reinterpret_cast<sx_paos_reg *>(op.payload.data());
+    reg->local_port = htobe16(port);
+    reg->admin_status = SX_PORT_STATUS_UP;
+    reg->ase = 1;
+
+    /* The write answers with the link status too; then poll it */
+    for (;;) {
+        err = e.access(op);
+        if (err)
+            return err;
+        reg = reinterpret_cast<sx_paos_reg *>(op.payload.data());
+        if (reg->oper_status == SX_PORT_STATUS_UP)
+            return 0;
+        if (std::chrono::steady_clock::now() >= end)
+            return -ETIMEDOUT;
+        std::this_thread::sleep_for(std::chrono::microseconds(SX_PORT_POLL_US));
+        op.method = SX_EMAD_METHOD_QUERY;
+    }
+}
+
+unsigned probe_stages(init_graph &g, const std::string &name, dev &d, emad &e,
+                      const probe_config &cfg)
+{
+    std::string p = name + "/";
+    std::vector<unsigned> cqs, queues;
+
+    if (!cfg.num_sdq || !cfg.num_rdq)
+        return g.add(p + "ready", [] { return -EINVAL; });
+
+    unsigned fw = g.add(p + "fw", [&d, cfg] { return d.reset_fw(cfg.fw_timeout_ms); });
+    unsigned caps = g.add(p + "caps", [&d] { return d.init(); }, { fw });
+
+    for (unsigned n = 0; n < cfg.num_sdq + cfg.num_rdq; n++) {
+        cqs.push_back(g.add(p + "cq." + std::to_string(n),
+                            [&d, cfg, n] { return d.create_cq(n, cfg.log_cq_size); }, { caps }));
+    }
+    for (unsigned n = 0; n < cfg.num_sdq; n++) {
+        queues.push_back(g.add(p + "sdq." + std::to_string(n),
+                               [&d, cfg, n] { return d.create_sdq(n, cfg.log_dq_size, n); },
+                               { cqs[n] }));
+    }
+    for (unsigned n = 0; n < cfg.num_rdq; n++) {
+        unsigned cqn = cfg.num_sdq + n;
+
+        queues.push_back(g.add(p + "rdq." + std::to_string(n),
+                               [&d, cfg, n, cqn] {
+                                   return d.create_rdq(n, cfg.log_dq_size, cqn, cfg.rdq_buf_size);
+                               },
+                               { cqs[cqn] }));
+    }
+
+    unsigned trap = g.add(p + "trap", [&d] {
+        int err = d.set_trap_group_rdq(SX_PROBE_EMAD_GROUP, 0);
+
+        return err ? err : d.set_trap_group(SX_TRAP_ID_EMAD, SX_PROBE_EMAD_GROUP);
+    }, { queues[cfg.num_sdq] });
+    unsigned em = g.add(p + "emad", [&e] { return e.init(); }, { trap, queues[0] });
+
+    std::vector<unsigned> all = queues;
+    all.push_back(em);
+    for (unsigned port = 0; port < cfg.num_ports; port++) {
+        all.push_back(g.add(p + "port." + std::to_string(port),
+                            [&e, port] { return port_up(e, port); }, { em }));
+    }
+    return g.add(p + "ready", [] { return 0; }, all);
+}
+
+} /* namespace sx */
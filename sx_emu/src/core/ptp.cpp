@@ -0,0 +1,271 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "sx/compiler.h"
+#include "sx/ptp.h"
+
+namespace sx {
+
+static bool key_is_rx(uint64_t key)
+{
+    return !((key >> 28) & 1);
+}
+
+ptp::ptp(dev &d, unsigned size, unsigned max_age_us)
+    : dev_(d), max_age_ns_(max_age_us * 1000ull)
+{
+    nbuckets_ = roundup_pow_of_two(std::max(2u, size / SX_PTP_BUCKET_WAYS));
+    buckets_.reset(new bucket[nbuckets_]);
+    shift_ = 64 - __builtin_ctz(nbuckets_);
+}
+
+ptp::~ptp()
+{
+    if (started_) {
+        dev_.del_listener(SX_TRAP_ID_PTP_EVENT);
+        dev_.del_listener(SX_TRAP_ID_PTP_TS);
+    }
+    for (unsigned i = 0; i < nbuckets_; i++) {
+        for (const entry &e : buckets_[i].e) {
+            if ((e.h.tag & TAG_KIND) == TAG_PKT && key_is_rx(e.h.tag & TAG_KEY))
+                pkt_buf_free(reinterpret_cast<pkt_buf *>(e.h.val));
+        }
+    }
+}
+
+int ptp::start(ptp_rx_fn rx, ptp_tx_fn tx)
+{
+    int err;
+
+    rx_ = std::move(rx);
+    tx_ = std::move(tx);
+    err = dev_.add_listener(SX_TRAP_ID_PTP_EVENT, [this](const rx_info &info, pkt_buf *buf) {
+        event(info, buf);
+    });
+    if (err)
+        return err;
+    err = dev_.add_listener(SX_TRAP_ID_PTP_TS, [this](const rx_info &info, pkt_buf *buf) {
+        stamps(info, buf);
+    });
+    if (err) {
+        dev_.del_listener(SX_TRAP_ID_PTP_EVENT);
+        return err;
+    }
+    started_ = true;
+    return 0;
+}
+
+/* The two buckets of @key; distinct, as there are at least two */
+void ptp::buckets_of(uint64_t key, bucket *b[2])
+{
+    unsigned i = (key * 0x9e3779b97f4a7c15ull) >> shift_;
+    unsigned j = (key * 0xc2b2ae3d27d4eb4full) >> shift_;
+
+    b[0] = &buckets_[i];
+    b[1] = &buckets_[j != i ? j : i ^ 1];
+}
+
+/* Lower index first, so two keys sharing both buckets cannot deadlock */
+void ptp::lock(bucket *const b[2])
+{
+    std::min(b[0], b[1])->lock.lock();
+    std::max(b[0], b[1])->lock.lock();
+}
+
+void ptp::unlock(bucket *const b[2])
+{
+    b[0]->lock.unlock();
+    b[1]->lock.unlock();
+}
+
+/* A half that waited in vain: the packet goes on without its stamp */
+void ptp::expire(const half &h)
+{
+    if ((h.tag & TAG_KIND) == TAG_TS) {
+        ts_dropped_.fetch_add(1, std::memory_order_relaxed);
+    } else if (key_is_rx(h.tag & TAG_KEY)) {
+        rx_unmatched_.fetch_add(1, std::memory_order_relaxed);
+        rx_(h.info, reinterpret_cast<pkt_buf *>(h.val), 0);
+    } else {
+        tx_unmatched_.fetch_add(1, std::memory_order_relaxed);
+        tx_(h.val, 0);
+    }
+}
+
+/*
+ * Meet the other half of @h's key in either of its buckets, or wait there
+ * for it. Returns 1 with the other half in @other, 0 if @h waits now, or
+ * -EBUSY if both buckets are full of other keys none of which has aged.
+ * @now is the host time @h arrived; halves are delivered outside the
+ * bucket locks.
+ */
+int ptp::settle(const half &h, uint64_t now, half *other)
+{
+    uint64_t match = (h.tag & TAG_KEY) | ((h.tag & TAG_KIND) == TAG_PKT ? TAG_TS : TAG_PKT);
+    bucket *b[2];
+    entry *victim = nullptr;
+    half old;
+
+    buckets_of(h.tag & TAG_KEY, b);
+    lock(b);
+    for (bucket *bk : b) {
+        for (entry &e : bk->e) {
+            if (e.h.tag == match) {
+                *other = e.h;
+                e.h.tag = TAG_EMPTY;
+                unlock(b);
+                return 1;
+            }
+
+            /* Same key and kind (a reused sequence ID), else empty, else the oldest */
+            if (victim && victim->h.tag == h.tag)
+                continue;
+            if (!victim || e.h.tag == h.tag ||
+                (e.h.tag == TAG_EMPTY && victim->h.tag != TAG_EMPTY) ||
+                (victim->h.tag != TAG_EMPTY &&
+                 static_cast<int64_t>(e.since_ns - victim->since_ns) < 0))
+                victim = &e;
+        }
+    }
+    if (victim->h.tag != TAG_EMPTY && victim->h.tag != h.tag &&
+        static_cast<int64_t>(now - victim->since_ns) < static_cast<int64_t>(max_age_ns_)) {
+        unlock(b);
+        collisions_.fetch_add(1, std::memory_order_relaxed);
+        return -EBUSY;
+    }
+    old = victim->h;
+    victim->h = h;
+    victim->since_ns = now;
+    unlock(b);
+
+    if (old.tag != TAG_EMPTY)
+        expire(old);
+    return 0;
+}
+
+void ptp::event(const rx_info &info, pkt_buf *buf)
+{
+    sx_ptp_ts_rec rec;
+    half h, o;
+    int ret = -EINVAL;
+
+    if (sx_ptp_parse(buf->data, buf->len, &rec)) {
+        h.tag = TAG_PKT | sx_ptp_key(info.sys_port, SX_PTP_DIR_RX, rec.msg_type, rec.domain,
+                                     rec.seq_id);
+        h.val = reinterpret_cast<uint64_t>(buf);
+        h.info = info;
+        ret = settle(h, now_ns(), &o);
+    }
+    if (ret > 0) {
+        rx_matched_.fetch_add(1, std::memory_order_relaxed);
+        rx_(info, buf, o.val);
+    } else if (ret < 0) {
+        rx_unmatched_.fetch_add(1, std::memory_order_relaxed);
+        rx_(info, buf, 0);
+    }
+}
+
+void ptp::stamps(const rx_info &, pkt_buf *buf)
+{
+    uint64_t now = now_ns();
+
+    for (uint32_t off = 0; off + sizeof(sx_ptp_ts_rec) <= buf->len; off += sizeof(sx_ptp_ts_rec)) {
+        sx_ptp_ts_rec rec;
+        half h = {}, o;
+        int ret;
+
+        memcpy(&rec, buf->data + off, sizeof(rec));
+        h.tag = TAG_TS | sx_ptp_rec_key(rec);
+        h.val = rec.timestamp;
+        ret = settle(h, now, &o);
+        if (ret < 0) {
+            ts_dropped_.fetch_add(1, std::memory_order_relaxed);
+        } else if (!ret) {
+            continue;
+        } else if (rec.dir == SX_PTP_DIR_RX) {
+            rx_matched_.fetch_add(1, std::memory_order_relaxed);
+            rx_(o.info, reinterpret_cast<pkt_buf *>(o.val), rec.timestamp);
+        } else {
+            tx_matched_.fetch_add(1, std::memory_order_relaxed);
+            tx_(o.val, rec.timestamp);
+        }
+    }
+    pkt_buf_free(buf);
+}
+
+int ptp::xmit(unsigned sdq, uint16_t port, const void *data, uint32_t len, uint64_t cookie)
+{
+    sx_ptp_ts_rec rec;
+    half h = {}, o;
+    int ret, err;
+
+    if (!sx_ptp_parse(static_cast<const uint8_t *>(data), len, &rec))
+        return -EINVAL;
+    h.tag = TAG_PKT | sx_ptp_key(port, SX_PTP_DIR_TX, rec.msg_type, rec.domain, rec.seq_id);
+    h.val = cookie;
+
+    /* A stamp already waiting belongs to an earlier send of the same key */
+    while ((ret = settle(h, now_ns(), &o)) > 0)
+        ts_dropped_.fetch_add(1, std::memory_order_relaxed);
+    if (ret)
+        return ret;
+
+    err = dev_.send(sdq, port, data, len);
+    if (err) {
+        bucket *b[2];
+
+        /* Never sent, so no stamp can have claimed it */
+        buckets_of(h.tag & TAG_KEY, b);
+        lock(b);
+        for (bucket *bk : b) {
+            for (entry &e : bk->e) {
+                if (e.h.tag == h.tag && e.h.val == cookie)
+                    e.h.tag = TAG_EMPTY;
+            }
+        }
+        unlock(b);
+    }
+    return err;
+}
+
+unsigned ptp::age()
+{
+    uint64_t now = now_ns();
+    unsigned n = 0;
+
+    for (unsigned i = 0; i < nbuckets_; i++) {
+        bucket &b = buckets_[i];
+        half old[SX_PTP_BUCKET_WAYS];
+        unsigned k = 0;
+
+        b.lock.lock();
+        for (entry &e : b.e) {
+            if (e.h.tag == TAG_EMPTY ||
+                static_cast<int64_t>(now - e.since_ns) < static_cast<int64_t>(max_age_ns_))
+                continue;
+            old[k++] = e.h;
+            e.h.tag = TAG_EMPTY;
+        }
+        b.lock.unlock();
+
+        for (unsigned j = 0; j < k; j++)
+            expire(old[j]);
+        n += k;
+    }
+    return n;
+}
+
+void ptp::get_stats(ptp_stats *out) const
+{
+    out->rx_matched = rx_matched_.load(std::memory_order_relaxed);
+    out->tx_matched = tx_matched_.load(std::memory_order_relaxed);
+    out->rx_unmatched = rx_unmatched_.load(std::memory_order_relaxed);
+    out->tx_unmatched = tx_unmatched_.load(std::memory_order_relaxed);
+    out->ts_dropped = ts_dropped_.load(std::memory_order_relaxed);
+    out->collisions = collisions_.load(std::memory_order_relaxed);
+}
+
+} /* namespace sx */
@@ -0,0 +1,165 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <endian.h>
+
+#include "sx/route.h"
+
+namespace sx {
+
+static bool route_valid(const route_entry &r)
+{
+    unsigned bits = r.protocol == SX_RALUE_PROTO_IPV4 ? 32 : 128;
+
+    if (r.protocol > SX_RALUE_PROTO_IPV6 || r.prefix_len > bits)
+        return false;
+    for (unsigned i = r.prefix_len / 8; i < 16; i++) {
+        uint8_t host = i == r.prefix_len / 8 ? 0xff >> (r.prefix_len % 8) : 0xff;
+
+        if (i >= bits / 8 ? r.dip[i] : r.dip[i] & host)
+            return false;
+    }
+    return true;
+}
+
+static bool same_region(const route_entry &a, const route_entry &b)
+{
+    return a.protocol == b.protocol && a.vr == b.vr && a.prefix_len == b.prefix_len &&
+           sx_lpm_region(a.protocol, a.dip) == sx_lpm_region(b.protocol, b.dip);
+}
+
+static int ralue_errno(uint8_t status)
+{
+    switch (status) {
+    case SX_EMAD_STATUS_OK:
+        return 0;
+    case SX_EMAD_STATUS_BAD_PARAM:
+        return -EINVAL;
+    case SX_EMAD_STATUS_NO_RESOURCES:
+        return -ENOSPC;
+    default:
+        return -EIO;
+    }
+}
+
+int route_bulk::flush(route_entry *routes, size_t nops)
+{
+    int err = emad_.transact(ops_.data(), nops, window_);
+
+    if (err)
+        return err;
+
+    for (size_t k = 0; k < nops; k++) {
+        const emad_op &op = ops_[k];
+        const sx_ralue_reg *reg = reinterpret_cast<const sx_ralue_reg *>(op.payload.data());
+
+        for (size_t m = first_[k]; m < first_[k + 1]; m++) {
+            route_entry &r = routes[order_[m]];
+
+            r.err = op.err ? op.err : ralue_errno(reg->rec[m - first_[k]].status);
+        }
+    }
+    stats_.writes += nops;
+    return 0;
+}
+
+ssize_t route_bulk::run(route_entry *routes, size_t n, uint8_t op)
+{
+    unsigned batch = std::max(1u, std::min(batch_, static_cast<unsigned>(SX_RALUE_MAX_REC)));
+    size_t nops = 0;
+    ssize_t failed = 0;
+    int err;
+
+    order_.clear();
+    for (size_t i = 0; i < n; i++) {
+        routes[i].err = route_valid(routes[i]) ? 0 : -EINVAL;
+        if (!routes[i].err)
+            order_.push_back(i);
+    }
+
+    /* Sort flat keys, not the routes: one compare is a few integer compares */
+    if (sort_) {
+        keys_.resize(order_.size());
+        for (size_t i = 0; i < order_.size(); i++) {
+            const route_entry &r = routes[order_[i]];
+            sort_key &k = keys_[i];
+
+            memcpy(&k.hi, r.dip, sizeof(k.hi));
+            memcpy(&k.lo, r.dip + 8, sizeof(k.lo));
+            k.hi = be64toh(k.hi);
+            k.lo = be64toh(k.lo);
+            k.meta = static_cast<uint32_t>(r.protocol) << 24 | r.vr << 8 | r.prefix_len;
+            k.idx = order_[i];
+        }
+        std::sort(keys_.begin(), keys_.end(), [](const sort_key &a, const sort_key &b) {
+            if (a.meta != b.meta)
+                return a.meta < b.meta;
+            if (a.hi != b.hi)
+                return a.hi < b.hi;
+            if (a.lo != b.lo)
+                return a.lo < b.lo;
+            return a.idx < b.idx;
+        });
+        for (size_t i = 0; i < keys_.size(); i++)
+            order_[i] = keys_[i].idx;
+    }
+
+    ops_.resize(SX_ROUTE_BULK_OPS);
+    first_.resize(SX_ROUTE_BULK_OPS + 1);
+    for (size_t i = 0; i < order_.size();) {
+        const route_entry &r = routes[order_[i]];
+        size_t j = i + 1;
+
+        while (j < order_.size() && j - i < batch && same_region(r, routes[order_[j]]))
+            j++;
+
+        emad_op &o = ops_[nops];
+        o.reg_id = SX_REG_ID_RALUE;
+        o.method = SX_EMAD_METHOD_WRITE;
+        o.payload.assign(sizeof(sx_ralue_reg) + (j - i) * sizeof(sx_ralue_rec), 0);
+
+        sx_ralue_reg *reg = reinterpret_cast<sx_ralue_reg *>(o.payload.data());
+        reg->protocol = r.protocol;
+        reg->op = op;
+        reg->virtual_router = htobe16(r.vr);
+        reg->prefix_len = r.prefix_len;
+        reg->num_rec = j - i;
+        reg->region = htobe32(sx_lpm_region(r.protocol, r.dip));
+        for (size_t m = i; m < j; m++) {
+            const route_entry &e = routes[order_[m]];
+
+            memcpy(reg->rec[m - i].dip, e.dip, sizeof(e.dip));
+            reg->rec[m - i].adj_index = htobe32(e.adj_index);
+        }
+
+        first_[nops++] = i;
+        i = j;
+        if (nops == SX_ROUTE_BULK_OPS || i == order_.size()) {
+            first_[nops] = i;
+            err = flush(routes, nops);
+            if (err)
+                return err;
+            nops = 0;
+        }
+    }
+
+    for (size_t i = 0; i < n; i++)
+        failed += routes[i].err != 0;
+    stats_.routes += n;
+    stats_.failed += failed;
+    return failed;
+}
+
+ssize_t route_bulk::add(route_entry *routes, size_t n)
+{
+    return run(routes, n, SX_RALUE_OP_WRITE);
+}
+
+ssize_t route_bulk::del(route_entry *routes, size_t n)
+{
+    return run(routes, n, SX_RALUE_OP_DELETE);
+}
+
+} /* namespace sx */
@@ -0,0 +1,258 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#include <atomic>
+#include <cerrno>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sx/rx_ring.h"
+
+namespace sx {
+
+#define SX_RX_RING_PAGE 4096
+
+static size_t page_align(size_t v)
+{
+    return (v + SX_RX_RING_PAGE - 1) & ~static_cast<size_t>(SX_RX_RING_PAGE - 1);
+}
+
+rx_ring::~rx_ring()
+{
+    destroy();
+}
+
+int rx_ring::create(unsigned nent, uint32_t buf_size)
+{
+    uint32_t stride = (buf_size + SX_CACHELINE - 1) & ~(SX_CACHELINE - 1);
+    size_t desc_off, data_off;
+    uint32_t nbufs;
+    int err;
+
+    if (map_)
+        return -EBUSY;
+    if (!nent || nent > 0x10000 || !buf_size || buf_size > 0xffff)
+        return -EINVAL;
+
+    nent = roundup_pow_of_two(nent);
+    nbufs = nent;
+    desc_off = SX_RX_RING_PAGE;
+    data_off = desc_off + page_align(nent * sizeof(sx_rx_ring_desc));
+    map_size_ = data_off + page_align(static_cast<size_t>(nbufs) * stride);
+
+    mem_fd_ = memfd_create("sx_rx_ring", MFD_CLOEXEC);
+    if (mem_fd_ < 0)
+        return -errno;
+    if (ftruncate(mem_fd_, map_size_)) {
+        err = -errno;
+        destroy();
+        return err;
+    }
+
+    void *p = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd_, 0);
+    if (p == MAP_FAILED) {
+        err = -errno;
+        destroy();
+        return err;
+    }
+    map_ = static_cast<uint8_t *>(p);
+
+    event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd_ < 0) {
+        err = -errno;
+        destroy();
+        return err;
+    }
+
+    hdr_ = reinterpret_cast<sx_rx_ring_hdr *>(map_);
+    hdr_->magic = SX_RX_RING_MAGIC;
+    hdr_->version = SX_RX_RING_VERSION;
+    hdr_->nent = nent;
+    hdr_->nbufs = nbufs;
+    hdr_->buf_size = buf_size;
+    hdr_->desc_off = desc_off;
+    hdr_->data_off = data_off;
+    desc_ = reinterpret_cast<sx_rx_ring_desc *>(map_ + desc_off);
+
+    nent_ = nent;
+    buf_size_ = buf_size;
+    prod_ = flushed_ = reclaimed_ = 0;
+    wakeups_ = 0;
+    slot_buf_.assign(nent, 0);
+    bufs_.resize(nbufs);
+    free_.clear();
+    free_.reserve(nbufs);
+    for (uint32_t i = 0; i < nbufs; i++) {
+        pkt_buf &b = bufs_[i];
+
+        b.data = map_ + data_off + static_cast<size_t>(i) * stride;
+        b.len = 0;
+        b.size = buf_size;
+        b.dma = dma_map_single(b.data);
+        b.owner = this;
+        free_.push_back(nbufs - 1 - i);
+    }
+    return 0;
+}
+
+void rx_ring::destroy()
+{
+    if (map_)
+        munmap(map_, map_size_);
+    if (mem_fd_ >= 0)
+        ::close(mem_fd_);
+    if (event_fd_ >= 0)
+        ::close(event_fd_);
+    map_ = nullptr;
+    hdr_ = nullptr;
+    desc_ = nullptr;
+    mem_fd_ = event_fd_ = -1;
+    bufs_.clear();
+    free_.clear();
+}
+
+void rx_ring::reclaim()
+{
+    uint32_t cons = load_acquire(&hdr_->cons);
+
+    /* User space owns the index; ignore values outside what was published */
+    if (cons - reclaimed_ > flushed_ - reclaimed_)
+        return;
+
+    for (; reclaimed_ != cons; reclaimed_++)
+        free_.push_back(slot_buf_[reclaimed_ & (nent_ - 1)]);
+}
+
+pkt_buf *rx_ring::alloc_buf()
+{
+    if (free_.empty())
+        reclaim();
+    if (free_.empty())
+        return nullptr;
+
+    uint32_t idx = free_.back();
+    free_.pop_back();
+    return &bufs_[idx];
+}
+
+void rx_ring::release(pkt_buf *buf)
+{
+    free_.push_back(static_cast<uint32_t>(buf - bufs_.data()));
+}
+
+void rx_ring::deliver(const rx_info &info, pkt_buf *buf)
+{
+    if (prod_ - reclaimed_ >= nent_) {
+        reclaim();
+        if (prod_ - reclaimed_ >= nent_) {
+            write_once(&hdr_->drops, hdr_->drops + 1);
+            release(buf);
+            return;
+        }
+    }
+
+    uint32_t slot = prod_ & (nent_ - 1);
+    sx_rx_ring_desc *d = &desc_[slot];
+
+    d->buf_off = static_cast<uint32_t>(buf->data - map_);
+    d->len = buf->len;
+    d->trap_id = info.trap_id;
+    d->sys_port = info.sys_port;
+    d->timestamp = info.timestamp;
+    slot_buf_[slot] = static_cast<uint32_t>(buf - bufs_.data());
+    prod_++;
+}
+
+void rx_ring::flush()
+{
+    if (prod_ == flushed_)
+        return;
+
+    store_release(&hdr_->prod, prod_);
+
+    /*
+     * Wake the reader only if it had drained everything published before
+     * this batch; otherwise it is still consuming and will see the new
+     * descriptors without a syscall. Pairs with the fence in
+     * rx_ring_reader::wait().
+     */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (read_once(&hdr_->cons) == flushed_) {
+        uint64_t one = 1;
+
+        if (write(event_fd_, &one, sizeof(one)) == sizeof(one))
+            wakeups_++;
+    }
+    flushed_ = prod_;
+}
+
+rx_ring_reader::~rx_ring_reader()
+{
+    close();
+}
+
+int rx_ring_reader::open(int fd, int event_fd)
+{
+    struct stat st;
+
+    if (map_)
+        return -EBUSY;
+    if (fstat(fd, &st))
+        return -errno;
+
+    void *p = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+        return -errno;
+
+    map_ = static_cast<uint8_t *>(p);
+    map_size_ = st.st_size;
+    hdr_ = reinterpret_cast<sx_rx_ring_hdr *>(map_);
+    if (hdr_->magic != SX_RX_RING_MAGIC || hdr_->version != SX_RX_RING_VERSION ||
+        hdr_->data_off >= map_size_) {
+        close();
+        return -EPROTO;
+    }
+    desc_ = reinterpret_cast<sx_rx_ring_desc *>(map_ + hdr_->desc_off);
+    cons_ = read_once(&hdr_->cons);
+    event_fd_ = event_fd;
+    return 0;
+}
+
+void rx_ring_reader::close()
+{
+    if (map_)
+        munmap(map_, map_size_);
+    map_ = nullptr;
+    hdr_ = nullptr;
+    desc_ = nullptr;
+}
+
+int rx_ring_reader::wait(int timeout_ms)
+{
+    for (;;) {
+        uint32_t n = available();
+        struct pollfd pfd = { event_fd_, POLLIN, 0 };
+        uint64_t cnt;
+
+        if (n)
+            return n;
+
+        /* Publish our consumer index before deciding to sleep */
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        n = available();
+        if (n)
+            return n;
+
+        int ret = poll(&pfd, 1, timeout_ms);
+        if (ret < 0)
+            return errno == EINTR ? 0 : -errno;
+        if (ret == 0)
+            return available();
+        if (read(event_fd_, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN)
+            return -errno;
+    }
+}
+
+} /* namespace sx */
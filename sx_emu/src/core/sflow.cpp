@@ -0,0 +1,238 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <endian.h>
+
+#include "sx/compiler.h"
+#include "sx/sflow.h"
+
+namespace sx {
+
+static uint8_t *put32(uint8_t *p, uint32_t v)
+{
+    v = htobe32(v);
+    memcpy(p, &v, sizeof(v));
+    return p + sizeof(v);
+}
+
+sflow::sflow(dev &d, emad &e, uint8_t group, uint16_t header_bytes, size_t dgram_bytes,
+             unsigned window_us, size_t max_pending)
+    : dev_(d), emad_(e), group_(group), header_bytes_(header_bytes ? header_bytes : 1),
+      dgram_bytes_(dgram_bytes), window_ns_(window_us * 1000ull), max_pending_(max_pending)
+{
+}
+
+sflow::~sflow()
+{
+    if (started_)
+        dev_.del_listener(SX_TRAP_ID_PKT_SAMPLE);
+}
+
+int sflow::start()
+{
+    int err;
+
+    err = dev_.set_trap_group_trunc(group_, header_bytes_);
+    if (!err)
+        err = dev_.set_trap_group(SX_TRAP_ID_PKT_SAMPLE, group_);
+    if (!err)
+        err = dev_.add_listener(SX_TRAP_ID_PKT_SAMPLE, [this](const rx_info &info, pkt_buf *buf) {
+            enqueue(info, buf);
+        });
+    if (!err)
+        started_ = true;
+    return err;
+}
+
+int sflow::write_mpsc(uint16_t port, uint32_t rate)
+{
+    emad_op o;
+
+    o.reg_id = SX_REG_ID_MPSC;
+    o.method = SX_EMAD_METHOD_WRITE;
+    o.payload.assign(sizeof(sx_mpsc_reg), 0);
+
+    sx_mpsc_reg *reg = reinterpret_cast<sx_mpsc_reg *>(o.payload.data());
+    reg->local_port = htobe16(port);
+    reg->enable = rate != 0;
+    reg->rate = htobe32(rate);
+    return emad_.access(o);
+}
+
+int sflow::add_session(uint16_t port, uint32_t rate, uint32_t max_per_sec)
+{
+    int err;
+
+    if (port >= SX_MAX_PORTS || !rate)
+        return -EINVAL;
+
+    /* Armed before the ASIC samples, so no sample finds it missing */
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        session &s = sessions_[port];
+
+        s = session();
+        s.rate = rate;
+        if (max_per_sec) {
+            s.cost_ns = 1000000000ull / max_per_sec;
+            s.burst_ns = std::max<uint64_t>(s.cost_ns, 100000000ull);
+            s.credit_ns = s.burst_ns;
+        }
+    }
+    err = write_mpsc(port, rate);
+    if (err) {
+        std::lock_guard<std::mutex> guard(lock_);
+
+        sessions_[port].rate = 0;
+    }
+    return err;
+}
+
+int sflow::del_session(uint16_t port)
+{
+    int err;
+
+    if (port >= SX_MAX_PORTS)
+        return -EINVAL;
+
+    err = write_mpsc(port, 0);
+    if (!err) {
+        std::lock_guard<std::mutex> guard(lock_);
+
+        sessions_[port].rate = 0;
+    }
+    return err;
+}
+
+void sflow::enqueue(const rx_info &info, pkt_buf *buf)
+{
+    uint32_t hlen = std::min<uint32_t>(buf->len, header_bytes_), padded = (hlen + 3) & ~3u;
+    uint32_t size = SX_SFLOW_SAMPLE_FIXED + padded;
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        session *s = info.sys_port < SX_MAX_PORTS ? &sessions_[info.sys_port] : nullptr;
+
+        stats_.sampled++;
+        if (!s || !s->rate) {
+            stats_.no_session++;
+            pkt_buf_free(buf);
+            return;
+        }
+        s->pool += s->rate;
+
+        /* Token bucket on ASIC time: no clock read per sample */
+        if (s->cost_ns) {
+            s->credit_ns = std::min(s->burst_ns, s->credit_ns + (info.timestamp - s->last_ns));
+            s->last_ns = info.timestamp;
+            if (s->credit_ns < s->cost_ns) {
+                s->drops++;
+                stats_.limited++;
+                pkt_buf_free(buf);
+                return;
+            }
+            s->credit_ns -= s->cost_ns;
+        }
+
+        size_t base = head_ ? ends_[head_ - 1] : 0, off = pending_.size();
+        if (off - base + size > max_pending_) {
+            s->drops++;
+            stats_.overflow++;
+            pkt_buf_free(buf);
+            return;
+        }
+        if (off == base) {
+            first_ns_ = now_ns();
+            wake = true;
+        }
+
+        pending_.resize(off + size);
+        uint8_t *p = pending_.data() + off;
+        p = put32(p, SX_SFLOW_FLOW_SAMPLE);
+        p = put32(p, size - 8);
+        p = put32(p, ++s->seq);
+        p = put32(p, info.sys_port);                    /* source_id: ifIndex */
+        p = put32(p, s->rate);
+        p = put32(p, s->pool);
+        p = put32(p, s->drops);
+        p = put32(p, info.sys_port);
+        p = put32(p, info.egress_port == SX_CQE_NO_PORT ? SX_SFLOW_IF_UNKNOWN : info.egress_port);
+        p = put32(p, 1);                                /* flow records */
+        p = put32(p, SX_SFLOW_RAW_HEADER);
+        p = put32(p, 16 + padded);
+        p = put32(p, SX_SFLOW_PROTO_ETHERNET);
+        p = put32(p, info.pkt_len ? info.pkt_len : buf->len);
+        p = put32(p, 0);                                /* stripped */
+        p = put32(p, hlen);
+        memcpy(p, buf->data, hlen);
+        memset(p + hlen, 0, padded - hlen);
+        ends_.push_back(off + size);
+
+        wake |= off + size - base >= dgram_bytes_;
+    }
+    pkt_buf_free(buf);
+    if (wake)
+        wq_.notify_one();
+}
+
+ssize_t sflow::read(uint8_t *buf, size_t len, unsigned *nsamples, bool nonblock)
+{
+    std::unique_lock<std::mutex> guard(lock_);
+    size_t base, end;
+    unsigned n = 0;
+
+    if (len < max_sample())
+        return -EINVAL;
+
+    for (;;) {
+        base = head_ ? ends_[head_ - 1] : 0;
+        if (pending_.size() > base && (nonblock || pending_.size() - base >= dgram_bytes_ ||
+                                       now_ns() >= first_ns_ + window_ns_))
+            break;
+        if (nonblock)
+            return -EAGAIN;
+        if (pending_.size() > base)
+            wq_.wait_until(guard, std::chrono::steady_clock::time_point(
+                                      std::chrono::nanoseconds(first_ns_ + window_ns_)));
+        else
+            wq_.wait(guard);
+    }
+
+    /* One datagram's worth at most, and always the first sample */
+    len = std::max(std::min(len, dgram_bytes_), static_cast<size_t>(ends_[head_] - base));
+    end = base;
+    while (head_ < ends_.size() && ends_[head_] - base <= len) {
+        end = ends_[head_++];
+        n++;
+    }
+    memcpy(buf, pending_.data() + base, end - base);
+
+    /* Drop the consumed prefix; what is left is due right away */
+    if (head_ == ends_.size()) {
+        pending_.clear();
+        ends_.clear();
+        head_ = 0;
+    } else if (head_ >= ends_.size() / 2) {
+        pending_.erase(pending_.begin(), pending_.begin() + end);
+        ends_.erase(ends_.begin(), ends_.begin() + head_);
+        for (uint32_t &e : ends_)
+            e -= end;
+        head_ = 0;
+    }
+    stats_.records += n;
+    stats_.datagrams++;
+    *nsamples = n;
+    return end - base;
+}
+
+void sflow::get_stats(sflow_stats *out)
+{
+    std::lock_guard<std::mutex> guard(lock_);
+
+    *out = stats_;
+}
+
+} /* namespace sx */
@@ -0,0 +1,288 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <endian.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sx/compiler.h"
+#include "sx/telemetry.h"
+
+namespace sx {
+
+#define SX_TELE_PAGE    4096
+
+telemetry::~telemetry()
+{
+    destroy();
+}
+
+int telemetry::create(unsigned nent, unsigned nports)
+{
+    int err;
+
+    if (map_)
+        return -EBUSY;
+    if (!nports || nports > SX_MAX_PORTS || nent < nports || nent > (1u << 20))
+        return -EINVAL;
+
+    nent = roundup_pow_of_two(nent);
+    map_size_ = SX_TELE_PAGE + static_cast<size_t>(nent) * sizeof(sx_tele_rec);
+
+    mem_fd_ = memfd_create("sx_telemetry", MFD_CLOEXEC);
+    if (mem_fd_ < 0)
+        return -errno;
+    if (ftruncate(mem_fd_, map_size_)) {
+        err = -errno;
+        destroy();
+        return err;
+    }
+
+    void *p = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd_, 0);
+    if (p == MAP_FAILED) {
+        err = -errno;
+        destroy();
+        return err;
+    }
+    map_ = static_cast<uint8_t *>(p);
+
+    hdr_ = reinterpret_cast<sx_tele_hdr *>(map_);
+    hdr_->magic = SX_TELE_MAGIC;
+    hdr_->version = SX_TELE_VERSION;
+    hdr_->nent = nent;
+    hdr_->rec_size = sizeof(sx_tele_rec);
+    hdr_->rec_off = SX_TELE_PAGE;
+    hdr_->nports = nports;
+    hdr_->interval_ms = interval_ms_;
+    rec_ = reinterpret_cast<sx_tele_rec *>(map_ + SX_TELE_PAGE);
+
+    nent_ = nent;
+    nports_ = nports;
+    head_ = 0;
+    return 0;
+}
+
+void telemetry::destroy()
+{
+    stop();
+    if (map_)
+        munmap(map_, map_size_);
+    if (mem_fd_ >= 0)
+        ::close(mem_fd_);
+    map_ = nullptr;
+    hdr_ = nullptr;
+    rec_ = nullptr;
+    mem_fd_ = -1;
+}
+
+void telemetry::set_interval_ms(unsigned ms)
+{
+    {
+        std::lock_guard<std::mutex> guard(wait_lock_);
+        interval_ms_ = ms ? ms : 1;
+    }
+    if (hdr_)
+        write_once(&hdr_->interval_ms, static_cast<uint32_t>(interval_ms_));
+    wq_.notify_all();
+}
+
+int telemetry::snapshot()
+{
+    std::lock_guard<std::mutex> guard(lock_);
+    uint64_t t0 = now_ns(), c0 = thread_cpu_ns();
+    int err;
+
+    if (!map_)
+        return -ENODEV;
+
+    ops_.resize(nports_);
+    for (uint32_t i = 0; i < nports_; i++) {
+        emad_op &o = ops_[i];
+
+        o.reg_id = SX_REG_ID_PPCNT;
+        o.method = SX_EMAD_METHOD_QUERY;
+        o.payload.assign(sizeof(sx_ppcnt_reg), 0);
+        reinterpret_cast<sx_ppcnt_reg *>(o.payload.data())->local_port = htobe16(i);
+    }
+    err = emad_.transact(ops_.data(), nports_, window_);
+    for (uint32_t i = 0; !err && i < nports_; i++)
+        err = ops_[i].err;
+    if (err) {
+        stats_.errors++;
+        return err;
+    }
+
+    for (uint32_t i = 0; i < nports_; i++) {
+        const sx_ppcnt_reg *reg = reinterpret_cast<const sx_ppcnt_reg *>(ops_[i].payload.data());
+        sx_tele_rec *r = &rec_[head_ & (nent_ - 1)];
+        sx_port_cnt &c = r->cnt;
+
+        /* Readers still copying the old record see the odd count change */
+        write_once(&r->seq, 2 * head_ + 1);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        r->snapshot = stats_.snapshots;
+        r->timestamp = t0;
+        r->local_port = i;
+        c.rx_packets = be64toh(reg->cnt.rx_packets);
+        c.rx_bytes = be64toh(reg->cnt.rx_bytes);
+        c.tx_packets = be64toh(reg->cnt.tx_packets);
+        c.tx_bytes = be64toh(reg->cnt.tx_bytes);
+        c.rx_discards = be64toh(reg->cnt.rx_discards);
+        c.tx_discards = be64toh(reg->cnt.tx_discards);
+        for (unsigned p = 0; p < SX_PORT_PRIOS; p++) {
+            c.pg_rx_bytes[p] = be64toh(reg->cnt.pg_rx_bytes[p]);
+            c.tc_tx_bytes[p] = be64toh(reg->cnt.tc_tx_bytes[p]);
+            c.tc_discards[p] = be64toh(reg->cnt.tc_discards[p]);
+            c.pg_occupancy[p] = be32toh(reg->cnt.pg_occupancy[p]);
+            c.tc_occupancy[p] = be32toh(reg->cnt.tc_occupancy[p]);
+        }
+
+        store_release(&r->seq, 2 * head_ + 2);
+        store_release(&hdr_->head, ++head_);
+    }
+
+    stats_.snapshots++;
+    stats_.records += nports_;
+    stats_.snapshot_ns = now_ns() - t0;
+    stats_.cpu_ns += thread_cpu_ns() - c0;
+    return 0;
+}
+
+void telemetry::thread_fn()
+{
+    std::unique_lock<std::mutex> guard(wait_lock_);
+    auto next = std::chrono::steady_clock::now();
+
+    while (!stop_) {
+        guard.unlock();
+        snapshot();
+        guard.lock();
+
+        /* On the interval's grid: a slow snapshot does not shift the next */
+        next += std::chrono::milliseconds(interval_ms_);
+        if (next < std::chrono::steady_clock::now())
+            next = std::chrono::steady_clock::now();
+        wq_.wait_until(guard, next, [this] { return stop_; });
+    }
+}
+
+int telemetry::start()
+{
+    if (!map_)
+        return -ENODEV;
+    if (thread_.joinable())
+        return -EBUSY;
+
+    stop_ = false;
+    thread_ = std::thread(&telemetry::thread_fn, this);
+    return 0;
+}
+
+void telemetry::stop()
+{
+    if (!thread_.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> guard(wait_lock_);
+        stop_ = true;
+    }
+    wq_.notify_all();
+    thread_.join();
+}
+
+void telemetry::get_stats(telemetry_stats *out)
+{
+    std::lock_guard<std::mutex> guard(lock_);
+
+    *out = stats_;
+}
+
+telemetry_reader::~telemetry_reader()
+{
+    close();
+}
+
+int telemetry_reader::open(int fd)
+{
+    struct stat st;
+
+    if (map_)
+        return -EBUSY;
+    if (fstat(fd, &st))
+        return -errno;
+    if (st.st_size < static_cast<off_t>(sizeof(sx_tele_hdr)))
+        return -EINVAL;
+
+    void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+        return -errno;
+
+    map_ = static_cast<uint8_t *>(p);
+    map_size_ = st.st_size;
+    hdr_ = reinterpret_cast<const sx_tele_hdr *>(map_);
+    if (hdr_->magic != SX_TELE_MAGIC || hdr_->version != SX_TELE_VERSION ||
+        hdr_->rec_size != sizeof(sx_tele_rec) || !hdr_->nent || (hdr_->nent & (hdr_->nent - 1)) ||
+        hdr_->rec_off + static_cast<size_t>(hdr_->nent) * hdr_->rec_size > map_size_) {
+        close();
+        return -EPROTO;
+    }
+    rec_ = reinterpret_cast<const sx_tele_rec *>(map_ + hdr_->rec_off);
+    nent_ = hdr_->nent;
+    cursor_ = 0;
+    resync(load_acquire(&hdr_->head));
+    lost_ = 0;
+    return 0;
+}
+
+void telemetry_reader::close()
+{
+    if (map_)
+        munmap(map_, map_size_);
+    map_ = nullptr;
+    hdr_ = nullptr;
+    rec_ = nullptr;
+}
+
+/* Overtaken by the driver: continue from the oldest record left */
+void telemetry_reader::resync(uint64_t head)
+{
+    if (head - cursor_ > nent_) {
+        lost_ += head - cursor_ - nent_;
+        cursor_ = head - nent_;
+    }
+}
+
+int telemetry_reader::next(sx_tele_rec *out)
+{
+    for (;;) {
+        uint64_t head = load_acquire(&hdr_->head), want, seq;
+
+        if (cursor_ == head)
+            return 0;
+        resync(head);
+        want = 2 * cursor_ + 2;
+
+        const sx_tele_rec *r = &rec_[cursor_ & (nent_ - 1)];
+        seq = load_acquire(&r->seq);
+        if (seq == want) {
+            memcpy(out, r, sizeof(*out));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (read_once(&r->seq) == want) {
+                out->seq = want;
+                cursor_++;
+                return 1;
+            }
+        }
+
+        /* Being rewritten for a later record: it is gone */
+        lost_++;
+        cursor_++;
+    }
+}
+
+} /* namespace sx */
@@ -0,0 +1,508 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#include <cerrno>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "sx/compiler.h"
+#include "sx/warm_boot.h"
+
+namespace sx {
+
+static sx_wb_route route_rec(const route_entry &r)
+{
+    sx_wb_route rec = {};
+
+    rec.protocol = r.protocol;
+    rec.prefix_len = r.prefix_len;
+    rec.vr = r.vr;
+    memcpy(rec.dip, r.dip, sizeof(rec.dip));
+    rec.adj_index = r.adj_index;
+    return rec;
+}
+
+static route_entry route_of(const sx_wb_route &rec)
+{
+    route_entry r = {};
+
+    r.protocol = rec.protocol;
+    r.prefix_len = rec.prefix_len;
+    r.vr = rec.vr;
+    memcpy(r.dip, rec.dip, sizeof(r.dip));
+    r.adj_index = rec.adj_index;
+    return r;
+}
+
+static sx_wb_fdb fdb_rec(const sx_wb_fdb &e)
+{
+    sx_wb_fdb rec = {};
+
+    rec.fid = e.fid;
+    memcpy(rec.mac, e.mac, sizeof(rec.mac));
+    rec.port = e.port;
+    return rec;
+}
+
+static sx_wb_acl_rule acl_rec(uint16_t acl_id, const acl_placement &p)
+{
+    sx_wb_acl_rule rec = {};
+
+    rec.acl_id = acl_id;
+    rec.handle = p.handle;
+    rec.offset = p.offset;
+    rec.rule.priority = p.rule.priority;
+    rec.rule.action = p.rule.action;
+    rec.rule.key_len = p.rule.key_len;
+    memcpy(rec.rule.key, p.rule.key, sizeof(rec.rule.key));
+    memcpy(rec.rule.mask, p.rule.mask, sizeof(rec.rule.mask));
+    return rec;
+}
+
+/* ACL rules are the same rule if they match the same packets first */
+static bool acl_same(const acl_rule &a, const acl_rule &b)
+{
+    return a.priority == b.priority && a.key_len == b.key_len &&
+           !memcmp(a.key, b.key, sizeof(a.key)) && !memcmp(a.mask, b.mask, sizeof(a.mask));
+}
+
+static uint64_t acl_hash(const acl_rule &r)
+{
+    uint64_t h = static_cast<uint64_t>(r.priority) << 8 | r.key_len;
+
+    for (unsigned i = 0; i < SX_TCAM_KEY_MAX; i += 8) {
+        uint64_t k, m;
+
+        memcpy(&k, r.key + i, sizeof(k));
+        memcpy(&m, r.mask + i, sizeof(m));
+        h = (h ^ k ^ (m << 1)) * 0x9e3779b97f4a7c15ull;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+ssize_t warm_boot::sync_routes(route_bulk &rb, route_entry *routes, size_t n, warm_sync_stats *st)
+{
+    warm_sync_stats s = {};
+    std::vector<bool> seen(img_.nslots(SX_WB_ROUTE));
+    std::vector<route_entry> push, gone;
+    std::vector<size_t> idx;
+    uint64_t t0 = now_ns();
+    ssize_t failed = 0, ret;
+    int err;
+
+    for (size_t i = 0; i < n; i++) {
+        sx_wb_route rec = route_rec(routes[i]);
+        ssize_t slot = img_.find(SX_WB_ROUTE, &rec);
+
+        routes[i].err = 0;
+        if (slot >= 0) {
+            seen[slot] = true;
+            if (!memcmp(img_.at(SX_WB_ROUTE, slot), &rec, sizeof(rec))) {
+                s.kept++;
+                continue;
+            }
+            s.changed++;
+        } else {
+            s.added++;
+        }
+        push.push_back(routes[i]);
+        idx.push_back(i);
+    }
+    for (size_t i = 0; i < seen.size(); i++) {
+        const void *rec = seen[i] ? nullptr : img_.at(SX_WB_ROUTE, i);
+
+        if (rec)
+            gone.push_back(route_of(*static_cast<const sx_wb_route *>(rec)));
+    }
+    s.removed = gone.size();
+    if (img_.count(SX_WB_ROUTE) + s.added > img_.nslots(SX_WB_ROUTE) / 2)
+        return -ENOSPC;
+
+    uint64_t t1 = now_ns();
+    img_.begin();
+    ret = push.empty() ? 0 : rb.add(push.data(), push.size());
+    if (ret < 0) {
+        /* Nothing went out: every route to push failed with it */
+        for (size_t k = 0; k < push.size(); k++)
+            routes[idx[k]].err = static_cast<int>(ret);
+        failed = push.size();
+    }
+    for (size_t k = 0; k < push.size() && ret >= 0; k++) {
+        sx_wb_route rec = route_rec(push[k]);
+
+        routes[idx[k]].err = push[k].err;
+        if (push[k].err)
+            failed++;
+        else
+            img_.put(SX_WB_ROUTE, &rec);
+    }
+    if (ret >= 0 && !gone.empty())
+        ret = rb.del(gone.data(), gone.size());
+    for (size_t k = 0; k < gone.size() && ret >= 0; k++) {
+        sx_wb_route rec = route_rec(gone[k]);
+
+        if (gone[k].err)
+            failed++;
+        else
+            img_.del(SX_WB_ROUTE, &rec);
+    }
+    err = img_.commit();
+
+    s.failed = failed;
+    s.diff_ns = t1 - t0;
+    s.push_ns = now_ns() - t1;
+    if (st)
+        *st = s;
+    if (ret < 0)
+        return ret;
+    return err ? err : failed;
+}
+
+ssize_t warm_boot::sync_fdb(emad &e, fdb_shadow &fdb, const sx_wb_fdb *entries, size_t n,
+                            warm_sync_stats *st)
+{
+    warm_sync_stats s = {};
+    std::vector<sx_wb_fdb> gone;
+    std::vector<size_t> push;
+    uint64_t t0 = now_ns();
+    ssize_t failed = 0;
+    int err;
+
+    /* The shadow learns the static entries as they are */
+    if (!fdb_restored_) {
+        sx_fdb_rec learn = {};
+
+        learn.type = SX_FDB_EV_LEARN;
+        for (size_t i = 0; i < img_.nslots(SX_WB_FDB); i++) {
+            const sx_wb_fdb *rec = static_cast<const sx_wb_fdb *>(img_.at(SX_WB_FDB, i));
+
+            if (!rec)
+                continue;
+            learn.fid = rec->fid;
+            memcpy(learn.mac, rec->mac, sizeof(learn.mac));
+            learn.port = rec->port;
+            fdb.apply(learn);
+        }
+        fdb_restored_ = true;
+    }
+
+    uint64_t t1 = now_ns();
+    std::vector<bool> seen(img_.nslots(SX_WB_FDB));
+    for (size_t i = 0; i < n; i++) {
+        sx_wb_fdb rec = fdb_rec(entries[i]);
+        ssize_t slot = img_.find(SX_WB_FDB, &rec);
+
+        if (slot >= 0) {
+            seen[slot] = true;
+            if (!memcmp(img_.at(SX_WB_FDB, slot), &rec, sizeof(rec))) {
+                s.kept++;
+                continue;
+            }
+            s.changed++;
+        } else {
+            s.added++;
+        }
+        push.push_back(i);
+    }
+    for (size_t i = 0; i < seen.size(); i++) {
+        const void *rec = seen[i] ? nullptr : img_.at(SX_WB_FDB, i);
+
+        if (rec)
+            gone.push_back(*static_cast<const sx_wb_fdb *>(rec));
+    }
+    s.removed = gone.size();
+    if (img_.count(SX_WB_FDB) + s.added > img_.nslots(SX_WB_FDB) / 2)
+        return -ENOSPC;
+
+    uint64_t t2 = now_ns();
+    img_.begin();
+    for (size_t i : push) {
+        sx_wb_fdb rec = fdb_rec(entries[i]);
+
+        if (fdb.add(e, rec.fid, rec.mac, rec.port))
+            failed++;
+        else
+            img_.put(SX_WB_FDB, &rec);
+    }
+    for (const sx_wb_fdb &rec : gone) {
+        if (fdb.del(e, rec.fid, rec.mac))
+            failed++;
+        else
+            img_.del(SX_WB_FDB, &rec);
+    }
+    err = img_.commit();
+
+    s.failed = failed;
+    s.restore_ns = t1 - t0;
+    s.diff_ns = t2 - t1;
+    s.push_ns = now_ns() - t2;
+    if (st)
+        *st = s;
+    return err ? err : failed;
+}
+
+/* The ACL's regions and rules from the image, into an empty acl_table */
+int warm_boot::restore_acl(acl_table &acl, uint16_t acl_id)
+{
+    std::vector<acl_placement> rules;
+    acl_layout layout = {};
+    bool any = false;
+
+    for (uint8_t w = 0; w < 3; w++) {
+        sx_wb_acl_region key = {};
+        ssize_t slot;
+
+        key.acl_id = acl_id;
+        key.width = w;
+        slot = img_.find(SX_WB_ACL_REGION, &key);
+        if (slot < 0)
+            continue;
+
+        const sx_wb_acl_region *rec =
+            static_cast<const sx_wb_acl_region *>(img_.at(SX_WB_ACL_REGION, slot));
+        layout.region[w] = rec->region;
+        layout.size[w] = rec->size;
+        any = true;
+    }
+    if (!any)
+        return 0;
+
+    for (size_t i = 0; i < img_.nslots(SX_WB_ACL_RULE); i++) {
+        const sx_wb_acl_rule *rec = static_cast<const sx_wb_acl_rule *>(img_.at(SX_WB_ACL_RULE, i));
+
+        if (rec && rec->acl_id == acl_id)
+            rules.push_back({ rec->handle, rec->offset, rec->rule });
+    }
+    return acl.restore(layout, rules.data(), rules.size());
+}
+
+/* Rewrite the ACL's records to match the table; within begin() and commit() */
+void warm_boot::record_acl(const acl_table &acl, uint16_t acl_id)
+{
+    std::vector<acl_placement> rules;
+    std::unordered_set<uint64_t> live;
+    std::vector<sx_wb_acl_rule> stale;
+    acl_layout layout;
+
+    acl.save(&layout, &rules);
+    for (uint8_t w = 0; w < 3; w++) {
+        sx_wb_acl_region rec = {};
+
+        rec.acl_id = acl_id;
+        rec.width = w;
+        rec.region = layout.region[w];
+        rec.size = layout.size[w];
+        if (rec.size)
+            img_.put(SX_WB_ACL_REGION, &rec);
+        else
+            img_.del(SX_WB_ACL_REGION, &rec);
+    }
+
+    for (const acl_placement &p : rules)
+        live.insert(p.handle);
+    for (size_t i = 0; i < img_.nslots(SX_WB_ACL_RULE); i++) {
+        const sx_wb_acl_rule *rec = static_cast<const sx_wb_acl_rule *>(img_.at(SX_WB_ACL_RULE, i));
+
+        if (rec && rec->acl_id == acl_id && !live.count(rec->handle))
+            stale.push_back(*rec);
+    }
+    for (const sx_wb_acl_rule &rec : stale)
+        img_.del(SX_WB_ACL_RULE, &rec);
+    for (const acl_placement &p : rules) {
+        sx_wb_acl_rule rec = acl_rec(acl_id, p);
+
+        img_.put(SX_WB_ACL_RULE, &rec);
+    }
+}
+
+int warm_boot::sync_acl(acl_table &acl, uint16_t acl_id, const acl_rule *rules, size_t n,
+                        uint64_t *handles, warm_sync_stats *st)
+{
+    warm_sync_stats s = {};
+    std::vector<acl_placement> cur;
+    std::unordered_multimap<uint64_t, size_t> by_rule;
+    std::vector<size_t> ins;
+    std::vector<uint64_t> rm;
+    acl_layout layout;
+    uint64_t t0 = now_ns();
+    int err = 0, ret;
+
+    if (!acls_restored_.count(acl_id)) {
+        err = restore_acl(acl, acl_id);
+        if (err)
+            return err;
+        acls_restored_.insert(acl_id);
+    }
+
+    uint64_t t1 = now_ns();
+    acl.save(&layout, &cur);
+    std::vector<bool> used(cur.size());
+    for (size_t j = 0; j < cur.size(); j++)
+        by_rule.emplace(acl_hash(cur[j].rule), j);
+
+    for (size_t i = 0; i < n; i++) {
+        auto range = by_rule.equal_range(acl_hash(rules[i]));
+        size_t match = SIZE_MAX;
+
+        for (auto it = range.first; it != range.second; ++it) {
+            if (!used[it->second] && acl_same(cur[it->second].rule, rules[i])) {
+                match = it->second;
+                break;
+            }
+        }
+        if (match == SIZE_MAX) {
+            s.added++;
+            ins.push_back(i);
+            continue;
+        }
+        used[match] = true;
+        if (cur[match].rule.action == rules[i].action) {
+            s.kept++;
+            if (handles)
+                handles[i] = cur[match].handle;
+            continue;
+        }
+        s.changed++;
+        ins.push_back(i);
+        rm.push_back(cur[match].handle);
+    }
+    for (size_t j = 0; j < cur.size(); j++) {
+        if (!used[j]) {
+            s.removed++;
+            rm.push_back(cur[j].handle);
+        }
+    }
+
+    uint64_t t2 = now_ns();
+    if (ins.empty() && rm.empty())
+        goto out;
+    img_.begin();
+    if (ins.size() + rm.size() > n / 2) {
+        err = acl.replace(rules, n, handles);
+    } else {
+        for (size_t i : ins) {
+            uint64_t h;
+
+            err = acl.insert(rules[i], &h);
+            if (err)
+                break;
+            if (handles)
+                handles[i] = h;
+        }
+        for (size_t k = 0; k < rm.size() && !err; k++)
+            err = acl.remove(rm[k]);
+    }
+    if (err)
+        s.failed++;
+    record_acl(acl, acl_id);
+    ret = img_.commit();
+    err = err ? err : ret;
+
+out:
+    s.restore_ns = t1 - t0;
+    s.diff_ns = t2 - t1;
+    s.push_ns = now_ns() - t2;
+    if (st)
+        *st = s;
+    return err;
+}
+
+ssize_t warm_boot::sync_counters(counter_pool &pool, sx_wb_counter *ctrs, size_t n,
+                                 warm_sync_stats *st)
+{
+    warm_sync_stats s = {};
+    std::vector<sx_wb_counter> gone, moved;
+    std::vector<size_t> push;
+    uint64_t t0 = now_ns();
+    ssize_t failed = 0;
+    int err;
+
+    /*
+     * The pool takes its blocks back where they are, counts and all. A
+     * retry after a failed restore goes on from the block that failed.
+     */
+    if (!counters_restored_) {
+        for (; counters_next_ < img_.nslots(SX_WB_COUNTER); counters_next_++) {
+            const sx_wb_counter *rec =
+                static_cast<const sx_wb_counter *>(img_.at(SX_WB_COUNTER, counters_next_));
+
+            if (rec) {
+                err = pool.restore(rec->index, rec->count);
+                if (err)
+                    return err;
+            }
+        }
+        counters_restored_ = true;
+    }
+
+    uint64_t t1 = now_ns();
+    std::vector<bool> seen(img_.nslots(SX_WB_COUNTER));
+    for (size_t i = 0; i < n; i++) {
+        ssize_t slot = img_.find(SX_WB_COUNTER, &ctrs[i]);
+
+        if (slot >= 0) {
+            const sx_wb_counter *rec =
+                static_cast<const sx_wb_counter *>(img_.at(SX_WB_COUNTER, slot));
+
+            seen[slot] = true;
+            if (rec->count == ctrs[i].count) {
+                ctrs[i].index = rec->index;
+                s.kept++;
+                continue;
+            }
+            moved.push_back(*rec);
+            s.changed++;
+        } else {
+            s.added++;
+        }
+        push.push_back(i);
+    }
+    for (size_t i = 0; i < seen.size(); i++) {
+        const void *rec = seen[i] ? nullptr : img_.at(SX_WB_COUNTER, i);
+
+        if (rec)
+            gone.push_back(*static_cast<const sx_wb_counter *>(rec));
+    }
+    s.removed = gone.size();
+    if (img_.count(SX_WB_COUNTER) + s.added > img_.nslots(SX_WB_COUNTER) / 2)
+        return -ENOSPC;
+
+    /* New blocks first; a resized one keeps its old block until it has one */
+    uint64_t t2 = now_ns();
+    img_.begin();
+    for (size_t i : push) {
+        sx_wb_counter rec = { ctrs[i].owner, 0, ctrs[i].count };
+
+        if (pool.alloc(rec.count, &rec.index)) {
+            ctrs[i].index = UINT32_MAX;
+            failed++;
+            continue;
+        }
+        ctrs[i].index = rec.index;
+        img_.put(SX_WB_COUNTER, &rec);
+    }
+    for (const sx_wb_counter &rec : moved) {
+        ssize_t slot = img_.find(SX_WB_COUNTER, &rec);
+        const sx_wb_counter *now = static_cast<const sx_wb_counter *>(img_.at(SX_WB_COUNTER, slot));
+
+        if (now->index != rec.index)
+            pool.free(rec.index);
+    }
+    for (const sx_wb_counter &rec : gone) {
+        pool.free(rec.index);
+        img_.del(SX_WB_COUNTER, &rec);
+    }
+    err = img_.commit();
+
+    s.failed = failed;
+    s.restore_ns = t1 - t0;
+    s.diff_ns = t2 - t1;
+    s.push_ns = now_ns() - t2;
+    if (st)
+        *st = s;
+    return err ? err : failed;
+}
+
+} /* namespace sx */
@@ -0,0 +1,262 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sx/compiler.h"
+#include "sx/warm_image.h"
+
+namespace sx {
+
+#define SX_WB_PAGE  4096
+
+struct wb_format {
+    uint32_t rec_size;
+    uint32_t key_len;
+};
+
+static const wb_format wb_formats[SX_WB_TABLES] = {
+    { sizeof(sx_wb_route), offsetof(sx_wb_route, adj_index) },
+    { sizeof(sx_wb_fdb), offsetof(sx_wb_fdb, port) },
+    { sizeof(sx_wb_acl_region), offsetof(sx_wb_acl_region, region) },
+    { sizeof(sx_wb_acl_rule), offsetof(sx_wb_acl_rule, offset) },
+    { sizeof(sx_wb_counter), offsetof(sx_wb_counter, index) },
+};
+
+static_assert(sizeof(sx_wb_hdr) <= SX_WB_PAGE, "sx_wb_hdr must fit its page");
+
+static uint32_t slot_tag(const uint8_t *s)
+{
+    uint32_t tag;
+
+    memcpy(&tag, s, sizeof(tag));
+    return tag;
+}
+
+warm_image::~warm_image()
+{
+    close();
+}
+
+/* Home slot in the low bits, the slot's tag from the high ones */
+uint64_t warm_image::hash(unsigned t, const void *rec) const
+{
+    const uint8_t *p = static_cast<const uint8_t *>(rec);
+    uint32_t len = hdr_->table[t].key_len;
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ len;
+
+    for (uint32_t i = 0; i < len; i += 8) {
+        uint64_t w = 0;
+
+        memcpy(&w, p + i, std::min<uint32_t>(8, len - i));
+        h = (h ^ w) * 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+    }
+    return h;
+}
+
+bool warm_image::valid(size_t size) const
+{
+    if (hdr_->magic != SX_WB_MAGIC || hdr_->version != SX_WB_VERSION || hdr_->size != size ||
+        hdr_->ntables != SX_WB_TABLES || hdr_->dirty)
+        return false;
+    for (unsigned t = 0; t < SX_WB_TABLES; t++) {
+        const sx_wb_table &tb = hdr_->table[t];
+
+        if (tb.rec_size != wb_formats[t].rec_size || tb.key_len != wb_formats[t].key_len ||
+            !tb.nslots || tb.nslots & (tb.nslots - 1) || tb.off % SX_CACHELINE ||
+            tb.off < SX_WB_PAGE || tb.off > size || (size - tb.off) / slot_size_[t] < tb.nslots ||
+            tb.count > tb.nslots / 2)
+            return false;
+    }
+    return true;
+}
+
+/* A fresh, empty image: the file is cut to nothing and regrown zeroed */
+int warm_image::create(const size_t *max)
+{
+    sx_wb_table tables[SX_WB_TABLES];
+    uint64_t off = SX_WB_PAGE;
+
+    for (unsigned t = 0; t < SX_WB_TABLES; t++) {
+        uint64_t n = std::max<uint64_t>(2 * max[t], SX_CACHELINE);
+
+        if (n > 1ull << 31)
+            return -EINVAL;
+        tables[t] = { wb_formats[t].rec_size, wb_formats[t].key_len, off,
+                      roundup_pow_of_two(static_cast<uint32_t>(n)), 0 };
+        off += tables[t].nslots * slot_size_[t];
+        off = (off + SX_CACHELINE - 1) & ~static_cast<uint64_t>(SX_CACHELINE - 1);
+    }
+    map_size_ = (off + SX_WB_PAGE - 1) & ~static_cast<uint64_t>(SX_WB_PAGE - 1);
+
+    if (ftruncate(fd_, 0) || ftruncate(fd_, map_size_))
+        return -errno;
+    void *p = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (p == MAP_FAILED)
+        return -errno;
+    map_ = static_cast<uint8_t *>(p);
+    hdr_ = reinterpret_cast<sx_wb_hdr *>(map_);
+
+    hdr_->version = SX_WB_VERSION;
+    hdr_->size = map_size_;
+    hdr_->ntables = SX_WB_TABLES;
+    memcpy(hdr_->table, tables, sizeof(tables));
+    hdr_->magic = SX_WB_MAGIC;
+    return msync(map_, SX_WB_PAGE, MS_SYNC) ? -errno : 0;
+}
+
+int warm_image::open(const char *path, const size_t *max)
+{
+    struct stat st;
+    int err;
+
+    if (fd_ >= 0)
+        return -EBUSY;
+    for (unsigned t = 0; t < SX_WB_TABLES; t++)
+        slot_size_[t] = 8 + ((wb_formats[t].rec_size + 7) & ~7u);
+
+    fd_ = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd_ < 0)
+        return -errno;
+    if (fstat(fd_, &st)) {
+        err = -errno;
+        close();
+        return err;
+    }
+
+    if (static_cast<size_t>(st.st_size) >= SX_WB_PAGE) {
+        void *p = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+
+        if (p != MAP_FAILED) {
+            map_ = static_cast<uint8_t *>(p);
+            map_size_ = st.st_size;
+            hdr_ = reinterpret_cast<sx_wb_hdr *>(map_);
+            if (valid(map_size_))
+                return 1;
+            munmap(map_, map_size_);
+            map_ = nullptr;
+            hdr_ = nullptr;
+        }
+    }
+
+    err = create(max);
+    if (err)
+        close();
+    return err;
+}
+
+void warm_image::close()
+{
+    if (map_)
+        munmap(map_, map_size_);
+    if (fd_ >= 0)
+        ::close(fd_);
+    map_ = nullptr;
+    hdr_ = nullptr;
+    map_size_ = 0;
+    fd_ = -1;
+}
+
+ssize_t warm_image::find(unsigned t, const void *rec) const
+{
+    const sx_wb_table &tb = hdr_->table[t];
+    uint64_t h = hash(t, rec), mask = tb.nslots - 1;
+    uint32_t tag = static_cast<uint32_t>(h >> 32) | 1;
+
+    for (uint64_t i = h & mask;; i = (i + 1) & mask) {
+        const uint8_t *s = slot(t, i);
+        uint32_t st = slot_tag(s);
+
+        if (!st)
+            return -1;
+        if (st == tag && !memcmp(s + 8, rec, tb.key_len))
+            return i;
+    }
+}
+
+const void *warm_image::at(unsigned t, size_t i) const
+{
+    const uint8_t *s = slot(t, i);
+
+    return slot_tag(s) ? s + 8 : nullptr;
+}
+
+void warm_image::begin()
+{
+    if (hdr_->dirty)
+        return;
+    hdr_->dirty = 1;
+    msync(map_, SX_WB_PAGE, MS_SYNC);
+}
+
+int warm_image::put(unsigned t, const void *rec)
+{
+    sx_wb_table &tb = hdr_->table[t];
+    uint64_t h = hash(t, rec), mask = tb.nslots - 1;
+    uint32_t tag = static_cast<uint32_t>(h >> 32) | 1;
+    uint8_t *s;
+
+    for (uint64_t i = h & mask;; i = (i + 1) & mask) {
+        s = slot(t, i);
+        if (!slot_tag(s))
+            break;
+        if (slot_tag(s) == tag && !memcmp(s + 8, rec, tb.key_len)) {
+            memcpy(s + 8, rec, tb.rec_size);
+            return 0;
+        }
+    }
+    if (tb.count >= tb.nslots / 2)
+        return -ENOSPC;
+    memcpy(s + 8, rec, tb.rec_size);
+    memcpy(s, &tag, sizeof(tag));
+    tb.count++;
+    return 0;
+}
+
+/* Backward-shift deletion, as in fdb_shadow */
+void warm_image::del(unsigned t, const void *rec)
+{
+    sx_wb_table &tb = hdr_->table[t];
+    uint64_t mask = tb.nslots - 1;
+    ssize_t found = find(t, rec);
+    uint64_t i, j;
+
+    if (found < 0)
+        return;
+    for (i = j = found;;) {
+        j = (j + 1) & mask;
+
+        uint8_t *s = slot(t, j);
+        if (!slot_tag(s))
+            break;
+
+        /* Leave records whose home lies cyclically in (i, j] */
+        uint64_t k = hash(t, s + 8) & mask;
+        if (i <= j ? i < k && k <= j : i < k || k <= j)
+            continue;
+        memcpy(slot(t, i), s, slot_size_[t]);
+        i = j;
+    }
+    memset(slot(t, i), 0, slot_size_[t]);
+    tb.count--;
+}
+
+int warm_image::commit()
+{
+    if (!hdr_->dirty)
+        return 0;
+    if (msync(map_, map_size_, MS_SYNC))
+        return -errno;
+    hdr_->generation++;
+    hdr_->dirty = 0;
+    return msync(map_, SX_WB_PAGE, MS_SYNC) ? -errno : 0;
+}
+
+} /* namespace sx */
@@ -0,0 +1,345 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sx/xsk.h"
+
+namespace sx {
+
+#define SX_XSK_PAGE         4096
+#define SX_XSK_MIN_CHUNK    2048
+
+static size_t page_align(size_t v)
+{
+    return (v + SX_XSK_PAGE - 1) & ~static_cast<size_t>(SX_XSK_PAGE - 1);
+}
+
+xsk::~xsk()
+{
+    destroy();
+}
+
+int xsk::reg_umem(int fd, size_t size, uint32_t chunk_size, uint32_t headroom)
+{
+    size_t nchunks = size / chunk_size;
+
+    if (umem_)
+        return -EBUSY;
+    if (chunk_size < SX_XSK_MIN_CHUNK || chunk_size > 0x10000 ||
+        (chunk_size & (chunk_size - 1)) || !nchunks || nchunks > UINT32_MAX || headroom % 8 ||
+        headroom + sizeof(sx_xsk_meta) + SX_XSK_MIN_CHUNK / 2 > chunk_size)
+        return -EINVAL;
+
+    void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+        return -errno;
+
+    umem_ = static_cast<uint8_t *>(p);
+    umem_size_ = size;
+    chunk_shift_ = __builtin_ctz(chunk_size);
+    headroom_ = headroom;
+    frame_size_ = chunk_size - headroom - sizeof(sx_xsk_meta);
+    bufs_.resize(nchunks);
+    for (size_t i = 0; i < nchunks; i++) {
+        pkt_buf &b = bufs_[i];
+
+        b.data = umem_ + (i << chunk_shift_) + headroom + sizeof(sx_xsk_meta);
+        b.len = 0;
+        b.size = frame_size_;
+        b.dma = dma_map_single(b.data);
+        b.owner = this;
+    }
+    free_.clear();
+    free_.reserve(nchunks);
+    return 0;
+}
+
+int xsk::create_rings(unsigned fill_nent, unsigned rx_nent)
+{
+    size_t fill_off, rx_off;
+    int err;
+
+    if (!umem_)
+        return -EINVAL;
+    if (map_)
+        return -EBUSY;
+    if (!fill_nent || fill_nent > 0x10000 || !rx_nent || rx_nent > 0x10000)
+        return -EINVAL;
+
+    fill_nent = roundup_pow_of_two(fill_nent);
+    rx_nent = roundup_pow_of_two(rx_nent);
+    fill_off = SX_XSK_PAGE;
+    rx_off = fill_off + page_align(fill_nent * sizeof(uint64_t));
+    map_size_ = rx_off + page_align(rx_nent * sizeof(sx_xsk_desc));
+
+    ring_fd_ = memfd_create("sx_xsk", MFD_CLOEXEC);
+    if (ring_fd_ < 0)
+        return -errno;
+    if (ftruncate(ring_fd_, map_size_)) {
+        err = -errno;
+        destroy();
+        return err;
+    }
+
+    void *p = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, ring_fd_, 0);
+    if (p == MAP_FAILED) {
+        err = -errno;
+        destroy();
+        return err;
+    }
+    map_ = static_cast<uint8_t *>(p);
+
+    event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd_ < 0) {
+        err = -errno;
+        destroy();
+        return err;
+    }
+
+    hdr_ = reinterpret_cast<sx_xsk_hdr *>(map_);
+    hdr_->magic = SX_XSK_MAGIC;
+    hdr_->version = SX_XSK_VERSION;
+    hdr_->fill_nent = fill_nent;
+    hdr_->rx_nent = rx_nent;
+    hdr_->fill_off = fill_off;
+    hdr_->rx_off = rx_off;
+    hdr_->chunk_size = 1u << chunk_shift_;
+    hdr_->headroom = headroom_;
+    hdr_->umem_size = umem_size_;
+    fill_ = reinterpret_cast<uint64_t *>(map_ + fill_off);
+    rx_ = reinterpret_cast<sx_xsk_desc *>(map_ + rx_off);
+
+    fill_nent_ = fill_nent;
+    rx_nent_ = rx_nent;
+    fill_cons_ = rx_prod_ = rx_flushed_ = 0;
+    wakeups_ = bad_addrs_ = 0;
+    return 0;
+}
+
+int xsk::bind(dev &d, unsigned rdq, unsigned cqn)
+{
+    int err;
+
+    if (!map_ || cqn >= SX_MAX_CQ)
+        return -EINVAL;
+    if (dev_)
+        return -EBUSY;
+    err = d.bind_rdq(rdq, this);
+    if (err)
+        return err;
+    dev_ = &d;
+    cqn_ = cqn;
+    return 0;
+}
+
+int xsk::wakeup()
+{
+    if (!dev_)
+        return -ENOTCONN;
+    dev_->irq(cqn_);
+    return 0;
+}
+
+void xsk::destroy()
+{
+    if (map_)
+        munmap(map_, map_size_);
+    if (umem_)
+        munmap(umem_, umem_size_);
+    if (ring_fd_ >= 0)
+        ::close(ring_fd_);
+    if (event_fd_ >= 0)
+        ::close(event_fd_);
+    map_ = umem_ = nullptr;
+    hdr_ = nullptr;
+    fill_ = nullptr;
+    rx_ = nullptr;
+    ring_fd_ = event_fd_ = -1;
+    bufs_.clear();
+    free_.clear();
+    dev_ = nullptr;
+}
+
+pkt_buf *xsk::alloc_buf()
+{
+    if (!free_.empty()) {
+        uint32_t idx = free_.back();
+
+        free_.pop_back();
+        return &bufs_[idx];
+    }
+
+    for (;;) {
+        uint32_t prod = load_acquire(&hdr_->fill_prod);
+
+        if (prod == fill_cons_) {
+            /*
+             * Empty: ask for a wakeup, then look again, so a fill that
+             * missed the flag is still seen. Pairs with the fence in
+             * xsk_socket::fill().
+             */
+            write_once(&hdr_->fill_flags, static_cast<uint32_t>(SX_XSK_NEED_WAKEUP));
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (load_acquire(&hdr_->fill_prod) == fill_cons_)
+                return nullptr;
+            continue;
+        }
+        if (read_once(&hdr_->fill_flags))
+            write_once(&hdr_->fill_flags, 0u);
+
+        /* User space owns the ring; take the address once and check it */
+        uint64_t addr = read_once(&fill_[fill_cons_ & (fill_nent_ - 1)]);
+        store_release(&hdr_->fill_cons, ++fill_cons_);
+        if (addr < umem_size_ && (addr >> chunk_shift_) < bufs_.size())
+            return &bufs_[addr >> chunk_shift_];
+        bad_addrs_++;
+    }
+}
+
+void xsk::release(pkt_buf *buf)
+{
+    free_.push_back(static_cast<uint32_t>(buf - bufs_.data()));
+}
+
+void xsk::deliver(const rx_info &info, pkt_buf *buf)
+{
+    if (rx_prod_ - load_acquire(&hdr_->rx_cons) >= rx_nent_) {
+        write_once(&hdr_->rx_drops, hdr_->rx_drops + 1);
+        release(buf);
+        return;
+    }
+
+    sx_xsk_meta *m = reinterpret_cast<sx_xsk_meta *>(buf->data - sizeof(sx_xsk_meta));
+    sx_xsk_desc *d = &rx_[rx_prod_ & (rx_nent_ - 1)];
+
+    m->timestamp = info.timestamp;
+    m->trap_id = info.trap_id;
+    m->sys_port = info.sys_port;
+    m->rsvd = 0;
+    d->addr = static_cast<uint64_t>(buf->data - umem_);
+    d->len = buf->len;
+    d->options = 0;
+    rx_prod_++;
+}
+
+void xsk::flush()
+{
+    if (rx_prod_ == rx_flushed_)
+        return;
+
+    store_release(&hdr_->rx_prod, rx_prod_);
+
+    /* As rx_ring::flush(): wake the reader only if it had drained the ring */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (read_once(&hdr_->rx_cons) == rx_flushed_) {
+        uint64_t one = 1;
+
+        if (write(event_fd_, &one, sizeof(one)) == sizeof(one))
+            wakeups_++;
+    }
+    rx_flushed_ = rx_prod_;
+}
+
+xsk_socket::~xsk_socket()
+{
+    close();
+}
+
+int xsk_socket::open(int fd, int event_fd, uint8_t *umem)
+{
+    struct stat st;
+
+    if (map_)
+        return -EBUSY;
+    if (fstat(fd, &st))
+        return -errno;
+    if (st.st_size < static_cast<off_t>(sizeof(sx_xsk_hdr)))
+        return -EINVAL;
+
+    void *p = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+        return -errno;
+
+    map_ = static_cast<uint8_t *>(p);
+    map_size_ = st.st_size;
+    hdr_ = reinterpret_cast<sx_xsk_hdr *>(map_);
+
+    /* Both rings past the header and within the mapping, of 2^n entries */
+    uint32_t fill_nent = hdr_->fill_nent, rx_nent = hdr_->rx_nent;
+    if (hdr_->magic != SX_XSK_MAGIC || hdr_->version != SX_XSK_VERSION ||
+        !fill_nent || (fill_nent & (fill_nent - 1)) || !rx_nent || (rx_nent & (rx_nent - 1)) ||
+        hdr_->fill_off < sizeof(sx_xsk_hdr) || hdr_->rx_off < sizeof(sx_xsk_hdr) ||
+        hdr_->fill_off % alignof(uint64_t) || hdr_->rx_off % alignof(sx_xsk_desc) ||
+        hdr_->fill_off + static_cast<size_t>(fill_nent) * sizeof(uint64_t) > map_size_ ||
+        hdr_->rx_off + static_cast<size_t>(rx_nent) * sizeof(sx_xsk_desc) > map_size_) {
+        close();
+        return -EPROTO;
+    }
+    fill_ = reinterpret_cast<uint64_t *>(map_ + hdr_->fill_off);
+    rx_ = reinterpret_cast<sx_xsk_desc *>(map_ + hdr_->rx_off);
+    fill_prod_ = read_once(&hdr_->fill_prod);
+    rx_cons_ = read_once(&hdr_->rx_cons);
+    umem_ = umem;
+    event_fd_ = event_fd;
+    return 0;
+}
+
+void xsk_socket::close()
+{
+    if (map_)
+        munmap(map_, map_size_);
+    map_ = nullptr;
+    hdr_ = nullptr;
+    fill_ = nullptr;
+    rx_ = nullptr;
+}
+
+unsigned xsk_socket::fill(const uint64_t *addrs, unsigned n)
+{
+    uint32_t room = hdr_->fill_nent - (fill_prod_ - load_acquire(&hdr_->fill_cons));
+
+    n = std::min<uint32_t>(n, room);
+    for (unsigned i = 0; i < n; i++)
+        fill_[(fill_prod_ + i) & (hdr_->fill_nent - 1)] = addrs[i];
+    fill_prod_ += n;
+    store_release(&hdr_->fill_prod, fill_prod_);
+
+    /* Publish the chunks before needs_wakeup() reads the flag */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return n;
+}
+
+int xsk_socket::wait(int timeout_ms)
+{
+    for (;;) {
+        uint32_t n = available();
+        struct pollfd pfd = { event_fd_, POLLIN, 0 };
+        uint64_t cnt;
+
+        if (n)
+            return n;
+
+        /* Publish our consumer index before deciding to sleep */
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        n = available();
+        if (n)
+            return n;
+
+        int ret = poll(&pfd, 1, timeout_ms);
+        if (ret < 0)
+            return errno == EINTR ? 0 : -errno;
+        if (ret == 0)
+            return available();
+        if (read(event_fd_, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN)
+            return -errno;
+    }
+}
+
+} /* namespace sx */
@@ -0,0 +1,650 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <sys/prctl.h>
+
+#include "sx/compiler.h"
+#include "sx/dma.h"
+#include "sx/emad_defs.h"
+#include "sx/emu/asic.h"
+
+namespace sx {
+namespace emu {
+
+#define SX_EMU_MAX_FRAME 0x10000
+
+asic::asic(const asic_config &cfg)
+    : cfg_(cfg), regs_(SX_BAR0_SIZE / 4), irq_pending_(SX_MAX_CQ),
+      flow_cnt_(2 * static_cast<size_t>(cfg.flow_counters))
+{
+    cfg_.num_sdq = std::min(cfg_.num_sdq, static_cast<unsigned>(SX_MAX_SDQ));
+    cfg_.num_rdq = std::min(cfg_.num_rdq, static_cast<unsigned>(SX_MAX_RDQ));
+    cfg_.num_ports = std::min(cfg_.num_ports, static_cast<unsigned>(SX_MAX_PORTS));
+
+    regs_[SX_REG_FW_REV / 4] = cfg_.fw_rev;
+    regs_[SX_REG_HW_ID / 4] = cfg_.hw_id;
+    regs_[SX_REG_CAP_DQ / 4] = cfg_.num_rdq << 16 | cfg_.num_sdq;
+    regs_[SX_REG_CAP_CQ / 4] = cfg_.num_rdq + cfg_.num_sdq;
+    regs_[SX_REG_CAP_PORTS / 4] = cfg_.num_ports;
+    for (unsigned trap = 0; trap < SX_MAX_TRAP_ID; trap++)
+        regs_[SX_REG_HPKT(trap) / 4] = SX_HPKT_DISCARD;
+
+    reg_fns_[SX_REG_ID_MGIR] = [this](uint8_t method, uint8_t *data, uint32_t len) {
+        return mgir(method, data, len);
+    };
+    reg_fns_[SX_REG_ID_SFD] = [this](uint8_t method, uint8_t *data, uint32_t len) {
+        return sfd(method, data, len);
+    };
+    reg_fns_[SX_REG_ID_RALUE] = [this](uint8_t method, uint8_t *data, uint32_t len) {
+        return ralue(method, data, len);
+    };
+    reg_fns_[SX_REG_ID_PTAR] = [this](uint8_t method, uint8_t *data, uint32_t len) {
+        return ptar(method, data, len);
+    };
+    reg_fns_[SX_REG_ID_PTCE] = [this](uint8_t method, uint8_t *data, uint32_t len) {
+        return ptce(method, data, len);
+    };
+    reg_fns_[SX_REG_ID_PACL] = [this](uint8_t method, uint8_t *data, uint32_t len) {
+        return pacl(method, data, len);
+    };
+    reg_fns_[SX_REG_ID_MGPC] = [this](uint8_t method, uint8_t *data, uint32_t len) {
+        return mgpc(method, data, len);
+    };
+    reg_fns_[SX_REG_ID_MOCS] = [this](uint8_t method, uint8_t *data, uint32_t len) {
+        return mocs(method, data, len);
+    };
+    reg_fns_[SX_REG_ID_MPSC] = [this](uint8_t method, uint8_t *data, uint32_t len) {
+        return mpsc(method, data, len);
+    };
+    reg_fns_[SX_REG_ID_PPCNT] = [this](uint8_t method, uint8_t *data, uint32_t len) {
+        return ppcnt(method, data, len);
+    };
+    reg_fns_[SX_REG_ID_PAOS] = [this](uint8_t method, uint8_t *data, uint32_t len) {
+        return paos(method, data, len);
+    };
+}
+
+asic::~asic()
+{
+    {
+        std::lock_guard<std::mutex> guard(irq_lock_);
+        irq_stop_ = true;
+    }
+    irq_wq_.notify_one();
+    if (irq_thread_.joinable())
+        irq_thread_.join();
+
+    {
+        std::lock_guard<std::mutex> guard(fw_queue_lock_);
+        fw_stop_ = true;
+    }
+    fw_wq_.notify_one();
+    if (fw_thread_.joinable())
+        fw_thread_.join();
+}
+
+uint64_t asic::now_ns()
+{
+    return sx::now_ns();
+}
+
+void asic::mmio_delay() const
+{
+    if (!cfg_.mmio_delay_ns)
+        return;
+
+    uint64_t end = now_ns() + cfg_.mmio_delay_ns;
+    while (now_ns() < end)
+        cpu_relax();
+}
+
+uint32_t asic::read32(uint32_t off)
+{
+    std::atomic<uint64_t> *ready;
+    uint32_t val;
+
+    mmio_delay();
+    if (off >= SX_DB_BASE || off & 3)
+        return 0xffffffff;
+    if (off == SX_REG_FW_REV && now_ns() < fw_ready_ns_.load())
+        return 0;
+
+    val = read_once(&regs_[off / 4]);
+    if (cfg_.queue_init_ns && val & SX_Q_CTRL_EN && (ready = queue_ready(off)) &&
+        now_ns() < ready->load())
+        val |= SX_Q_CTRL_BUSY;
+    return val;
+}
+
+void asic::write32(uint32_t off, uint32_t val)
+{
+    mmio_delay();
+    if (off & 3 || off >= SX_BAR0_SIZE)
+        return;
+    if (off >= SX_DB_BASE)
+        doorbell_write(off, val);
+    else
+        config_write(off, val);
+}
+
+/* Set-up deadline of the queue whose SX_Q_CTRL is at @off, else nullptr */
+std::atomic<uint64_t> *asic::queue_ready(uint32_t off)
+{
+    if (off % 0x20 != SX_Q_CTRL)
+        return nullptr;
+    if (off >= SX_REG_CQ(0) && off < SX_REG_CQ(SX_MAX_CQ))
+        return &cqs_[(off - SX_REG_CQ(0)) / 0x20].ready_ns;
+    if (off >= SX_REG_SDQ(0) && off < SX_REG_SDQ(SX_MAX_SDQ))
+        return &sdqs_[(off - SX_REG_SDQ(0)) / 0x20].ready_ns;
+    if (off >= SX_REG_RDQ(0) && off < SX_REG_RDQ(SX_MAX_RDQ))
+        return &rdqs_[(off - SX_REG_RDQ(0)) / 0x20].ready_ns;
+    return nullptr;
+}
+
+/* Tables and queues stay; ports go down with the firmware */
+void asic::fw_reset()
+{
+    fw_ready_ns_.store(now_ns() + cfg_.fw_boot_ns);
+    for (port_state &p : port_state_) {
+        std::lock_guard<spinlock> guard(p.lock);
+
+        p.admin_up = false;
+    }
+}
+
+void asic::config_write(uint32_t off, uint32_t val)
+{
+    std::atomic<uint64_t> *ready;
+
+    if (off == SX_REG_FW_RESET) {
+        if (val & 1)
+            fw_reset();
+        return;
+    }
+    /* Other global registers are read-only */
+    if (off < SX_REG_CQ(0))
+        return;
+
+    write_once(&regs_[off / 4], val);
+    if (val & SX_Q_CTRL_EN && (ready = queue_ready(off)))
+        ready->store(now_ns() + cfg_.queue_init_ns);
+
+    if (off >= SX_REG_CQ(0) && off < SX_REG_CQ(SX_MAX_CQ)) {
+        if ((off - SX_REG_CQ(0)) % 0x20 == SX_Q_CTRL)
+            enable_cq((off - SX_REG_CQ(0)) / 0x20, val & SX_Q_CTRL_EN);
+        else if ((off - SX_REG_CQ(0)) % 0x20 == SX_Q_MOD)
+            set_cq_moderation((off - SX_REG_CQ(0)) / 0x20, val);
+    } else if (off >= SX_REG_SDQ(0) && off < SX_REG_SDQ(SX_MAX_SDQ)) {
+        unsigned n = (off - SX_REG_SDQ(0)) / 0x20;
+
+        if ((off - SX_REG_SDQ(0)) % 0x20 == SX_Q_CTRL)
+            enable_dq(sdqs_[n], SX_REG_SDQ(n), val & SX_Q_CTRL_EN);
+    } else if (off >= SX_REG_RDQ(0) && off < SX_REG_RDQ(SX_MAX_RDQ)) {
+        unsigned n = (off - SX_REG_RDQ(0)) / 0x20;
+
+        if ((off - SX_REG_RDQ(0)) % 0x20 == SX_Q_CTRL)
+            enable_dq(rdqs_[n], SX_REG_RDQ(n), val & SX_Q_CTRL_EN);
+    }
+}
+
+void asic::enable_cq(unsigned cqn, bool en)
+{
+    hw_cq &cq = cqs_[cqn];
+    uint32_t regs = SX_REG_CQ(cqn);
+    std::lock_guard<spinlock> guard(cq.lock);
+
+    if (cqn >= cfg_.num_sdq + cfg_.num_rdq)
+        return;
+
+    if (!en) {
+        cq.ring = nullptr;
+        return;
+    }
+    cq.ring = static_cast<sx_cqe *>(dma_to_virt(
+        static_cast<uint64_t>(reg(regs + SX_Q_ADDR_HI)) << 32 | reg(regs + SX_Q_ADDR_LO)));
+    cq.log_size = reg(regs + SX_Q_LOG_SIZE);
+    cq.vector = reg(regs + SX_Q_VECTOR);
+    cq.pi = 0;
+    cq.ci.store(0);
+    cq.armed.store(false);
+    cq.mod_next = reg(regs + SX_Q_MOD);
+    cq.mod_usecs = cq.mod_next >> 16;
+    cq.mod_count = cq.mod_next & 0xffff;
+    cq.mod_events = 0;
+    cq.mod_deadline.store(0);
+}
+
+/* Takes effect from the next arm; an interrupt already pending is kept */
+void asic::set_cq_moderation(unsigned cqn, uint32_t val)
+{
+    hw_cq &cq = cqs_[cqn];
+    std::lock_guard<spinlock> guard(cq.lock);
+
+    cq.mod_next = val;
+}
+
+void asic::enable_dq(hw_dq &q, uint32_t regs, bool en)
+{
+    std::lock_guard<spinlock> guard(q.lock);
+
+    if (!en) {
+        q.ring = nullptr;
+        return;
+    }
+    q.ring = static_cast<sx_wqe *>(dma_to_virt(
+        static_cast<uint64_t>(reg(regs + SX_Q_ADDR_HI)) << 32 | reg(regs + SX_Q_ADDR_LO)));
+    q.log_size = reg(regs + SX_Q_LOG_SIZE);
+    q.cqn = reg(regs + SX_Q_CQN);
+    q.pi.store(0);
+    q.ci = 0;
+}
+
+void asic::doorbell_write(uint32_t off, uint32_t val)
+{
+    uint32_t rel = off - SX_DB_BASE;
+    unsigned n = (rel & 0xfff) / 8;
+
+    stats_.doorbells.fetch_add(1, std::memory_order_relaxed);
+    switch (rel & ~0xfffu) {
+    case 0x0000:
+        if (n < cfg_.num_sdq) {
+            sdqs_[n].pi.store(val, std::memory_order_release);
+            sdq_process(n);
+        }
+        break;
+    case 0x1000:
+        if (n < cfg_.num_rdq)
+            rdqs_[n].pi.store(val, std::memory_order_release);
+        break;
+    case 0x2000:
+        if (n < SX_MAX_CQ) {
+            cqs_[n].ci.store(val, std::memory_order_release);
+
+            /* Sends held back for want of room in this CQ; pairs with sdq_process() */
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            for (unsigned i = 0; i < cfg_.num_sdq; i++) {
+                if (sdqs_[i].cqn == n && sdqs_[i].stalled.exchange(false))
+                    sdq_process(i);
+            }
+        }
+        break;
+    case 0x3000:
+        if (n < SX_MAX_CQ)
+            cq_arm(n, val);
+        break;
+    }
+}
+
+int asic::complete(unsigned cqn, sx_cqe &cqe)
+{
+    hw_cq &cq = cqs_[cqn];
+    bool fire = false, start_timer = false;
+
+    {
+        std::lock_guard<spinlock> guard(cq.lock);
+        uint32_t size = 1u << cq.log_size;
+
+        if (!cq.ring || cq.pi - cq.ci.load(std::memory_order_acquire) >= size) {
+            stats_.cq_overflow.fetch_add(1, std::memory_order_relaxed);
+            return -ENOSPC;
+        }
+
+        sx_cqe *slot = &cq.ring[cq.pi & (size - 1)];
+        memcpy(slot, &cqe, offsetof(sx_cqe, owner));
+        store_release(&slot->owner, static_cast<uint8_t>((cq.pi >> cq.log_size) & 1));
+        cq.pi++;
+        if (cq.armed.load(std::memory_order_relaxed)) {
+            cq.mod_events++;
+            if ((!cq.mod_usecs && !cq.mod_count) || (cq.mod_count && cq.mod_events >= cq.mod_count)) {
+                cq.armed.store(false, std::memory_order_relaxed);
+                cq.mod_deadline.store(0, std::memory_order_relaxed);
+                fire = true;
+            } else if (cq.mod_events == 1 && cq.mod_usecs) {
+                cq.mod_deadline.store(now_ns() + cq.mod_usecs * 1000ull, std::memory_order_relaxed);
+                start_timer = true;
+            }
+        }
+    }
+
+    if (fire)
+        raise_irq(cq.vector);
+    if (start_timer) {
+        {
+            std::lock_guard<std::mutex> guard(irq_lock_);
+            mod_kick_ = true;
+        }
+        irq_wq_.notify_one();
+    }
+    return 0;
+}
+
+void asic::cq_arm(unsigned cqn, uint32_t ci)
+{
+    hw_cq &cq = cqs_[cqn];
+    bool fire = false;
+
+    {
+        std::lock_guard<spinlock> guard(cq.lock);
+
+        if (!cq.ring)
+            return;
+        /* Completions already past the armed index fire right away */
+        cq.mod_usecs = cq.mod_next >> 16;
+        cq.mod_count = cq.mod_next & 0xffff;
+        cq.mod_events = 0;
+        cq.mod_deadline.store(0, std::memory_order_relaxed);
+        if (cq.pi != ci)
+            fire = true;
+        else
+            cq.armed.store(true, std::memory_order_release);
+    }
+
+    if (fire)
+        raise_irq(cq.vector);
+}
+
+static inline uint32_t hash_mix(uint32_t h, uint32_t v)
+{
+    h ^= v * 0xcc9e2d51;
+    h = (h << 13 | h >> 19) * 5 + 0xe6546b64;
+    return h;
+}
+
+/*
+ * Flow hash of a trapped packet: the IPv4 5-tuple when there is one, the
+ * MAC addresses and EtherType otherwise.
+ */
+static uint32_t flow_hash(const uint8_t *p, uint32_t len)
+{
+    uint32_t h = 0x5358, w;
+
+    if (len >= 38 && p[12] == 0x08 && p[13] == 0x00 && (p[14] >> 4) == 4) {
+        unsigned ihl = (p[14] & 0xf) * 4;
+
+        memcpy(&w, p + 26, 4);
+        h = hash_mix(h, w);
+        memcpy(&w, p + 30, 4);
+        h = hash_mix(h, w);
+        h = hash_mix(h, p[23]);
+        if ((p[23] == 6 || p[23] == 17) && len >= 14 + ihl + 4) {
+            memcpy(&w, p + 14 + ihl, 4);
+            h = hash_mix(h, w);
+        }
+    } else if (len >= 14) {
+        for (unsigned i = 0; i < 12; i += 4) {
+            memcpy(&w, p + i, 4);
+            h = hash_mix(h, w);
+        }
+        h = hash_mix(h, p[12] << 8 | p[13]);
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    return h;
+}
+
+int asic::inject(uint16_t trap_id, uint16_t port, const void *data, uint32_t len)
+{
+    return trap(trap_id, port, SX_CQE_NO_PORT, data, len);
+}
+
+int asic::trap(uint16_t trap_id, uint16_t port, uint16_t egress_port, const void *data,
+               uint32_t len)
+{
+    const uint8_t *src = static_cast<const uint8_t *>(data);
+    uint32_t group, rdq, count, trunc, hash, dma_len, copied = 0, room = 0;
+    sx_cqe cqe = {};
+
+    if (trap_id >= SX_MAX_TRAP_ID || port >= cfg_.num_ports)
+        return -EINVAL;
+
+    group = read_once(&regs_[SX_REG_HPKT(trap_id) / 4]);
+    if (group >= SX_MAX_TRAP_GROUP) {
+        stats_.trap_discard.fetch_add(1, std::memory_order_relaxed);
+        return -ENOENT;
+    }
+    rdq = read_once(&regs_[(SX_REG_HTGT(group) + SX_HTGT_RDQ) / 4]);
+    count = read_once(&regs_[(SX_REG_HTGT(group) + SX_HTGT_RDQ_COUNT) / 4]);
+    trunc = read_once(&regs_[(SX_REG_HTGT(group) + SX_HTGT_TRUNC) / 4]);
+    dma_len = trunc ? std::min(len, trunc) : len;
+    hash = flow_hash(src, len);
+    if (count > 1)
+        rdq += static_cast<uint32_t>((static_cast<uint64_t>(hash) * count) >> 32);
+    if (rdq >= cfg_.num_rdq) {
+        stats_.trap_discard.fetch_add(1, std::memory_order_relaxed);
+        return -ENOENT;
+    }
+
+    hw_dq &q = rdqs_[rdq];
+    std::lock_guard<spinlock> guard(q.lock);
+
+    if (!q.ring) {
+        stats_.trap_discard.fetch_add(1, std::memory_order_relaxed);
+        return -ENOENT;
+    }
+    if (q.ci == q.pi.load(std::memory_order_acquire)) {
+        stats_.rdq_no_desc.fetch_add(1, std::memory_order_relaxed);
+        return -ENOSPC;
+    }
+
+    const sx_wqe *wqe = &q.ring[q.ci & ((1u << q.log_size) - 1)];
+    for (unsigned i = 0; i < SX_WQE_MAX_FRAGS && wqe->byte_count[i]; i++) {
+        uint32_t chunk = std::min<uint32_t>(dma_len - copied, wqe->byte_count[i]);
+
+        memcpy(dma_to_virt(wqe->dma_addr[i]), src + copied, chunk);
+        copied += chunk;
+        room += wqe->byte_count[i];
+    }
+
+    cqe.trap_id = trap_id;
+    cqe.byte_count = copied;
+    cqe.wqe_counter = static_cast<uint16_t>(q.ci);
+    cqe.sys_port = port;
+    cqe.dqn = rdq;
+    cqe.flags = dma_len > room ? SX_CQE_F_TRUNC : 0;
+    cqe.pkt_len = static_cast<uint16_t>(std::min<uint32_t>(len, UINT16_MAX));
+    cqe.flow_hash = hash;
+    cqe.timestamp = now_ns();
+    cqe.egress_port = egress_port;
+
+    int err = complete(q.cqn, cqe);
+    if (err)
+        return err;
+    q.ci++;
+    stats_.trapped.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+}
+
+bool asic::cq_full(unsigned cqn)
+{
+    hw_cq &cq = cqs_[cqn];
+    std::lock_guard<spinlock> guard(cq.lock);
+
+    return cq.ring && cq.pi - cq.ci.load(std::memory_order_acquire) >= 1u << cq.log_size;
+}
+
+/*
+ * A WQE is consumed only with room for its completion, else the driver
+ * would never see the send and its buffer would leak. With the CQ full the
+ * SDQ stops there until the driver returns CQEs.
+ */
+void asic::sdq_process(unsigned sdq)
+{
+    static thread_local uint8_t frame[SX_EMU_MAX_FRAME];
+    hw_dq &q = sdqs_[sdq];
+    std::lock_guard<spinlock> guard(q.lock);
+    uint32_t pi = q.pi.load(std::memory_order_acquire);
+
+    if (!q.ring)
+        return;
+
+    for (; q.ci != pi; q.ci++) {
+        const sx_wqe *wqe = &q.ring[q.ci & ((1u << q.log_size) - 1)];
+        uint32_t len = 0;
+        sx_cqe cqe = {};
+
+        if (cq_full(q.cqn)) {
+            q.stalled.store(true);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (cq_full(q.cqn)) {
+                stats_.tx_cq_stalls.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            q.stalled.store(false, std::memory_order_relaxed);
+        }
+
+        for (unsigned i = 0; i < SX_WQE_MAX_FRAGS && wqe->byte_count[i]; i++) {
+            if (len + wqe->byte_count[i] > sizeof(frame))
+                break;
+            memcpy(frame + len, dma_to_virt(wqe->dma_addr[i]), wqe->byte_count[i]);
+            len += wqe->byte_count[i];
+        }
+
+        const sx_tx_hdr *hdr = reinterpret_cast<const sx_tx_hdr *>(frame);
+        cqe.flags = SX_CQE_F_SR;
+        if (len >= sizeof(*hdr) && hdr->version == SX_TX_HDR_VER &&
+            hdr->ctl == SX_TX_CTL_EMAD) {
+            emad_process(frame + sizeof(*hdr), len - sizeof(*hdr));
+        } else if (len < sizeof(*hdr) || hdr->version != SX_TX_HDR_VER ||
+                   hdr->ctl != SX_TX_CTL_TO_PORT || hdr->dest_port >= cfg_.num_ports) {
+            cqe.flags |= SX_CQE_F_ERR;
+            stats_.tx_errors.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            stats_.tx_packets.fetch_add(1, std::memory_order_relaxed);
+            stats_.tx_bytes.fetch_add(len - sizeof(*hdr), std::memory_order_relaxed);
+            ptp_stamp(hdr->dest_port, SX_PTP_DIR_TX, frame + sizeof(*hdr), len - sizeof(*hdr),
+                      now_ns());
+            if (egress_)
+                egress_(hdr->dest_port, frame + sizeof(*hdr), len - sizeof(*hdr));
+        }
+
+        cqe.byte_count = len;
+        cqe.wqe_counter = static_cast<uint16_t>(q.ci);
+        cqe.dqn = sdq;
+        cqe.timestamp = now_ns();
+
+        /* Only if receive completions on a shared CQ took the room meanwhile */
+        if (complete(q.cqn, cqe))
+            stats_.tx_cqe_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void asic::set_egress_handler(egress_fn fn)
+{
+    egress_ = std::move(fn);
+}
+
+void asic::set_irq_handler(irq_fn fn)
+{
+    std::unique_lock<std::mutex> guard(irq_lock_);
+
+    irq_ = std::move(fn);
+    if (irq_ && !irq_thread_.joinable())
+        irq_thread_ = std::thread(&asic::irq_thread, this);
+
+    /* Like free_irq(): a handler still running on the old function finishes first */
+    irq_idle_.wait(guard, [this] { return !irq_busy_; });
+}
+
+void asic::raise_irq(unsigned vector)
+{
+    stats_.irqs.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> guard(irq_lock_);
+
+        if (!irq_ || vector >= irq_pending_.size())
+            return;
+        irq_pending_[vector] = true;
+        irq_any_ = true;
+    }
+    irq_wq_.notify_one();
+}
+
+/* Earliest moderation timer of any CQ, or 0 */
+uint64_t asic::mod_next_deadline() const
+{
+    uint64_t next = 0;
+
+    for (const hw_cq &cq : cqs_) {
+        uint64_t d = cq.mod_deadline.load(std::memory_order_relaxed);
+
+        if (d && (!next || d < next))
+            next = d;
+    }
+    return next;
+}
+
+void asic::mod_expire(uint64_t now)
+{
+    for (hw_cq &cq : cqs_) {
+        uint64_t d = cq.mod_deadline.load(std::memory_order_relaxed);
+        bool fire = false;
+
+        if (!d || d > now)
+            continue;
+        {
+            std::lock_guard<spinlock> guard(cq.lock);
+
+            d = cq.mod_deadline.load(std::memory_order_relaxed);
+            if (d && d <= now && cq.armed.load(std::memory_order_relaxed)) {
+                cq.armed.store(false, std::memory_order_relaxed);
+                fire = true;
+            }
+            if (d && d <= now)
+                cq.mod_deadline.store(0, std::memory_order_relaxed);
+        }
+        if (fire)
+            raise_irq(cq.vector);
+    }
+}
+
+/* Delivers interrupts and runs the CQ moderation timers. */
+void asic::irq_thread()
+{
+    std::unique_lock<std::mutex> guard(irq_lock_);
+
+    /* Moderation timers are a few microseconds; do not let them slip */
+    prctl(PR_SET_TIMERSLACK, 1UL);
+
+    for (;;) {
+        auto ready = [this] { return irq_any_ || irq_stop_ || mod_kick_; };
+        uint64_t next = mod_next_deadline(), now = now_ns();
+
+        if (!next)
+            irq_wq_.wait(guard, ready);
+        else if (next > now)
+            irq_wq_.wait_for(guard, std::chrono::nanoseconds(next - now), ready);
+        if (irq_stop_)
+            return;
+        mod_kick_ = false;
+
+        if (next && now_ns() >= next) {
+            guard.unlock();
+            mod_expire(now_ns());
+            guard.lock();
+        }
+
+        irq_any_ = false;
+        for (unsigned v = 0; v < irq_pending_.size(); v++) {
+            if (!irq_pending_[v])
+                continue;
+            irq_pending_[v] = false;
+            irq_fn fn = irq_;
+
+            if (!fn)
+                continue;
+            irq_busy_ = true;
+            guard.unlock();
+            fn(v);
+            guard.lock();
+            irq_busy_ = false;
+            irq_idle_.notify_all();
+        }
+    }
+}
+
+} /* namespace emu */
+} /* namespace sx */
@@ -0,0 +1,148 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * Flow counters of the model. Traffic bumps them through flow_count();
+ * MGPC reads or clears them one access at a time, MOCS DMAs a range of
+ * them into host memory in one. Port counters, bumped by port_traffic(),
+ * are read a port at a time by PPCNT.
+ */
+
+#include <endian.h>
+
+#include "sx/dma.h"
+#include "sx/emu/asic.h"
+
+namespace sx {
+namespace emu {
+
+void asic::flow_count(uint32_t index, uint64_t packets, uint64_t bytes)
+{
+    if (index >= cfg_.flow_counters)
+        return;
+    flow_cnt_[2 * index].fetch_add(packets, std::memory_order_relaxed);
+    flow_cnt_[2 * index + 1].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+uint8_t asic::mgpc(uint8_t method, uint8_t *data, uint32_t len)
+{
+    sx_mgpc_reg *reg = reinterpret_cast<sx_mgpc_reg *>(data);
+
+    if (len < sizeof(*reg))
+        return SX_EMAD_STATUS_BAD_PARAM;
+
+    uint32_t index = be32toh(reg->index);
+    uint32_t num = be16toh(reg->num) ? be16toh(reg->num) : 1;
+
+    if (method == SX_EMAD_METHOD_QUERY) {
+        if (index >= cfg_.flow_counters)
+            return SX_EMAD_STATUS_BAD_PARAM;
+        reg->packets = htobe64(flow_cnt_[2 * index].load(std::memory_order_relaxed));
+        reg->bytes = htobe64(flow_cnt_[2 * index + 1].load(std::memory_order_relaxed));
+        return SX_EMAD_STATUS_OK;
+    }
+    if (method != SX_EMAD_METHOD_WRITE)
+        return SX_EMAD_STATUS_BAD_METHOD;
+    if (reg->op > SX_MGPC_OP_CLEAR || index >= cfg_.flow_counters ||
+        num > cfg_.flow_counters - index)
+        return SX_EMAD_STATUS_BAD_PARAM;
+    if (reg->op == SX_MGPC_OP_CLEAR) {
+        for (uint32_t i = index; i < index + num; i++) {
+            flow_cnt_[2 * i].store(0, std::memory_order_relaxed);
+            flow_cnt_[2 * i + 1].store(0, std::memory_order_relaxed);
+        }
+    }
+    return SX_EMAD_STATUS_OK;
+}
+
+uint8_t asic::mocs(uint8_t method, uint8_t *data, uint32_t len)
+{
+    const sx_mocs_reg *reg = reinterpret_cast<const sx_mocs_reg *>(data);
+
+    if (method != SX_EMAD_METHOD_WRITE)
+        return SX_EMAD_STATUS_BAD_METHOD;
+    if (len < sizeof(*reg))
+        return SX_EMAD_STATUS_BAD_PARAM;
+
+    uint32_t base = be32toh(reg->base), num = be32toh(reg->num);
+    uint64_t addr = be64toh(reg->dma_addr);
+
+    if (!num || num > SX_MOCS_MAX_COUNTERS || base >= cfg_.flow_counters ||
+        num > cfg_.flow_counters - base || !addr)
+        return SX_EMAD_STATUS_BAD_PARAM;
+
+    sx_flow_cnt *out = static_cast<sx_flow_cnt *>(dma_to_virt(addr));
+    for (uint32_t i = 0; i < num; i++) {
+        out[i].packets = flow_cnt_[2 * (base + i)].load(std::memory_order_relaxed);
+        out[i].bytes = flow_cnt_[2 * (base + i) + 1].load(std::memory_order_relaxed);
+    }
+    return SX_EMAD_STATUS_OK;
+}
+
+void asic::port_traffic(uint16_t port, unsigned prio, uint64_t packets, uint64_t bytes,
+                        uint64_t drops)
+{
+    if (port >= cfg_.num_ports || prio >= SX_PORT_PRIOS || !packets || drops > packets)
+        return;
+
+    port_cnt &p = port_cnt_[port];
+    uint64_t sent = static_cast<unsigned __int128>(bytes) * (packets - drops) / packets;
+    std::lock_guard<spinlock> guard(p.lock);
+
+    p.cnt.rx_packets += packets;
+    p.cnt.rx_bytes += bytes;
+    p.cnt.pg_rx_bytes[prio] += bytes;
+    p.cnt.tx_packets += packets - drops;
+    p.cnt.tx_bytes += sent;
+    p.cnt.tc_tx_bytes[prio] += sent;
+    p.cnt.tx_discards += drops;
+    p.cnt.tc_discards[prio] += drops;
+}
+
+void asic::port_occupancy(uint16_t port, unsigned prio, uint32_t pg_cells, uint32_t tc_cells)
+{
+    if (port >= cfg_.num_ports || prio >= SX_PORT_PRIOS)
+        return;
+
+    port_cnt &p = port_cnt_[port];
+    std::lock_guard<spinlock> guard(p.lock);
+
+    p.cnt.pg_occupancy[prio] = pg_cells;
+    p.cnt.tc_occupancy[prio] = tc_cells;
+}
+
+uint8_t asic::ppcnt(uint8_t method, uint8_t *data, uint32_t len)
+{
+    sx_ppcnt_reg *reg = reinterpret_cast<sx_ppcnt_reg *>(data);
+    uint16_t port;
+    sx_port_cnt c;
+
+    if (method != SX_EMAD_METHOD_QUERY)
+        return SX_EMAD_STATUS_BAD_METHOD;
+    if (len < sizeof(*reg))
+        return SX_EMAD_STATUS_BAD_PARAM;
+    port = be16toh(reg->local_port);
+    if (port >= cfg_.num_ports)
+        return SX_EMAD_STATUS_BAD_PARAM;
+
+    {
+        std::lock_guard<spinlock> guard(port_cnt_[port].lock);
+        c = port_cnt_[port].cnt;
+    }
+    reg->cnt.rx_packets = htobe64(c.rx_packets);
+    reg->cnt.rx_bytes = htobe64(c.rx_bytes);
+    reg->cnt.tx_packets = htobe64(c.tx_packets);
+    reg->cnt.tx_bytes = htobe64(c.tx_bytes);
+    reg->cnt.rx_discards = htobe64(c.rx_discards);
+    reg->cnt.tx_discards = htobe64(c.tx_discards);
+    for (unsigned i = 0; i < SX_PORT_PRIOS; i++) {
+        reg->cnt.pg_rx_bytes[i] = htobe64(c.pg_rx_bytes[i]);
+        reg->cnt.tc_tx_bytes[i] = htobe64(c.tc_tx_bytes[i]);
+        reg->cnt.tc_discards[i] = htobe64(c.tc_discards[i]);
+        reg->cnt.pg_occupancy[i] = htobe32(c.pg_occupancy[i]);
+        reg->cnt.tc_occupancy[i] = htobe32(c.tc_occupancy[i]);
+    }
+    return SX_EMAD_STATUS_OK;
+}
+
+} /* namespace emu */
+} /* namespace sx */
@@ -0,0 +1,158 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * Firmware side of the model: EMAD register access. Requests arrive on an
+ * SDQ with SX_TX_CTL_EMAD; the response is the request frame with the
+ * status and the response bit set and the register TLV rewritten by the
+ * register handler, trapped to the host as SX_TRAP_ID_EMAD.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <endian.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <sys/prctl.h>
+
+#include "sx/emad_defs.h"
+#include "sx/emu/asic.h"
+
+namespace sx {
+namespace emu {
+
+/* MGIR: hardware and firmware revision, read only */
+uint8_t asic::mgir(uint8_t method, uint8_t *data, uint32_t len)
+{
+    uint32_t info[2] = { htobe32(cfg_.hw_id), htobe32(cfg_.fw_rev) };
+
+    if (method != SX_EMAD_METHOD_QUERY)
+        return SX_EMAD_STATUS_BAD_METHOD;
+    if (len < sizeof(info))
+        return SX_EMAD_STATUS_BAD_PARAM;
+    memset(data, 0, len);
+    memcpy(data, info, sizeof(info));
+    return SX_EMAD_STATUS_OK;
+}
+
+void asic::register_reg(uint16_t reg_id, reg_fn fn)
+{
+    std::lock_guard<std::mutex> guard(fw_lock_);
+
+    reg_fns_[reg_id] = std::move(fn);
+}
+
+void asic::add_reg_file(uint16_t reg_id, unsigned key_len)
+{
+    auto store = std::make_shared<std::map<std::string, std::vector<uint8_t>>>();
+
+    register_reg(reg_id, [store, key_len](uint8_t method, uint8_t *data, uint32_t len) -> uint8_t {
+        if (len < key_len)
+            return SX_EMAD_STATUS_BAD_PARAM;
+
+        std::string key(reinterpret_cast<const char *>(data), key_len);
+
+        if (method == SX_EMAD_METHOD_WRITE) {
+            (*store)[key].assign(data, data + len);
+            return SX_EMAD_STATUS_OK;
+        }
+        if (method != SX_EMAD_METHOD_QUERY)
+            return SX_EMAD_STATUS_BAD_METHOD;
+
+        auto it = store->find(key);
+        uint32_t n = it == store->end() ? 0 : std::min<uint32_t>(len, it->second.size());
+
+        if (n)
+            memcpy(data, it->second.data(), n);
+        memset(data + std::max(n, key_len), 0, len - std::max(n, key_len));
+        return SX_EMAD_STATUS_OK;
+    });
+}
+
+void asic::emad_process(const uint8_t *frame, uint32_t len)
+{
+    const uint32_t min_len = sizeof(sx_emad_eth_hdr) + sizeof(sx_emad_op_tlv) + sizeof(sx_emad_reg_tlv);
+    std::vector<uint8_t> resp(frame, frame + len);
+    uint8_t status = SX_EMAD_STATUS_OK;
+
+    stats_.emad_requests.fetch_add(1, std::memory_order_relaxed);
+    if (len < min_len) {
+        stats_.emad_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    sx_emad_op_tlv *op = reinterpret_cast<sx_emad_op_tlv *>(resp.data() + sizeof(sx_emad_eth_hdr));
+    sx_emad_reg_tlv *reg_tlv = reinterpret_cast<sx_emad_reg_tlv *>(op + 1);
+    uint32_t reg_dw = be16toh(reg_tlv->type_len) & 0x7ff;
+    uint32_t reg_len = reg_dw ? (reg_dw - 1) * 4 : 0;
+
+    if (be16toh(op->type_len) >> 11 != SX_EMAD_TLV_OP ||
+        be16toh(reg_tlv->type_len) >> 11 != SX_EMAD_TLV_REG ||
+        reg_len > len - min_len || reg_len > SX_EMAD_MAX_REG_LEN) {
+        status = SX_EMAD_STATUS_BAD_TLV;
+    } else if (op->reg_class != SX_EMAD_CLASS_REG_ACCESS) {
+        status = SX_EMAD_STATUS_BAD_PARAM;
+    } else {
+        reg_fn fn;
+        {
+            std::lock_guard<std::mutex> guard(fw_lock_);
+            auto it = reg_fns_.find(be16toh(op->register_id));
+
+            if (it != reg_fns_.end())
+                fn = it->second;
+        }
+        status = fn ? fn(op->r_method & ~SX_EMAD_OP_R, reg_tlv->data, reg_len) : SX_EMAD_STATUS_BAD_REG;
+    }
+    op->status = status;
+    op->r_method |= SX_EMAD_OP_R;
+
+    if (!cfg_.emad_latency_ns) {
+        if (inject(SX_TRAP_ID_EMAD, 0, resp.data(), resp.size()))
+            stats_.emad_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(fw_queue_lock_);
+
+        if (!fw_thread_.joinable())
+            fw_thread_ = std::thread(&asic::fw_thread, this);
+        fw_queue_.push_back({ now_ns() + cfg_.emad_latency_ns, std::move(resp) });
+    }
+    fw_wq_.notify_one();
+}
+
+/*
+ * Sends responses once their latency has elapsed. The latency is the same
+ * for every request, so the queue is ordered by due time.
+ */
+void asic::fw_thread()
+{
+    std::unique_lock<std::mutex> guard(fw_queue_lock_);
+
+    /* Sleep, not spin, so the host keeps the CPU; wake close to the due time */
+    prctl(PR_SET_TIMERSLACK, 1UL);
+
+    for (;;) {
+        fw_wq_.wait(guard, [this] { return !fw_queue_.empty() || fw_stop_; });
+        if (fw_stop_)
+            return;
+
+        uint64_t now = now_ns(), due = fw_queue_.front().due;
+        if (now < due) {
+            fw_wq_.wait_for(guard, std::chrono::nanoseconds(due - now));
+            continue;
+        }
+
+        fw_resp r = std::move(fw_queue_.front());
+        fw_queue_.pop_front();
+        guard.unlock();
+        if (inject(SX_TRAP_ID_EMAD, 0, r.frame.data(), r.frame.size()))
+            stats_.emad_dropped.fetch_add(1, std::memory_order_relaxed);
+        guard.lock();
+    }
+}
+
+} /* namespace emu */
+} /* namespace sx */
@@ -0,0 +1,142 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * MAC table of the model. Learning and aging change it and report every
+ * change to the host as an SX_TRAP_ID_FDB_EVENT record, one per trap. The
+ * SFD register reads it and writes static entries, silently.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <endian.h>
+
+#include "sx/emad_defs.h"
+#include "sx/emu/asic.h"
+#include "sx/fdb_defs.h"
+
+namespace sx {
+namespace emu {
+
+int asic::fdb_event(uint8_t type, uint64_t key, uint16_t port)
+{
+    sx_fdb_rec rec = {};
+    int err;
+
+    rec.type = type;
+    rec.fid = static_cast<uint16_t>(key >> 48);
+    sx_fdb_key_mac(key, rec.mac);
+    rec.port = port;
+
+    /* Nobody listening is no reason to hold the table back */
+    err = inject(SX_TRAP_ID_FDB_EVENT, port, &rec, sizeof(rec));
+    return err == -ENOENT ? 0 : err;
+}
+
+int asic::fdb_learn(uint16_t fid, const uint8_t *mac, uint16_t port)
+{
+    uint64_t key = sx_fdb_key(fid, mac);
+    std::lock_guard<std::mutex> guard(fdb_lock_);
+    auto it = fdb_.find(key);
+    int err;
+
+    if (port >= cfg_.num_ports)
+        return -EINVAL;
+    if (it != fdb_.end() && it->second == port)
+        return 0;
+
+    err = fdb_event(it == fdb_.end() ? SX_FDB_EV_LEARN : SX_FDB_EV_MOVE, key, port);
+    if (err)
+        return err;
+    fdb_[key] = port;
+    return 0;
+}
+
+int asic::fdb_age(uint16_t fid, const uint8_t *mac)
+{
+    uint64_t key = sx_fdb_key(fid, mac);
+    std::lock_guard<std::mutex> guard(fdb_lock_);
+    auto it = fdb_.find(key);
+    int err;
+
+    if (it == fdb_.end())
+        return -ENOENT;
+
+    err = fdb_event(SX_FDB_EV_AGE, key, it->second);
+    if (err)
+        return err;
+    fdb_.erase(it);
+    return 0;
+}
+
+std::unordered_map<uint64_t, uint16_t> asic::fdb_dump()
+{
+    std::lock_guard<std::mutex> guard(fdb_lock_);
+
+    return std::unordered_map<uint64_t, uint16_t>(fdb_.begin(), fdb_.end());
+}
+
+static uint64_t sfd_key(const sx_sfd_rec &rec)
+{
+    return sx_fdb_key(be16toh(rec.fid), rec.mac);
+}
+
+static void sfd_set(sx_sfd_rec *rec, uint64_t key, uint16_t port)
+{
+    rec->fid = htobe16(static_cast<uint16_t>(key >> 48));
+    sx_fdb_key_mac(key, rec->mac);
+    rec->port = htobe16(port);
+    rec->rsvd0 = 0;
+}
+
+uint8_t asic::sfd(uint8_t method, uint8_t *data, uint32_t len)
+{
+    sx_sfd_reg *reg = reinterpret_cast<sx_sfd_reg *>(data);
+    uint32_t room = len < sizeof(*reg) ? 0 : (len - sizeof(*reg)) / sizeof(sx_sfd_rec);
+    std::lock_guard<std::mutex> guard(fdb_lock_);
+
+    if (!room)
+        return SX_EMAD_STATUS_BAD_PARAM;
+
+    if (method == SX_EMAD_METHOD_WRITE) {
+        if (reg->num_rec > room || (reg->op != SX_SFD_OP_ADD && reg->op != SX_SFD_OP_DEL))
+            return SX_EMAD_STATUS_BAD_PARAM;
+        for (unsigned i = 0; i < reg->num_rec; i++) {
+            if (reg->op == SX_SFD_OP_ADD && be16toh(reg->rec[i].port) >= cfg_.num_ports)
+                return SX_EMAD_STATUS_BAD_PARAM;
+        }
+        for (unsigned i = 0; i < reg->num_rec; i++) {
+            if (reg->op == SX_SFD_OP_ADD)
+                fdb_[sfd_key(reg->rec[i])] = be16toh(reg->rec[i].port);
+            else
+                fdb_.erase(sfd_key(reg->rec[i]));
+        }
+        return SX_EMAD_STATUS_OK;
+    }
+    if (method != SX_EMAD_METHOD_QUERY)
+        return SX_EMAD_STATUS_BAD_METHOD;
+
+    if (reg->op == SX_SFD_OP_LOOKUP) {
+        auto it = fdb_.find(sfd_key(reg->rec[0]));
+
+        reg->num_rec = it != fdb_.end();
+        reg->rec[0].port = htobe16(reg->num_rec ? it->second : 0);
+        return SX_EMAD_STATUS_OK;
+    }
+    if (reg->op != SX_SFD_OP_DUMP)
+        return SX_EMAD_STATUS_BAD_PARAM;
+
+    auto it = fdb_.lower_bound(be64toh(reg->cursor));
+    unsigned n = 0;
+
+    room = std::min<uint32_t>(room, SX_SFD_MAX_REC);
+    for (; it != fdb_.end() && n < room; ++it)
+        sfd_set(&reg->rec[n++], it->first, it->second);
+    memset(&reg->rec[n], 0, (room - n) * sizeof(sx_sfd_rec));
+    reg->num_rec = n;
+    reg->cursor = htobe64(it == fdb_.end() ? SX_SFD_CURSOR_END : it->first);
+    return SX_EMAD_STATUS_OK;
+}
+
+} /* namespace emu */
+} /* namespace sx */
@@ -0,0 +1,107 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * LPM routes of the model, written through RALUE a KVD region at a time.
+ * Only the table is kept; nothing is forwarded by it.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <endian.h>
+
+#include "sx/emad_defs.h"
+#include "sx/emu/asic.h"
+
+namespace sx {
+namespace emu {
+
+static unsigned addr_bits(uint8_t protocol)
+{
+    return protocol == SX_RALUE_PROTO_IPV4 ? 32 : 128;
+}
+
+/* No address bit beyond the prefix length may be set */
+static bool prefix_valid(const uint8_t *dip, unsigned prefix_len, unsigned bits)
+{
+    for (unsigned i = prefix_len / 8; i < 16; i++) {
+        uint8_t host = i == prefix_len / 8 ? 0xff >> (prefix_len % 8) : 0xff;
+
+        if (i >= bits / 8 ? dip[i] : dip[i] & host)
+            return false;
+    }
+    return true;
+}
+
+asic::lpm_key asic::make_lpm_key(uint8_t protocol, uint16_t vr, const uint8_t *dip,
+                                 uint8_t prefix_len)
+{
+    lpm_key k;
+
+    memcpy(&k.hi, dip, sizeof(k.hi));
+    memcpy(&k.lo, dip + 8, sizeof(k.lo));
+    k.meta = static_cast<uint32_t>(protocol) << 24 | prefix_len << 16 | vr;
+    return k;
+}
+
+uint8_t asic::ralue(uint8_t method, uint8_t *data, uint32_t len)
+{
+    sx_ralue_reg *reg = reinterpret_cast<sx_ralue_reg *>(data);
+    uint32_t room = len < sizeof(*reg) ? 0 : (len - sizeof(*reg)) / sizeof(sx_ralue_rec);
+
+    if (method != SX_EMAD_METHOD_WRITE)
+        return SX_EMAD_STATUS_BAD_METHOD;
+    if (!room || reg->num_rec > room || reg->protocol > SX_RALUE_PROTO_IPV6 ||
+        reg->op > SX_RALUE_OP_DELETE || reg->prefix_len > addr_bits(reg->protocol))
+        return SX_EMAD_STATUS_BAD_PARAM;
+
+    uint16_t vr = be16toh(reg->virtual_router);
+    uint32_t region = be32toh(reg->region);
+    std::lock_guard<std::mutex> guard(lpm_lock_);
+
+    /* The KVD is there from the start: no rehash stalls under load */
+    if (lpm_.bucket_count() < cfg_.kvd_lpm_entries)
+        lpm_.reserve(cfg_.kvd_lpm_entries);
+
+    for (unsigned i = 0; i < reg->num_rec; i++) {
+        sx_ralue_rec &rec = reg->rec[i];
+        lpm_key key = make_lpm_key(reg->protocol, vr, rec.dip, reg->prefix_len);
+
+        if (!prefix_valid(rec.dip, reg->prefix_len, addr_bits(reg->protocol)) ||
+            sx_lpm_region(reg->protocol, rec.dip) != region) {
+            rec.status = SX_EMAD_STATUS_BAD_PARAM;
+        } else if (reg->op == SX_RALUE_OP_DELETE) {
+            lpm_.erase(key);
+            rec.status = SX_EMAD_STATUS_OK;
+        } else if (be32toh(rec.adj_index) >= cfg_.kvd_adj_entries) {
+            rec.status = SX_EMAD_STATUS_BAD_PARAM;
+        } else if (lpm_.size() >= cfg_.kvd_lpm_entries && !lpm_.count(key)) {
+            rec.status = SX_EMAD_STATUS_NO_RESOURCES;
+        } else {
+            lpm_[key] = be32toh(rec.adj_index);
+            rec.status = SX_EMAD_STATUS_OK;
+        }
+    }
+    return SX_EMAD_STATUS_OK;
+}
+
+size_t asic::lpm_routes()
+{
+    std::lock_guard<std::mutex> guard(lpm_lock_);
+
+    return lpm_.size();
+}
+
+int asic::lpm_route(uint8_t protocol, uint16_t vr, const uint8_t *dip, uint8_t prefix_len,
+                    uint32_t *adj_index)
+{
+    std::lock_guard<std::mutex> guard(lpm_lock_);
+    auto it = lpm_.find(make_lpm_key(protocol, vr, dip, prefix_len));
+
+    if (it == lpm_.end())
+        return -ENOENT;
+    *adj_index = it->second;
+    return 0;
+}
+
+} /* namespace emu */
+} /* namespace sx */
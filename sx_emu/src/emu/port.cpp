@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * Port status of the model. PAOS takes a port up or down; its link comes up
+ * port_up_ns later, as link training would take, and goes down at once.
+ */
+
+#include <endian.h>
+
+#include "sx/emu/asic.h"
+
+namespace sx {
+namespace emu {
+
+uint8_t asic::paos(uint8_t method, uint8_t *data, uint32_t len)
+{
+    sx_paos_reg *reg = reinterpret_cast<sx_paos_reg *>(data);
+    uint16_t port;
+
+    if (len < sizeof(*reg))
+        return SX_EMAD_STATUS_BAD_PARAM;
+    port = be16toh(reg->local_port);
+    if (port >= cfg_.num_ports)
+        return SX_EMAD_STATUS_BAD_PARAM;
+    if (method != SX_EMAD_METHOD_QUERY && method != SX_EMAD_METHOD_WRITE)
+        return SX_EMAD_STATUS_BAD_METHOD;
+
+    port_state &p = port_state_[port];
+    std::lock_guard<spinlock> guard(p.lock);
+    uint64_t now = now_ns();
+
+    if (method == SX_EMAD_METHOD_WRITE && reg->ase) {
+        if (reg->admin_status != SX_PORT_STATUS_UP && reg->admin_status != SX_PORT_STATUS_DOWN)
+            return SX_EMAD_STATUS_BAD_PARAM;
+        if (reg->admin_status == SX_PORT_STATUS_UP && !p.admin_up)
+            p.up_ns = now + cfg_.port_up_ns;
+        p.admin_up = reg->admin_status == SX_PORT_STATUS_UP;
+    }
+    reg->admin_status = p.admin_up ? SX_PORT_STATUS_UP : SX_PORT_STATUS_DOWN;
+    reg->oper_status = p.admin_up && now >= p.up_ns ? SX_PORT_STATUS_UP : SX_PORT_STATUS_DOWN;
+    return SX_EMAD_STATUS_OK;
+}
+
+} /* namespace emu */
+} /* namespace sx */
@@ -0,0 +1,86 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * PTP timestamping of the model. Ports stamp event messages as they pass,
+ * in and out; the stamps wait in one FIFO until ptp_ts_drain() traps them,
+ * separately from the packets, as sx_ptp_ts_rec records.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <random>
+#include <vector>
+
+#include "sx/emu/asic.h"
+
+namespace sx {
+namespace emu {
+
+void asic::ptp_stamp(uint16_t port, uint8_t dir, const uint8_t *data, uint32_t len, uint64_t ts)
+{
+    sx_ptp_ts_rec rec = {};
+
+    if (!sx_ptp_parse(data, len, &rec))
+        return;
+    rec.timestamp = ts;
+    rec.port = port;
+    rec.dir = dir;
+
+    std::lock_guard<std::mutex> guard(ptp_lock_);
+    if (ptp_fifo_.size() >= cfg_.ptp_fifo_size) {
+        stats_.ptp_ts_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    ptp_fifo_.push_back(rec);
+}
+
+int asic::ptp_rx(uint16_t port, const void *data, uint32_t len, uint64_t *ts)
+{
+    const uint8_t *frame = static_cast<const uint8_t *>(data);
+    sx_ptp_ts_rec rec;
+
+    if (port >= cfg_.num_ports || !sx_ptp_parse(frame, len, &rec))
+        return -EINVAL;
+
+    /* Stamped at the port, long before the packet reaches the CPU */
+    *ts = now_ns();
+    ptp_stamp(port, SX_PTP_DIR_RX, frame, len, *ts);
+    return inject(SX_TRAP_ID_PTP_EVENT, port, data, len);
+}
+
+int asic::ptp_ts_drain(unsigned max, uint64_t seed)
+{
+    std::vector<sx_ptp_ts_rec> recs;
+    size_t done = 0;
+
+    {
+        std::lock_guard<std::mutex> guard(ptp_lock_);
+        size_t n = std::min<size_t>(max, ptp_fifo_.size());
+
+        recs.assign(ptp_fifo_.begin(), ptp_fifo_.begin() + n);
+        ptp_fifo_.erase(ptp_fifo_.begin(), ptp_fifo_.begin() + n);
+    }
+    if (seed) {
+        std::mt19937_64 rng(seed);
+
+        std::shuffle(recs.begin(), recs.end(), rng);
+    }
+
+    while (done < recs.size()) {
+        size_t n = std::min<size_t>(recs.size() - done, SX_PTP_TS_PER_TRAP);
+
+        if (inject(SX_TRAP_ID_PTP_TS, 0, &recs[done], n * sizeof(sx_ptp_ts_rec)))
+            break;
+        done += n;
+    }
+
+    if (done < recs.size()) {
+        std::lock_guard<std::mutex> guard(ptp_lock_);
+
+        ptp_fifo_.insert(ptp_fifo_.begin(), recs.begin() + done, recs.end());
+    }
+    return static_cast<int>(done);
+}
+
+} /* namespace emu */
+} /* namespace sx */
@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * Packet sampling of the model. MPSC sets a port's rate; packets forwarded
+ * from the port through port_forward() are picked one in rate on average,
+ * at random gaps as sFlow requires, and trapped with their egress port.
+ */
+
+#include <cerrno>
+#include <endian.h>
+
+#include "sx/emu/asic.h"
+
+namespace sx {
+namespace emu {
+
+static uint32_t sample_gap(uint64_t *rng, uint32_t rate)
+{
+    uint64_t x = *rng;
+
+    /* xorshift64: a gap uniform over [1, 2 * rate - 1], rate on average */
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *rng = x;
+    return 1 + static_cast<uint32_t>(x % (2 * static_cast<uint64_t>(rate) - 1));
+}
+
+int asic::port_forward(uint16_t port, uint16_t egress_port, const void *data, uint32_t len)
+{
+    if (port >= cfg_.num_ports)
+        return -EINVAL;
+
+    port_sampler &s = sampler_[port];
+    {
+        std::lock_guard<spinlock> guard(s.lock);
+
+        if (!s.rate || --s.skip)
+            return 0;
+        s.skip = sample_gap(&s.rng, s.rate);
+    }
+
+    int err = trap(SX_TRAP_ID_PKT_SAMPLE, port, egress_port, data, len);
+    return err ? err : 1;
+}
+
+uint8_t asic::mpsc(uint8_t method, uint8_t *data, uint32_t len)
+{
+    sx_mpsc_reg *reg = reinterpret_cast<sx_mpsc_reg *>(data);
+    uint16_t port;
+
+    if (len < sizeof(*reg))
+        return SX_EMAD_STATUS_BAD_PARAM;
+    port = be16toh(reg->local_port);
+    if (port >= cfg_.num_ports)
+        return SX_EMAD_STATUS_BAD_PARAM;
+
+    port_sampler &s = sampler_[port];
+    std::lock_guard<spinlock> guard(s.lock);
+
+    if (method == SX_EMAD_METHOD_QUERY) {
+        reg->enable = s.rate != 0;
+        reg->rate = htobe32(s.rate);
+        return SX_EMAD_STATUS_OK;
+    }
+    if (method != SX_EMAD_METHOD_WRITE)
+        return SX_EMAD_STATUS_BAD_METHOD;
+    if (reg->enable && !be32toh(reg->rate))
+        return SX_EMAD_STATUS_BAD_PARAM;
+
+    s.rate = reg->enable ? be32toh(reg->rate) : 0;
+    s.rng = 0x9e3779b97f4a7c15ull * (port + 1);
+    s.skip = s.rate ? sample_gap(&s.rng, s.rate) : 0;
+    return SX_EMAD_STATUS_OK;
+}
+
+} /* namespace emu */
+} /* namespace sx */
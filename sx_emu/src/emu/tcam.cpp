@@ -0,0 +1,185 @@
+/* SPDX-License-Identifier: GPL-2.0 OR BSD-3-Clause */
+
+/*
+ * TCAM of the model: regions allocated by PTAR, entries written by PTCE,
+ * ACLs bound to regions by PACL. Lookups are for the host to check what
+ * the TCAM would match; no traffic goes through them.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <endian.h>
+
+#include "sx/emu/asic.h"
+
+namespace sx {
+namespace emu {
+
+static bool width_valid(uint8_t w)
+{
+    return w == SX_TCAM_WIDTH_1 || w == SX_TCAM_WIDTH_2 || w == SX_TCAM_WIDTH_4;
+}
+
+uint8_t asic::ptar(uint8_t method, uint8_t *data, uint32_t len)
+{
+    sx_ptar_reg *reg = reinterpret_cast<sx_ptar_reg *>(data);
+
+    if (method != SX_EMAD_METHOD_WRITE)
+        return SX_EMAD_STATUS_BAD_METHOD;
+    if (len < sizeof(*reg) || reg->op > SX_PTAR_OP_FREE)
+        return SX_EMAD_STATUS_BAD_PARAM;
+
+    uint16_t id = be16toh(reg->region);
+    uint32_t size = be32toh(reg->size);
+    std::lock_guard<std::mutex> guard(tcam_lock_);
+
+    if (reg->op == SX_PTAR_OP_ALLOC) {
+        if (!width_valid(reg->key_width) || !size)
+            return SX_EMAD_STATUS_BAD_PARAM;
+        if (tcam_used_ + static_cast<size_t>(size) * reg->key_width > cfg_.tcam_slots ||
+            tcam_regions_.size() > UINT16_MAX)
+            return SX_EMAD_STATUS_NO_RESOURCES;
+        while (tcam_regions_.count(next_region_))
+            next_region_++;
+        id = next_region_++;
+
+        tcam_region &r = tcam_regions_[id];
+        r.key_width = reg->key_width;
+        r.entries.assign(size, tcam_entry());
+        tcam_used_ += static_cast<size_t>(size) * r.key_width;
+        reg->region = htobe16(id);
+        return SX_EMAD_STATUS_OK;
+    }
+
+    auto it = tcam_regions_.find(id);
+    if (it == tcam_regions_.end())
+        return SX_EMAD_STATUS_BAD_PARAM;
+    tcam_region &r = it->second;
+
+    if (reg->op == SX_PTAR_OP_FREE) {
+        for (auto &acl : acls_) {
+            for (uint16_t bound : acl.second) {
+                if (bound == id)
+                    return SX_EMAD_STATUS_BAD_PARAM;
+            }
+        }
+        tcam_used_ -= r.entries.size() * r.key_width;
+        tcam_regions_.erase(it);
+        return SX_EMAD_STATUS_OK;
+    }
+
+    if (!size)
+        return SX_EMAD_STATUS_BAD_PARAM;
+    if (size > r.entries.size() &&
+        tcam_used_ + (size - r.entries.size()) * r.key_width > cfg_.tcam_slots)
+        return SX_EMAD_STATUS_NO_RESOURCES;
+    tcam_used_ = tcam_used_ - r.entries.size() * r.key_width + static_cast<size_t>(size) * r.key_width;
+    r.entries.resize(size, tcam_entry());
+    return SX_EMAD_STATUS_OK;
+}
+
+uint8_t asic::ptce(uint8_t method, uint8_t *data, uint32_t len)
+{
+    const sx_ptce_reg *reg = reinterpret_cast<const sx_ptce_reg *>(data);
+
+    if (method != SX_EMAD_METHOD_WRITE)
+        return SX_EMAD_STATUS_BAD_METHOD;
+    if (len < sizeof(*reg) || reg->op > SX_PTCE_OP_CLEAR)
+        return SX_EMAD_STATUS_BAD_PARAM;
+
+    uint32_t offset = be32toh(reg->offset);
+    std::lock_guard<std::mutex> guard(tcam_lock_);
+    auto it = tcam_regions_.find(be16toh(reg->region));
+
+    if (it == tcam_regions_.end() || offset >= it->second.entries.size())
+        return SX_EMAD_STATUS_BAD_PARAM;
+
+    tcam_entry &e = it->second.entries[offset];
+    unsigned bytes = it->second.key_width * SX_TCAM_SLOT_BYTES;
+
+    if (reg->op == SX_PTCE_OP_CLEAR) {
+        e.valid = false;
+        return SX_EMAD_STATUS_OK;
+    }
+    for (unsigned i = bytes; i < SX_TCAM_KEY_MAX; i++) {
+        if (reg->key[i] || reg->mask[i])
+            return SX_EMAD_STATUS_BAD_PARAM;
+    }
+    for (unsigned i = 0; i < SX_TCAM_KEY_MAX; i++) {
+        e.key[i] = reg->key[i] & reg->mask[i];
+        e.mask[i] = reg->mask[i];
+    }
+    e.priority = be32toh(reg->priority);
+    e.action = be32toh(reg->action);
+    e.valid = true;
+    return SX_EMAD_STATUS_OK;
+}
+
+uint8_t asic::pacl(uint8_t method, uint8_t *data, uint32_t len)
+{
+    const sx_pacl_reg *reg = reinterpret_cast<const sx_pacl_reg *>(data);
+
+    if (method != SX_EMAD_METHOD_WRITE)
+        return SX_EMAD_STATUS_BAD_METHOD;
+    if (len < sizeof(*reg) || reg->num_regions > SX_ACL_MAX_REGIONS)
+        return SX_EMAD_STATUS_BAD_PARAM;
+
+    std::vector<uint16_t> regions;
+    std::lock_guard<std::mutex> guard(tcam_lock_);
+
+    for (unsigned i = 0; i < reg->num_regions; i++) {
+        uint16_t id = be16toh(reg->region[i]);
+
+        if (!tcam_regions_.count(id))
+            return SX_EMAD_STATUS_BAD_PARAM;
+        regions.push_back(id);
+    }
+    if (regions.empty())
+        acls_.erase(be16toh(reg->acl_id));
+    else
+        acls_[be16toh(reg->acl_id)] = std::move(regions);
+    return SX_EMAD_STATUS_OK;
+}
+
+int asic::acl_lookup(uint16_t acl_id, const uint8_t *key, uint32_t *action)
+{
+    std::lock_guard<std::mutex> guard(tcam_lock_);
+    auto acl = acls_.find(acl_id);
+    const tcam_entry *best = nullptr;
+
+    if (acl == acls_.end())
+        return -ENOENT;
+
+    for (uint16_t id : acl->second) {
+        const tcam_region &r = tcam_regions_[id];
+        unsigned bytes = r.key_width * SX_TCAM_SLOT_BYTES;
+
+        for (const tcam_entry &e : r.entries) {
+            unsigned i = 0;
+
+            if (!e.valid)
+                continue;
+            while (i < bytes && (key[i] & e.mask[i]) == e.key[i])
+                i++;
+            if (i < bytes)
+                continue;
+            if (!best || e.priority < best->priority)
+                best = &e;
+            break;
+        }
+    }
+    if (!best)
+        return -ENOENT;
+    *action = best->action;
+    return 0;
+}
+
+size_t asic::tcam_used()
+{
+    std::lock_guard<std::mutex> guard(tcam_lock_);
+
+    return tcam_used_;
+}
+
+} /* namespace emu */
+} /* namespace sx */